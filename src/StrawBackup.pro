@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui sql
+QT       += core gui sql concurrent network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -18,6 +18,7 @@ DEFINES += PROGRAM_VERSION=\\\"$$VERSION\\\"
 win32:DEFINES += PLATFORM_SUFFIX=\\\"win32\\\"
 
 win32:RC_ICONS += ../res/icon.ico
+win32:LIBS += -lpsapi
 
 Release:TARGET = strawBackup
 Debug:TARGET = strawBackup_dbg
@@ -31,10 +32,28 @@ main.cpp \
     gui/backupdirectoryeditdialog.cpp \
     job/backupmanager.cpp \
     gui/aboutdialog.cpp \
+    gui/restoredialog.cpp \
     job/jobthread.cpp \
-    threaddb/dbmanager.cpp \
-    threaddb/dbmodel.cpp \
-    threaddb/dbquery.cpp
+    job/logsink.cpp \
+    gui/logmodel.cpp \
+    job/runstats.cpp \
+    job/metricsexporter.cpp \
+    job/tracer.cpp \
+    job/dbschema.cpp \
+    job/backupscheduler.cpp \
+    job/versionstore.cpp \
+    job/processmemory.cpp \
+    job/filecopy.cpp \
+    job/resumablecopy.cpp \
+    job/directorywalk.cpp \
+    job/fanoutcopy.cpp \
+    job/storagebackend.cpp \
+    job/localstorage.cpp \
+    job/s3storage.cpp \
+    job/destinationcache.cpp \
+    job/restoremanager.cpp \
+    job/historycatalog.cpp \
+    daemon/daemonclient.cpp
 
 
 HEADERS  += \
@@ -43,16 +62,38 @@ global.h \
     gui/backupdirectoryeditdialog.h \
     job/backupmanager.h \
     gui/aboutdialog.h \
+    gui/restoredialog.h \
     job/jobthread.h \
-    threaddb/dbmanager.h \
-    threaddb/dbmodel.h \
-    threaddb/dbquery.h
+    job/logsink.h \
+    gui/logmodel.h \
+    job/runstats.h \
+    job/metricsexporter.h \
+    job/tracer.h \
+    job/dbschema.h \
+    job/backupscheduler.h \
+    job/versionstore.h \
+    job/processmemory.h \
+    job/filecopy.h \
+    job/resumablecopy.h \
+    job/directorywalk.h \
+    job/fanoutcopy.h \
+    job/storagebackend.h \
+    job/localstorage.h \
+    job/s3storage.h \
+    job/destinationcache.h \
+    job/restoremanager.h \
+    job/historycatalog.h \
+    daemon/daemonclient.h
+
+
+include(threaddb/threaddb.pri)
 
 
 FORMS    += \
 gui/mainwindow.ui \
     gui/backupdirectoryeditdialog.ui \
-    gui/aboutdialog.ui
+    gui/aboutdialog.ui \
+    gui/restoredialog.ui
 
 
 
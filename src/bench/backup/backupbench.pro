@@ -0,0 +1,65 @@
+#-------------------------------------------------
+#
+# End-to-end benchmark of the backup engine
+#
+#-------------------------------------------------
+
+QT       += core sql concurrent network
+QT       -= gui
+
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+TARGET = backupBench
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+main.cpp \
+    treegenerator.cpp \
+    slowlocalstorage.cpp \
+    ../../job/backupmanager.cpp \
+    ../../job/dbschema.cpp \
+    ../../job/backupscheduler.cpp \
+    ../../job/versionstore.cpp \
+    ../../job/filecopy.cpp \
+    ../../job/resumablecopy.cpp \
+    ../../job/directorywalk.cpp \
+    ../../job/fanoutcopy.cpp \
+    ../../job/storagebackend.cpp \
+    ../../job/localstorage.cpp \
+    ../../job/s3storage.cpp \
+    ../../job/destinationcache.cpp \
+    ../../job/processmemory.cpp \
+    ../../job/jobthread.cpp \
+    ../../job/logsink.cpp \
+    ../../job/runstats.cpp \
+    ../../job/tracer.cpp
+
+HEADERS += \
+    treegenerator.h \
+    slowlocalstorage.h \
+    ../../job/backupmanager.h \
+    ../../job/dbschema.h \
+    ../../job/backupscheduler.h \
+    ../../job/versionstore.h \
+    ../../job/filecopy.h \
+    ../../job/resumablecopy.h \
+    ../../job/directorywalk.h \
+    ../../job/fanoutcopy.h \
+    ../../job/storagebackend.h \
+    ../../job/localstorage.h \
+    ../../job/s3storage.h \
+    ../../job/destinationcache.h \
+    ../../job/processmemory.h \
+    ../../job/jobthread.h \
+    ../../job/logsink.h \
+    ../../job/runstats.h \
+    ../../job/tracer.h
+
+win32: LIBS += -lpsapi
+
+include(../../threaddb/threaddb.pri)
+
+DESTDIR = ../../../bin
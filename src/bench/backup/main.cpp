@@ -0,0 +1,308 @@
+#include <atomic>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QThread>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QSqlRecord>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include "threaddb/dbmanager.h"
+#include "job/backupmanager.h"
+#include "job/dbschema.h"
+#include "job/logsink.h"
+#include "job/storagebackend.h"
+#include "job/s3storage.h"
+#include "treegenerator.h"
+#include "slowlocalstorage.h"
+
+/// Peak resident set size of the process so far
+static qint64 peakRssBytes()
+{
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return -1;
+
+	return qint64(counters.PeakWorkingSetSize);
+#elif defined(Q_OS_MACOS)
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return qint64(usage.ru_maxrss);
+#elif defined(Q_OS_UNIX)
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return qint64(usage.ru_maxrss) * 1024;
+#else
+	return -1;
+#endif
+}
+
+/// Size of the database including the WAL file
+static qint64 dbSizeBytes(const QString &dbFilePath)
+{
+	return QFileInfo(dbFilePath).size() + QFileInfo(dbFilePath + "-wal").size();
+}
+
+/// BackupManager versions files with one second resolution, two runs must not start within the same second
+static void waitForNextSecond()
+{
+	QThread::msleep(1000 - QDateTime::currentMSecsSinceEpoch() % 1000 + 10);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("End-to-end benchmark of the backup engine on a synthetic source tree; prints the results as JSON.");
+	parser.addHelpOption();
+
+	const QCommandLineOption filesOption("files", "Number of files in the source tree.", "count", "10000");
+	const QCommandLineOption depthOption("depth", "Directory levels below the root.", "levels", "3");
+	const QCommandLineOption fanoutOption("fanout", "Subdirectories of each directory.", "count", "6");
+	const QCommandLineOption medianSizeOption("median-size", "Median file size.", "bytes", "16384");
+	const QCommandLineOption sizeSigmaOption("size-sigma", "Sigma of the log-normal file size distribution.", "sigma", "1.5");
+	const QCommandLineOption maxSizeOption("max-size", "Maximum file size.", "bytes", "67108864");
+	const QCommandLineOption excludedOption("excluded-subtrees", "Number of excluded subtrees.", "count", "2");
+	const QCommandLineOption churnOption("churn", "Percentage of files modified for the churn run.", "percent", "1");
+	const QCommandLineOption deleteOption("delete", "Percentage of files deleted for the mass deletion run.", "percent", "50");
+	const QCommandLineOption seedOption("seed", "Random seed of the generator.", "seed", "1");
+	const QCommandLineOption workDirOption("work-dir", "Directory for the trees and the database (a temporary directory by default).", "path");
+	const QCommandLineOption labelOption("label", "Label stored in the report (e.g. the commit).", "label");
+	const QCommandLineOption outputOption("output", "Writes the report to the file instead of stdout.", "file");
+	const QCommandLineOption latencyOption("latency", "Simulated latency of each request to the local backup directory, as of a share behind a slow link; the metadata requests sent and saved are reported.", "ms", "0");
+	const QCommandLineOption remoteOption("remote", "Empty backup storage to use instead of a directory in the work directory, e.g. s3+http://localhost:9000/bench for a local S3-compatible server.", "url");
+
+	parser.addOptions({filesOption, depthOption, fanoutOption, medianSizeOption, sizeSigmaOption, maxSizeOption, excludedOption, churnOption, deleteOption, seedOption, workDirOption, labelOption, outputOption, latencyOption, remoteOption});
+	parser.process(app);
+
+	QTextStream err(stderr);
+
+	QTemporaryDir tmpDir;
+	const QDir workDir(parser.isSet(workDirOption) ? parser.value(workDirOption) : tmpDir.path());
+	const QString sourcePath = workDir.absoluteFilePath("source");
+	const bool isLocalRemote = !parser.isSet(remoteOption);
+	const QString remotePath = isLocalRemote ? workDir.absoluteFilePath("remote") : parser.value(remoteOption);
+	const QString dbFilePath = workDir.absoluteFilePath("bench.sqlite");
+
+	if(QFileInfo(sourcePath).exists() || (isLocalRemote && QFileInfo(remotePath).exists()) || QFileInfo(dbFilePath).exists()) {
+		err << "Work directory " << workDir.path() << " is not empty\n";
+		return 1;
+	}
+
+	if(!workDir.mkpath("source") || (isLocalRemote && !workDir.mkpath("remote"))) {
+		err << "Failed to create the trees in " << workDir.path() << "\n";
+		return 1;
+	}
+
+	// The first scenario is a seed, which needs an empty destination
+	if(!isLocalRemote) {
+		const std::shared_ptr<StorageBackend> storage = StorageBackend::create(remotePath);
+
+		if(!storage->isAvailable() || !storage->isEmpty()) {
+			err << "Backup storage " << remotePath << " is not available or not empty\n";
+			return 1;
+		}
+	}
+
+	// The local backup directories the runs create are then delayed, object stores have their own latency
+	const int latencyMSecs = parser.value(latencyOption).toInt();
+	if(latencyMSecs > 0) {
+		StorageBackend::setFactory([latencyMSecs](const QString &remoteDir) -> std::shared_ptr<StorageBackend> {
+			if(StorageBackend::isObjectStore(remoteDir))
+				return std::make_shared<S3Storage>(QUrl(remoteDir));
+
+			return std::make_shared<SlowLocalStorage>(remoteDir, latencyMSecs);
+		});
+	}
+
+	TreeGenerator::Config config;
+	config.fileCount = parser.value(filesOption).toInt();
+	config.depth = parser.value(depthOption).toInt();
+	config.fanout = parser.value(fanoutOption).toInt();
+	config.medianFileSize = parser.value(medianSizeOption).toLongLong();
+	config.fileSizeSigma = parser.value(sizeSigmaOption).toDouble();
+	config.maxFileSize = parser.value(maxSizeOption).toLongLong();
+	config.excludedSubtrees = parser.value(excludedOption).toInt();
+	config.seed = parser.value(seedOption).toUInt();
+
+	TreeGenerator tree(sourcePath, config);
+	{
+		QElapsedTimer tmr;
+		tmr.start();
+
+		if(!tree.generate()) {
+			err << "Failed to generate the source tree\n";
+			return 1;
+		}
+
+		err << "Generated " << tree.fileCount() << " files (" << tree.totalSize() / (1024 * 1024) << " MB) in " << tmr.elapsed() << " ms\n";
+		err.flush();
+	}
+
+	LogSink logSink;
+	DBManager db;
+	QObject::connect(&db, &DBManager::sigQueryError, [&](QString query, QString error){
+		err << "Query error '" << error << "' in '" << query << "'\n";
+		err.flush();
+	});
+
+	db.openSQLITE(dbFilePath);
+	DBSchema::create(&db);
+
+	// Each scenario requests the backup explicitly (as "Backup now" does), the interval only has to keep the scheduler from starting one on its own
+	const qlonglong dirId = db.insert("INSERT INTO backupDirectories (sourceDir, remoteDir, backupInterval, keepHistoryDuration, excludeFilter) VALUES (?, ?, ?, ?, ?)", {
+		sourcePath,
+		remotePath,
+		qlonglong(365) * 24 * 3600,
+		qlonglong(365) * 24 * 3600,
+		TreeGenerator::excludeFilter()
+	}).toLongLong();
+
+	BackupManager backupManager(&db, &logSink);
+
+	QJsonArray scenarios;
+
+	// Runs a backup check and reports it together with the run statistics stored by the engine
+	auto runScenario = [&](const QString &name) {
+		waitForNextSecond();
+
+		std::atomic<bool> isDone{false};
+		QVector<LogRecord> logRecords;
+		int errorCount = 0;
+
+		QElapsedTimer tmr;
+		tmr.start();
+
+		// idle() is emitted once the scheduled run finished
+		const QMetaObject::Connection idleConnection = QObject::connect(&backupManager, &BackupManager::idle, [&]{
+			isDone = true;
+		});
+
+		db.exec("UPDATE backupDirectories SET lastFinishedBackup = NULL WHERE id = ?", {dirId});
+		QMetaObject::invokeMethod(&backupManager, "checkForBackups");
+
+		// Consume the log like the GUI does, so that its cost is included and errors are not dropped
+		auto drainLog = [&]{
+			logRecords.clear();
+			logSink.drain(logRecords, 65536);
+			for(const LogRecord &record : logRecords) {
+				if(record.level != LogLevel::error)
+					continue;
+
+				errorCount ++;
+				err << name << ": " << record.text() << "\n";
+			}
+		};
+
+		while(!isDone) {
+			drainLog();
+			QThread::msleep(20);
+		}
+
+		const double seconds = double(tmr.nsecsElapsed()) / 1e9;
+		QObject::disconnect(idleConnection);
+		drainLog();
+
+		const QSqlRecord run = db.selectRow("SELECT * FROM runs WHERE backupDirectory = ? ORDER BY id DESC LIMIT 1", {dirId});
+		const qlonglong files = run.value("filesNew").toLongLong() + run.value("filesChanged").toLongLong() + run.value("filesUnchanged").toLongLong() + run.value("filesRemoved").toLongLong();
+		const qlonglong bytes = run.value("bytesNew").toLongLong() + run.value("bytesChanged").toLongLong();
+
+		QJsonObject phases;
+		for(const char *phase : {"walkTime", "statTime", "excludeTime", "lookupTime", "copyTime", "historyTime", "pruneTime", "commitTime"})
+			phases[phase] = run.value(phase).toLongLong();
+
+		QJsonObject result;
+		result["name"] = name;
+		result["seconds"] = seconds;
+		result["isSeed"] = run.value("isSeed").toBool();
+		result["filesNew"] = run.value("filesNew").toLongLong();
+		result["filesChanged"] = run.value("filesChanged").toLongLong();
+		result["filesUnchanged"] = run.value("filesUnchanged").toLongLong();
+		result["filesRemoved"] = run.value("filesRemoved").toLongLong();
+		result["filesFailed"] = run.value("filesFailed").toLongLong();
+		result["metadataRequests"] = run.value("metadataRequests").toLongLong();
+		result["metadataRequestsSaved"] = run.value("metadataRequestsSaved").toLongLong();
+		result["historyVersions"] = db.selectValue("SELECT COUNT(*) FROM history WHERE backupDirectory = ?", {dirId}).toLongLong();
+		result["errors"] = errorCount;
+		result["filesPerSecond"] = files / seconds;
+		result["mbPerSecond"] = bytes / seconds / (1024 * 1024);
+		result["dbSizeBytes"] = dbSizeBytes(dbFilePath);
+		result["peakRssBytes"] = peakRssBytes();
+		result["phaseMs"] = phases;
+		scenarios.append(result);
+
+		err << name << ": " << seconds << " s\n";
+		err.flush();
+	};
+
+	runScenario("seed");
+	runScenario("rescan");
+
+	const int modifiedCount = tree.modify(parser.value(churnOption).toDouble());
+	runScenario("churn");
+
+	const int deletedCount = tree.remove(parser.value(deleteOption).toDouble());
+	runScenario("delete");
+
+	// Every history version is older than the run now
+	db.blockingExec("UPDATE backupDirectories SET keepHistoryDuration = 0 WHERE id = ?", {dirId});
+	runScenario("prune");
+
+	if(modifiedCount < 0 || deletedCount < 0)
+		err << "Failed to modify the source tree\n";
+
+	QJsonObject configJson;
+	configJson["files"] = config.fileCount;
+	configJson["depth"] = config.depth;
+	configJson["fanout"] = config.fanout;
+	configJson["medianFileSize"] = config.medianFileSize;
+	configJson["fileSizeSigma"] = config.fileSizeSigma;
+	configJson["maxFileSize"] = config.maxFileSize;
+	configJson["excludedSubtrees"] = config.excludedSubtrees;
+	configJson["seed"] = qint64(config.seed);
+	configJson["modifiedFiles"] = modifiedCount;
+	configJson["deletedFiles"] = deletedCount;
+	configJson["latencyMs"] = latencyMSecs;
+	configJson["remote"] = isLocalRemote ? QString("local") : StorageBackend::create(remotePath)->location(QString());
+
+	QJsonObject report;
+	report["benchmark"] = "backup";
+	report["label"] = parser.value(labelOption);
+	report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+#ifdef THREADDB_NATIVE_SQLITE
+	report["backend"] = "sqlite3";
+#else
+	report["backend"] = "qtsql";
+#endif
+	report["config"] = configJson;
+	report["scenarios"] = scenarios;
+
+	const QByteArray json = QJsonDocument(report).toJson();
+	if(parser.isSet(outputOption)) {
+		QFile file(parser.value(outputOption));
+		if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+			err << "Failed to write " << file.fileName() << "\n";
+			return 1;
+		}
+	} else
+		QTextStream(stdout) << json;
+
+	return 0;
+}
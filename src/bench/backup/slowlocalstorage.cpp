@@ -0,0 +1,81 @@
+#include "slowlocalstorage.h"
+
+#include <QThread>
+
+SlowLocalStorage::SlowLocalStorage(const QString &rootDir, int latencyMSecs) :
+	LocalStorage(rootDir),
+	latencyMSecs_(latencyMSecs)
+{
+
+}
+
+bool SlowLocalStorage::isAvailable()
+{
+	delay();
+	return LocalStorage::isAvailable();
+}
+
+bool SlowLocalStorage::isEmpty()
+{
+	delay();
+	return LocalStorage::isEmpty();
+}
+
+bool SlowLocalStorage::exists(const QString &path)
+{
+	delay();
+	return LocalStorage::exists(path);
+}
+
+qint64 SlowLocalStorage::size(const QString &path)
+{
+	delay();
+	return LocalStorage::size(path);
+}
+
+bool SlowLocalStorage::mkpath(const QString &dirPath)
+{
+	delay();
+	return LocalStorage::mkpath(dirPath);
+}
+
+void SlowLocalStorage::rmpath(const QString &path)
+{
+	delay();
+	LocalStorage::rmpath(path);
+}
+
+bool SlowLocalStorage::put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress)
+{
+	delay();
+	return LocalStorage::put(sourceFilePath, path, onProgress);
+}
+
+bool SlowLocalStorage::get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress)
+{
+	delay();
+	return LocalStorage::get(path, targetFilePath, onProgress);
+}
+
+bool SlowLocalStorage::rename(const QString &path, const QString &newPath)
+{
+	delay();
+	return LocalStorage::rename(path, newPath);
+}
+
+bool SlowLocalStorage::remove(const QString &path)
+{
+	delay();
+	return LocalStorage::remove(path);
+}
+
+bool SlowLocalStorage::list(const QString &dirPath, QStringList &filePaths)
+{
+	delay();
+	return LocalStorage::list(dirPath, filePaths);
+}
+
+void SlowLocalStorage::delay() const
+{
+	QThread::msleep(ulong(latencyMSecs_));
+}
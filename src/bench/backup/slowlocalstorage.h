@@ -0,0 +1,34 @@
+#ifndef SLOWLOCALSTORAGE_H
+#define SLOWLOCALSTORAGE_H
+
+#include "job/localstorage.h"
+
+/// Local backup directory whose requests are delayed, as those to a share behind a slow link; the data the backup writes in place is not delayed
+class SlowLocalStorage : public LocalStorage
+{
+
+public:
+	SlowLocalStorage(const QString &rootDir, int latencyMSecs);
+
+public:
+	bool isAvailable() override;
+	bool isEmpty() override;
+	bool exists(const QString &path) override;
+	qint64 size(const QString &path) override;
+	bool mkpath(const QString &dirPath) override;
+	void rmpath(const QString &path) override;
+	bool put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress = ProgressFunc()) override;
+	bool get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress = ProgressFunc()) override;
+	bool rename(const QString &path, const QString &newPath) override;
+	bool remove(const QString &path) override;
+	bool list(const QString &dirPath, QStringList &filePaths) override;
+
+private:
+	void delay() const;
+
+private:
+	const int latencyMSecs_;
+
+};
+
+#endif // SLOWLOCALSTORAGE_H
@@ -0,0 +1,169 @@
+#include "treegenerator.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+TreeGenerator::TreeGenerator(const QString &rootPath, const TreeGenerator::Config &config) :
+	rootPath_(rootPath),
+	config_(config),
+	random_(config.seed)
+{
+	contentBlock_.resize(1024 * 1024);
+	for(int i = 0; i < contentBlock_.size(); i ++)
+		contentBlock_[i] = char(random_());
+}
+
+bool TreeGenerator::generate()
+{
+	const QDir root(rootPath_);
+
+	// Directories level by level, the root included
+	QStringList dirs{QString()};
+	QStringList level{QString()};
+	for(int d = 0; d < config_.depth; d ++) {
+		QStringList nextLevel;
+		for(const QString &parent : level) {
+			for(int i = 0; i < config_.fanout; i ++)
+				nextLevel.append(QString("%1dir%2/").arg(parent).arg(i));
+		}
+
+		dirs.append(nextLevel);
+		level = nextLevel;
+	}
+
+	for(const QString &dir : dirs) {
+		if(!root.mkpath(dir.isEmpty() ? "." : dir))
+			return false;
+	}
+
+	std::uniform_int_distribution<int> dirDistribution(0, dirs.size() - 1);
+
+	files_.clear();
+	sizes_.clear();
+	for(int i = 0; i < config_.fileCount; i ++) {
+		const QString filePath = QString("%1file%2.dat").arg(dirs[dirDistribution(random_)]).arg(i);
+		const qint64 size = randomFileSize();
+
+		if(!writeFile(filePath, size))
+			return false;
+
+		files_.append(filePath);
+		sizes_.append(size);
+	}
+
+	for(int s = 0; s < config_.excludedSubtrees; s ++) {
+		const QString subtree = QString("%1bench_excluded%2/").arg(dirs[dirDistribution(random_)]).arg(s);
+		if(!root.mkpath(subtree))
+			return false;
+
+		for(int i = 0; i < config_.excludedFileCount; i ++) {
+			if(!writeFile(QString("%1file%2.dat").arg(subtree).arg(i), randomFileSize()))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+int TreeGenerator::modify(double percent)
+{
+	const QVector<int> picked = pickFiles(qRound(files_.size() * percent / 100));
+
+	for(int i : picked) {
+		const QString absolutePath = QDir(rootPath_).absoluteFilePath(files_[i]);
+		const QDateTime lastModified = QFileInfo(absolutePath).lastModified();
+
+		sizes_[i] = randomFileSize();
+		if(!writeFile(files_[i], sizes_[i]))
+			return -1;
+
+		// Backups compare modification times with one second resolution, a rewrite within the same second would go unnoticed
+		QFile file(absolutePath);
+		if(!file.open(QIODevice::ReadWrite) || !file.setFileTime(lastModified.addSecs(60), QFileDevice::FileModificationTime))
+			return -1;
+	}
+
+	return picked.size();
+}
+
+int TreeGenerator::remove(double percent)
+{
+	QVector<int> picked = pickFiles(qRound(files_.size() * percent / 100));
+
+	// Removing from the back keeps the remaining indexes valid
+	std::sort(picked.begin(), picked.end(), std::greater<int>());
+
+	for(int i : picked) {
+		if(!QFile::remove(QDir(rootPath_).absoluteFilePath(files_[i])))
+			return -1;
+
+		files_.removeAt(i);
+		sizes_.removeAt(i);
+	}
+
+	return picked.size();
+}
+
+qint64 TreeGenerator::totalSize() const
+{
+	qint64 result = 0;
+	for(qint64 size : sizes_)
+		result += size;
+
+	return result;
+}
+
+QString TreeGenerator::excludeFilter()
+{
+	return "*bench_excluded*/*";
+}
+
+qint64 TreeGenerator::randomFileSize()
+{
+	std::lognormal_distribution<double> distribution(std::log(double(qMax<qint64>(config_.medianFileSize, 1))), config_.fileSizeSigma);
+	return qMin(config_.maxFileSize, qint64(distribution(random_)));
+}
+
+QVector<int> TreeGenerator::pickFiles(int count)
+{
+	QVector<int> indexes(files_.size());
+	for(int i = 0; i < indexes.size(); i ++)
+		indexes[i] = i;
+
+	// Partial Fisher-Yates shuffle
+	count = qMin(count, indexes.size());
+	for(int i = 0; i < count; i ++) {
+		std::uniform_int_distribution<int> distribution(i, indexes.size() - 1);
+		std::swap(indexes[i], indexes[distribution(random_)]);
+	}
+
+	indexes.resize(count);
+	return indexes;
+}
+
+bool TreeGenerator::writeFile(const QString &filePath, qint64 size)
+{
+	QFile file(QDir(rootPath_).absoluteFilePath(filePath));
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	// Content starts at a random offset of the block so that the files differ
+	std::uniform_int_distribution<int> offsetDistribution(0, contentBlock_.size() - 1);
+	int offset = offsetDistribution(random_);
+
+	while(size > 0) {
+		const int chunk = int(qMin<qint64>(size, contentBlock_.size() - offset));
+		if(file.write(contentBlock_.constData() + offset, chunk) != chunk)
+			return false;
+
+		size -= chunk;
+		offset = 0;
+	}
+
+	return true;
+}
@@ -0,0 +1,81 @@
+#ifndef TREEGENERATOR_H
+#define TREEGENERATOR_H
+
+#include <random>
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QByteArray>
+
+/// Synthetic source tree for the backup benchmarks; the same config always produces the same tree
+class TreeGenerator
+{
+
+public:
+	struct Config {
+		int fileCount = 10000;
+
+		/// Directory levels below the root and subdirectories of each directory
+		int depth = 3;
+		int fanout = 6;
+
+		/// File sizes are log-normally distributed around the median (sigma of the underlying normal distribution), capped at maxFileSize
+		qint64 medianFileSize = 16 * 1024;
+		double fileSizeSigma = 1.5;
+		qint64 maxFileSize = 64 * 1024 * 1024;
+
+		/// Subtrees matching excludeFilter(), with excludedFileCount files each
+		int excludedSubtrees = 2;
+		int excludedFileCount = 100;
+
+		quint32 seed = 1;
+	};
+
+public:
+	TreeGenerator(const QString &rootPath, const Config &config);
+
+public:
+	/// Creates the tree, returns false on I/O error
+	bool generate();
+
+	/// Rewrites percent of the files and moves their modification time forward, returns the number of files modified (-1 on I/O error)
+	int modify(double percent);
+
+	/// Deletes percent of the files, returns the number of files deleted (-1 on I/O error)
+	int remove(double percent);
+
+public:
+	/// Files that are backed up (the excluded subtrees are not counted)
+	int fileCount() const {
+		return files_.size();
+	}
+
+	qint64 totalSize() const;
+
+	/// Value for backupDirectories.excludeFilter matching the excluded subtrees
+	static QString excludeFilter();
+
+private:
+	qint64 randomFileSize();
+
+	/// Picks count distinct indexes into files_
+	QVector<int> pickFiles(int count);
+
+	bool writeFile(const QString &filePath, qint64 size);
+
+private:
+	const QString rootPath_;
+	const Config config_;
+	std::mt19937_64 random_;
+
+	/// Random block the file contents are cut from
+	QByteArray contentBlock_;
+
+	/// Paths relative to the root and sizes of the backed up files
+	QStringList files_;
+	QVector<qint64> sizes_;
+
+};
+
+#endif // TREEGENERATOR_H
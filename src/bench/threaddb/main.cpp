@@ -0,0 +1,294 @@
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QDir>
+
+#include <algorithm>
+
+#include "threaddb/dbmanager.h"
+#include "threaddb/dbstatement.h"
+#include "threaddb/dbmodel.h"
+
+/// Result of iterations operations that took ns in total as a JSON object
+QJsonObject makeResult(const QString &name, int iterations, qint64 ns)
+{
+	QJsonObject result;
+	result["name"] = name;
+	result["iterations"] = iterations;
+	result["totalMs"] = double(ns) / 1000000;
+	result["nsPerOp"] = double(ns) / iterations;
+	return result;
+}
+
+/// Runs func iterations times and then finish once, both timed, and returns the result as a JSON object; finish waits for the jobs that func only queued
+template<typename F, typename Finish>
+QJsonObject measure(const QString &name, int iterations, F func, Finish finish)
+{
+	QElapsedTimer tmr;
+	tmr.start();
+
+	for(int i = 0; i < iterations; i ++)
+		func(i);
+
+	finish();
+
+	return makeResult(name, iterations, tmr.nsecsElapsed());
+}
+
+template<typename F>
+QJsonObject measure(const QString &name, int iterations, F func)
+{
+	return measure(name, iterations, func, []{});
+}
+
+/// Adds percentiles of the latencies (ns) to the result
+QJsonObject withLatencies(QJsonObject result, QVector<qint64> latencies)
+{
+	std::sort(latencies.begin(), latencies.end());
+
+	auto percentile = [&](double p) {
+		return latencies.isEmpty() ? 0 : latencies[qMin(latencies.size() - 1, int(latencies.size() * p))];
+	};
+
+	result["p50Ns"] = percentile(0.5);
+	result["p90Ns"] = percentile(0.9);
+	result["p99Ns"] = percentile(0.99);
+	result["maxNs"] = latencies.isEmpty() ? 0 : latencies.last();
+	return result;
+}
+
+/// Like measure, but also reports the latency distribution of the single calls
+template<typename F>
+QJsonObject measureLatency(const QString &name, int iterations, F func)
+{
+	QVector<qint64> latencies;
+	latencies.reserve(iterations);
+
+	QElapsedTimer total, tmr;
+	total.start();
+
+	for(int i = 0; i < iterations; i ++) {
+		tmr.start();
+		func(i);
+		latencies.append(tmr.nsecsElapsed());
+	}
+
+	return withLatencies(makeResult(name, iterations, total.nsecsElapsed()), latencies);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	const int rowCount = argc > 1 ? QString(argv[1]).toInt() : 20000;
+
+	QTemporaryDir tmpDir;
+	DBManager db;
+	db.openSQLITE(QDir(tmpDir.path()).absoluteFilePath("bench.sqlite"));
+
+	db.blockingExec("CREATE TABLE files (id INTEGER PRIMARY KEY, backupDirectory INTEGER, filePath TEXT, lastChecked INTEGER, remoteVersion INTEGER)");
+	db.blockingExec("CREATE INDEX i_files_backupDirectory_filePath ON files (backupDirectory, filePath)");
+
+	const QString filePathPattern("dir%1/subdir/file%2.txt");
+	auto filePath = [&](int i) { return filePathPattern.arg(i % 64).arg(i); };
+
+	QJsonArray results;
+
+	// Job queue
+	{
+		JobThread jobThread;
+
+		results.append(measureLatency("jobthread.executeBlocking", rowCount, [&](int){
+			jobThread.executeBlocking([]{});
+		}));
+
+		// Throughput of queueing with the queue drained at the end
+		{
+			QElapsedTimer tmr;
+			tmr.start();
+
+			for(int i = 0; i < rowCount; i ++)
+				jobThread.executeNonblocking([]{});
+
+			jobThread.executeBlocking([]{});
+			results.append(makeResult("jobthread.executeNonblocking", rowCount, tmr.nsecsElapsed()));
+		}
+
+		// Time from enqueueing a job to its start, the producer paced so that the queue does not grow
+		{
+			QVector<qint64> latencies;
+			latencies.reserve(rowCount);
+
+			QElapsedTimer tmr;
+			tmr.start();
+
+			for(int i = 0; i < rowCount; i ++) {
+				const qint64 enqueued = tmr.nsecsElapsed();
+				jobThread.executeNonblocking([&latencies, &tmr, enqueued]{
+					latencies.append(tmr.nsecsElapsed() - enqueued);
+				});
+
+				if(i % 64 == 63)
+					jobThread.executeBlocking([]{});
+			}
+
+			jobThread.executeBlocking([]{});
+			results.append(withLatencies(makeResult("jobthread.queueLatency", rowCount, tmr.nsecsElapsed()), latencies));
+		}
+	}
+
+	// Inserts
+	{
+		db.blockingExec("BEGIN");
+		results.append(measure("insert.execAssoc", rowCount, [&](int i){
+			db.execAssoc("INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (:backupDirectory, :filePath, :lastChecked, :remoteVersion)", {
+				{":backupDirectory", 1},
+				{":filePath", filePath(i)},
+				{":lastChecked", i},
+				{":remoteVersion", i}
+			});
+		}, [&]{
+			db.waitJobDone();
+		}));
+		db.blockingExec("COMMIT");
+	}
+	{
+		db.blockingExec("BEGIN");
+		results.append(measure("insert.exec", rowCount, [&](int i){
+			db.exec("INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (?, ?, ?, ?)", {3, filePath(i), i, i});
+		}, [&]{
+			db.waitJobDone();
+		}));
+		db.blockingExec("COMMIT");
+	}
+	{
+		DBStatement<std::tuple<>(qlonglong, QString, qlonglong, qlonglong)> insertStatement(&db, "INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (?, ?, ?, ?)");
+
+		db.blockingExec("BEGIN");
+		results.append(measure("insert.DBStatement", rowCount, [&](int i){
+			insertStatement.execAsync(2, filePath(i), i, i);
+		}, [&]{
+			db.waitJobDone();
+		}));
+		db.blockingExec("COMMIT");
+	}
+
+	// Lookups
+	results.append(measure("lookup.selectRowDefAssoc", rowCount, [&](int i){
+		const QSqlRecord rec = db.selectRowDefAssoc("SELECT id, remoteVersion FROM files WHERE (backupDirectory = :backupDirectory) AND (filePath = :filePath)", {
+			{":backupDirectory", 1},
+			{":filePath", filePath(i)}
+		});
+		Q_UNUSED(rec.value("remoteVersion").toLongLong());
+	}));
+	{
+		DBQuery query(&db);
+		query.prepare("SELECT id, remoteVersion FROM files WHERE (backupDirectory = :backupDirectory) AND (filePath = :filePath)");
+		results.append(measure("lookup.DBQuery.execAssoc", rowCount, [&](int i){
+			query.execAssoc({{":backupDirectory", 1}, {":filePath", filePath(i)}});
+			query.next();
+			Q_UNUSED(query.value("remoteVersion").toLongLong());
+		}));
+	}
+	{
+		using FindStatement = DBStatement<std::tuple<qlonglong, qlonglong>(qlonglong, QString)>;
+		FindStatement findStatement(&db, "SELECT id, remoteVersion FROM files WHERE (backupDirectory = ?) AND (filePath = ?)");
+		results.append(measure("lookup.DBStatement", rowCount, [&](int i){
+			Q_UNUSED(std::get<1>(findStatement.selectRowDef(FindStatement::Row(-1, 0), 2, filePath(i))));
+		}));
+	}
+
+	// Binding cost of named vs positional parameters, without an index lookup
+	{
+		db.blockingExec("BEGIN");
+		results.append(measure("update.execAssoc", rowCount, [&](int i){
+			db.execAssoc("UPDATE files SET lastChecked = :lastChecked WHERE id = :id", {
+				{":lastChecked", i + 1},
+				{":id", i + 1}
+			});
+		}, [&]{
+			db.waitJobDone();
+		}));
+		results.append(measure("update.exec", rowCount, [&](int i){
+			db.exec("UPDATE files SET lastChecked = ? WHERE id = ?", {i + 2, i + 1});
+		}, [&]{
+			db.waitJobDone();
+		}));
+		db.blockingExec("COMMIT");
+	}
+
+	// Iterating over a result; the reported time is per row
+	{
+		const int repeats = 5;
+
+		QElapsedTimer tmr;
+		tmr.start();
+
+		for(int r = 0; r < repeats; r ++) {
+			DBQuery query = db.selectQueryAssoc("SELECT id, filePath, lastChecked FROM files WHERE backupDirectory = :backupDirectory", {{":backupDirectory", 1}});
+			while(query.next()) {
+				Q_UNUSED(query.value("filePath").toString());
+				Q_UNUSED(query.value(2).toLongLong());
+			}
+		}
+
+		results.append(makeResult("select.selectQueryAssoc.next", rowCount * repeats, tmr.nsecsElapsed()));
+	}
+
+	// Model access as done by the views; the reported time is per cell
+	{
+		DBQuery query = db.selectQuery("SELECT id, backupDirectory, filePath, lastChecked, remoteVersion FROM files WHERE backupDirectory = ?", {1});
+		DBModel model;
+		model.setQuery(query);
+
+		const int columnCount = model.columnCount();
+		results.append(measure("dbmodel.data.sequential", rowCount * columnCount, [&](int i){
+			Q_UNUSED(model.data(model.index(i / columnCount, i % columnCount)));
+		}));
+
+		// Rows in a pseudo-random order, like jumping around with the scrollbar
+		results.append(measure("dbmodel.data.random", rowCount * columnCount, [&](int i){
+			const int row = int((qint64(i / columnCount) * 7919) % rowCount);
+			Q_UNUSED(model.data(model.index(row, i % columnCount)));
+		}));
+	}
+
+	// lastChecked update of unchanged files as in BackupManager::commitUnchangedFileIds; the reported time is per file
+	for(int batchSize : {64, 512, 4096}) {
+		DBStatement<std::tuple<>(qlonglong, qlonglong)> updateLastCheckedStatement(&db, "UPDATE files SET lastChecked = ? WHERE id = ?");
+
+		QElapsedTimer tmr;
+		tmr.start();
+
+		QVector<std::tuple<qlonglong, qlonglong>> batch;
+		batch.reserve(batchSize);
+
+		for(int i = 0; i < rowCount; i ++) {
+			batch.append(std::make_tuple(qlonglong(batchSize), qlonglong(i + 1)));
+
+			if(batch.size() == batchSize || i == rowCount - 1) {
+				updateLastCheckedStatement.execBatch(batch);
+				batch.clear();
+			}
+		}
+
+		results.append(makeResult(QString("commitUnchangedFileIds.batch%1").arg(batchSize), rowCount, tmr.nsecsElapsed()));
+	}
+
+	QJsonObject report;
+	report["benchmark"] = "threaddb";
+#ifdef THREADDB_NATIVE_SQLITE
+	report["backend"] = "sqlite3";
+#else
+	report["backend"] = "qtsql";
+#endif
+	report["rows"] = rowCount;
+	report["results"] = results;
+
+	QTextStream(stdout) << QJsonDocument(report).toJson();
+	return 0;
+}
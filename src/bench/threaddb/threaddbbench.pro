@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Microbenchmarks of the threaddb layer
+#
+#-------------------------------------------------
+
+QT       += core sql
+QT       -= gui
+
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+TARGET = threaddbBench
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+main.cpp \
+    ../../job/jobthread.cpp \
+    ../../job/tracer.cpp
+
+HEADERS += \
+    ../../job/jobthread.h \
+    ../../job/tracer.h
+
+include(../../threaddb/threaddb.pri)
+
+DESTDIR = ../../../bin
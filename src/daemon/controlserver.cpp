@@ -0,0 +1,305 @@
+#include "controlserver.h"
+
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QTextStream>
+#include <QDateTime>
+#include <QSqlRecord>
+#include <QCoreApplication>
+#include <QDir>
+#include <QPointer>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrent>
+
+#include "threaddb/dbmanager.h"
+#include "threaddb/dbsnapshot.h"
+#include "job/backupmanager.h"
+#include "job/logsink.h"
+#include "job/processmemory.h"
+#include "job/storagebackend.h"
+#include "daemonclient.h"
+
+ControlServer::ControlServer(DBManager *db, BackupManager *backupManager, LogSink *logSink) :
+	db_(db),
+	backupManager_(backupManager),
+	logSink_(logSink)
+{
+	connect(&server_, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+	connect(backupManager_, SIGNAL(backupFinished()), this, SLOT(onBackupFinished()));
+	connect(backupManager_, SIGNAL(idle()), this, SLOT(onBackupIdle()));
+
+	connect(&logTimer_, SIGNAL(timeout()), this, SLOT(drainLog()));
+	logTimer_.start(logDrainInterval);
+
+	uptime_.start();
+}
+
+bool ControlServer::listen()
+{
+	// A stale socket of a crashed daemon would make listen() fail, but a running daemon must not be replaced
+	DaemonClient probe;
+	if(probe.connectToDaemon())
+		return false;
+
+	QLocalServer::removeServer(DaemonClient::socketName());
+	server_.setSocketOptions(QLocalServer::UserAccessOption);
+	return server_.listen(DaemonClient::socketName());
+}
+
+void ControlServer::onNewConnection()
+{
+	while(QLocalSocket *socket = server_.nextPendingConnection()) {
+		connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	}
+}
+
+void ControlServer::onReadyRead()
+{
+	processRequests(qobject_cast<QLocalSocket*>(sender()));
+}
+
+void ControlServer::onDisconnected()
+{
+	QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+	subscribers_.remove(socket);
+	pausedSockets_.remove(socket);
+	socket->deleteLater();
+}
+
+void ControlServer::processRequests(QLocalSocket *socket)
+{
+	// The requests after one that is answered later stay buffered, the client gets the responses in order
+	while(!pausedSockets_.contains(socket) && socket->canReadLine()) {
+		QJsonParseError error;
+		const QJsonDocument request = QJsonDocument::fromJson(socket->readLine(), &error);
+
+		if(error.error != QJsonParseError::NoError || !request.isObject()) {
+			send(socket, {{"ok", false}, {"error", QString("Invalid request: %1").arg(error.errorString())}});
+			continue;
+		}
+
+		const QJsonObject response = handleRequest(request.object(), socket);
+		if(!response.isEmpty())
+			send(socket, response);
+	}
+}
+
+void ControlServer::onBackupFinished()
+{
+	broadcast({{"event", "backupFinished"}});
+}
+
+void ControlServer::onBackupIdle()
+{
+	broadcast({{"event", "idle"}});
+}
+
+void ControlServer::drainLog()
+{
+	QVector<LogRecord> records;
+	logSink_->drain(records, 4096);
+
+	if(const quint64 droppedCount = logSink_->takeDroppedCount()) {
+		LogRecord record(LogLevel::warning, QString(), staticMetaObject.className(), QT_TR_NOOP("%1 zpráv nebylo kvůli zahlcení zobrazeno."), 1);
+		record.args[0] = QString::number(droppedCount);
+		records.append(record);
+	}
+
+	static const char *const levelNames[] = {"info", "success", "warning", "error"};
+
+	QTextStream out(stdout);
+	for(const LogRecord &record : records) {
+		const QString text = record.text();
+		out << QDateTime::fromMSecsSinceEpoch(record.time).toString("yyyy-MM-dd hh:mm:ss") << " [" << levelNames[int(record.level)] << "] " << text << "\n";
+
+		if(!subscribers_.isEmpty())
+			broadcast({{"event", "log"}, {"level", int(record.level)}, {"directory", record.directory}, {"time", record.time}, {"text", text}});
+	}
+}
+
+QJsonObject ControlServer::handleRequest(const QJsonObject &request, QLocalSocket *socket)
+{
+	const QString command = request.value("command").toString();
+
+	if(command == "list")
+		return listDirectories();
+
+	else if(command == "add") {
+		addDirectory(request, socket);
+		return {};
+
+	} else if(command == "status")
+		return status();
+
+	else if(command == "run") {
+		// A specific directory is made due first; queries are executed in order, so the backup check sees the update
+		if(request.contains("id"))
+			db_->exec("UPDATE backupDirectories SET lastFinishedBackup = NULL WHERE id = ?", {request.value("id").toVariant()});
+
+		QMetaObject::invokeMethod(backupManager_, "checkForBackups");
+		return {{"ok", true}};
+
+	} else if(command == "subscribe") {
+		subscribers_.insert(socket);
+		return {{"ok", true}};
+
+	} else if(command == "stop") {
+		// The response is sent before the event loop gets to quit; a running backup is interrupted
+		QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
+		return {{"ok", true}};
+
+	}
+
+	return {{"ok", false}, {"error", QString("Unknown command '%1'").arg(command)}};
+}
+
+QJsonObject ControlServer::listDirectories()
+{
+	DBSnapshot snapshot(db_);
+	DBQuery query = snapshot.selectQuery("SELECT id, sourceDir, remoteDir, backupInterval, keepHistoryDuration, lastFinishedBackup, excludeFilter, windowStart, windowEnd, historyLayout, stagingDir, stagingLimit FROM backupDirectories ORDER BY id");
+	return {{"ok", true}, {"directories", rowsToJson(query)}};
+}
+
+void ControlServer::addDirectory(const QJsonObject &request, QLocalSocket *socket)
+{
+	const QString sourceDir = request.value("sourceDir").toString();
+	const QString remoteDir = request.value("remoteDir").toString();
+
+	if(!QDir(sourceDir).exists()) {
+		send(socket, {{"ok", false}, {"error", QString("Source directory '%1' does not exist").arg(sourceDir)}});
+		return;
+	}
+
+	// A network share or an object store can take seconds to answer, the event loop keeps serving the other clients and the log meanwhile
+	pausedSockets_.insert(socket);
+	QPointer<QLocalSocket> socketPtr(socket);
+
+	QFutureWatcher<QString> *watcher = new QFutureWatcher<QString>(this);
+	connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, socketPtr, request]{
+		watcher->deleteLater();
+
+		// Disconnected meanwhile, nobody waits for the response
+		if(!socketPtr)
+			return;
+
+		pausedSockets_.remove(socketPtr);
+
+		const QString error = watcher->result();
+		send(socketPtr, error.isEmpty() ? insertDirectory(request) : QJsonObject{{"ok", false}, {"error", error}});
+
+		processRequests(socketPtr);
+	});
+
+	watcher->setFuture(QtConcurrent::run([remoteDir]{
+		const std::shared_ptr<StorageBackend> storage = StorageBackend::create(remoteDir);
+
+		if(!storage->isAvailable())
+			return QString("Backup directory '%1' does not exist").arg(remoteDir);
+
+		if(!storage->isEmpty())
+			return QString("Backup directory '%1' is not empty").arg(remoteDir);
+
+		return QString();
+	}));
+}
+
+QJsonObject ControlServer::insertDirectory(const QJsonObject &request)
+{
+	const QString sourceDir = request.value("sourceDir").toString();
+	const QString remoteDir = request.value("remoteDir").toString();
+
+	const QString stagingDir = request.value("stagingDir").toString();
+	if(!stagingDir.isEmpty() && !QDir(stagingDir).exists())
+		return {{"ok", false}, {"error", QString("Staging directory '%1' does not exist").arg(stagingDir)}};
+
+	const qlonglong id = db_->insertAssoc(
+				"INSERT INTO backupDirectories (sourceDir, remoteDir, backupInterval, keepHistoryDuration, excludeFilter, windowStart, windowEnd, historyLayout, stagingDir, stagingLimit) "
+				"VALUES (:sourceDir, :remoteDir, :backupInterval, :keepHistoryDuration, :excludeFilter, :windowStart, :windowEnd, :historyLayout, :stagingDir, :stagingLimit)",
+				{
+					{":sourceDir", QDir(sourceDir).absolutePath()},
+					{":remoteDir", StorageBackend::isObjectStore(remoteDir) ? remoteDir : QDir(remoteDir).absolutePath()},
+					{":backupInterval", request.value("backupInterval").toVariant().toLongLong()},
+					{":keepHistoryDuration", request.value("keepHistoryDuration").toVariant().toLongLong()},
+					{":excludeFilter", request.value("excludeFilter").toString()},
+					{":windowStart", request.contains("windowStart") ? QVariant(request.value("windowStart").toInt()) : QVariant()},
+					{":windowEnd", request.contains("windowEnd") ? QVariant(request.value("windowEnd").toInt()) : QVariant()},
+					{":historyLayout", request.value("historyLayout").toInt()},
+					{":stagingDir", stagingDir.isEmpty() ? QVariant() : QVariant(QDir(stagingDir).absolutePath())},
+					{":stagingLimit", request.contains("stagingLimit") ? QVariant(request.value("stagingLimit").toVariant().toLongLong()) : QVariant()}
+				}).toLongLong();
+
+	QMetaObject::invokeMethod(backupManager_, "checkForBackups");
+	return {{"ok", true}, {"id", id}};
+}
+
+QJsonObject ControlServer::status()
+{
+	const RunStats &totals = backupManager_->totals();
+
+	QJsonObject result;
+	result["ok"] = true;
+	result["pid"] = QCoreApplication::applicationPid();
+	result["uptimeSeconds"] = uptime_.elapsed() / 1000;
+	result["backupRunning"] = backupManager_->isBackupRunning();
+	result["pendingCopies"] = backupManager_->pendingCopyCount();
+	result["residentBytes"] = ProcessMemory::residentBytes();
+	result["idleResidentBytes"] = backupManager_->idleResidentBytes();
+	result["filesNew"] = qint64(totals.fileCount(RunStats::Outcome::newFile));
+	result["filesChanged"] = qint64(totals.fileCount(RunStats::Outcome::changed));
+	result["filesFailed"] = qint64(totals.fileCount(RunStats::Outcome::failed));
+	result["bytesCopied"] = qint64(totals.byteCount(RunStats::Outcome::newFile) + totals.byteCount(RunStats::Outcome::changed));
+	result["reflinkedFiles"] = qint64(totals.reflinkCount());
+	result["bytesWriteSaved"] = qint64(totals.bytesWriteSaved());
+	result["bytesSpaceSaved"] = qint64(totals.bytesSpaceSaved());
+	result["drainingDirectories"] = backupManager_->drainingCount();
+
+	DBSnapshot snapshot(db_);
+	DBQuery query = snapshot.selectQuery(
+				"SELECT d.id, d.sourceDir, d.lastFinishedBackup, r.filesNew, r.filesChanged, r.filesRemoved, r.filesFailed, r.isInterrupted, "
+				"s.stagedFiles, s.stagedBytes "
+				"FROM backupDirectories d LEFT JOIN runs r ON r.id = (SELECT MAX(id) FROM runs WHERE backupDirectory = d.id) "
+				"LEFT JOIN (SELECT backupDirectory, COUNT(*) AS stagedFiles, SUM(size) AS stagedBytes FROM stagedFiles WHERE state = ? GROUP BY backupDirectory) s ON s.backupDirectory = d.id "
+				"ORDER BY d.id", {int(BackupManager::StageState::staged)});
+
+	// As scheduled by the manager; null while the directory is being backed up (and before the first check)
+	const QHash<qlonglong, qlonglong> nextBackupTimes = backupManager_->nextBackupTimes();
+
+	QJsonArray directories = rowsToJson(query);
+	for(int i = 0; i < directories.size(); i ++) {
+		QJsonObject directory = directories[i].toObject();
+		const auto nextBackup = nextBackupTimes.find(qlonglong(directory.value("id").toDouble()));
+		directory["nextBackup"] = nextBackup != nextBackupTimes.end() ? QJsonValue(qint64(*nextBackup)) : QJsonValue();
+		directories[i] = directory;
+	}
+
+	result["directories"] = directories;
+	return result;
+}
+
+QJsonArray ControlServer::rowsToJson(DBQuery &query)
+{
+	QJsonArray result;
+	while(query.next()) {
+		QJsonObject row;
+		const QSqlRecord &record = query.record();
+		for(int i = 0; i < record.count(); i ++)
+			row[record.fieldName(i)] = QJsonValue::fromVariant(query.value(i));
+
+		result.append(row);
+	}
+
+	return result;
+}
+
+void ControlServer::send(QLocalSocket *socket, const QJsonObject &message)
+{
+	socket->write(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+	socket->flush();
+}
+
+void ControlServer::broadcast(const QJsonObject &message)
+{
+	for(QLocalSocket *socket : subscribers_)
+		send(socket, message);
+}
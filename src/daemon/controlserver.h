@@ -0,0 +1,78 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSet>
+
+class DBManager;
+class DBQuery;
+class BackupManager;
+class LogSink;
+
+/// Control socket of straw-backupd (protocol described at DaemonClient).
+/// Also drains the log sink: messages are printed to stdout and sent to the subscribed clients.
+class ControlServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	ControlServer(DBManager *db, BackupManager *backupManager, LogSink *logSink);
+
+public:
+	/// Returns false if another daemon is running or the socket cannot be created
+	bool listen();
+
+public:
+	static const int logDrainInterval = 100;
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onDisconnected();
+	void onBackupFinished();
+	void onBackupIdle();
+	void drainLog();
+
+private:
+	/// Handles the buffered requests of the socket until one of them is answered later
+	void processRequests(QLocalSocket *socket);
+
+	/// Returns an empty object if the response is sent later (the socket is paused until then)
+	QJsonObject handleRequest(const QJsonObject &request, QLocalSocket *socket);
+
+	QJsonObject listDirectories();
+
+	/// Checks the destination off the event loop thread, then inserts the directory and responds
+	void addDirectory(const QJsonObject &request, QLocalSocket *socket);
+	QJsonObject insertDirectory(const QJsonObject &request);
+	QJsonObject status();
+
+	/// Rows of the query as objects keyed by the column names
+	static QJsonArray rowsToJson(DBQuery &query);
+
+	static void send(QLocalSocket *socket, const QJsonObject &message);
+	void broadcast(const QJsonObject &message);
+
+private:
+	DBManager *db_;
+	BackupManager *backupManager_;
+	LogSink *logSink_;
+
+private:
+	QLocalServer server_;
+	QSet<QLocalSocket*> subscribers_;
+
+	/// Sockets waiting for the response to an add request
+	QSet<QLocalSocket*> pausedSockets_;
+	QTimer logTimer_;
+	QElapsedTimer uptime_;
+
+};
+
+#endif // CONTROLSERVER_H
@@ -0,0 +1,72 @@
+#-------------------------------------------------
+#
+# Headless backup service and its command line client
+#
+#-------------------------------------------------
+
+QT       += core sql concurrent network
+QT       -= gui
+
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+VERSION = 1.1.0.9
+DEFINES += PROGRAM_VERSION=\\\"$$VERSION\\\"
+
+TARGET = straw-backupd
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+main.cpp \
+    controlserver.cpp \
+    daemonclient.cpp \
+    ../job/backupmanager.cpp \
+    ../job/dbschema.cpp \
+    ../job/backupscheduler.cpp \
+    ../job/versionstore.cpp \
+    ../job/processmemory.cpp \
+    ../job/filecopy.cpp \
+    ../job/resumablecopy.cpp \
+    ../job/directorywalk.cpp \
+    ../job/fanoutcopy.cpp \
+    ../job/storagebackend.cpp \
+    ../job/localstorage.cpp \
+    ../job/s3storage.cpp \
+    ../job/destinationcache.cpp \
+    ../job/restoremanager.cpp \
+    ../job/jobthread.cpp \
+    ../job/logsink.cpp \
+    ../job/metricsexporter.cpp \
+    ../job/runstats.cpp \
+    ../job/tracer.cpp
+
+HEADERS += \
+    controlserver.h \
+    daemonclient.h \
+    ../job/backupmanager.h \
+    ../job/dbschema.h \
+    ../job/backupscheduler.h \
+    ../job/versionstore.h \
+    ../job/processmemory.h \
+    ../job/filecopy.h \
+    ../job/resumablecopy.h \
+    ../job/directorywalk.h \
+    ../job/fanoutcopy.h \
+    ../job/storagebackend.h \
+    ../job/localstorage.h \
+    ../job/s3storage.h \
+    ../job/destinationcache.h \
+    ../job/restoremanager.h \
+    ../job/jobthread.h \
+    ../job/logsink.h \
+    ../job/metricsexporter.h \
+    ../job/runstats.h \
+    ../job/tracer.h
+
+win32: LIBS += -lpsapi
+
+include(../threaddb/threaddb.pri)
+
+DESTDIR = ../../bin
@@ -0,0 +1,115 @@
+#include "daemonclient.h"
+
+#include <QJsonDocument>
+#include <QElapsedTimer>
+
+#include "threaddb/dbmanager.h"
+#include "job/logsink.h"
+
+DaemonClient::DaemonClient(DBManager *db, LogSink *logSink) :
+	db_(db),
+	logSink_(logSink)
+{
+	connect(&socket_, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+}
+
+QString DaemonClient::socketName()
+{
+	return "straw-backupd";
+}
+
+bool DaemonClient::connectToDaemon(int timeoutMs)
+{
+	socket_.connectToServer(socketName());
+	return socket_.waitForConnected(timeoutMs);
+}
+
+QJsonObject DaemonClient::request(const QJsonObject &request, int timeoutMs)
+{
+	auto error = [](const QString &message) {
+		return QJsonObject{{"ok", false}, {"error", message}};
+	};
+
+	if(socket_.state() != QLocalSocket::ConnectedState && !connectToDaemon())
+		return error(QString("Daemon is not running (%1)").arg(socket_.errorString()));
+
+	send(request);
+
+	QElapsedTimer tmr;
+	tmr.start();
+
+	while(true) {
+		while(socket_.canReadLine()) {
+			const QJsonObject message = QJsonDocument::fromJson(socket_.readLine()).object();
+
+			// Events are only sent to subscribed clients, but skip them anyway
+			if(!message.contains("event"))
+				return message;
+		}
+
+		const int remaining = timeoutMs - int(tmr.elapsed());
+		if(remaining <= 0 || !socket_.waitForReadyRead(remaining))
+			return error(QString("No response from the daemon (%1)").arg(socket_.errorString()));
+	}
+}
+
+void DaemonClient::subscribe()
+{
+	connect(&socket_, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+	isSubscribed_ = true;
+	send({{"command", "subscribe"}});
+}
+
+void DaemonClient::checkForBackups()
+{
+	// The daemon reads the backup directories from the database, it has to see what this process wrote
+	if(db_)
+		db_->waitJobDone();
+
+	if(socket_.state() != QLocalSocket::ConnectedState) {
+		if(!connectToDaemon()) {
+			if(logSink_)
+				logSink_->log(LogLevel::error, QString(), staticMetaObject.className(), QT_TR_NOOP("Služba straw-backupd neběží, zálohování nelze spustit."));
+
+			return;
+		}
+
+		// The daemon was restarted meanwhile
+		if(isSubscribed_)
+			send({{"command", "subscribe"}});
+	}
+
+	send({{"command", "run"}});
+}
+
+void DaemonClient::onReadyRead()
+{
+	while(socket_.canReadLine()) {
+		const QJsonObject message = QJsonDocument::fromJson(socket_.readLine()).object();
+		const QString event = message.value("event").toString();
+
+		if(event == "backupFinished")
+			emit backupFinished();
+
+		else if(event == "idle")
+			emit idle();
+
+		else if(event == "log" && logSink_) {
+			// The daemon sends the messages already translated
+			const LogLevel level = LogLevel(qBound(int(LogLevel::info), message.value("level").toInt(), int(LogLevel::error)));
+			logSink_->log(level, message.value("directory").toString(), staticMetaObject.className(), "%1", message.value("text").toString());
+		}
+	}
+}
+
+void DaemonClient::onDisconnected()
+{
+	if(logSink_)
+		logSink_->log(LogLevel::warning, QString(), staticMetaObject.className(), QT_TR_NOOP("Spojení se službou straw-backupd bylo přerušeno."));
+}
+
+void DaemonClient::send(const QJsonObject &message)
+{
+	socket_.write(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+	socket_.flush();
+}
@@ -0,0 +1,61 @@
+#ifndef DAEMONCLIENT_H
+#define DAEMONCLIENT_H
+
+#include <QObject>
+#include <QLocalSocket>
+#include <QJsonObject>
+
+class DBManager;
+class LogSink;
+
+/// Connection to a running straw-backupd through its control socket.
+/// Requests and responses are JSON objects, one per line; subscribed clients also receive events ({"event": "log" | "backupFinished" | "idle", ...}).
+/// Used by the CLI (blocking requests) and by the GUI, which then runs its backups in the daemon instead of its own BackupManager.
+class DaemonClient : public QObject
+{
+	Q_OBJECT
+
+public:
+	/// Pending writes of db are flushed before the daemon is asked to run the backups; log events are queued to logSink (both may be nullptr)
+	explicit DaemonClient(DBManager *db = nullptr, LogSink *logSink = nullptr);
+
+public:
+	/// Name of the control socket (path on Unix, pipe name on Windows)
+	static QString socketName();
+
+	/// Returns false if the daemon is not running
+	bool connectToDaemon(int timeoutMs = 500);
+
+	/// Blocking request, returns the response ({"ok": false, "error": ...} on failure). Must not be used after subscribe().
+	QJsonObject request(const QJsonObject &request, int timeoutMs = 30000);
+
+	/// Starts receiving events, asynchronously from the event loop
+	void subscribe();
+
+signals:
+	/// The daemon finished a backup of a directory (same as BackupManager::backupFinished)
+	void backupFinished();
+
+	/// Same as BackupManager::idle
+	void idle();
+
+public slots:
+	/// Asks the daemon to back up the due directories (same as BackupManager::checkForBackups)
+	void checkForBackups();
+
+private slots:
+	void onReadyRead();
+	void onDisconnected();
+
+private:
+	void send(const QJsonObject &message);
+
+private:
+	QLocalSocket socket_;
+	DBManager *db_;
+	LogSink *logSink_;
+	bool isSubscribed_ = false;
+
+};
+
+#endif // DAEMONCLIENT_H
@@ -0,0 +1,353 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QTextStream>
+#include <QDateTime>
+#include <QTime>
+#include <QFileInfo>
+#include <QDir>
+#include <QLockFile>
+
+#include "threaddb/dbmanager.h"
+#include "job/backupmanager.h"
+#include "job/metricsexporter.h"
+#include "job/dbschema.h"
+#include "job/logsink.h"
+#include "job/tracer.h"
+#include "job/restoremanager.h"
+#include "job/versionstore.h"
+#include "job/storagebackend.h"
+#include "controlserver.h"
+#include "daemonclient.h"
+
+/// Opens (or creates) the database shared with the GUI, reports the errors to err
+static bool openDatabase(DBManager &db, LogSink &logSink, QTextStream &err)
+{
+	const QString dbPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+	if(!QDir(dbPath).mkpath(".")) {
+		err << "Failed to create the database directory " << dbPath << "\n";
+		return false;
+	}
+
+	QObject::connect(&db, &DBManager::sigQueryError, [&](QString query, QString error){
+		err << "Database error '" << error << "' in query '" << query << "'\n";
+		err.flush();
+	});
+	QObject::connect(&db, &DBManager::sigOpenError, [&](QString error){
+		err << "Failed to open the database: " << error << "\n";
+		err.flush();
+		exit(1);
+	});
+
+	const QString dbFilePath = QDir(dbPath).absoluteFilePath("db.sqlite");
+	const bool dbExists = QFileInfo(dbFilePath).exists();
+
+	db.openSQLITE(dbFilePath);
+
+	if(!dbExists)
+		DBSchema::create(&db);
+
+	else if(!DBSchema::upgrade(&db, &logSink)) {
+		err << "Unsupported database version " << DBSchema::storedVersion(&db) << "\n";
+		return false;
+	}
+
+	return true;
+}
+
+/// Runs the backups until terminated
+static int runDaemon()
+{
+	QTextStream err(stderr);
+
+	const QString traceFilePath = QString::fromLocal8Bit(qgetenv("STRAW_BACKUP_TRACE"));
+	if(!traceFilePath.isEmpty())
+		Tracer::start();
+
+	LogSink logSink;
+	DBManager db;
+	if(!openDatabase(db, logSink, err))
+		return 1;
+
+	// A lock left by a crashed process is stale (its pid is gone), a running one is never
+	QLockFile backupLock(BackupManager::lockFilePath());
+	backupLock.setStaleLockTime(0);
+	if(!backupLock.tryLock(0)) {
+		err << "The backups are run by another process (the Straw Backup GUI or straw-backupd), lock " << BackupManager::lockFilePath() << "\n";
+		return 1;
+	}
+
+	BackupManager backupManager(&db, &logSink);
+
+	ControlServer controlServer(&db, &backupManager, &logSink);
+	if(!controlServer.listen()) {
+		err << "Another straw-backupd is running or the control socket " << DaemonClient::socketName() << " cannot be created\n";
+		return 1;
+	}
+
+	// Same settings as the GUI, see Global::init
+	MetricsExporter metricsExporter(&db, &backupManager);
+	metricsExporter.setTextfilePath(db.selectValue("SELECT MAX(value) FROM settings WHERE key = 'metricsTextfile'").toString());
+
+	const QString metricsSocket = db.selectValue("SELECT MAX(value) FROM settings WHERE key = 'metricsSocket'").toString();
+	metricsExporter.listen(metricsSocket.isEmpty() ? "straw-backup-metrics" : metricsSocket);
+
+	QMetaObject::invokeMethod(&backupManager, "checkForBackups");
+
+	const int result = QCoreApplication::exec();
+
+	if(!traceFilePath.isEmpty() && !Tracer::stop(traceFilePath))
+		err << "Failed to write trace to " << traceFilePath << "\n";
+
+	return result;
+}
+
+/// Restores a directory in this process, the daemon does not have to be running
+static int runRestore(const QStringList &args, const QCommandLineParser &parser)
+{
+	QTextStream err(stderr);
+
+	if(args.size() != 2) {
+		err << "Usage: straw-backupd restore <id> <targetDir> [--at <time>] [--path <path>] [--overwrite]\n";
+		return 2;
+	}
+
+	qlonglong time = QDateTime::currentSecsSinceEpoch();
+	if(parser.isSet("at")) {
+		QDateTime at;
+		for(const QString &format : {"yyyy-MM-dd hh:mm:ss", "yyyy-MM-dd hh:mm", "yyyy-MM-dd"}) {
+			at = QDateTime::fromString(parser.value("at"), format);
+			if(at.isValid())
+				break;
+		}
+
+		if(!at.isValid()) {
+			err << "Invalid --at '" << parser.value("at") << "', expected yyyy-MM-dd [hh:mm[:ss]]\n";
+			return 2;
+		}
+
+		time = at.toSecsSinceEpoch();
+	}
+
+	const QString targetDir = QFileInfo(args[1]).absoluteFilePath();
+	if(!QDir(targetDir).mkpath(".")) {
+		err << "Failed to create the target directory " << targetDir << "\n";
+		return 1;
+	}
+
+	const bool overwrite = parser.isSet("overwrite");
+	if(!overwrite && !QDir(targetDir).isEmpty()) {
+		err << "The target directory " << targetDir << " is not empty, its files would be overwritten (use --overwrite)\n";
+		return 1;
+	}
+
+	LogSink logSink;
+	DBManager db;
+	if(!openDatabase(db, logSink, err))
+		return 1;
+
+	const qlonglong dirId = args[0].toLongLong();
+	if(!db.selectValue("SELECT COUNT(*) FROM backupDirectories WHERE id = ?", {dirId}).toLongLong()) {
+		err << "No backed up directory with id " << args[0] << "\n";
+		return 1;
+	}
+
+	RestoreManager restoreManager(&db, &logSink);
+
+	// The progress is rewritten on a single line, log messages are printed above it
+	bool isProgressShown = false;
+	QVector<LogRecord> logRecords;
+	auto drainLog = [&]{
+		logRecords.clear();
+		logSink.drain(logRecords, 65536);
+
+		if(!logRecords.isEmpty() && isProgressShown) {
+			err << "\n";
+			isProgressShown = false;
+		}
+
+		for(const LogRecord &record : logRecords)
+			err << record.text() << "\n";
+	};
+
+	QObject::connect(&restoreManager, &RestoreManager::progress, [&](int filesDone, int fileCount, qint64 bytesDone, qint64 byteCount, int etaSeconds){
+		drainLog();
+
+		err << "\r" << filesDone << "/" << fileCount << " files, " << bytesDone / (1024 * 1024) << "/" << byteCount / (1024 * 1024) << " MB, ETA "
+				<< (etaSeconds >= 0 ? QTime(0, 0).addSecs(etaSeconds).toString("hh:mm:ss") : QString("?")) << "   ";
+		err.flush();
+		isProgressShown = true;
+	});
+
+	const RestoreManager::Plan plan = restoreManager.plan(dirId, time, parser.value("path"));
+	drainLog();
+
+	const bool isRestored = restoreManager.restore(plan, targetDir, overwrite);
+	if(isProgressShown)
+		err << "\n";
+
+	drainLog();
+	return isRestored ? 0 : 1;
+}
+
+/// Sends a command to the running daemon and prints the response
+static int runCommand(const QString &command, const QStringList &args, const QCommandLineParser &parser)
+{
+	QTextStream out(stdout), err(stderr);
+
+	QJsonObject request{{"command", command}};
+
+	if(command == "add") {
+		if(args.size() != 2) {
+			err << "Usage: straw-backupd add <sourceDir> <backupDir | s3://host/bucket/prefix>\n";
+			return 2;
+		}
+
+		request["sourceDir"] = QFileInfo(args[0]).absoluteFilePath();
+		request["remoteDir"] = StorageBackend::isObjectStore(args[1]) ? args[1] : QFileInfo(args[1]).absoluteFilePath();
+		request["backupInterval"] = parser.value("interval").toLongLong();
+		request["keepHistoryDuration"] = parser.value("keep").toLongLong();
+		request["excludeFilter"] = parser.values("exclude").join('\n');
+		request["historyLayout"] = int(parser.isSet("version-store") ? VersionStore::Layout::versionStore : VersionStore::Layout::besideOriginals);
+
+		if(parser.isSet("staging-dir"))
+			request["stagingDir"] = QFileInfo(parser.value("staging-dir")).absoluteFilePath();
+
+		if(parser.isSet("staging-limit"))
+			request["stagingLimit"] = parser.value("staging-limit").toLongLong() * 1024 * 1024;
+
+		if(parser.isSet("window")) {
+			const QStringList window = parser.value("window").split('-');
+			const QTime windowStart = QTime::fromString(window.value(0), "H:mm"), windowEnd = QTime::fromString(window.value(1), "H:mm");
+
+			if(window.size() != 2 || !windowStart.isValid() || !windowEnd.isValid() || windowStart == windowEnd) {
+				err << "Invalid --window '" << parser.value("window") << "', expected for example 22:00-6:00\n";
+				return 2;
+			}
+
+			request["windowStart"] = QTime(0, 0).secsTo(windowStart) / 60;
+			request["windowEnd"] = QTime(0, 0).secsTo(windowEnd) / 60;
+		}
+
+	} else if(command == "run" && !args.isEmpty())
+		request["id"] = args[0].toLongLong();
+
+	DaemonClient client;
+	const QJsonObject response = client.request(request);
+
+	if(!response.value("ok").toBool()) {
+		err << response.value("error").toString() << "\n";
+		return 1;
+	}
+
+	if(parser.isSet("json")) {
+		out << QJsonDocument(response).toJson();
+		return 0;
+	}
+
+	auto formatTime = [](const QJsonValue &secsSinceEpoch) {
+		return secsSinceEpoch.isNull() ? QString("never") : QDateTime::fromSecsSinceEpoch(qint64(secsSinceEpoch.toDouble())).toString("yyyy-MM-dd hh:mm:ss");
+	};
+
+	if(command == "list") {
+		for(const QJsonValue &value : response.value("directories").toArray()) {
+			const QJsonObject d = value.toObject();
+			out << d.value("id").toInt() << "\t" << d.value("sourceDir").toString() << " -> " << d.value("remoteDir").toString()
+					<< "\tinterval " << qint64(d.value("backupInterval").toDouble()) << " s, last backup " << formatTime(d.value("lastFinishedBackup"));
+
+			if(!d.value("windowStart").isNull())
+				out << ", window " << QTime(0, 0).addSecs(d.value("windowStart").toInt() * 60).toString("hh:mm") << "-" << QTime(0, 0).addSecs(d.value("windowEnd").toInt() * 60).toString("hh:mm");
+
+			if(d.value("historyLayout").toInt() == int(VersionStore::Layout::versionStore))
+				out << ", version store";
+
+			if(!d.value("stagingDir").toString().isEmpty())
+				out << ", staged in " << d.value("stagingDir").toString();
+
+			out << "\n";
+		}
+
+	} else if(command == "add")
+		out << "Added directory " << response.value("id").toInt() << "\n";
+
+	else if(command == "status") {
+		out << "pid " << response.value("pid").toInt() << ", up " << qint64(response.value("uptimeSeconds").toDouble()) << " s, "
+				<< (response.value("backupRunning").toBool() ? "backup running" : "idle") << "\n"
+				<< "copied " << qint64(response.value("filesNew").toDouble() + response.value("filesChanged").toDouble()) << " files ("
+				<< qint64(response.value("bytesCopied").toDouble()) / (1024 * 1024) << " MB), " << qint64(response.value("filesFailed").toDouble()) << " failed\n";
+
+		if(response.value("reflinkedFiles").toDouble() > 0)
+			out << "reflinked " << qint64(response.value("reflinkedFiles").toDouble()) << " versions, saved " << qint64(response.value("bytesWriteSaved").toDouble()) / (1024 * 1024) << " MB of writes and "
+					<< qint64(response.value("bytesSpaceSaved").toDouble()) / (1024 * 1024) << " MB of space\n";
+
+		if(response.value("drainingDirectories").toInt() > 0)
+			out << "draining the stages of " << response.value("drainingDirectories").toInt() << " directories\n";
+
+		if(response.value("idleResidentBytes").toDouble() >= 0)
+			out << "resident memory " << qint64(response.value("residentBytes").toDouble()) / 1024 << " kB, after the last backup check " << qint64(response.value("idleResidentBytes").toDouble()) / 1024 << " kB\n";
+
+		for(const QJsonValue &value : response.value("directories").toArray()) {
+			const QJsonObject d = value.toObject();
+			out << d.value("id").toInt() << "\t" << d.value("sourceDir").toString() << "\tlast " << formatTime(d.value("lastFinishedBackup"))
+					<< ", next " << (d.value("nextBackup").isNull() ? QString("running") : formatTime(d.value("nextBackup")));
+
+			if(!d.value("filesNew").isNull())
+				out << ", last run " << qint64(d.value("filesNew").toDouble()) << " new, " << qint64(d.value("filesChanged").toDouble()) << " changed, "
+						<< qint64(d.value("filesRemoved").toDouble()) << " removed, " << qint64(d.value("filesFailed").toDouble()) << " failed"
+						<< (d.value("isInterrupted").toDouble() ? " (interrupted)" : "");
+
+			if(!d.value("stagedFiles").isNull())
+				out << ", " << qint64(d.value("stagedFiles").toDouble()) << " files (" << qint64(d.value("stagedBytes").toDouble()) / (1024 * 1024) << " MB) waiting in the stage";
+
+			out << "\n";
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	// The daemon shares the database with the (release build of the) GUI, which is located by the application name
+	QCoreApplication::setApplicationName("strawBackup");
+	QCoreApplication::setApplicationVersion(PROGRAM_VERSION);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Straw Backup service. Without a command, runs the backups; the commands control the running service.\n"
+									 "The backup directory may be an S3-compatible bucket, s3://host/bucket/prefix (s3+http:// without TLS, ?region=...&requests=... to tune),\n"
+									 "with the credentials in AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY.");
+	parser.addHelpOption();
+	parser.addVersionOption();
+	parser.addPositionalArgument("command", "list | add <sourceDir> <backupDir> | run [id] | status | stop | restore <id> <targetDir>");
+	parser.addOptions({
+		{"interval", "Backup interval of an added directory.", "seconds", "3600"},
+		{"keep", "How long an added directory keeps old versions.", "seconds", "604800"},
+		{"exclude", "Exclude filter of an added directory (wildcard, can be repeated).", "pattern"},
+		{"window", "Time of day an added directory may be backed up in.", "HH:mm-HH:mm"},
+		{"version-store", "Keeps the old versions of an added directory in a separate version store instead of beside the current files."},
+		{"staging-dir", "Captures the changes of an added directory in this local directory first and drains them to the backup directory in the background.", "dir"},
+		{"staging-limit", "Space the staged changes of an added directory may take.", "MB", "10240"},
+		{"at", "Time the restored directory is restored to (default now).", "yyyy-MM-dd hh:mm:ss"},
+		{"path", "Restores only this file or subdirectory (relative to the backed up directory).", "path"},
+		{"overwrite", "Restores into a non-empty directory, replacing the files there."},
+		{"json", "Prints the response of the service as JSON."}
+	});
+	parser.process(app);
+
+	QStringList args = parser.positionalArguments();
+	if(args.isEmpty())
+		return runDaemon();
+
+	const QString command = args.takeFirst();
+	if(command == "restore")
+		return runRestore(args, parser);
+
+	if(!QStringList{"list", "add", "run", "status", "stop"}.contains(command))
+		parser.showHelp(2);
+
+	return runCommand(command, args, parser);
+}
@@ -5,11 +5,18 @@
 #include <QApplication>
 #include <QMessageBox>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThread>
 
 #include "gui/mainwindow.h"
 #include "gui/backupdirectoryeditdialog.h"
 #include "gui/aboutdialog.h"
+#include "gui/restoredialog.h"
 #include "job/backupmanager.h"
+#include "job/metricsexporter.h"
+#include "job/tracer.h"
+#include "job/dbschema.h"
+#include "daemon/daemonclient.h"
 
 Global *global;
 
@@ -20,19 +27,31 @@ Global::Global()
 
 void Global::init()
 {
+	traceFilePath_ = QString::fromLocal8Bit(qgetenv("STRAW_BACKUP_TRACE"));
+	if(!traceFilePath_.isEmpty()) {
+		Tracer::start();
+		Tracer::setThreadName("GUI");
+	}
+
+	logSink = new LogSink();
+
 	initDb();
 
 	mainWindow = new MainWindow();
 	backupDirectoryEditDialog = new BackupDirectoryEditDialog(mainWindow);
 	aboutDialog = new AboutDialog(mainWindow);
+	restoreDialog = new RestoreDialog(mainWindow);
 	trayIcon = new QSystemTrayIcon();
-	backupManager = new BackupManager();
+	if(!initBackupService()) {
+		QMessageBox::critical(nullptr, tr("Kritická chyba"), tr("Zálohy provádí jiný proces, který nereaguje (zámek %1).").arg(BackupManager::lockFilePath()));
+		exit(1);
+	}
 
 	{
 		trayIcon->setIcon(QIcon(":/16/icons8_Database_16px.png"));
 		trayIcon->setToolTip(tr("Straw Backup"));
 		connect(trayIcon, SIGNAL(activated(QSystemTrayIcon::ActivationReason)), this, SLOT(onTrayIconActivated(QSystemTrayIcon::ActivationReason)));
-		connect(backupManager, SIGNAL(logError(QString)), this, SLOT(onLogError()));
+		connect(mainWindow, SIGNAL(errorLogged()), this, SLOT(onLogError()));
 
 		trayIconMenu = new QMenu();
 		trayIconMenu->addAction(mainWindow->getUI()->actionShowMainWindow);
@@ -45,15 +64,24 @@ void Global::init()
 
 	trayIcon->show();
 
-	QMetaObject::invokeMethod(backupManager, "checkForBackups");
+	if(backupManager)
+		QMetaObject::invokeMethod(backupManager, "checkForBackups");
 }
 
 void Global::uninit()
 {
 	delete mainWindow;
 	delete trayIcon;
+	delete metricsExporter;
 	delete backupManager;
+	delete backupLock_;
+	delete daemonClient;
 	delete db;
+
+	if(!traceFilePath_.isEmpty() && !Tracer::stop(traceFilePath_))
+		qWarning("Failed to write trace to '%s'", qPrintable(traceFilePath_));
+
+	delete logSink;
 }
 
 void Global::initDb()
@@ -74,63 +102,12 @@ void Global::initDb()
 
 	db->openSQLITE(dbFilepath);
 
-	if(!dbExists) {
-		db->execAssoc("CREATE TABLE settings ("
-					 "key VARCHAR(64) PRIMARY KEY,"
-					 "value TEXT"
-					 ")");
-		db->execAssoc("INSERT INTO settings(key, value) VALUES('dbVersion', '2')");
-
-		db->execAssoc("CREATE TABLE backupDirectories ("
-					 "id INTEGER PRIMARY KEY,"
-					 "sourceDir TEXT,"
-					 "remoteDir TEXT,"
-					 "lastFinishedBackup INTEGER,"
-					 "backupInterval INTEGER,"
-					 "keepHistoryDuration INTEGER,"
-					 "excludeFilter TEXT"
-					 ")");
-
-		db->execAssoc("CREATE TABLE files ("
-					 "id INTEGER PRIMARY KEY,"
-					 "backupDirectory INTEGER,"
-					 "filePath TEXT,"
-					 "lastChecked INTEGER,"
-					 "remoteVersion INTEGER" // Modified time of the backed up file
-					 ")");
-
-		db->execAssoc("CREATE TABLE history ("
-					 "id INTEGER PRIMARY KEY,"
-					 "backupDirectory INTEGER,"
-					 "remoteFilePath TEXT,"
-					 "originalFilePath TEXT,"
-					 "version INTEGER"
-					 ")");
-
-		db->execAssoc("CREATE INDEX i_files_backupDirectory_filePath ON files (backupDirectory, filePath)");
-		db->execAssoc("CREATE INDEX i_files_backupDirectory_lastChecked ON files (backupDirectory, lastChecked)");
-		db->execAssoc("CREATE INDEX i_history_backupDirectory_version ON history (backupDirectory, version)");
-
-	} else {
-		QString version = db->selectValueAssoc("SELECT value FROM settings WHERE key = 'dbVersion'").toString();
-
-		if(version == "1") {
-			db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN excludeFilter TEXT");
-
-			db->execAssoc("CREATE INDEX i_files_backupDirectory_filePath ON files (backupDirectory, filePath)");
-			db->execAssoc("CREATE INDEX i_files_backupDirectory_lastChecked ON files (backupDirectory, lastChecked)");
-			db->execAssoc("CREATE INDEX i_history_backupDirectory_version ON history (backupDirectory, version)");
-
-			db->execAssoc("UPDATE settings SET value = '2' WHERE key = 'dbVersion'");
-			emit backupManager->logWarning(tr("Verze databáze aktualizovaná na verzi 2."));
-
-			version = "2";
-		}
+	if(!dbExists)
+		DBSchema::create(db);
 
-		if(version != "2") {
-			QMessageBox::critical(nullptr, tr("Kritická chyba"), tr("Nepodporovaná verze databáze (%1)").arg(version));
-			exit(1);
-		}
+	else if(!DBSchema::upgrade(db, logSink)) {
+		QMessageBox::critical(nullptr, tr("Kritická chyba"), tr("Nepodporovaná verze databáze (%1)").arg(DBSchema::storedVersion(db)));
+		exit(1);
 	}
 
 	/*// REMOVEME
@@ -138,6 +115,62 @@ void Global::initDb()
 	db->exec("DELETE FROM history");*/
 }
 
+bool Global::initBackupService()
+{
+	backupManager = nullptr;
+	metricsExporter = nullptr;
+
+	// A running straw-backupd does the backups, this process only shows them
+	daemonClient = new DaemonClient(db, logSink);
+	bool isAttached = daemonClient->connectToDaemon();
+
+	if(!isAttached) {
+		// A lock left by a crashed process is stale (its pid is gone), a running one is never
+		backupLock_ = new QLockFile(BackupManager::lockFilePath());
+		backupLock_->setStaleLockTime(0);
+
+		// Held by a straw-backupd that is starting and not listening yet: attach to it once it does
+		QElapsedTimer timer;
+		timer.start();
+
+		while(!backupLock_->tryLock(0)) {
+			if(daemonClient->connectToDaemon()) {
+				isAttached = true;
+				break;
+			}
+
+			if(timer.elapsed() > daemonStartTimeout)
+				return false;
+
+			QThread::msleep(100);
+		}
+	}
+
+	if(isAttached) {
+		delete backupLock_;
+		backupLock_ = nullptr;
+
+		daemonClient->subscribe();
+		backupService = daemonClient;
+		return true;
+	}
+
+	delete daemonClient;
+	daemonClient = nullptr;
+
+	backupManager = new BackupManager(db, logSink);
+	backupService = backupManager;
+
+	// Monitoring; the textfile export is enabled by setting its path in the settings table (MAX() yields NULL rather than no row if the key is not set)
+	metricsExporter = new MetricsExporter(db, backupManager);
+	metricsExporter->setTextfilePath(db->selectValue("SELECT MAX(value) FROM settings WHERE key = 'metricsTextfile'").toString());
+
+	const QString metricsSocket = db->selectValue("SELECT MAX(value) FROM settings WHERE key = 'metricsSocket'").toString();
+	metricsExporter->listen(metricsSocket.isEmpty() ? "straw-backup-metrics" : metricsSocket);
+
+	return true;
+}
+
 void Global::onTrayIconActivated(QSystemTrayIcon::ActivationReason reason)
 {
 	if(reason == QSystemTrayIcon::DoubleClick)
@@ -4,13 +4,18 @@
 #include <QSystemTrayIcon>
 #include <QObject>
 #include <QMenu>
+#include <QLockFile>
 
 #include "threaddb/dbmanager.h"
+#include "job/logsink.h"
 
 class MainWindow;
 class BackupDirectoryEditDialog;
 class AboutDialog;
+class RestoreDialog;
 class BackupManager;
+class MetricsExporter;
+class DaemonClient;
 
 class Global : public QObject
 {
@@ -27,18 +32,41 @@ public:
 	MainWindow *mainWindow;
 	BackupDirectoryEditDialog *backupDirectoryEditDialog;
 	AboutDialog *aboutDialog;
+	RestoreDialog *restoreDialog;
 
 public:
 	QSystemTrayIcon *trayIcon;
 	QMenu *trayIconMenu;
 
 public:
+	/// Runs the backups: the local backupManager, or daemonClient when attached to a running straw-backupd.
+	/// Both have the checkForBackups() slot and the backupFinished() signal.
+	QObject *backupService;
+
+	/// Only one of them exists (metricsExporter only with the local backupManager)
 	BackupManager *backupManager;
+	DaemonClient *daemonClient;
+	MetricsExporter *metricsExporter;
 	DBManager *db;
+	LogSink *logSink;
+
+public:
+	/// How long the GUI waits for a straw-backupd that holds the backup lock to start listening
+	static const int daemonStartTimeout = 5000;
 
 private:
 	void initDb();
 
+	/// Attaches to a running straw-backupd, or takes the backup lock to run the backups in this process; returns false if neither succeeds
+	bool initBackupService();
+
+private:
+	/// Trace output file, tracing is enabled when set (STRAW_BACKUP_TRACE environment variable)
+	QString traceFilePath_;
+
+	/// Held while backupManager exists, see BackupManager::lockFilePath
+	QLockFile *backupLock_ = nullptr;
+
 private slots:
 	void onTrayIconActivated(QSystemTrayIcon::ActivationReason reason);
 	void onLogError();
@@ -4,10 +4,12 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QDir>
+#include <QTime>
 
 #include "global.h"
 #include "gui/mainwindow.h"
 #include "job/backupmanager.h"
+#include "job/versionstore.h"
 
 static const QVector<qlonglong> backupIntervals{
 	60 * 5,
@@ -26,6 +28,8 @@ static const QVector<qlonglong> backupIntervals{
 	3600 * 24 * 180,
 };
 
+static const qlonglong gigabyte = 1024 * 1024 * 1024;
+
 BackupDirectoryEditDialog::BackupDirectoryEditDialog(QWidget *parent) :
 	QDialog(parent),
 	ui(new Ui::BackupDirectoryEditDialog)
@@ -49,6 +53,13 @@ void BackupDirectoryEditDialog::show(int rowId)
 		ui->cmbBackupInterval->setCurrentIndex(backupIntervals.indexOf(3600));
 		ui->cmbBackupKeepInterval->setCurrentIndex(backupIntervals.indexOf(3600 * 24 * 7));
 		ui->teExcludeFilter->setText("*.tmp\n*/.dropbox/*\n*/.git/*\n*~*");
+		ui->cbWindow->setChecked(false);
+		ui->teWindowStart->setTime(QTime(22, 0));
+		ui->teWindowEnd->setTime(QTime(6, 0));
+		ui->cbVersionStore->setChecked(false);
+		ui->cbStaging->setChecked(false);
+		ui->btnStagingFolder->setText("");
+		ui->sbStagingLimit->setValue(int(BackupManager::defaultStagingLimit / gigabyte));
 
 	} else {
 		QSqlRecord row = global->db->selectRowAssoc("SELECT * FROM backupDirectories WHERE id = :id", {{":id", rowId}});
@@ -58,6 +69,17 @@ void BackupDirectoryEditDialog::show(int rowId)
 		ui->cmbBackupInterval->setCurrentIndex( backupIntervals.indexOf( row.value("backupInterval").toLongLong() ) );
 		ui->cmbBackupKeepInterval->setCurrentIndex( backupIntervals.indexOf( row.value("keepHistoryDuration").toLongLong() ) );
 		ui->teExcludeFilter->setText(row.value("excludeFilter").toString());
+
+		const bool hasWindow = !row.value("windowStart").isNull();
+		ui->cbWindow->setChecked(hasWindow);
+		ui->teWindowStart->setTime(hasWindow ? QTime(0, 0).addSecs(row.value("windowStart").toInt() * 60) : QTime(22, 0));
+		ui->teWindowEnd->setTime(hasWindow ? QTime(0, 0).addSecs(row.value("windowEnd").toInt() * 60) : QTime(6, 0));
+		ui->cbVersionStore->setChecked(VersionStore::layout(row.value("historyLayout")) == VersionStore::Layout::versionStore);
+
+		const bool hasStaging = !row.value("stagingDir").toString().isEmpty();
+		ui->cbStaging->setChecked(hasStaging);
+		ui->btnStagingFolder->setText(row.value("stagingDir").toString());
+		ui->sbStagingLimit->setValue(int((row.value("stagingLimit").isNull() ? BackupManager::defaultStagingLimit : row.value("stagingLimit").toLongLong()) / gigabyte));
 	}
 
 	ui->btnSourceFolder->setEnabled(isNewRecord);
@@ -86,6 +108,23 @@ void BackupDirectoryEditDialog::on_btnOk_clicked()
 		return;
 	}*/
 
+	const bool hasWindow = ui->cbWindow->isChecked();
+	const int windowStart = QTime(0, 0).secsTo(ui->teWindowStart->time()) / 60;
+	const int windowEnd = QTime(0, 0).secsTo(ui->teWindowEnd->time()) / 60;
+
+	if( hasWindow && windowStart == windowEnd ) {
+		QMessageBox::critical(this, tr("Chyba"), tr("Začátek a konec doby zálohování musí být různé."));
+		return;
+	}
+
+	const bool hasStaging = ui->cbStaging->isChecked();
+	const QString stagingFolder = ui->btnStagingFolder->text();
+
+	if( hasStaging && (stagingFolder.isEmpty() || !QDir(stagingFolder).exists()) ) {
+		QMessageBox::critical(this, tr("Chyba"), tr("Přípravná oblast '%1' neexistuje.").arg(stagingFolder));
+		return;
+	}
+
 	if( rowId_ == -1 ) {
 		if( !QDir(targetFolder).isEmpty() ) {
 			QMessageBox::critical(this, tr("Chyba"), tr("Složka na zálohy '%1' není prázdná!").arg(targetFolder));
@@ -96,19 +135,24 @@ void BackupDirectoryEditDialog::on_btnOk_clicked()
 	}
 
 	global->db->blockingExecAssoc(
-				"UPDATE backupDirectories SET remoteDir = :remoteDir, sourceDir = :sourceDir, backupInterval = :backupInterval, keepHistoryDuration = :keepHistoryDuration, excludeFilter = :excludeFilter WHERE id = :id",
+				"UPDATE backupDirectories SET remoteDir = :remoteDir, sourceDir = :sourceDir, backupInterval = :backupInterval, keepHistoryDuration = :keepHistoryDuration, excludeFilter = :excludeFilter, windowStart = :windowStart, windowEnd = :windowEnd, historyLayout = :historyLayout, stagingDir = :stagingDir, stagingLimit = :stagingLimit WHERE id = :id",
 				{
 					{":sourceDir", ui->btnSourceFolder->text()},
 					{":remoteDir", ui->btnBackupFolder->text()},
 					{":backupInterval", backupIntervals[ui->cmbBackupInterval->currentIndex()]},
 					{":keepHistoryDuration", backupIntervals[ui->cmbBackupKeepInterval->currentIndex()]},
 					{":excludeFilter", ui->teExcludeFilter->toPlainText()},
+					{":windowStart", hasWindow ? QVariant(windowStart) : QVariant()},
+					{":windowEnd", hasWindow ? QVariant(windowEnd) : QVariant()},
+					{":historyLayout", int(ui->cbVersionStore->isChecked() ? VersionStore::Layout::versionStore : VersionStore::Layout::besideOriginals)},
+					{":stagingDir", hasStaging ? QVariant(stagingFolder) : QVariant()},
+					{":stagingLimit", ui->sbStagingLimit->value() * gigabyte},
 					{":id", rowId_}
 				}
 				);
 
 	accept();
-	QMetaObject::invokeMethod(global->backupManager, "checkForBackups");
+	QMetaObject::invokeMethod(global->backupService, "checkForBackups");
 }
 
 void BackupDirectoryEditDialog::on_btnCancel_clicked()
@@ -135,3 +179,13 @@ void BackupDirectoryEditDialog::on_btnBackupFolder_clicked()
 
 	ui->btnBackupFolder->setText(dir);
 }
+
+void BackupDirectoryEditDialog::on_btnStagingFolder_clicked()
+{
+	QString prevDir = ui->btnStagingFolder->text();
+	QString dir = QFileDialog::getExistingDirectory( this, nullptr, prevDir );
+	if( dir.isEmpty() || dir == prevDir )
+		return;
+
+	ui->btnStagingFolder->setText(dir);
+}
@@ -23,6 +23,7 @@ private slots:
 	void on_btnCancel_clicked();
 	void on_btnSourceFolder_clicked();
 	void on_btnBackupFolder_clicked();
+	void on_btnStagingFolder_clicked();
 
 private:
 	Ui::BackupDirectoryEditDialog *ui;
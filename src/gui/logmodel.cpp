@@ -0,0 +1,138 @@
+#include "logmodel.h"
+
+#include <QDateTime>
+#include <QColor>
+
+LogModel::LogModel(int capacity, QObject *parent) : QAbstractListModel(parent),
+	capacity_(capacity)
+{
+
+}
+
+void LogModel::append(const QVector<LogRecord> &records)
+{
+	const int skip = qMax(0, records.size() - capacity_);
+	const int count = records.size() - skip;
+
+	if(!count)
+		return;
+
+	// Make room for the new records by removing the oldest ones
+	const int overflow = count_ + count - capacity_;
+	if(overflow > 0) {
+		beginRemoveRows(QModelIndex(), 0, overflow - 1);
+		start_ = (start_ + overflow) % capacity_;
+		count_ -= overflow;
+		endRemoveRows();
+	}
+
+	beginInsertRows(QModelIndex(), count_, count_ + count - 1);
+
+	for(int i = skip; i < records.size(); i++) {
+		const LogRecord &record = records[i];
+
+		// The buffer grows up to the capacity first, then the slots are reused
+		if(buffer_.size() < capacity_)
+			buffer_.append(record);
+		else
+			buffer_[(start_ + count_) % capacity_] = record;
+
+		count_ ++;
+
+		if(!record.directory.isEmpty() && !directories_.contains(record.directory)) {
+			directories_.append(record.directory);
+			emit directoryAdded(record.directory);
+		}
+	}
+
+	endInsertRows();
+}
+
+void LogModel::trim(int keepCount)
+{
+	const int removeCount = count_ - qMax(0, keepCount);
+	if(removeCount > 0) {
+		beginRemoveRows(QModelIndex(), 0, removeCount - 1);
+		start_ = (start_ + removeCount) % capacity_;
+		count_ -= removeCount;
+		endRemoveRows();
+	}
+
+	// Linearized, so that the buffer grows by appending again
+	QVector<LogRecord> buffer;
+	buffer.reserve(count_);
+	for(int i = 0; i < count_; i++)
+		buffer.append(record(i));
+
+	buffer_.swap(buffer);
+	start_ = 0;
+}
+
+int LogModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : count_;
+}
+
+QVariant LogModel::data(const QModelIndex &item, int role) const
+{
+	if(item.row() < 0 || item.row() >= count_)
+		return QVariant();
+
+	const LogRecord &r = record(item.row());
+
+	switch(role) {
+	case Qt::DisplayRole:
+		return QString("[%1] %2").arg(QDateTime::fromMSecsSinceEpoch(r.time).toString("HH:mm:ss"), r.text());
+
+	case Qt::ToolTipRole:
+		return r.text();
+
+	case Qt::ForegroundRole:
+		switch(r.level) {
+		case LogLevel::info: return QColor(Qt::gray);
+		case LogLevel::success: return QColor(Qt::darkGreen);
+		case LogLevel::warning: return QColor(255, 140, 0);
+		case LogLevel::error: return QColor(Qt::red);
+		}
+		return QVariant();
+
+	case LevelRole:
+		return int(r.level);
+
+	case DirectoryRole:
+		return r.directory;
+
+	default:
+		return QVariant();
+	}
+}
+
+LogFilterModel::LogFilterModel(QObject *parent) : QSortFilterProxyModel(parent)
+{
+
+}
+
+void LogFilterModel::setMinimumLevel(LogLevel level)
+{
+	minimumLevel_ = level;
+	invalidateFilter();
+}
+
+void LogFilterModel::setDirectory(const QString &directory)
+{
+	directory_ = directory;
+	invalidateFilter();
+}
+
+bool LogFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+	const QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+
+	if(index.data(LogModel::LevelRole).toInt() < int(minimumLevel_))
+		return false;
+
+	if(!directory_.isEmpty() && index.data(LogModel::DirectoryRole).toString() != directory_)
+		return false;
+
+	return true;
+}
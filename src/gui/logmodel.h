@@ -0,0 +1,77 @@
+#ifndef LOGMODEL_H
+#define LOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QSortFilterProxyModel>
+#include <QVector>
+#include <QStringList>
+
+#include "job/logsink.h"
+
+/// List model of log messages kept in a bounded ring buffer; the oldest messages are removed once the capacity is reached.
+/// Message text is composed only when a row is painted.
+class LogModel : public QAbstractListModel
+{
+	Q_OBJECT
+
+public:
+	enum Role {
+		LevelRole = Qt::UserRole,
+		DirectoryRole
+	};
+
+public:
+	explicit LogModel(int capacity = 65536, QObject *parent = 0);
+
+	/// Appends the records as a single row insertion
+	void append(const QVector<LogRecord> &records);
+
+	/// Removes all but the newest keepCount records and frees the unused part of the buffer
+	void trim(int keepCount);
+
+	/// Directories that appeared in the log so far
+	const QStringList &directories() const {
+		return directories_;
+	}
+
+public:
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex &item, int role = Qt::DisplayRole) const override;
+
+signals:
+	void directoryAdded(QString directory);
+
+private:
+	const LogRecord &record(int row) const {
+		return buffer_[(start_ + row) % capacity_];
+	}
+
+private:
+	const int capacity_;
+	QVector<LogRecord> buffer_;
+	int start_ = 0, count_ = 0;
+	QStringList directories_;
+
+};
+
+/// Filters LogModel rows by the minimum level and the directory (empty = all directories)
+class LogFilterModel : public QSortFilterProxyModel
+{
+	Q_OBJECT
+
+public:
+	explicit LogFilterModel(QObject *parent = 0);
+
+	void setMinimumLevel(LogLevel level);
+	void setDirectory(const QString &directory);
+
+protected:
+	bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+
+private:
+	LogLevel minimumLevel_ = LogLevel::info;
+	QString directory_;
+
+};
+
+#endif // LOGMODEL_H
@@ -6,17 +6,24 @@
 #include <QScrollBar>
 #include <QDesktopServices>
 #include <QDir>
-#include <QTextCursor>
+#include <QSqlRecord>
+#include <QSignalBlocker>
 
 #include "gui/backupdirectoryeditdialog.h"
 #include "gui/aboutdialog.h"
 #include "job/backupmanager.h"
+#include "job/historycatalog.h"
+#include "job/logsink.h"
+#include "job/processmemory.h"
 #include "threaddb/dbmanager.h"
+#include "threaddb/dbsnapshot.h"
 #include "global.h"
 
 MainWindow::MainWindow(QWidget *parent) :
 	QMainWindow(parent),
-	ui(new Ui::MainWindow)
+	ui(new Ui::MainWindow),
+	historyPathsModel_(global->db),
+	historyVersionsModel_(global->db)
 {
 	ui->setupUi(this);
 	ui->twBackups->setCornerWidget(ui->twBackupsCorner);
@@ -25,12 +32,44 @@ MainWindow::MainWindow(QWidget *parent) :
 	tvDirListMenu_ = new QMenu(this);
 	tvDirListMenu_->addActions({ui->actionFolderBackupNow, ui->actionFolderEdit, ui->actionFolderDelete});
 	tvDirListMenu_->addSeparator();
-	tvDirListMenu_->addActions({ui->actionFolderOpenSource, ui->actionFolderOpenTarget});
+	tvDirListMenu_->addActions({ui->actionFolderOpenSource, ui->actionFolderOpenTarget, ui->actionFolderRestore});
+	tvDirListMenu_->addSeparator();
+	tvDirListMenu_->addAction(ui->actionFolderRunStats);
 	connect(ui->tvDirList, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(onTvDirListMenuRequested(QPoint)));
 
-	auto text = tr("<span style='color: blue;'>Rádi přijmeme zpětnou vazbu a návrhy na vylepšení na e-mailové adrese danol@straw-solutions.cz.</span>");
-	rawLog(ui->tbLog, text);
-	rawLog(ui->tbErrorLog, text);
+	// Both log views share the same model, the error log only shows warnings and errors
+	logFilterModel_.setSourceModel(&logModel_);
+	errorLogFilterModel_.setSourceModel(&logModel_);
+	errorLogFilterModel_.setMinimumLevel(LogLevel::warning);
+	ui->lvLog->setModel(&logFilterModel_);
+	ui->lvErrorLog->setModel(&errorLogFilterModel_);
+
+	ui->cmbLogLevel->addItems({tr("Vše"), tr("Varování a chyby"), tr("Chyby")});
+	ui->cmbLogDirectory->addItem(tr("Všechny složky"), QString());
+
+	connect(&logModel_, SIGNAL(directoryAdded(QString)), this, SLOT(onLogDirectoryAdded(QString)));
+	connect(ui->cmbLogLevel, SIGNAL(currentIndexChanged(int)), this, SLOT(updateLogFilter()));
+	connect(ui->cmbLogDirectory, SIGNAL(currentIndexChanged(int)), this, SLOT(updateLogFilter()));
+
+	// History browser; both views page their queries as they are scrolled
+	ui->tvHistoryPaths->setModel(&historyPathsModel_);
+	ui->tvHistoryVersions->setModel(&historyVersionsModel_);
+	ui->cmbHistoryDirectory->addItem(tr("Všechny složky"), -1);
+	ui->cmbHistoryPeriod->addItem(tr("Kdykoliv"), -1);
+	ui->cmbHistoryPeriod->addItem(tr("Za poslední den"), 24 * 3600);
+	ui->cmbHistoryPeriod->addItem(tr("Za poslední týden"), 7 * 24 * 3600);
+	ui->cmbHistoryPeriod->addItem(tr("Za poslední měsíc"), 30 * 24 * 3600);
+
+	historySearchTimer_.setSingleShot(true);
+	historySearchTimer_.setInterval(300);
+	connect(&historySearchTimer_, SIGNAL(timeout()), this, SLOT(updateHistoryPaths()));
+	connect(ui->leHistorySearch, SIGNAL(textChanged(QString)), &historySearchTimer_, SLOT(start()));
+	connect(ui->cmbHistoryDirectory, SIGNAL(currentIndexChanged(int)), this, SLOT(updateHistoryPaths()));
+	connect(ui->cmbHistoryPeriod, SIGNAL(currentIndexChanged(int)), this, SLOT(updateHistoryPaths()));
+	connect(ui->tvHistoryPaths->selectionModel(), SIGNAL(currentRowChanged(QModelIndex,QModelIndex)), this, SLOT(onHistoryPathSelected()));
+	connect(ui->tvHistoryVersions, SIGNAL(activated(QModelIndex)), this, SLOT(onHistoryVersionActivated(QModelIndex)));
+
+	logModel_.append({LogRecord(LogLevel::success, QString(), staticMetaObject.className(), QT_TR_NOOP("Rádi přijmeme zpětnou vazbu a návrhy na vylepšení na e-mailové adrese danol@straw-solutions.cz."))});
 }
 
 MainWindow::~MainWindow()
@@ -44,11 +83,12 @@ void MainWindow::init()
 	ui->tvDirList->setModel(&model_);
 
 	connect(global->backupDirectoryEditDialog, SIGNAL(accepted()), this, SLOT(updateBkpDirList()));
-	connect(global->backupManager, SIGNAL(logInfo(QString)), this, SLOT(logInfo(QString)));
-	connect(global->backupManager, SIGNAL(logWarning(QString)), this, SLOT(logWarning(QString)));
-	connect(global->backupManager, SIGNAL(logError(QString)), this, SLOT(logError(QString)));
-	connect(global->backupManager, SIGNAL(logSuccess(QString)), this, SLOT(logSuccess(QString)));
-	connect(global->backupManager, SIGNAL(backupFinished()), this, SLOT(updateBkpDirList()));
+	connect(global->backupService, SIGNAL(backupFinished()), this, SLOT(updateBkpDirList()));
+	connect(global->backupService, SIGNAL(idle()), this, SLOT(onBackupIdle()));
+
+	// Log is delivered in batches at a fixed rate rather than per message
+	connect(&logTimer_, SIGNAL(timeout()), this, SLOT(drainLog()));
+	logTimer_.start(1000 / 30);
 
 	updateBkpDirList();
 }
@@ -82,12 +122,44 @@ int MainWindow::selectedFolderId()
 void MainWindow::updateBkpDirList()
 {
 	//bkpDirsModel_.setQuery(0);
-	model_.setQuery(global->db->selectQueryAssoc(
-		QString("SELECT id, sourceDir AS '%1', remoteDir AS '%4', strftime('%2', datetime(lastFinishedBackup, 'unixepoch', 'localtime')) AS '%3' FROM backupDirectories ORDER BY sourceDir ASC")
-		.arg(tr("Zdrojová složka"), tr("%d.%m.%Y %H:%M"), tr("Poslední záloha"), tr("Cílová složka"))));
+	DBSnapshot snapshot(global->db);
+	DBQuery query = snapshot.selectQueryAssoc(
+		QString("SELECT d.id, d.sourceDir AS '%1', d.remoteDir AS '%4', strftime('%2', datetime(d.lastFinishedBackup, 'unixepoch', 'localtime')) AS '%3', "
+				"(r.finished - r.started) AS '%5', (r.filesNew + r.filesChanged) AS '%6', ROUND((r.bytesNew + r.bytesChanged) / 1048576.0, 1) AS '%7' "
+				"FROM backupDirectories d LEFT JOIN runs r ON r.id = (SELECT MAX(id) FROM runs WHERE backupDirectory = d.id) ORDER BY d.sourceDir ASC")
+		.arg(tr("Zdrojová složka"), tr("%d.%m.%Y %H:%M"), tr("Poslední záloha"), tr("Cílová složka"), tr("Trvání [s]"), tr("Zkopírováno souborů"), tr("Zkopírováno [MB]")));
+	model_.setQuery(query);
 
 	ui->tvDirList->hideColumn(0);
 	ui->tvDirList->show();
+
+	// Directory filter of the history browser; the search is only reloaded if the directories changed, not after every backup
+	QVector<QPair<QVariant,QString>> dirs;
+	DBQuery dirQuery = snapshot.selectQuery("SELECT id, sourceDir FROM backupDirectories ORDER BY sourceDir ASC");
+	while(dirQuery.next())
+		dirs.append({dirQuery.value(0), dirQuery.value(1).toString()});
+
+	bool isChanged = historyPathsModel_.columnCount() == 0 || dirs.size() != ui->cmbHistoryDirectory->count() - 1;
+	for(int i = 0; !isChanged && i < dirs.size(); i++)
+		isChanged = ui->cmbHistoryDirectory->itemData(i + 1) != dirs[i].first || ui->cmbHistoryDirectory->itemText(i + 1) != dirs[i].second;
+
+	if(!isChanged)
+		return;
+
+	const QVariant historyDirId = ui->cmbHistoryDirectory->currentData();
+	{
+		const QSignalBlocker blocker(ui->cmbHistoryDirectory);
+
+		while(ui->cmbHistoryDirectory->count() > 1)
+			ui->cmbHistoryDirectory->removeItem(1);
+
+		for(const auto &dir : dirs)
+			ui->cmbHistoryDirectory->addItem(dir.second, dir.first);
+
+		ui->cmbHistoryDirectory->setCurrentIndex(qMax(0, ui->cmbHistoryDirectory->findData(historyDirId)));
+	}
+
+	updateHistoryPaths();
 }
 
 void MainWindow::onTvDirListMenuRequested(const QPoint &pos)
@@ -99,42 +171,113 @@ void MainWindow::onTvDirListMenuRequested(const QPoint &pos)
 	tvDirListMenu_->popup(ui->tvDirList->viewport()->mapToGlobal(pos));
 }
 
-void MainWindow::logInfo(QString text)
+void MainWindow::drainLog()
+{
+	// Bounds the time spent per frame; the rest stays queued for the next frames
+	QVector<LogRecord> records;
+	global->logSink->drain(records, 1024);
+
+	if(const quint64 droppedCount = global->logSink->takeDroppedCount()) {
+		LogRecord record(LogLevel::warning, QString(), staticMetaObject.className(), QT_TR_NOOP("%1 zpráv nebylo kvůli zahlcení zobrazeno."), 1);
+		record.args[0] = QString::number(droppedCount);
+		records.append(record);
+	}
+
+	if(records.isEmpty())
+		return;
+
+	// Views scrolled to the bottom keep following the new messages
+	const bool logWasDown = isScrolledDown(ui->lvLog);
+	const bool errorLogWasDown = isScrolledDown(ui->lvErrorLog);
+
+	logModel_.append(records);
+
+	if(logWasDown)
+		ui->lvLog->scrollToBottom();
+
+	if(errorLogWasDown)
+		ui->lvErrorLog->scrollToBottom();
+
+	for(const LogRecord &record : records) {
+		if(record.level == LogLevel::error) {
+			emit errorLogged();
+			break;
+		}
+	}
+}
+
+void MainWindow::onLogDirectoryAdded(QString directory)
 {
-	rawLog(ui->tbLog, "<span style='color: gray;'>" + text + "</span>");
+	ui->cmbLogDirectory->addItem(directory, directory);
 }
 
-void MainWindow::logWarning(QString text)
+void MainWindow::updateLogFilter()
 {
-	rawLog(ui->tbLog, "<span style='color: orange;'>" + text + "</span>");
-	rawLog(ui->tbErrorLog, "<span style='color: orange;'>" + text + "</span>");
+	const LogLevel levels[] = {LogLevel::info, LogLevel::warning, LogLevel::error};
+	const QString directory = ui->cmbLogDirectory->currentData().toString();
+
+	logFilterModel_.setMinimumLevel(levels[qMax(0, ui->cmbLogLevel->currentIndex())]);
+	logFilterModel_.setDirectory(directory);
+	errorLogFilterModel_.setDirectory(directory);
+
+	ui->lvLog->scrollToBottom();
+	ui->lvErrorLog->scrollToBottom();
 }
 
-void MainWindow::logError(QString text)
+bool MainWindow::isScrolledDown(QAbstractItemView *view)
 {
-	rawLog(ui->tbLog, "<span style='color: red;'>" + text + "</span>");
-	rawLog(ui->tbErrorLog, "<span style='color: red;'>" + text + "</span>");
+	const QScrollBar *scrollBar = view->verticalScrollBar();
+	return scrollBar->value() == scrollBar->maximum();
 }
 
-void MainWindow::logSuccess(QString text)
+void MainWindow::onBackupIdle()
 {
-	rawLog(ui->tbLog, "<span style='color: green;'>" + text + "</span>");
+	if(isVisible())
+		return;
+
+	logModel_.trim(idleLogRecords);
+	ProcessMemory::releaseFreeMemory();
 }
 
-void MainWindow::rawLog(QTextBrowser *tb, QString text)
+void MainWindow::updateHistoryPaths()
 {
-	QScrollBar *scrollBar = tb->verticalScrollBar();
-	const bool wasDown = scrollBar->value() == scrollBar->maximum();
+	historySearchTimer_.stop();
 
-	tb->append(QString("<span style='color: gray;'>[%1]</span> %2").arg(QDateTime::currentDateTime().toString("HH:mm:ss"), text));
-	if(wasDown)
-		scrollBar->setValue( scrollBar->maximum() );
+	const qlonglong period = ui->cmbHistoryPeriod->currentData().toLongLong();
+	const HistoryCatalog::Query query = HistoryCatalog::searchPaths(
+				global->db,
+				ui->cmbHistoryDirectory->currentData().toLongLong(),
+				ui->leHistorySearch->text(),
+				period == -1 ? -1 : QDateTime::currentSecsSinceEpoch() - period);
 
+	historyPathsModel_.setQuery(query.text, query.args, query.keyColumns);
+	historyVersionsModel_.clear();
 
-	QTextCursor cursor = tb->textCursor();
-	cursor.movePosition(QTextCursor::Start, QTextCursor::MoveAnchor);
-	cursor.movePosition(QTextCursor::NextBlock, QTextCursor::KeepAnchor, ui->tbLog->document()->blockCount() - 4096);
-	cursor.removeSelectedText();
+	ui->tvHistoryPaths->hideColumn(0);
+}
+
+void MainWindow::onHistoryPathSelected()
+{
+	const int row = ui->tvHistoryPaths->currentIndex().row();
+	if( row < 0 ) {
+		historyVersionsModel_.clear();
+		return;
+	}
+
+	const HistoryCatalog::Query query = HistoryCatalog::versions(historyPathsModel_.value(row, 0).toLongLong(), historyPathsModel_.value(row, 1).toString());
+	historyVersionsModel_.setQuery(query.text, query.args, query.keyColumns);
+
+	ui->tvHistoryVersions->hideColumn(0);
+	ui->tvHistoryVersions->hideColumn(3);
+}
+
+void MainWindow::onHistoryVersionActivated(const QModelIndex &index)
+{
+	const QString filePath = historyVersionsModel_.value(index.row(), 2).toString();
+	if( filePath.isEmpty() )
+		return;
+
+	QDesktopServices::openUrl( QUrl::fromLocalFile( QDir(historyVersionsModel_.value(index.row(), 3).toString()).absoluteFilePath(filePath) ));
 }
 
 void MainWindow::on_btnNewBackupFolder_clicked()
@@ -154,8 +297,9 @@ void MainWindow::on_actionAbout_triggered()
 
 void MainWindow::on_actionBackupAll_triggered()
 {
-	global->db->blockingExecAssoc("UPDATE backupDirectories SET lastFinishedBackup = NULL");
-	QMetaObject::invokeMethod(global->backupManager, "checkForBackups");
+	// Queries are executed in order, so the backup check sees the update without waiting for it here
+	global->db->execAssoc("UPDATE backupDirectories SET lastFinishedBackup = NULL");
+	QMetaObject::invokeMethod(global->backupService, "checkForBackups");
 }
 
 void MainWindow::on_actionShowMainWindow_triggered()
@@ -171,8 +315,8 @@ void MainWindow::on_actionShowMainWindow_triggered()
 
 void MainWindow::on_btnLogScrollDown_clicked()
 {
-	ui->tbLog->verticalScrollBar()->setValue(ui->tbLog->verticalScrollBar()->maximum());
-	ui->tbErrorLog->verticalScrollBar()->setValue(ui->tbErrorLog->verticalScrollBar()->maximum());
+	ui->lvLog->scrollToBottom();
+	ui->lvErrorLog->scrollToBottom();
 }
 
 void MainWindow::on_actionFolderDelete_triggered()
@@ -184,11 +328,22 @@ void MainWindow::on_actionFolderDelete_triggered()
 	if( QMessageBox::question(this, tr("Potvrdit smazání"), tr("Opravdu smazat vybraný záznam?")) != QMessageBox::Yes )
 		return;
 
-	global->db->blockingExec("DELETE FROM files WHERE backupDirectory = ?", {id});
-	global->db->blockingExec("DELETE FROM history WHERE backupDirectory = ?", {id});
-	global->db->blockingExec("DELETE FROM backupDirectories WHERE id = ?", {id});
-
-	updateBkpDirList();
+	global->db->exec("DELETE FROM files WHERE backupDirectory = ?", {id});
+	global->db->exec("DELETE FROM history WHERE backupDirectory = ?", {id});
+	global->db->exec("DELETE FROM runs WHERE backupDirectory = ?", {id});
+	global->db->exec("DELETE FROM paths WHERE backupDirectory = ?", {id});
+	global->db->exec("DELETE FROM partialCopies WHERE backupDirectory = ?", {id});
+	global->db->exec("DELETE FROM runCheckpoints WHERE backupDirectory = ?", {id});
+
+	// Changes not drained yet are dropped along with the catalog
+	const QString stagingDir = global->db->selectValue("SELECT stagingDir FROM backupDirectories WHERE id = ?", {id}).toString();
+	if(!stagingDir.isEmpty())
+		QDir(BackupManager::stageDirPath(stagingDir, id)).removeRecursively();
+
+	global->db->exec("DELETE FROM stagedFiles WHERE backupDirectory = ?", {id});
+	global->db->execAsync("DELETE FROM backupDirectories WHERE id = ?", {id}).then(this, [this](bool){
+		updateBkpDirList();
+	});
 }
 
 void MainWindow::on_actionFolderBackupNow_triggered()
@@ -197,8 +352,8 @@ void MainWindow::on_actionFolderBackupNow_triggered()
 	if( id == -1 )
 		return;
 
-	global->db->blockingExec("UPDATE backupDirectories SET lastFinishedBackup = NULL WHERE id = ?", {id});
-	QMetaObject::invokeMethod(global->backupManager, "checkForBackups");
+	global->db->exec("UPDATE backupDirectories SET lastFinishedBackup = NULL WHERE id = ?", {id});
+	QMetaObject::invokeMethod(global->backupService, "checkForBackups");
 }
 
 void MainWindow::on_actionFolderOpenSource_triggered()
@@ -207,7 +362,7 @@ void MainWindow::on_actionFolderOpenSource_triggered()
 	if( id == -1 )
 		return;
 
-	QDesktopServices::openUrl( QUrl( "file:///" + QDir::toNativeSeparators( global->db->selectValue("SELECT sourceDir FROM backupDirectories WHERE id = ?", {id}).toString() )));
+	QDesktopServices::openUrl( QUrl( "file:///" + QDir::toNativeSeparators( DBSnapshot(global->db).selectValue("SELECT sourceDir FROM backupDirectories WHERE id = ?", {id}).toString() )));
 }
 
 void MainWindow::on_actionFolderOpenTarget_triggered()
@@ -216,7 +371,7 @@ void MainWindow::on_actionFolderOpenTarget_triggered()
 	if( id == -1 )
 		return;
 
-	QDesktopServices::openUrl( QUrl( "file:///" + QDir::toNativeSeparators( global->db->selectValue("SELECT remoteDir FROM backupDirectories WHERE id = ?", {id}).toString() )));
+	QDesktopServices::openUrl( QUrl( "file:///" + QDir::toNativeSeparators( DBSnapshot(global->db).selectValue("SELECT remoteDir FROM backupDirectories WHERE id = ?", {id}).toString() )));
 }
 
 void MainWindow::on_actionFolderEdit_triggered()
@@ -227,3 +382,57 @@ void MainWindow::on_actionFolderEdit_triggered()
 
 	global->backupDirectoryEditDialog->show( id );
 }
+
+void MainWindow::on_actionFolderRunStats_triggered()
+{
+	int id = selectedFolderId();
+	if( id == -1 )
+		return;
+
+	const QSqlRecord run = DBSnapshot(global->db).selectRowDef("SELECT * FROM runs WHERE backupDirectory = ? ORDER BY id DESC LIMIT 1", {id});
+	if( run.isEmpty() ) {
+		QMessageBox::information(this, tr("Statistiky posledního běhu"), tr("Složka zatím nebyla zálohována."));
+		return;
+	}
+
+	auto mb = [&](const char *field) {
+		return QString::number(run.value(field).toLongLong() / 1048576.0, 'f', 1);
+	};
+
+	QStringList lines;
+	lines << tr("Začátek: %1, trvání: %2 s%3").arg(
+					QDateTime::fromSecsSinceEpoch(run.value("started").toLongLong()).toString("dd.MM.yyyy HH:mm:ss"),
+					QString::number(run.value("finished").toLongLong() - run.value("started").toLongLong()),
+					run.value("isInterrupted").toBool() ? tr(" (přerušeno)") : run.value("isSeed").toBool() ? tr(" (úvodní záloha)") : QString());
+	lines << QString();
+	lines << tr("Nové soubory: %1 (%2 MB)").arg(run.value("filesNew").toString(), mb("bytesNew"));
+	lines << tr("Změněné soubory: %1 (%2 MB)").arg(run.value("filesChanged").toString(), mb("bytesChanged"));
+	lines << tr("Beze změny: %1").arg(run.value("filesUnchanged").toString());
+	lines << tr("Smazané: %1").arg(run.value("filesRemoved").toString());
+	lines << tr("Chyby: %1").arg(run.value("filesFailed").toString());
+
+	if( run.value("reflinkedFiles").toLongLong() > 0 )
+		lines << tr("Verze vytvořené jako reflink: %1, ušetřeno zápisu %2 MB, místa %3 MB").arg(run.value("reflinkedFiles").toString(), mb("bytesWriteSaved"), mb("bytesSpaceSaved"));
+	if( run.value("metadataRequestsSaved").toLongLong() > 0 )
+		lines << tr("Dotazy na cílovou složku: %1, ušetřeno díky mezipaměti: %2").arg(run.value("metadataRequests").toString(), run.value("metadataRequestsSaved").toString());
+	lines << QString();
+	lines << tr("Čas fází (součet přes vlákna) [ms]:");
+	lines << tr("  procházení: %1, stat: %2, vyloučení: %3").arg(run.value("walkTime").toString(), run.value("statTime").toString(), run.value("excludeTime").toString());
+	lines << tr("  katalog: %1, kopírování: %2, historie: %3").arg(run.value("lookupTime").toString(), run.value("copyTime").toString(), run.value("historyTime").toString());
+	lines << tr("  promazávání: %1, zápis do databáze: %2").arg(run.value("pruneTime").toString(), run.value("commitTime").toString());
+	lines << QString();
+	lines << tr("Histogramy latencí (počty v intervalech <1, 1, 2, 4, ... µs):");
+	lines << tr("  kopírování: %1").arg(run.value("copyLatency").toString());
+	lines << tr("  databáze: %1").arg(run.value("dbLatency").toString());
+
+	QMessageBox::information(this, tr("Statistiky posledního běhu"), lines.join('\n'));
+}
+
+void MainWindow::on_actionFolderRestore_triggered()
+{
+	int id = selectedFolderId();
+	if( id == -1 )
+		return;
+
+	global->restoreDialog->show( id );
+}
@@ -5,8 +5,11 @@
 #include <QSqlQuery>
 #include <QSqlQueryModel>
 #include <QMenu>
+#include <QTimer>
 
 #include "threaddb/dbmodel.h"
+#include "threaddb/dbpagedmodel.h"
+#include "gui/logmodel.h"
 
 #include "ui_mainwindow.h"
 
@@ -27,23 +30,39 @@ public:
 public:
 	virtual void closeEvent(QCloseEvent *e) override;
 
+public:
+	/// Log messages kept while the window is hidden between backups
+	static const int idleLogRecords = 1000;
+
 public:
 	Ui::MainWindow *getUI() {
 		return ui;
 	}
 
+signals:
+	/// Emitted at most once per log drain if any errors were logged
+	void errorLogged();
+
 private:
 	int selectedFolderId();
+	static bool isScrolledDown(QAbstractItemView *view);
 
 private slots:
 	void updateBkpDirList();
 	void onTvDirListMenuRequested(const QPoint &pos);
 
-	void logInfo(QString text);
-	void logWarning(QString text);
-	void logError(QString text);
-	void logSuccess(QString text);
-	void rawLog(QTextBrowser *tb, QString text);
+	/// Moves messages queued in the log sink to the log model, called at a fixed rate
+	void drainLog();
+	void onLogDirectoryAdded(QString directory);
+	void updateLogFilter();
+
+	/// Releases the memory of the log while nobody is looking at it
+	void onBackupIdle();
+
+	/// Reloads the paths of the history browser from the search fields
+	void updateHistoryPaths();
+	void onHistoryPathSelected();
+	void onHistoryVersionActivated(const QModelIndex &index);
 
 private slots:
 	void on_btnNewBackupFolder_clicked();
@@ -57,6 +76,8 @@ private slots:
 	void on_actionFolderOpenSource_triggered();
 	void on_actionFolderOpenTarget_triggered();
 	void on_actionFolderEdit_triggered();
+	void on_actionFolderRunStats_triggered();
+	void on_actionFolderRestore_triggered();
 
 private:
 	Ui::MainWindow *ui;
@@ -66,6 +87,13 @@ private:
 	QSqlQueryModel bkpDirsModel_;
 	DBModel model_;
 	QMenu *tvDirListMenu_;
+	QTimer logTimer_;
+	LogModel logModel_;
+	LogFilterModel logFilterModel_, errorLogFilterModel_;
+	DBPagedModel historyPathsModel_, historyVersionsModel_;
+
+	/// Delays the search until the user stops typing
+	QTimer historySearchTimer_;
 
 };
 
@@ -0,0 +1,136 @@
+#include "restoredialog.h"
+#include "ui_restoredialog.h"
+
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QDateTime>
+#include <QTime>
+#include <QDir>
+#include <QtConcurrent/QtConcurrent>
+
+#include "global.h"
+#include "threaddb/dbsnapshot.h"
+
+RestoreDialog::RestoreDialog(QWidget *parent) :
+	QDialog(parent),
+	ui(new Ui::RestoreDialog),
+	restoreManager_(global->db, global->logSink)
+{
+	ui->setupUi(this);
+
+	connect(&restoreManager_, SIGNAL(progress(int,int,qint64,qint64,int)), this, SLOT(onProgress(int,int,qint64,qint64,int)));
+	connect(&restoreWatcher_, SIGNAL(finished()), this, SLOT(onRestoreFinished()));
+}
+
+RestoreDialog::~RestoreDialog()
+{
+	restoreManager_.cancel();
+	restoreWatcher_.waitForFinished();
+
+	delete ui;
+}
+
+void RestoreDialog::show(int dirId)
+{
+	if(restoreWatcher_.isRunning()) {
+		QDialog::show();
+		return;
+	}
+
+	dirId_ = dirId;
+
+	ui->lblSourceFolder->setText(DBSnapshot(global->db).selectValue("SELECT sourceDir FROM backupDirectories WHERE id = ?", {dirId}).toString());
+	ui->dteTime->setDateTime(QDateTime::currentDateTime());
+	ui->lePath->clear();
+	ui->btnTargetFolder->setText("");
+	ui->pbProgress->setValue(0);
+	ui->lblProgress->clear();
+
+	setRunning(false);
+	QDialog::show();
+}
+
+void RestoreDialog::reject()
+{
+	if(restoreWatcher_.isRunning()) {
+		restoreManager_.cancel();
+		return;
+	}
+
+	QDialog::reject();
+}
+
+void RestoreDialog::onProgress(int filesDone, int fileCount, qint64 bytesDone, qint64 byteCount, int etaSeconds)
+{
+	ui->pbProgress->setValue(byteCount ? int(bytesDone * 1000 / byteCount) : fileCount ? filesDone * 1000 / fileCount : 1000);
+
+	ui->lblProgress->setText(tr("Obnoveno souborů: %1 z %2, %3 z %4 MB, zbývá %5").arg(
+				QString::number(filesDone),
+				QString::number(fileCount),
+				QString::number(bytesDone / (1024 * 1024)),
+				QString::number(byteCount / (1024 * 1024)),
+				etaSeconds >= 0 ? QTime(0, 0).addSecs(etaSeconds).toString("HH:mm:ss") : tr("?")));
+}
+
+void RestoreDialog::onRestoreFinished()
+{
+	setRunning(false);
+
+	if(restoreWatcher_.result())
+		QMessageBox::information(this, tr("Obnovit zálohu"), tr("Obnova byla dokončena."));
+	else
+		QMessageBox::warning(this, tr("Obnovit zálohu"), tr("Obnova nebyla dokončena, podrobnosti jsou v záznamu."));
+}
+
+void RestoreDialog::on_btnRestore_clicked()
+{
+	const QString targetFolder = ui->btnTargetFolder->text();
+
+	if( targetFolder.isEmpty() || !QDir(targetFolder).exists() ) {
+		QMessageBox::critical(this, tr("Chyba"), tr("Složka '%1' neexistuje.").arg(targetFolder));
+		return;
+	}
+
+	// The user confirms overwriting the files, the restore refuses a non-empty folder otherwise
+	const bool overwrite = !QDir(targetFolder).isEmpty();
+	if( overwrite && QMessageBox::question(this, tr("Obnovit zálohu"), tr("Složka '%1' není prázdná, soubory v ní mohou být přepsány. Pokračovat?").arg(targetFolder)) != QMessageBox::Yes )
+		return;
+
+	const qlonglong dirId = dirId_;
+	const qlonglong time = ui->dteTime->dateTime().toSecsSinceEpoch();
+	const QString pathPrefix = ui->lePath->text().trimmed();
+
+	setRunning(true);
+	ui->pbProgress->setValue(0);
+	ui->lblProgress->setText(tr("Připravuji seznam souborů..."));
+
+	RestoreManager *restoreManager = &restoreManager_;
+	restoreWatcher_.setFuture(QtConcurrent::run([=]{
+		const RestoreManager::Plan plan = restoreManager->plan(dirId, time, pathPrefix);
+		return restoreManager->restore(plan, targetFolder, overwrite);
+	}));
+}
+
+void RestoreDialog::on_btnClose_clicked()
+{
+	reject();
+}
+
+void RestoreDialog::on_btnTargetFolder_clicked()
+{
+	QString prevDir = ui->btnTargetFolder->text();
+	QString dir = QFileDialog::getExistingDirectory( this, nullptr, prevDir );
+	if( dir.isEmpty() || dir == prevDir )
+		return;
+
+	ui->btnTargetFolder->setText(dir);
+}
+
+void RestoreDialog::setRunning(bool isRunning)
+{
+	ui->dteTime->setEnabled(!isRunning);
+	ui->lePath->setEnabled(!isRunning);
+	ui->btnTargetFolder->setEnabled(!isRunning);
+	ui->btnRestore->setEnabled(!isRunning);
+	ui->btnClose->setText(isRunning ? tr(" Přerušit") : tr(" Zavřít"));
+}
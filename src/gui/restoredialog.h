@@ -0,0 +1,49 @@
+#ifndef RESTOREDIALOG_H
+#define RESTOREDIALOG_H
+
+#include <QDialog>
+#include <QFutureWatcher>
+
+#include "job/restoremanager.h"
+
+namespace Ui {
+	class RestoreDialog;
+}
+
+/// Restores a backed up directory as it was at a chosen time
+class RestoreDialog : public QDialog
+{
+	Q_OBJECT
+
+public:
+	explicit RestoreDialog(QWidget *parent = 0);
+	~RestoreDialog();
+
+public:
+	void show(int dirId);
+
+public slots:
+	/// Cancels the restore in progress instead of closing
+	virtual void reject() override;
+
+private slots:
+	void onProgress(int filesDone, int fileCount, qint64 bytesDone, qint64 byteCount, int etaSeconds);
+	void onRestoreFinished();
+
+private slots:
+	void on_btnRestore_clicked();
+	void on_btnClose_clicked();
+	void on_btnTargetFolder_clicked();
+
+private:
+	void setRunning(bool isRunning);
+
+private:
+	Ui::RestoreDialog *ui;
+	int dirId_;
+	RestoreManager restoreManager_;
+	QFutureWatcher<bool> restoreWatcher_;
+
+};
+
+#endif // RESTOREDIALOG_H
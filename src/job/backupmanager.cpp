@@ -1,303 +1,1127 @@
 #include "backupmanager.h"
 
+#include <memory>
+#include <vector>
+
 #include <QDateTime>
 #include <QVariant>
-#include <QApplication>
+#include <QCoreApplication>
 #include <QDirIterator>
 #include <QRegExp>
 #include <QSqlQuery>
 #include <QElapsedTimer>
 #include <QSqlError>
-
-#include "global.h"
-
-BackupManager::BackupManager()
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QReadLocker>
+#include <QMutex>
+#include <QSet>
+#include <QStorageInfo>
+#include <QStandardPaths>
+#include <QtConcurrent/QtConcurrent>
+
+#include "threaddb/dbstatement.h"
+#include "job/dbschema.h"
+#include "job/runstats.h"
+#include "job/tracer.h"
+#include "job/processmemory.h"
+#include "job/filecopy.h"
+#include "job/resumablecopy.h"
+#include "job/directorywalk.h"
+#include "job/fanoutcopy.h"
+
+const int BackupManager::defaultMaxConcurrentRuns;
+const int BackupManager::checkpointMSecs;
+const int BackupManager::idleThreadExpiryMSecs;
+const qint64 BackupManager::defaultStagingLimit;
+const qint64 BackupManager::stagingMinFreeBytes;
+const int BackupManager::stageWaitMSecs;
+
+BackupManager::BackupManager(DBManager *db, LogSink *logSink) :
+	db_(db),
+	logSink_(logSink),
+	totals_(false)
 {
-	connect(qApp, &QApplication::aboutToQuit, this, [this]{
-		thread_.requestInterruption();
+	connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]{
+		isInterrupted_ = true;
 		thread_.quit();
 	});
 
-	thread_.start();
+	runPool_.setExpiryTimeout(idleThreadExpiryMSecs);
+	drainPool_.setExpiryTimeout(idleThreadExpiryMSecs);
 
-	backupCheckTimer_ = new QTimer();
-	connect(backupCheckTimer_, SIGNAL(timeout()), this, SLOT(checkForBackups()));
-	backupCheckTimer_->moveToThread(&thread_);
+	thread_.start();
 
-	connect(this, SIGNAL(logError(QString)), this, SLOT(updateLastLogTime()));
-	connect(this, SIGNAL(logInfo(QString)), this, SLOT(updateLastLogTime()));
-	connect(this, SIGNAL(logWarning(QString)), this, SLOT(updateLastLogTime()));
+	scheduleTimer_ = new QTimer();
+	scheduleTimer_->setSingleShot(true);
+	connect(scheduleTimer_, SIGNAL(timeout()), this, SLOT(checkForBackups()));
+	scheduleTimer_->moveToThread(&thread_);
 
 	moveToThread(&thread_);
 }
 
 BackupManager::~BackupManager()
 {
-	thread_.requestInterruption();
+	isInterrupted_ = true;
+	runPool_.waitForDone();
+	drainPool_.waitForDone();
+
+	thread_.quit();
 	thread_.wait();
 }
 
 void BackupManager::checkForBackups()
+{
+	if(Tracer::isEnabled())
+		Tracer::setThreadName("BackupManager");
+
+	if(isInterrupted_)
+		return;
+
+	const QVariant maxConcurrentRuns = db_->selectValue("SELECT MAX(value) FROM settings WHERE key = 'maxConcurrentRuns'");
+	maxConcurrentRuns_ = maxConcurrentRuns.isNull() ? defaultMaxConcurrentRuns : qMax(1, maxConcurrentRuns.toInt());
+	runPool_.setMaxThreadCount(maxConcurrentRuns_);
+
+	QVector<BackupScheduler::Directory> directories;
+	auto directory = db_->selectQuery("SELECT id, backupInterval, IFNULL(lastFinishedBackup, -1), IFNULL(windowStart, -1), IFNULL(windowEnd, -1), sourceDir FROM backupDirectories");
+	while(directory.next())
+		directories.append({directory.value(0).toLongLong(), directory.value(1).toLongLong(), directory.value(2).toLongLong(), directory.value(3).toInt(), directory.value(4).toInt(), QDir::cleanPath(directory.value(5).toString())});
+
+	scheduler_.update(directories, QDateTime::currentSecsSinceEpoch());
+	dispatchDueRuns();
+
+	// Drains stopped by an unavailable destination or by the end of the program are retried
+	auto stagedDirectory = db_->selectQuery("SELECT DISTINCT backupDirectory FROM stagedFiles WHERE state = ?", {int(StageState::staged)});
+	while(stagedDirectory.next())
+		requestDrain(stagedDirectory.value(0).toLongLong());
+}
+
+void BackupManager::dispatchDueRuns()
 {
 	const qlonglong currentTime = QDateTime::currentSecsSinceEpoch();
-	currentTimeFileSuffix_ = QDateTime::fromSecsSinceEpoch(currentTime).toString("yyyyMMddhhmmss");
+	const bool wasIdle = scheduler_.runningCount() == 0;
+	const QVector<QVector<qlonglong>> dueRuns = scheduler_.takeDue(currentTime, maxConcurrentRuns_ - scheduler_.runningCount());
+
+	{
+		QMutexLocker ml(&nextBackupTimesMutex_);
+		nextBackupTimes_ = scheduler_.deadlines();
+	}
 
-	emit logInfo(tr("Kontroluji zálohy..."));
+	if(wasIdle && !dueRuns.isEmpty())
+		log(LogLevel::info, QT_TR_NOOP("Kontroluji zálohy..."));
+
+	for(const QVector<qlonglong> &dirIds : dueRuns) {
+		runningCount_ ++;
+		QtConcurrent::run(&runPool_, [this, dirIds]{
+			const QVector<qlonglong> failedDirIds = backupDirectories(dirIds);
+			QMetaObject::invokeMethod(this, [this, dirIds, failedDirIds]{
+				onRunFinished(dirIds, failedDirIds);
+			}, Qt::QueuedConnection);
+		});
+	}
 
-	DBQuery findFileQuery(global->db);
-	findFileQuery.prepare("SELECT * FROM files WHERE (backupDirectory = :backupDirectory) AND (filePath = :filePath)");
+	// Directories that are due but did not get a run slot are started when a run finishes.
+	// The timer is limited to an hour, so that directories edited meanwhile are rescheduled even if nobody calls checkForBackups.
+	const qlonglong nextDeadline = scheduler_.nextDeadline();
+	if(nextDeadline == -1 || nextDeadline <= currentTime)
+		scheduleTimer_->stop();
+	else
+		scheduleTimer_->start(int(qMin<qlonglong>(nextDeadline - currentTime, 3600)) * 1000);
+}
 
-	size_t filesChecked = 0;
+QHash<qlonglong, qlonglong> BackupManager::nextBackupTimes() const
+{
+	QMutexLocker ml(&nextBackupTimesMutex_);
+	return nextBackupTimes_;
+}
 
-	auto backupDirectory = global->db->selectQueryAssoc("SELECT * FROM backupDirectories WHERE IFNULL(lastFinishedBackup+backupInterval, 0) <= :time", {{":time", currentTime}});
-	while( backupDirectory.next() ) {
-		if( thread_.isInterruptionRequested() )
-			break;
+void BackupManager::onRunFinished(const QVector<qlonglong> &dirIds, const QVector<qlonglong> &failedDirIds)
+{
+	runningCount_ --;
+	scheduler_.finish(dirIds, failedDirIds, QDateTime::currentSecsSinceEpoch());
+
+	if(!failedDirIds.isEmpty())
+		log(LogLevel::warning, QT_TR_NOOP("Záloha se nezdařila, další pokus bude proveden později."));
+
+	// The run updated lastFinishedBackup of the directory -> reload
+	checkForBackups();
+
+	if(!scheduler_.runningCount() && !isInterrupted_) {
+		log(LogLevel::info, QT_TR_NOOP("Kontrola záloh dokončena."));
+
+		// The thread of the finished run is still in the pool; its stack and malloc arena are released once it expires
+		QTimer::singleShot(idleThreadExpiryMSecs * 2, this, [this]{
+			if(!scheduler_.runningCount() && !isInterrupted_)
+				releaseIdleMemory();
+		});
+	}
+}
+
+QVector<qlonglong> BackupManager::backupDirectories(const QVector<qlonglong> &dirIds)
+{
+	QVector<qlonglong> failedDirIds;
+	QVector<Run> runs;
 
-		const QString sourceDir = backupDirectory.value("sourceDir").toString();
-		const QString remoteDir = backupDirectory.value("remoteDir").toString();
-		const qlonglong dirId = backupDirectory.value("id").toLongLong();
+	for(const qlonglong dirId : dirIds) {
+		Run run;
 
-		if(sourceDir.isEmpty() || remoteDir.isEmpty()) {
-			emit logError(tr("Vnitřní chyba systému (dir.isEmpty)"));
-			lastLogTime_ = QDateTime::currentDateTime();
+		switch(prepareRun(dirId, run)) {
+			case Preparation::ready:
+				runs.append(run);
+				break;
+
+			case Preparation::deleted:
+				break;
+
+			case Preparation::failed:
+				failedDirIds.append(dirId);
+				break;
+		}
+	}
+
+	std::vector<std::unique_ptr<RunStats>> runStats;
+	QVector<const Run *> scanRuns;
+
+	for(Run &run : runs) {
+		runStats.emplace_back(new RunStats(run.isSeed, &totals_));
+		run.stats = runStats.back().get();
+		run.destinationCache = std::make_shared<DestinationCache>(*run.storage, run.stats);
+
+		if(!run.isSeed)
+			scanRuns.append(&run);
+	}
+
+	// Seeds copy in parallel from their own walk and may drop the indexes the scans need, so they are not combined with the scans
+	for(const Run &run : runs) {
+		if(!run.isSeed)
 			continue;
+
+		if(seedDirectory(run, QDir(run.sourceDir)))
+			finishRun(run);
+		else
+			run.stats->store(db_, run.dirId, true);
+	}
+
+	if(scanRuns.isEmpty())
+		return failedDirIds;
+
+	// Scans look the files up by the indexes a concurrent seed may have dropped
+	QReadLocker indexLocker(&fileIndexLock_);
+
+	for(const Run *run : scanRuns) {
+		if(run->historyLayout == VersionStore::Layout::versionStore)
+			migrateHistory(*run);
+	}
+
+	if(scanRuns.size() > 1)
+		log(*scanRuns.first(), LogLevel::info, QT_TR_NOOP("Složka '%1' se zálohuje do %2 cílů najednou, soubory se čtou jen jednou."), scanRuns.first()->sourceDir, QString::number(scanRuns.size()));
+
+	const QVector<bool> isFinished = scanDirectory(scanRuns, QDir(scanRuns.first()->sourceDir));
+
+	for(int i = 0; i < scanRuns.size(); i ++) {
+		if(isFinished[i])
+			finishRun(*scanRuns[i]);
+		else
+			scanRuns[i]->stats->store(db_, scanRuns[i]->dirId, true);
+	}
+
+	return failedDirIds;
+}
+
+BackupManager::Preparation BackupManager::prepareRun(qlonglong dirId, Run &run)
+{
+	const QSqlRecord backupDirectory = db_->selectRowDef("SELECT * FROM backupDirectories WHERE id = ?", {dirId});
+
+	// Deleted since it was scheduled
+	if(backupDirectory.isEmpty())
+		return Preparation::deleted;
+
+	const qlonglong currentTime = QDateTime::currentSecsSinceEpoch();
+
+	run.dirId = dirId;
+	run.sourceDir = backupDirectory.value("sourceDir").toString();
+	run.remoteDir = backupDirectory.value("remoteDir").toString();
+	run.keepHistoryDuration = backupDirectory.value("keepHistoryDuration").toLongLong();
+	run.isSeed = false;
+	run.startTime = currentTime;
+	run.currentTime = currentTime;
+	run.timeSuffix = QDateTime::fromSecsSinceEpoch(currentTime).toString("yyyyMMddhhmmss");
+	run.historyLayout = VersionStore::layout(backupDirectory.value("historyLayout"));
+	run.canReflink = false;
+	run.stagingDir = backupDirectory.value("stagingDir").toString();
+	run.stagingLimit = backupDirectory.value("stagingLimit").isNull() ? defaultStagingLimit : backupDirectory.value("stagingLimit").toLongLong();
+	run.storage = StorageBackend::create(run.remoteDir);
+	run.stats = nullptr;
+
+	const QString &sourceDir = run.sourceDir;
+	const QString &remoteDir = run.remoteDir;
+
+	if(sourceDir.isEmpty() || remoteDir.isEmpty()) {
+		log(run, LogLevel::error, QT_TR_NOOP("Vnitřní chyba systému (dir.isEmpty)"));
+		return Preparation::failed;
+	}
+
+	const QDir sourceQDir(sourceDir);
+
+	const QStringList excludeFilters = backupDirectory.value("excludeFilter").toString().split('\n', QString::SkipEmptyParts);
+	for(const QString &filter : excludeFilters)
+		run.excludeRegexes.append(QRegExp(filter, Qt::CaseInsensitive, QRegExp::WildcardUnix));
+
+	log(run, LogLevel::info, QT_TR_NOOP("Zálohuji složku '%1'..."), sourceDir);
+
+	if(!sourceQDir.exists()) {
+		log(run, LogLevel::error, QT_TR_NOOP("Složka '%1' neexistuje!'"), sourceDir);
+		return Preparation::failed;
+	}
+
+	if(!run.storage->isAvailable()) {
+		log(run, LogLevel::error, QT_TR_NOOP("Složka pro zálohy '%1' neexistuje!'"), remoteDir);
+		return Preparation::failed;
+	}
+
+	if(!run.stagingDir.isEmpty()) {
+		const QString stagePath = stageDirPath(run.stagingDir, dirId);
+
+		if(!QDir().mkpath(stagePath)) {
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), stagePath);
+			return Preparation::failed;
 		}
 
-		const QDir sourceQDir(sourceDir);
-		const QDir remoteQDir(remoteDir);
+		// Captures cut short by the end of the program
+		DBQuery capture = db_->selectQuery("SELECT id, stagedPath FROM stagedFiles WHERE (backupDirectory = ?) AND (state = ?)", {dirId, int(StageState::capturing)});
+		while(capture.next()) {
+			QFile::remove(capture.value(1).toString());
+			db_->exec("DELETE FROM stagedFiles WHERE id = ?", {capture.value(0)});
+		}
+	}
 
-		const QStringList excludeFilters = backupDirectory.value("excludeFilter").toString().split('\n', QString::SkipEmptyParts);
-		QVector<QRegExp> excludeRegexes;
+	// Changes staged before the stage was turned off must reach the destination before anything is written there directly
+	if(run.stagingDir.isEmpty() && db_->selectValue("SELECT COUNT(*) FROM stagedFiles WHERE (backupDirectory = ?) AND (state = ?)", {dirId, int(StageState::staged)}).toLongLong()) {
+		waitForDrain(dirId);
+
+		if(db_->selectValue("SELECT COUNT(*) FROM stagedFiles WHERE (backupDirectory = ?) AND (state = ?)", {dirId, int(StageState::staged)}).toLongLong()) {
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se přenést změny z přípravné oblasti do '%1'."), remoteDir);
+			return Preparation::failed;
+		}
+	}
 
-		for(const QString &filter : excludeFilters)
-			excludeRegexes.append(QRegExp(filter, Qt::CaseInsensitive, QRegExp::WildcardUnix));
+	// First backup into an empty destination -> there is nothing to look up in the catalog and nothing to collide with
+	run.isSeed = backupDirectory.value("lastFinishedBackup").isNull()
+			&& db_->selectValue("SELECT COUNT(*) FROM files WHERE backupDirectory = ?", {dirId}).toLongLong() == 0
+			&& run.storage->isEmpty();
 
-		QVector<qlonglong> unchangedFileIds;
+	// An interrupted scan continues where it stopped, as the same run: the files it processed have lastChecked set to its time, so the removed files are still found
+	if(!run.isSeed) {
+		const QSqlRecord checkpoint = db_->selectRowDef("SELECT runTime, cursor FROM runCheckpoints WHERE backupDirectory = ?", {dirId});
 
-		emit logInfo(tr("Zálohuji složku '%1'...").arg(sourceDir));
+		if(!checkpoint.isEmpty()) {
+			run.currentTime = checkpoint.value("runTime").toLongLong();
+			run.timeSuffix = QDateTime::fromSecsSinceEpoch(run.currentTime).toString("yyyyMMddhhmmss");
+			run.resumeAfter = checkpoint.value("cursor").toString();
 
-		if(!sourceQDir.exists()) {
-			emit logError(tr("Složka '%1' neexistuje!'").arg(sourceDir));
-			continue;
+			log(run, LogLevel::info, QT_TR_NOOP("Navazuji na přerušenou zálohu za souborem '%1'."), run.resumeAfter);
 		}
+	}
 
-		if(!remoteQDir.exists()) {
-			emit logError(tr("Složka pro zálohy '%1' neexistuje!'").arg(remoteDir));
-			continue;
+	// Seeds make no history versions; only local file systems can clone
+	run.canReflink = !run.isSeed && !run.storage->localDir().isEmpty() && FileCopy::isCloneSupported(remoteDir);
+
+	return Preparation::ready;
+}
+
+void BackupManager::finishRun(const Run &run)
+{
+	const qlonglong dirId = run.dirId;
+	const QDir sourceQDir(run.sourceDir);
+	StorageBackend &storage = *run.storage;
+	RunStats &runStats = *run.stats;
+
+	db_->exec("DELETE FROM runCheckpoints WHERE backupDirectory = ?", {dirId});
+
+	// Walk removed files and update them as backup
+	auto removedFile = db_->selectQueryAssoc(
+				"SELECT * FROM files WHERE (backupDirectory = :backupDirectory) AND (lastChecked <> :lastChecked)",
+				{
+					{":lastChecked", run.currentTime},
+					{":backupDirectory", dirId}
+				});
+
+	while(removedFile.next()) {
+		const QString filePath = removedFile.value("filePath").toString();
+		const QString sourceFilePath = sourceQDir.absoluteFilePath(filePath);
+
+		log(run, LogLevel::info, QT_TR_NOOP("Soubor '%1' smazán, vytvářím zálohu..."), sourceFilePath);
+		runStats.addFile(RunStats::Outcome::removed);
+
+		db_->execAssoc("DELETE FROM files WHERE id = :id", {{":id", removedFile.value("id")}});
+
+		if(run.stagingDir.isEmpty())
+			moveToHistory(run, filePath);
+		else
+			stageRemoval(run, filePath);
+	}
+
+	RunStats::PhaseTimer pruneTimer(&runStats, RunStats::Phase::pruning);
+	auto backupToRemove = db_->selectQueryAssoc(
+				"SELECT * FROM history WHERE (backupDirectory = :backupDirectory) AND (version < :version)",
+				{
+					{":version", run.startTime - run.keepHistoryDuration},
+					{":backupDirectory", dirId}
+				});
+
+	// The versions are removed in parallel, on an object store each removal is a request of its own
+	QVector<QPair<QString, QFuture<bool>>> removals;
+
+	auto finishRemovals = [&]{
+		for(QPair<QString, QFuture<bool>> &removal : removals) {
+			if(!removal.second.result())
+				log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se smazat starou zálohu '%1'!"), storage.location(removal.first));
+
+			storage.rmpath(removal.first);
 		}
 
-		// Walk files in the sourceDir and update them eventually
-		QDirIterator iter(sourceDir, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
-		while(iter.hasNext()) {
-			if(thread_.isInterruptionRequested())
-				return;
+		removals.clear();
+	};
 
-			if(!remoteQDir.exists()) {
-				emit logError(tr("Složka '%1' přestala být dostupná.").arg(remoteDir));
-				break;
+	while(backupToRemove.next()) {
+		const QString filePath = backupToRemove.value("remoteFilePath").toString();
+
+		log(run, LogLevel::info, QT_TR_NOOP("Mažu starou zálohu '%1'."), storage.location(filePath));
+
+		db_->execAssoc("DELETE FROM history WHERE id = :id", {{":id", backupToRemove.value("id")}});
+
+		removals.append(qMakePair(filePath, storage.removeAsync(filePath)));
+		if(removals.size() >= 4 * storage.maxRequestsInFlight())
+			finishRemovals();
+	}
+
+	finishRemovals();
+
+	// Partial copies this run did not continue belong to files that are gone or were copied otherwise; with a stage they belong to the drain
+	if(run.stagingDir.isEmpty() && !storage.localDir().isEmpty()) {
+		const int staleCopyCount = ResumableCopy::removeStale(db_, dirId, run.remoteDir, run.startTime);
+		if(staleCopyCount)
+			log(run, LogLevel::info, QT_TR_NOOP("Smazáno %1 nedokončených kopií velkých souborů."), QString::number(staleCopyCount));
+	}
+
+	// The drained changes are kept in the catalog until the next finished run, for the status
+	db_->exec("DELETE FROM stagedFiles WHERE (backupDirectory = ?) AND (state = ?) AND (drainedAt < ?)", {dirId, int(StageState::drained), run.startTime});
+
+	pruneTimer.finish();
+
+	db_->execAssoc("UPDATE backupDirectories SET lastFinishedBackup = :lastFinishedBackup WHERE id = :id", {{":lastFinishedBackup", run.startTime}, {":id", dirId}});
+
+	log(run, LogLevel::success, QT_TR_NOOP("Zálohování složky '%1' dokončeno."), run.sourceDir);
+
+	{
+		RunStats::PhaseTimer commitTimer(&runStats, RunStats::Phase::dbCommit);
+		db_->waitJobDone();
+	}
+
+	runStats.store(db_, dirId, false);
+
+	if(!run.stagingDir.isEmpty())
+		requestDrain(dirId);
+
+	db_->waitJobDone();
+	emit backupFinished();
+}
+
+void BackupManager::releaseIdleMemory()
+{
+	db_->releaseMemory();
+	ProcessMemory::releaseFreeMemory();
+
+	idleResidentBytes_ = ProcessMemory::residentBytes();
+	if(idleResidentBytes_ >= 0)
+		log(LogLevel::info, QT_TR_NOOP("Uvolněna paměť, v nečinnosti zabírá program %1 MB."), QString::number(double(idleResidentBytes_) / (1024 * 1024), 'f', 1));
+
+	emit idle();
+}
+
+QVector<bool> BackupManager::scanDirectory(const QVector<const Run *> &runs, const QDir &sourceQDir)
+{
+	const QString sourceDir = sourceQDir.path();
+
+	FindFileStatement findFileStatement(db_, "SELECT id, remoteVersion FROM files WHERE (backupDirectory = ?) AND (filePath = ?)");
+	DBStatement<std::tuple<>(qlonglong, QString, qlonglong, qlonglong)> insertFileStatement(db_, "INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (?, ?, ?, ?)");
+	DBStatement<std::tuple<>(qlonglong, qlonglong, qlonglong)> updateFileStatement(db_, "UPDATE files SET lastChecked = ?, remoteVersion = ? WHERE id = ?");
+	UpdateLastCheckedStatement updateLastCheckedStatement(db_, "UPDATE files SET lastChecked = ? WHERE id = ?");
+
+	struct Destination {
+		const Run *run;
+		QVector<qlonglong> unchangedFileIds;
+
+		/// Files up to this one were processed before the interruption the run continues; cleared once the walk gets past it
+		QString skipUntil;
+
+		/// Last file whose catalog updates are queued; at the start of each iteration the previous file is done
+		QString processedFilePath;
+
+		bool isActive;
+	};
+
+	QVector<Destination> destinations;
+	QVector<bool> result;
+
+	// The walk starts at the earliest point any of the runs continues from
+	QString resumeAfter = runs.first()->resumeAfter;
+
+	for(const Run *run : runs) {
+		destinations.append({run, QVector<qlonglong>(), run->resumeAfter, run->resumeAfter, true});
+		result.append(true);
+
+		if(run->resumeAfter.isEmpty() || DirectoryWalk::isBefore(run->resumeAfter, resumeAfter))
+			resumeAfter = run->resumeAfter;
+	}
+
+	// The walk and the stats are shared: their time is split evenly among the runs using them (the runs still active, the targets of the file),
+	// so that the times of the runs sum up to the time spent
+	auto addSharedTime = [&](RunStats::Phase phase, qint64 nsecs, const QVector<int> &indexes) {
+		for(const int i : indexes)
+			destinations[i].run->stats->addPhaseTime(phase, nsecs / indexes.size());
+	};
+
+	QVector<int> activeIndexes;
+
+	size_t filesChecked = 0;
+
+	// Walk files in the sourceDir and update them eventually; the walk order is fixed, so that it can be continued from a checkpoint
+	DirectoryWalk iter(sourceDir, resumeAfter);
+	TraceSegments walkSegments("walk", "directory", "path");
+
+	// Finds next file that is not excluded for some destination and asynchronously looks it up in their catalogs
+	auto fetchNextFile = [&](PendingFile &file) {
+		while(true) {
+			QElapsedTimer walkTimer;
+			walkTimer.start();
+
+			const bool hasNext = iter.hasNext();
+			QFileInfo fileInfo;
+			if(hasNext) {
+				iter.next();
+				fileInfo = iter.fileInfo();
 			}
 
-			iter.next();
+			activeIndexes.clear();
+			for(int i = 0; i < destinations.size(); i ++) {
+				if(destinations[i].isActive)
+					activeIndexes.append(i);
+			}
+
+			addSharedTime(RunStats::Phase::walk, walkTimer.nsecsElapsed(), activeIndexes);
+
+			if(!hasNext)
+				return false;
+
+			walkSegments.update(fileInfo.path());
 
-			const QFileInfo fileInfo = iter.fileInfo();
 			const QString filePath = sourceQDir.relativeFilePath(fileInfo.absoluteFilePath());
 
-			// Check exclude filter
-			{
-				bool isOk = true;
-				for(QRegExp &regex : excludeRegexes) {
-					if(regex.exactMatch(filePath)) {
-						isOk = false;
-						break;
-					}
-				}
+			file.targets.clear();
+			file.records.clear();
 
-				if(!isOk)
+			for(int i = 0; i < destinations.size(); i ++) {
+				Destination &destination = destinations[i];
+
+				if(!destination.isActive)
 					continue;
+
+				if(!destination.skipUntil.isEmpty()) {
+					if(!DirectoryWalk::isBefore(destination.skipUntil, filePath))
+						continue;
+
+					destination.skipUntil.clear();
+				}
+
+				bool excluded;
+				{
+					RunStats::PhaseTimer excludeTimer(destination.run->stats, RunStats::Phase::excludeMatching);
+					excluded = isExcluded(filePath, destination.run->excludeRegexes);
+				}
+
+				if(!excluded)
+					file.targets.append(i);
 			}
 
-			if(lastLogTime_.msecsTo(QDateTime::currentDateTime()) >= 10000)
-				emit logInfo(tr("Zálohuji '%1'; zkontrolováno souborů: %2").arg(sourceDir).arg(filesChecked));
+			if(file.targets.isEmpty())
+				continue;
 
-			filesChecked ++;
+			QElapsedTimer statTimer;
+			statTimer.start();
 
-			findFileQuery.execAssoc({{":backupDirectory", dirId}, {":filePath", filePath}});
+			file.lastModified = fileInfo.lastModified().toSecsSinceEpoch();
+			file.size = fileInfo.size();
 
-			// File is not in the database -> copy it and create record
-			if(!findFileQuery.next()) {
-				const QString sourceFilePath = sourceQDir.absoluteFilePath(filePath);
-				const QString remoteFilePath = remoteQDir.absoluteFilePath(filePath);
-				const QString remotePath = QFileInfo(remoteFilePath).absolutePath();
+			addSharedTime(RunStats::Phase::stat, statTimer.nsecsElapsed(), file.targets);
 
-				emit logInfo(tr("Zálohuji nový soubor '%1'...").arg(sourceFilePath));
+			file.fileInfo = fileInfo;
+			file.filePath = filePath;
 
-				if( !QDir().mkpath(remotePath) ) {
-					emit logError(tr("Nepodařilo se vytvořit cestu '%1'!").arg(remotePath));
-					continue;
-				}
+			for(const int i : file.targets)
+				file.records.append(findFileStatement.selectRowDefAsync(FindFileStatement::Row(-1, 0), destinations[i].run->dirId, filePath));
 
-				if(!copyFile(sourceFilePath, remoteFilePath))
-					continue;
+			return true;
+		}
+	};
+
+	// A file needed by several destinations is read once and written to all of them by the writers of fanOut
+	struct FanOutWrite {
+		/// -1 for a new file
+		qlonglong fileId;
+		QString filePath;
+		qlonglong lastModified;
+	};
+
+	std::unique_ptr<FanOutCopy> fanOut(runs.size() > 1 ? new FanOutCopy(runs.size()) : nullptr);
+	QHash<qlonglong, FanOutWrite> fanOutWrites;
+	qlonglong nextFanOutTag = 0;
+
+	// Queues the catalog updates of the files the writers finished
+	auto commitFanOutResults = [&]{
+		if(!fanOut)
+			return;
+
+		for(const FanOutCopy::Result &copyResult : fanOut->takeResults()) {
+			const FanOutWrite write = fanOutWrites.take(copyResult.target.tag);
+			const Run &run = *destinations[copyResult.target.writer].run;
+
+			run.stats->addPhaseTime(RunStats::Phase::copy, copyResult.nsecs);
+
+			if(copyResult.status == FanOutCopy::Status::readError) {
+				log(run, LogLevel::error, QT_TR_NOOP("Chyba při čtení ze souboru '%1'!"), sourceQDir.absoluteFilePath(write.filePath));
+				run.stats->addFile(RunStats::Outcome::failed);
+				continue;
+			}
 
-				global->db->execAssoc(
-							"INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (:backupDirectory, :filePath, :lastChecked, :remoteVersion)",
-							{
-								{":lastChecked", currentTime},
-								{":backupDirectory", dirId},
-								{":filePath", filePath},
-								{":remoteVersion", fileInfo.lastModified().toSecsSinceEpoch()}
-							});
+			if(copyResult.status == FanOutCopy::Status::writeError) {
+				log(run, LogLevel::error, QT_TR_NOOP("Chyba při zápisu do souboru '%1'!"), copyResult.target.filePath);
+				run.stats->addFile(RunStats::Outcome::failed);
+				continue;
+			}
 
-			// File in the database is older -> create a backup of it and copy a new version
-			} else if(fileInfo.lastModified().toSecsSinceEpoch() != findFileQuery.value("remoteVersion").toLongLong()) {
-				const QString sourceFilePath = sourceQDir.absoluteFilePath(filePath);
-				const QString remoteFilePath = remoteQDir.absoluteFilePath(filePath);
-				const QString remotePath = QFileInfo(remoteFilePath).absolutePath();
+			run.destinationCache->setPresent(write.filePath);
 
-				emit logInfo(tr("Soubor '%1' změněn, vytvářím zálohu...").arg(sourceFilePath));
+			// Same as in updateFile
+			if(copyResult.target.isUpdate)
+				run.stats->addReflink(qMax<qint64>(0, copyResult.sourceSize - copyResult.bytesWritten), qMax<qint64>(0, qMin(copyResult.previousSize, copyResult.sourceSize) - copyResult.bytesWritten));
 
-				QString newFilePath = QDir(remotePath).absoluteFilePath( QString("%1.bkp.%2.%3").arg( fileInfo.completeBaseName(), currentTimeFileSuffix_, fileInfo.suffix() ) );
-				QString newRemoteFilePath = remoteQDir.absoluteFilePath(newFilePath);
+			if(write.fileId == -1) {
+				insertFileStatement.execAsync(run.dirId, write.filePath, run.currentTime, write.lastModified);
+				run.stats->addFile(RunStats::Outcome::newFile, copyResult.sourceSize);
 
-				if(!QFile(remoteFilePath).rename(newRemoteFilePath))
-					emit logError(tr("Nepodařilo se vytvořit soubor historie '%1'").arg(newRemoteFilePath));
+			} else {
+				updateFileStatement.execAsync(run.currentTime, write.lastModified, write.fileId);
+				run.stats->addFile(RunStats::Outcome::changed, copyResult.sourceSize);
+			}
+		}
+	};
+
+	// Queues the catalog update of a file written to the destination of run; stageFile updates the catalog of a staged file itself
+	auto commitWrite = [&](const Run &run, qlonglong fileId, const QString &filePath, qlonglong lastModified, qint64 size, bool isWritten, bool isStaged) {
+		if(!isWritten) {
+			run.stats->addFile(RunStats::Outcome::failed);
+			return;
+		}
 
-				global->db->execAssoc(
-							"INSERT INTO history (backupDirectory, remoteFilePath, originalFilePath, version) VALUES (:backupDirectory, :remoteFilePath, :originalFilePath, :version)",
-							{
-								{":version", currentTime},
-								{":backupDirectory", dirId},
-								{":originalFilePath", filePath},
-								{":remoteFilePath", newFilePath}
-							});
+		if(fileId == -1) {
+			if(!isStaged)
+				insertFileStatement.execAsync(run.dirId, filePath, run.currentTime, lastModified);
+			run.stats->addFile(RunStats::Outcome::newFile, size);
 
-				if(!copyFile(sourceFilePath, remoteFilePath))
-					continue;
+		} else {
+			if(!isStaged)
+				updateFileStatement.execAsync(run.currentTime, lastModified, fileId);
+			run.stats->addFile(RunStats::Outcome::changed, size);
+		}
+	};
+
+	// Files written to remote storages in the background, by the pools of the storages; a file at a time would wait for each round trip
+	struct PendingWrite {
+		int destination;
+
+		/// -1 for a new file
+		qlonglong fileId;
+		QString filePath;
+		qlonglong lastModified;
+		qint64 size;
+		QFuture<bool> isWritten;
+	};
+
+	QList<PendingWrite> pendingWrites;
+
+	// Commits the finished writes in the order they were queued, waits for the oldest ones while more than maxPendingCount are left
+	auto commitPendingWrites = [&](int maxPendingCount) {
+		while(!pendingWrites.isEmpty() && (pendingWrites.size() > maxPendingCount || pendingWrites.first().isWritten.isFinished())) {
+			const PendingWrite write = pendingWrites.takeFirst();
+			commitWrite(*destinations[write.destination].run, write.fileId, write.filePath, write.lastModified, write.size, write.isWritten.result(), false);
+		}
+	};
+
+	// The checkpoint must not get ahead of the copies queued to the writers and to the storages
+	auto checkpointDestination = [&](Destination &destination) {
+		if(fanOut) {
+			fanOut->waitForDone();
+			commitFanOutResults();
+		}
+
+		commitPendingWrites(0);
+
+		storeCheckpoint(*destination.run, destination.processedFilePath, updateLastCheckedStatement, destination.unchangedFileIds);
+	};
+
+	PendingFile nextFile;
+	bool hasNextFile = fetchNextFile(nextFile);
+
+	QElapsedTimer sinceCheckpoint;
+	sinceCheckpoint.start();
+
+	while(hasNextFile) {
+		const bool isInterrupted = isInterrupted_;
+		int activeCount = 0;
+
+		for(int i = 0; i < destinations.size(); i ++) {
+			Destination &destination = destinations[i];
+
+			if(!destination.isActive)
+				continue;
+
+			// Continued by the next run once the destination is back, instead of taking the files not walked yet as removed.
+			// The storage is asked once per DestinationCache::availabilityCheckMSecs, not for every file.
+			if(!destination.run->destinationCache->isAvailable()) {
+				log(*destination.run, LogLevel::error, QT_TR_NOOP("Složka '%1' přestala být dostupná."), destination.run->remoteDir);
+				checkpointDestination(destination);
+
+				destination.isActive = false;
+				result[i] = false;
+				continue;
+			}
+
+			if(isInterrupted) {
+				checkpointDestination(destination);
+				result[i] = false;
+				continue;
+			}
+
+			activeCount ++;
+		}
+
+		if(!activeCount)
+			return result;
+
+		if(sinceCheckpoint.elapsed() >= checkpointMSecs) {
+			for(Destination &destination : destinations) {
+				if(destination.isActive)
+					checkpointDestination(destination);
+			}
+
+			sinceCheckpoint.restart();
+		}
 
-				global->db->execAssoc(
-							"UPDATE files SET lastChecked = :lastChecked, remoteVersion = :remoteVersion WHERE id = :id",
-							{
-								{":lastChecked", currentTime},
-								{":remoteVersion", fileInfo.lastModified().toSecsSinceEpoch()},
-								{":id", findFileQuery.value("id")}
-							});
+		const PendingFile file = nextFile;
+
+		// Walking and stat-ing the next file overlaps with the database lookups of the current one
+		hasNextFile = fetchNextFile(nextFile);
+
+		const QString &filePath = file.filePath;
+		const QString sourceFilePath = sourceQDir.absoluteFilePath(filePath);
+
+		if(logSink_->msecsSinceLastLog() >= 10000)
+			log(*runs.first(), LogLevel::info, QT_TR_NOOP("Zálohuji '%1'; zkontrolováno souborů: %2"), sourceDir, QString::number(filesChecked));
+
+		filesChecked ++;
+
+		// Destinations that need a copy of the file, with the id of its record in their catalog (-1 if new)
+		QVector<QPair<int, qlonglong>> writes;
+
+		for(int k = 0; k < file.targets.size(); k ++) {
+			Destination &destination = destinations[file.targets[k]];
+			const Run &run = *destination.run;
+
+			FindFileStatement::Row fileRecord;
+			{
+				RunStats::PhaseTimer lookupTimer(run.stats, RunStats::Phase::catalogLookup);
+				fileRecord = file.records[k].result();
+			}
+
+			if(!destination.isActive)
+				continue;
+
+			destination.processedFilePath = filePath;
+
+			const qlonglong fileId = std::get<0>(fileRecord);
+			const qlonglong fileRemoteVersion = std::get<1>(fileRecord);
+
+			// File is not in the database -> copy it and create record
+			if(fileId == -1) {
+				log(run, LogLevel::info, QT_TR_NOOP("Zálohuji nový soubor '%1'..."), sourceFilePath);
+				writes.append(qMakePair(file.targets[k], fileId));
+
+			// File in the database is older -> create a backup of it and copy a new version
+			} else if(file.lastModified != fileRemoteVersion) {
+				log(run, LogLevel::info, QT_TR_NOOP("Soubor '%1' změněn, vytvářím zálohu..."), sourceFilePath);
+				writes.append(qMakePair(file.targets[k], fileId));
 
 			// Otherwise just update lastChecked of the file
 			} else {
-				//updateLastCheckedQuery.execAssoc({{":lastChecked", currentTime}, {":id", findFileQuery.value("id")}});
-				unchangedFileIds.append(findFileQuery.value("id").toLongLong());
+				destination.unchangedFileIds.append(fileId);
+				run.stats->addFile(RunStats::Outcome::unchanged);
+
+				if(destination.unchangedFileIds.size() >= 4096)
+					commitUnchangedFileIds(run, updateLastCheckedStatement, destination.unchangedFileIds);
 			}
+		}
+
+		// Large files are copied resumably, each destination from its own offset, so they are read by each of them.
+		// Destinations with a stage capture the file there, it is drained to them later. Remote storages take whole files.
+		QVector<QPair<int, qlonglong>> sharedWrites;
 
-			if(unchangedFileIds.size() >= 4096)
-				commitUnchangedFileIds(currentTime, unchangedFileIds);
+		if(file.size < ResumableCopy::minFileSize) {
+			for(const QPair<int, qlonglong> &write : writes) {
+				const Run &run = *destinations[write.first].run;
+
+				if(run.stagingDir.isEmpty() && !run.storage->localDir().isEmpty())
+					sharedWrites.append(write);
+			}
 		}
 
-		commitUnchangedFileIds(currentTime, unchangedFileIds);
+		if(sharedWrites.size() > 1) {
+			QVector<FanOutCopy::Target> targets;
+
+			for(const QPair<int, qlonglong> &write : sharedWrites) {
+				const Run &run = *destinations[write.first].run;
+
+				bool isUpdate;
+				if(!prepareFanOutTarget(run, filePath, write.second != -1, isUpdate)) {
+					run.stats->addFile(RunStats::Outcome::failed);
+					continue;
+				}
+
+				const qlonglong tag = nextFanOutTag ++;
+				fanOutWrites.insert(tag, {write.second, filePath, file.lastModified});
+				targets.append({write.first, QDir(run.storage->localDir()).absoluteFilePath(filePath), isUpdate, tag});
+			}
 
-		// Walk removed files and update them as backup
-		auto removedFile = global->db->selectQueryAssoc(
-					"SELECT * FROM files WHERE (backupDirectory = :backupDirectory) AND (lastChecked <> :lastChecked)",
-					{
-						{":lastChecked", currentTime},
-						{":backupDirectory", dirId}
-					});
+			if(!targets.isEmpty()) {
+				TraceSpan span("backup", "fanOutCopy", "source", sourceFilePath);
+				fanOut->copy(sourceFilePath, targets);
+			}
 
-		while(removedFile.next()) {
-			const QString filePath = removedFile.value("filePath").toString();
-			const QString sourceFilePath = sourceQDir.absoluteFilePath(filePath);
-			const QString remoteFilePath = remoteQDir.absoluteFilePath(filePath);
+			commitFanOutResults();
+		} else
+			sharedWrites.clear();
 
-			emit logInfo(tr("Soubor '%1' smazán, vytvářím zálohu...").arg(sourceFilePath));
+		for(const QPair<int, qlonglong> &write : writes) {
+			if(sharedWrites.contains(write))
+				continue;
 
-			global->db->execAssoc("DELETE FROM files WHERE id = :id", {{":id", removedFile.value("id")}});
+			const Run &run = *destinations[write.first].run;
+			const bool isChanged = write.second != -1;
 
-			QFileInfo fileInfo(remoteFilePath);
-			QString newFilePath = QDir(fileInfo.path()).absoluteFilePath( QString("%1.bkp.%2.%3").arg( fileInfo.completeBaseName(), currentTimeFileSuffix_, fileInfo.suffix() ) );
-			QString newRemoteFilePath = remoteQDir.absoluteFilePath(newFilePath);
+			if(run.stagingDir.isEmpty() && run.storage->localDir().isEmpty()) {
+				pendingWrites.append({write.first, write.second, filePath, file.lastModified, file.size, QtConcurrent::run(run.storage->threadPool(), [this, &run, filePath, isChanged]{
+					return writeFile(run, filePath, isChanged);
+				})});
 
-			if(!QFile(remoteFilePath).rename(newRemoteFilePath)) {
-				emit logError(tr("Nepodařilo se vytvořit soubor historie '%1'").arg(newRemoteFilePath));
+				commitPendingWrites(4 * run.storage->maxRequestsInFlight());
 				continue;
 			}
 
-			global->db->execAssoc(
-						"INSERT INTO history (backupDirectory, remoteFilePath, originalFilePath, version) VALUES (:backupDirectory, :remoteFilePath, :originalFilePath, :version)",
-						{
-							{":version", currentTime},
-							{":backupDirectory", dirId},
-							{":originalFilePath", filePath},
-							{":remoteFilePath", newFilePath}
-						});
+			bool isStaged = false;
+			const bool isWritten = run.stagingDir.isEmpty() ? writeFile(run, filePath, isChanged) : stageFile(run, filePath, write.second, file.size, file.lastModified, isStaged);
+			commitWrite(run, write.second, filePath, file.lastModified, file.size, isWritten, isStaged);
 		}
+	}
 
-		auto backupToRemove = global->db->selectQueryAssoc(
-					"SELECT * FROM history WHERE (backupDirectory = :backupDirectory) AND (version < :version)",
-					{
-						{":version", currentTime - backupDirectory.value("keepHistoryDuration").toLongLong()},
-						{":backupDirectory", dirId}
-					});
+	if(fanOut) {
+		fanOut->waitForDone();
+		commitFanOutResults();
+	}
 
-		while(backupToRemove.next()) {
-			const QString filePath = backupToRemove.value("remoteFilePath").toString();
-			const QString remoteFilePath = remoteQDir.absoluteFilePath(filePath);
+	commitPendingWrites(0);
 
-			emit logInfo(tr("Mažu starou zálohu '%1'.").arg(remoteFilePath));
+	for(Destination &destination : destinations) {
+		if(destination.isActive)
+			commitUnchangedFileIds(*destination.run, updateLastCheckedStatement, destination.unchangedFileIds);
+	}
+
+	return result;
+}
+
+bool BackupManager::seedDirectory(const Run &run, const QDir &sourceQDir)
+{
+	using InsertFileStatement = DBStatement<std::tuple<>(qlonglong, QString, qlonglong, qlonglong)>;
+
+	const qlonglong dirId = run.dirId;
+	const qlonglong currentTime = run.currentTime;
+
+	const QString sourceDir = sourceQDir.path();
+
+	log(run, LogLevel::info, QT_TR_NOOP("Složka '%1' se zálohuje poprvé, provádím úvodní zálohu."), sourceDir);
 
-			global->db->execAssoc("DELETE FROM history WHERE id = :id", {{":id", backupToRemove.value("id")}});
+	InsertFileStatement insertFileStatement(db_, "INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (?, ?, ?, ?)");
 
-			if(!QFile(remoteFilePath).remove())
-				emit logError(tr("Nepodařilo se smazat starou zálohu '%1'!").arg(remoteFilePath));
+	// Indexes are built once after the bulk load instead of being updated with each inserted row, and the paths are registered by a single statement
+	// instead of a trigger per row; only if no scan running meanwhile needs them
+	const bool isIndexDropped = fileIndexLock_.tryLockForWrite();
+	if(isIndexDropped) {
+		DBSchema::dropFileIndexes(db_);
+		DBSchema::dropPathTriggers(db_);
+	}
+
+	// As many copies as the storage keeps in flight
+	QThreadPool copyPool;
+	copyPool.setMaxThreadCount(run.storage->maxRequestsInFlight());
+	copyPool.setExpiryTimeout(idleThreadExpiryMSecs);
+
+	// Bounds the number of files waiting for a copy thread
+	QSemaphore copySlots(copyPool.maxThreadCount() * 4);
+
+	// Files successfully copied by the pool and waiting to be inserted into the catalog
+	QMutex copiedFilesMutex;
+	QVector<InsertFileStatement::ParamTuple> copiedFiles;
 
-			remoteQDir.rmpath(filePath);
+	auto commitCopiedFiles = [&]{
+		QVector<InsertFileStatement::ParamTuple> batch;
+		{
+			QMutexLocker ml(&copiedFilesMutex);
+			batch.swap(copiedFiles);
 		}
 
-		global->db->execAssoc("UPDATE backupDirectories SET lastFinishedBackup = :lastFinishedBackup WHERE id = :id", {{":lastFinishedBackup", currentTime}, {":id", dirId}});
+		if(!batch.isEmpty()) {
+			RunStats::PhaseTimer commitTimer(run.stats, RunStats::Phase::dbCommit);
+			insertFileStatement.execBatch(batch);
+		}
+	};
+
+	QSet<QString> createdPaths;
+	size_t filesSeeded = 0;
+	bool isFinished = true;
 
-		emit logSuccess(tr("Zálohování složky '%1' dokončeno.").arg(sourceDir));
+	QDirIterator iter(sourceDir, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+	TraceSegments walkSegments("walk", "directory", "path");
+	while(true) {
+		if(isInterrupted_) {
+			isFinished = false;
+			break;
+		}
 
-		global->db->waitJobDone();
-		emit backupFinished();
+		QFileInfo fileInfo;
+		{
+			RunStats::PhaseTimer walkTimer(run.stats, RunStats::Phase::walk);
+			if(!iter.hasNext())
+				break;
+
+			iter.next();
+			fileInfo = iter.fileInfo();
+		}
+
+		walkSegments.update(fileInfo.path());
+
+		const QString filePath = sourceQDir.relativeFilePath(fileInfo.absoluteFilePath());
+
+		bool excluded;
+		{
+			RunStats::PhaseTimer excludeTimer(run.stats, RunStats::Phase::excludeMatching);
+			excluded = isExcluded(filePath, run.excludeRegexes);
+		}
+
+		if(excluded)
+			continue;
+
+		qlonglong lastModified;
+		qint64 size;
+		{
+			RunStats::PhaseTimer statTimer(run.stats, RunStats::Phase::stat);
+			lastModified = fileInfo.lastModified().toSecsSinceEpoch();
+			size = fileInfo.size();
+		}
+
+		const QString sourceFilePath = fileInfo.absoluteFilePath();
+		const QString remotePath = QFileInfo(filePath).path();
+
+		if(!createdPaths.contains(remotePath)) {
+			if( !run.storage->mkpath(remotePath) ) {
+				log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), run.storage->location(remotePath));
+				run.stats->addFile(RunStats::Outcome::failed);
+				continue;
+			}
+
+			createdPaths.insert(remotePath);
+		}
+
+		copySlots.acquire();
+		pendingCopies_ ++;
+		QtConcurrent::run(&copyPool, [=, &run, &copiedFilesMutex, &copiedFiles, &copySlots]{
+			// The destination was empty when seeding started, so there is nothing to collide with
+			if(copyFile(run, sourceFilePath, filePath, false)) {
+				run.stats->addFile(RunStats::Outcome::newFile, size);
+
+				QMutexLocker ml(&copiedFilesMutex);
+				copiedFiles.append(InsertFileStatement::ParamTuple(dirId, filePath, currentTime, lastModified));
+			}
+			else
+				run.stats->addFile(RunStats::Outcome::failed);
+
+			pendingCopies_ --;
+			copySlots.release();
+		});
+
+		filesSeeded ++;
+
+		if(filesSeeded % 4096 == 0) {
+			commitCopiedFiles();
+
+			if(!run.storage->isAvailable()) {
+				log(run, LogLevel::error, QT_TR_NOOP("Složka '%1' přestala být dostupná."), run.remoteDir);
+				break;
+			}
+		}
+
+		if(logSink_->msecsSinceLastLog() >= 10000)
+			log(run, LogLevel::info, QT_TR_NOOP("Úvodní záloha '%1'; zpracováno souborů: %2"), sourceDir, QString::number(filesSeeded));
+	}
+
+	copyPool.waitForDone();
+	commitCopiedFiles();
+
+	if(isIndexDropped) {
+		DBSchema::createFileIndexes(db_);
+		DBSchema::createPathTriggers(db_, dirId);
+		db_->waitJobDone();
+		fileIndexLock_.unlock();
+	}
+
+	return isFinished;
+}
+
+bool BackupManager::writeFile(const Run &run, const QString &filePath, bool isChanged)
+{
+	const QString sourceFilePath = QDir(run.sourceDir).absoluteFilePath(filePath);
+
+	if(!isChanged) {
+		const QString remotePath = QFileInfo(filePath).path();
+
+		if( !run.destinationCache->mkpath(remotePath) ) {
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), run.storage->location(remotePath));
+			return false;
+		}
+
+		return copyFile(run, sourceFilePath, filePath);
 	}
 
-	emit logInfo(tr("Kontrola záloh dokončena."));
+	// An interrupted run may have moved the old copy to the history already, only the partial new one is left
+	if(!run.destinationCache->exists(filePath))
+		return copyFile(run, sourceFilePath, filePath);
+
+	// On copy-on-write file systems the version is a clone of the old copy, which is then updated in place
+	if(run.canReflink && moveToHistory(run, filePath, true))
+		return updateFile(run, sourceFilePath, QDir(run.storage->localDir()).absoluteFilePath(filePath));
 
-	updateBackupCheckTimer();
+	// If the old copy could not be moved, copyFile handles it as a collision
+	moveToHistory(run, filePath);
+
+	return copyFile(run, sourceFilePath, filePath);
 }
 
-void BackupManager::updateBackupCheckTimer()
+bool BackupManager::prepareFanOutTarget(const Run &run, const QString &filePath, bool isChanged, bool &isUpdate)
 {
-	QVariant lastFinishedBackup = global->db->selectValueAssoc("SELECT MIN(IFNULL(lastFinishedBackup, 0) + backupInterval) FROM backupDirectories");
+	isUpdate = false;
+
+	if(!isChanged) {
+		const QString remotePath = QFileInfo(filePath).path();
+
+		if( !run.destinationCache->mkpath(remotePath) ) {
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), run.storage->location(remotePath));
+			return false;
+		}
+
+	} else if(run.destinationCache->exists(filePath)) {
+		// Missing if an interrupted run moved the old copy to the history already
+		if(run.canReflink && moveToHistory(run, filePath, true)) {
+			isUpdate = true;
+			return true;
+		}
 
-	if( lastFinishedBackup.isNull() ) {
-		backupCheckTimer_->stop();
-	} else {
-		int diff = qMax<qlonglong>(60 * 10, lastFinishedBackup.toLongLong() - QDateTime::currentSecsSinceEpoch());
-		backupCheckTimer_->setInterval(diff * 1000);
-		backupCheckTimer_->start();
+		moveToHistory(run, filePath);
 	}
+
+	return clearTarget(run, filePath);
 }
 
-bool BackupManager::copyFile(QString sourceFilePath, QString targetFilePath)
+bool BackupManager::clearTarget(const Run &run, const QString &filePath)
 {
-	if(QFile(targetFilePath).exists()) {
-		const QFileInfo origTargetFileInfo(targetFilePath);
-		const QString newFileName = QString("%1.orig.%2").arg( origTargetFileInfo.completeBaseName(), origTargetFileInfo.suffix());//targetFilePath + ".orig." + currentTimeFileSuffix_;
-		const QString newFilePath = origTargetFileInfo.dir().absoluteFilePath(newFileName);
+	StorageBackend &storage = *run.storage;
+	DestinationCache &destinationCache = *run.destinationCache;
+
+	// The version store keeps the mirror clean, the file that was in the way becomes a history version
+	if(run.historyLayout == VersionStore::Layout::versionStore && destinationCache.exists(filePath)) {
+		log(run, LogLevel::warning, QT_TR_NOOP("Soubor '%1' již existuje, stará verze bude přesunuta do historie."), storage.location(filePath));
+
+		if(!moveToHistory(run, filePath))
+			return false;
+	}
 
-		emit logWarning(tr("Soubor '%1' již existuje, stará verze bude přejmenována na '%2'.").arg(targetFilePath, newFileName));
+	if(destinationCache.exists(filePath)) {
+		const QFileInfo origTargetFileInfo(filePath);
+		const QString newFileName = QString("%1.orig.%2").arg( origTargetFileInfo.completeBaseName(), origTargetFileInfo.suffix());//targetFilePath + ".orig." + run.timeSuffix;
+		const QString newFilePath = origTargetFileInfo.path() == "." ? newFileName : origTargetFileInfo.path() + '/' + newFileName;
 
-		if(QFile(newFilePath).exists() && !QFile(newFilePath).remove()) {
-			emit logError(tr("Nepodařilo se smazat soubor '%1', který překážel záloze!").arg(newFilePath));
+		log(run, LogLevel::warning, QT_TR_NOOP("Soubor '%1' již existuje, stará verze bude přejmenována na '%2'."), storage.location(filePath), newFileName);
+
+		if(destinationCache.exists(newFilePath) && !storage.remove(newFilePath)) {
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se smazat soubor '%1', který překážel záloze!"), storage.location(newFilePath));
 			return false;
 		}
 
-		if(!QFile(targetFilePath).rename(newFilePath)) {
-			emit logError(tr("Nepodařilo se přejmenovat soubor '%1' na '%2', který překážel záloze!").arg(targetFilePath, newFileName));
+		if(!storage.rename(filePath, newFilePath)) {
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se přejmenovat soubor '%1' na '%2', který překážel záloze!"), storage.location(filePath), newFileName);
 			return false;
 		}
+
+		destinationCache.setAbsent(filePath);
+		destinationCache.setPresent(newFilePath);
+	}
+
+	return true;
+}
+
+bool BackupManager::copyFile(const Run &run, const QString &sourceFilePath, const QString &filePath, bool checkCollision)
+{
+	if(checkCollision && !clearTarget(run, filePath))
+		return false;
+
+	RunStats::PhaseTimer copyTimer(run.stats, RunStats::Phase::copy);
+	TraceSpan span("backup", "copyFile", "source", sourceFilePath);
+
+	// Remote storages take the file as a whole, large files in parts sent in parallel
+	if(run.storage->localDir().isEmpty()) {
+		const QString targetLocation = run.storage->location(filePath);
+		const qint64 fileSize = QFileInfo(sourceFilePath).size();
+
+		QElapsedTimer tmr;
+		tmr.start();
+
+		qint64 bytesCopied = 0;
+		const bool isCopied = run.storage->put(sourceFilePath, filePath, [&](qint64 bytes) {
+			bytesCopied += bytes;
+
+			if(tmr.elapsed() >= 10000) {
+				tmr.restart();
+				log(run, LogLevel::info, QT_TR_NOOP("%1%: Kopíruji '%2' -> '%3'"), QString::number(bytesCopied * 100 / qMax<qint64>(1, fileSize)).rightJustified(3), sourceFilePath, targetLocation);
+			}
+		});
+
+		if(isCopied)
+			run.destinationCache->setPresent(filePath);
+		else
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se zkopírovat soubor '%1' -> '%2'!"), sourceFilePath, targetLocation);
+
+		return isCopied;
 	}
 
+	const QString targetFilePath = QDir(run.storage->localDir()).absoluteFilePath(filePath);
+
 	/*bool result = QFile(sourceFilePath).copy(targetFilePath);
 	if( !result )
 		emit logError(tr("Nepodařilo se zkopírovat soubor '%1' -> '%2'!").arg(sourceFilePath, targetFilePath));*/
@@ -307,12 +1131,20 @@ bool BackupManager::copyFile(QString sourceFilePath, QString targetFilePath)
 		QFile tgt(targetFilePath);
 
 		if(!src.open(QIODevice::ReadOnly)) {
-			emit logError(tr("Nepodařilo se otevřít soubor '%1' pro čtení!").arg(sourceFilePath));
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se otevřít soubor '%1' pro čtení!"), sourceFilePath);
 			return false;
 		}
 
+		if(src.size() >= ResumableCopy::minFileSize) {
+			const bool isCopied = copyFileResumable(run, src, targetFilePath);
+			if(isCopied)
+				run.destinationCache->setPresent(filePath);
+
+			return isCopied;
+		}
+
 		if(!tgt.open(QIODevice::WriteOnly)) {
-			emit logError(tr("Nepodařilo se otevřít soubor '%1' pro zápis!").arg(targetFilePath));
+			log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se otevřít soubor '%1' pro zápis!"), targetFilePath);
 			return false;
 		}
 
@@ -329,14 +1161,14 @@ bool BackupManager::copyFile(QString sourceFilePath, QString targetFilePath)
 			qint64 bytesRead = src.read(buffer.data(), qMin(bytesRemaining, (qint64) buffer.size()));
 
 			if(bytesRead <= 0) {
-				emit logError(tr("Chyba při čtení ze souboru '%1'!").arg(sourceFilePath));
+				log(run, LogLevel::error, QT_TR_NOOP("Chyba při čtení ze souboru '%1'!"), sourceFilePath);
 				tgt.remove();
 				return false;
 			}
 
 			qint64 bytesWritten = tgt.write(buffer.data(), bytesRead);
 			if(bytesWritten != bytesRead) {
-				emit logError(tr("Chyba při zápisu do souboru '%1'!").arg(targetFilePath));
+				log(run, LogLevel::error, QT_TR_NOOP("Chyba při zápisu do souboru '%1'!"), targetFilePath);
 				tgt.remove();
 				return false;
 			}
@@ -345,36 +1177,521 @@ bool BackupManager::copyFile(QString sourceFilePath, QString targetFilePath)
 
 			if(tmr.elapsed() >= 10000) {
 				tmr.restart();
-				emit logInfo(tr("%1%: Kopíruji '%2' -> '%3'").arg(100 - bytesRemaining*100/fileSize, 3).arg(sourceFilePath, targetFilePath));
+				log(run, LogLevel::info, QT_TR_NOOP("%1%: Kopíruji '%2' -> '%3'"), QString::number(100 - bytesRemaining*100/fileSize).rightJustified(3), sourceFilePath, targetFilePath);
 			}
 		}
 	}
 
+	run.destinationCache->setPresent(filePath);
 	return true;
 	//return result;
 }
 
-void BackupManager::commitUnchangedFileIds(const qlonglong &currentTime, QVector<qlonglong> &unchangedFileIds)
+bool BackupManager::copyFileResumable(const Run &run, QFile &source, const QString &targetFilePath)
 {
-	global->db->customQueryOperation([&](QSqlDatabase &db){
-		QSqlQuery q(db);
-		q.prepare("UPDATE files SET lastChecked = :lastChecked WHERE id = :id");
-		q.bindValue(":lastChecked", currentTime);
+	const QString sourceFilePath = source.fileName();
+	const qint64 fileSize = source.size();
 
-		db.transaction();
+	ResumableCopy resumableCopy(db_, run.dirId, run.remoteDir, QDir(run.remoteDir).relativeFilePath(targetFilePath));
 
-		for(qlonglong id : unchangedFileIds) {
-			q.bindValue(":id", id);
-			q.exec();
+	QElapsedTimer tmr;
+	tmr.start();
+
+	qint64 bytesCopied = 0;
+	const ResumableCopy::Result result = resumableCopy.copy(source, QFileInfo(source).lastModified().toSecsSinceEpoch(), isInterrupted_, [&](qint64 bytes) {
+		bytesCopied += bytes;
+
+		if(tmr.elapsed() >= 10000) {
+			tmr.restart();
+			log(run, LogLevel::info, QT_TR_NOOP("%1%: Kopíruji '%2' -> '%3'"), QString::number((resumableCopy.bytesResumed() + bytesCopied) * 100 / fileSize).rightJustified(3), sourceFilePath, targetFilePath);
+		}
+	});
+
+	if(resumableCopy.bytesResumed())
+		log(run, LogLevel::info, QT_TR_NOOP("Kopírování '%1' navázalo na přerušený přenos, přeskočeno %2 MB."), sourceFilePath, QString::number(resumableCopy.bytesResumed() / (1024 * 1024)));
+
+	switch(result) {
+		case ResumableCopy::Result::finished:
+			return true;
+
+		case ResumableCopy::Result::interrupted:
+			log(run, LogLevel::warning, QT_TR_NOOP("Kopírování '%1' přerušeno, bude dokončeno při příští záloze."), sourceFilePath);
+			return false;
+
+		case ResumableCopy::Result::readError:
+			log(run, LogLevel::error, QT_TR_NOOP("Chyba při čtení ze souboru '%1'!"), sourceFilePath);
+			return false;
+
+		case ResumableCopy::Result::writeError:
+			log(run, LogLevel::error, QT_TR_NOOP("Chyba při zápisu do souboru '%1', kopírování bude dokončeno při příští záloze."), resumableCopy.partialFilePath());
+			return false;
+	}
+
+	return false;
+}
+
+bool BackupManager::moveToHistory(const Run &run, const QString &filePath, bool isClone)
+{
+	RunStats::PhaseTimer renameTimer(run.stats, RunStats::Phase::historyRename);
+
+	StorageBackend &storage = *run.storage;
+	DestinationCache &destinationCache = *run.destinationCache;
+
+	// Clones are made only in local backup directories (canReflink)
+	auto createVersion = [&](const QString &versionPath) {
+		if(isClone) {
+			const QDir localQDir(storage.localDir());
+			if(!FileCopy::cloneFile(localQDir.absoluteFilePath(filePath), localQDir.absoluteFilePath(versionPath)))
+				return false;
+
+			destinationCache.setPresent(versionPath);
+			return true;
+		}
+
+		if(storage.rename(filePath, versionPath)) {
+			destinationCache.setAbsent(filePath);
+			destinationCache.setPresent(versionPath);
+			return true;
 		}
 
-		db.commit();
+		log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit soubor historie '%1'"), storage.location(versionPath));
+		return false;
+	};
+
+	if(run.historyLayout == VersionStore::Layout::besideOriginals) {
+		const QString versionPath = VersionStore::besideOriginalPath(filePath, run.timeSuffix);
+
+		if(!createVersion(versionPath))
+			return false;
+
+		db_->exec("INSERT INTO history (backupDirectory, remoteFilePath, originalFilePath, version) VALUES (?, ?, ?, ?)", {run.dirId, versionPath, filePath, run.currentTime});
+		return true;
+	}
+
+	// The store addresses the version by its history id, so the record is created first and removed again if the file cannot be moved
+	const qlonglong historyId = db_->insert("INSERT INTO history (backupDirectory, originalFilePath, version) VALUES (?, ?, ?)", {run.dirId, filePath, run.currentTime}).toLongLong();
+	const QString versionPath = VersionStore::versionPath(historyId, QFileInfo(filePath).suffix());
+	const QString versionDirPath = QFileInfo(versionPath).path();
+
+	const bool isPathCreated = destinationCache.mkpath(versionDirPath);
+	if(!isPathCreated)
+		log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), storage.location(versionDirPath));
+
+	if(!isPathCreated || !createVersion(versionPath)) {
+		db_->exec("DELETE FROM history WHERE id = ?", {historyId});
+		return false;
+	}
+
+	db_->exec("UPDATE history SET remoteFilePath = ? WHERE id = ?", {versionPath, historyId});
+	return true;
+}
+
+bool BackupManager::updateFile(const Run &run, const QString &sourceFilePath, const QString &targetFilePath)
+{
+	RunStats::PhaseTimer copyTimer(run.stats, RunStats::Phase::copy);
+	TraceSpan span("backup", "updateFile", "source", sourceFilePath);
+
+	QFile src(sourceFilePath);
+	QFile tgt(targetFilePath);
+
+	if(!src.open(QIODevice::ReadOnly)) {
+		log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se otevřít soubor '%1' pro čtení!"), sourceFilePath);
+		return false;
+	}
+
+	if(!tgt.open(QIODevice::ReadWrite)) {
+		log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se otevřít soubor '%1' pro zápis!"), targetFilePath);
+		return false;
+	}
+
+	const qint64 previousSize = tgt.size();
+	qint64 bytesWritten;
+
+	// A half updated copy is neither the old nor the new version; the next run copies the file again
+	if(!FileCopy::updateChangedBlocks(src, tgt, bytesWritten)) {
+		log(run, LogLevel::error, QT_TR_NOOP("Chyba při zápisu do souboru '%1'!"), targetFilePath);
+		tgt.remove();
+		return false;
+	}
+
+	// The blocks not rewritten within the old size stay shared with the version (approximately, the file system may reallocate more)
+	run.stats->addReflink(qMax<qint64>(0, src.size() - bytesWritten), qMax<qint64>(0, qMin(previousSize, src.size()) - bytesWritten));
+	return true;
+}
+
+bool BackupManager::stageFile(const Run &run, const QString &filePath, qlonglong fileId, qint64 size, qlonglong lastModified, bool &isStaged)
+{
+	const bool isChanged = fileId != -1;
+	isStaged = false;
+
+	// The catalog keeps the version at the destination until the drain, so a change that waits in the stage is seen again by the next run
+	if(isChanged && db_->selectValue(
+				"SELECT COUNT(*) FROM stagedFiles WHERE (backupDirectory = ?) AND (state = ?) AND (filePath = ?) AND (lastModified = ?)",
+				{run.dirId, int(StageState::staged), filePath, lastModified}).toLongLong()) {
+		db_->exec("UPDATE files SET lastChecked = ? WHERE id = ?", {run.currentTime, fileId});
+		isStaged = true;
+		return true;
+	}
+
+	bool isWaitLogged = false;
+
+	{
+		QMutexLocker ml(&drainMutex_);
+		loadStageUsage(run.dirId);
+
+		while(true) {
+			StageUsage &usage = stageUsage_[run.dirId];
+
+			const QStorageInfo storage(run.stagingDir);
+			const bool hasFreeSpace = !storage.isValid() || storage.bytesAvailable() - size >= stagingMinFreeBytes;
+
+			// Reserved for the capture, corrected to the size of the copy once it is staged
+			if(usage.byteCount + size <= run.stagingLimit && hasFreeSpace) {
+				usage.fileCount ++;
+				usage.byteCount += size;
+				break;
+			}
+
+			// Does not fit even into the empty stage -> written directly, once there is no staged change it could overtake
+			if(!usage.fileCount) {
+				ml.unlock();
+				return writeFile(run, filePath, isChanged);
+			}
+
+			if(!isWaitLogged) {
+				log(run, LogLevel::warning, QT_TR_NOOP("Přípravná oblast '%1' je plná, čekám na přenos do '%2'..."), run.stagingDir, run.remoteDir);
+				isWaitLogged = true;
+			}
+
+			const quint64 releaseCount = usage.releaseCount;
+
+			ml.unlock();
+			requestDrain(run.dirId);
+
+			if(isInterrupted_ || !run.destinationCache->isAvailable())
+				return false;
+
+			ml.relock();
+
+			// Woken by the drain as it frees the stage
+			if(stageUsage_[run.dirId].releaseCount == releaseCount)
+				stageReleased_.wait(&drainMutex_, stageWaitMSecs);
+		}
+	}
+
+	RunStats::PhaseTimer copyTimer(run.stats, RunStats::Phase::copy);
+
+	const QString sourceFilePath = QDir(run.sourceDir).absoluteFilePath(filePath);
+
+	// The copy is named by the id, so the record is created first (as capturing, which the drain skips)
+	const qlonglong stagedId = db_->insert(
+				"INSERT INTO stagedFiles (backupDirectory, filePath, size, runTime, state, lastModified) VALUES (?, ?, ?, ?, ?, ?)",
+				{run.dirId, filePath, size, run.currentTime, int(StageState::capturing), lastModified}).toLongLong();
+
+	const QString stagedFilePath = QDir(stageDirPath(run.stagingDir, run.dirId)).absoluteFilePath(QString::number(stagedId));
+	db_->exec("UPDATE stagedFiles SET stagedPath = ? WHERE id = ?", {stagedFilePath, stagedId});
+
+	QFile source(sourceFilePath);
+	QFile target(stagedFilePath);
+
+	auto discardCapture = [&]{
+		QMutexLocker ml(&drainMutex_);
+		db_->exec("DELETE FROM stagedFiles WHERE id = ?", {stagedId});
+		addStageUsage(run.dirId, -1, -size);
+	};
+
+	if(!source.open(QIODevice::ReadOnly)) {
+		log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se otevřít soubor '%1' pro čtení!"), sourceFilePath);
+		discardCapture();
+		return false;
+	}
+
+	if(!target.open(QIODevice::WriteOnly) || !FileCopy::copyData(source, target)) {
+		log(run, LogLevel::error, QT_TR_NOOP("Chyba při zápisu do souboru '%1'!"), stagedFilePath);
+		target.remove();
+		discardCapture();
+		return false;
+	}
+
+	// Queued before the capture is released to the drain, which then sets remoteVersion of the record; a new file has none until then
+	if(isChanged)
+		db_->exec("UPDATE files SET lastChecked = ? WHERE id = ?", {run.currentTime, fileId});
+	else
+		db_->exec("INSERT INTO files (backupDirectory, filePath, lastChecked, remoteVersion) VALUES (?, ?, ?, NULL)", {run.dirId, filePath, run.currentTime});
+
+	isStaged = true;
+
+	{
+		QMutexLocker ml(&drainMutex_);
+		db_->exec("UPDATE stagedFiles SET state = ?, size = ? WHERE id = ?", {int(StageState::staged), target.size(), stagedId});
+		addStageUsage(run.dirId, 0, target.size() - size);
+	}
+
+	requestDrain(run.dirId);
+
+	return true;
+}
+
+void BackupManager::loadStageUsage(qlonglong dirId)
+{
+	if(stageUsage_.contains(dirId))
+		return;
+
+	const QSqlRecord stage = db_->selectRowDef(
+				"SELECT COUNT(*), IFNULL(SUM(size), 0) FROM stagedFiles WHERE (backupDirectory = ?) AND (state IN (?, ?))",
+				{dirId, int(StageState::capturing), int(StageState::staged)});
+
+	stageUsage_.insert(dirId, {stage.value(0).toLongLong(), stage.value(1).toLongLong(), 0});
+}
+
+void BackupManager::addStageUsage(qlonglong dirId, qint64 fileCount, qint64 byteCount)
+{
+	auto usage = stageUsage_.find(dirId);
+	if(usage == stageUsage_.end())
+		return;
+
+	usage->fileCount += fileCount;
+	usage->byteCount += byteCount;
+
+	if(fileCount < 0 || byteCount < 0) {
+		usage->releaseCount ++;
+		stageReleased_.wakeAll();
+	}
+}
+
+void BackupManager::stageRemoval(const Run &run, const QString &filePath)
+{
+	QMutexLocker ml(&drainMutex_);
+	db_->exec("INSERT INTO stagedFiles (backupDirectory, filePath, size, runTime, state) VALUES (?, ?, 0, ?, ?)", {run.dirId, filePath, run.currentTime, int(StageState::staged)});
+	addStageUsage(run.dirId, 1, 0);
+}
+
+void BackupManager::requestDrain(qlonglong dirId)
+{
+	QMutexLocker ml(&drainMutex_);
+
+	// A running drain checks the requests before it ends
+	drainRequestDirIds_.insert(dirId);
+	if(drainingDirIds_.contains(dirId))
+		return;
+
+	drainingDirIds_.insert(dirId);
+	drainingCount_ ++;
+
+	QtConcurrent::run(&drainPool_, [this, dirId]{
+		drainStage(dirId);
 	});
+}
 
-	unchangedFileIds.clear();
+void BackupManager::waitForDrain(qlonglong dirId)
+{
+	requestDrain(dirId);
+
+	QMutexLocker ml(&drainMutex_);
+	while(drainingDirIds_.contains(dirId))
+		drainFinished_.wait(&drainMutex_);
+}
+
+void BackupManager::drainStage(qlonglong dirId)
+{
+	while(true) {
+		{
+			QMutexLocker ml(&drainMutex_);
+
+			if(!drainRequestDirIds_.remove(dirId) || isInterrupted_) {
+				drainingDirIds_.remove(dirId);
+				drainingCount_ --;
+				drainFinished_.wakeAll();
+
+				// Captures waiting for space request a drain that stopped again
+				stageReleased_.wakeAll();
+				return;
+			}
+		}
+
+		drainStagedFiles(dirId);
+	}
+}
+
+void BackupManager::drainStagedFiles(qlonglong dirId)
+{
+	const QSqlRecord backupDirectory = db_->selectRowDef("SELECT sourceDir, remoteDir, historyLayout FROM backupDirectories WHERE id = ?", {dirId});
+
+	// Deleted meanwhile
+	if(backupDirectory.isEmpty())
+		return;
+
+	Run run;
+	run.dirId = dirId;
+	run.sourceDir = backupDirectory.value("sourceDir").toString();
+	run.remoteDir = backupDirectory.value("remoteDir").toString();
+	run.isSeed = false;
+	run.historyLayout = VersionStore::layout(backupDirectory.value("historyLayout"));
+	run.canReflink = false;
+	run.storage = StorageBackend::create(run.remoteDir);
+	run.stats = nullptr;
+	run.destinationCache = std::make_shared<DestinationCache>(*run.storage, nullptr);
+
+	// Retried by the next check for backups
+	if(!run.storage->isAvailable())
+		return;
+
+	int drainedCount = 0;
+
+	while(!isInterrupted_) {
+		const QSqlRecord staged = db_->selectRowDef(
+					"SELECT id, filePath, stagedPath, runTime, size, lastModified FROM stagedFiles WHERE (backupDirectory = ?) AND (state = ?) ORDER BY id LIMIT 1",
+					{dirId, int(StageState::staged)});
+
+		if(staged.isEmpty())
+			break;
+
+		// The history versions get the time of the run that captured the change
+		run.currentTime = staged.value("runTime").toLongLong();
+		run.timeSuffix = QDateTime::fromSecsSinceEpoch(run.currentTime).toString("yyyyMMddhhmmss");
+
+		if(!drainStagedFile(run, staged.value("filePath").toString(), staged.value("stagedPath").toString())) {
+			log(run, LogLevel::warning, QT_TR_NOOP("Přenos z přípravné oblasti do '%1' přerušen, bude zopakován později."), run.remoteDir);
+			break;
+		}
+
+		{
+			QMutexLocker ml(&drainMutex_);
+
+			// The copy is at the destination now; removals and the changes captured before the column existed have no version to commit
+			if(!staged.value("lastModified").isNull())
+				db_->exec("UPDATE files SET remoteVersion = ? WHERE (backupDirectory = ?) AND (filePath = ?)", {staged.value("lastModified"), dirId, staged.value("filePath")});
+
+			db_->exec("UPDATE stagedFiles SET state = ?, drainedAt = ? WHERE id = ?", {int(StageState::drained), QDateTime::currentSecsSinceEpoch(), staged.value("id")});
+			addStageUsage(dirId, -1, -staged.value("size").toLongLong());
+		}
+
+		drainedCount ++;
+
+		if(logSink_->msecsSinceLastLog() >= 10000)
+			log(run, LogLevel::info, QT_TR_NOOP("Přenáším změny z přípravné oblasti do '%1'; přeneseno souborů: %2"), run.remoteDir, QString::number(drainedCount));
+	}
+
+	if(drainedCount)
+		log(run, LogLevel::info, QT_TR_NOOP("Z přípravné oblasti přeneseno do '%1' souborů: %2."), run.remoteDir, QString::number(drainedCount));
+}
+
+bool BackupManager::drainStagedFile(const Run &run, const QString &filePath, const QString &stagedFilePath)
+{
+	// The copy was lost from the stage (cleaned up by hand) -> the next run backs the file up again
+	if(!stagedFilePath.isEmpty() && !QFile::exists(stagedFilePath)) {
+		log(run, LogLevel::error, QT_TR_NOOP("Kopie souboru '%1' v přípravné oblasti chybí, soubor bude zálohován znovu."), filePath);
+		db_->exec("DELETE FROM files WHERE (backupDirectory = ?) AND (filePath = ?)", {run.dirId, filePath});
+		return true;
+	}
+
+	// The current copy becomes a history version; a retry after a failed copy finds it moved already
+	if(run.destinationCache->exists(filePath) && !moveToHistory(run, filePath))
+		return false;
+
+	// Removal of the file
+	if(stagedFilePath.isEmpty())
+		return true;
+
+	const QString remotePath = QFileInfo(filePath).path();
+	if( !run.destinationCache->mkpath(remotePath) ) {
+		log(run, LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), run.storage->location(remotePath));
+		return false;
+	}
+
+	if(!copyFile(run, stagedFilePath, filePath))
+		return false;
+
+	QFile::remove(stagedFilePath);
+	return true;
 }
 
-void BackupManager::updateLastLogTime()
+QString BackupManager::stageDirPath(const QString &stagingDir, qlonglong dirId)
 {
-	lastLogTime_ = QDateTime::currentDateTime();
+	return QDir(stagingDir).absoluteFilePath(QString::number(dirId));
+}
+
+QString BackupManager::lockFilePath()
+{
+	return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).absoluteFilePath("backup.lock");
+}
+
+void BackupManager::migrateHistory(const Run &run)
+{
+	StorageBackend &storage = *run.storage;
+
+	// Versions created before the switch; older catalogs store absolute paths, so the store prefix is checked on the relative path.
+	// The query scans the history of the directory once per run, which is small next to the walk of the source.
+	DBQuery version = db_->selectQuery(
+				"SELECT id, remoteFilePath FROM history WHERE (backupDirectory = ?) AND (remoteFilePath NOT LIKE ?)",
+				{run.dirId, VersionStore::dirName() + "/%"});
+
+	int migratedCount = 0, failedCount = 0;
+
+	while(version.next()) {
+		if(isInterrupted_)
+			break;
+
+		const QString storedPath = version.value(1).toString();
+		const QString filePath = QDir::isAbsolutePath(storedPath) ? QDir(run.remoteDir).relativeFilePath(storedPath) : storedPath;
+		if(VersionStore::isInStore(filePath))
+			continue;
+
+		const qlonglong historyId = version.value(0).toLongLong();
+		const QString versionPath = VersionStore::versionPath(historyId, QFileInfo(filePath).suffix());
+
+		if(!run.destinationCache->mkpath(QFileInfo(versionPath).path()) || !storage.rename(filePath, versionPath)) {
+			failedCount ++;
+			continue;
+		}
+
+		db_->exec("UPDATE history SET remoteFilePath = ? WHERE id = ?", {versionPath, historyId});
+		migratedCount ++;
+
+		if(logSink_->msecsSinceLastLog() >= 10000)
+			log(run, LogLevel::info, QT_TR_NOOP("Přesouvám historii do úložiště verzí; přesunuto souborů: %1"), QString::number(migratedCount));
+	}
+
+	if(migratedCount)
+		log(run, LogLevel::info, QT_TR_NOOP("Do úložiště verzí přesunuto %1 souborů historie."), QString::number(migratedCount));
+
+	if(failedCount)
+		log(run, LogLevel::warning, QT_TR_NOOP("%1 souborů historie se nepodařilo přesunout do úložiště verzí, zůstávají na původním místě."), QString::number(failedCount));
+}
+
+bool BackupManager::isExcluded(const QString &filePath, const QVector<QRegExp> &excludeRegexes)
+{
+	for(const QRegExp &regex : excludeRegexes) {
+		if(regex.exactMatch(filePath))
+			return true;
+	}
+
+	return false;
+}
+
+void BackupManager::storeCheckpoint(const Run &run, const QString &processedFilePath, UpdateLastCheckedStatement &updateLastCheckedStatement, QVector<qlonglong> &unchangedFileIds)
+{
+	commitUnchangedFileIds(run, updateLastCheckedStatement, unchangedFileIds);
+
+	if(processedFilePath.isEmpty())
+		return;
+
+	// Queued after the catalog updates it covers, so it never gets ahead of them
+	db_->exec("INSERT OR REPLACE INTO runCheckpoints (backupDirectory, runTime, cursor, updated) VALUES (?, ?, ?, ?)",
+			  {run.dirId, run.currentTime, processedFilePath, QDateTime::currentSecsSinceEpoch()});
+}
+
+void BackupManager::commitUnchangedFileIds(const Run &run, UpdateLastCheckedStatement &updateLastCheckedStatement, QVector<qlonglong> &unchangedFileIds)
+{
+	RunStats::PhaseTimer commitTimer(run.stats, RunStats::Phase::dbCommit);
+
+	QVector<std::tuple<qlonglong, qlonglong>> batch;
+	batch.reserve(unchangedFileIds.size());
+
+	for(qlonglong id : unchangedFileIds)
+		batch.append(std::make_tuple(run.currentTime, id));
+
+	updateLastCheckedStatement.execBatch(batch);
+
+	unchangedFileIds.clear();
 }
@@ -1,44 +1,331 @@
 #ifndef BACKUPMANAGER_H
 #define BACKUPMANAGER_H
 
+#include <tuple>
+#include <atomic>
+#include <memory>
+
 #include <QObject>
 #include <QTimer>
 #include <QThread>
 #include <QDateTime>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegExp>
+#include <QVector>
+#include <QThreadPool>
+#include <QReadWriteLock>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSet>
+#include <QHash>
+
+#include "threaddb/dbfuture.h"
+#include "job/logsink.h"
+#include "job/runstats.h"
+#include "job/backupscheduler.h"
+#include "job/versionstore.h"
+#include "job/storagebackend.h"
+#include "job/destinationcache.h"
+
+class DBManager;
 
+template<typename Signature>
+class DBStatement;
+
+/// Backs up the directories when they are due. Scheduling runs on the manager's own thread, the directories are backed up on a thread pool, up to maxConcurrentRuns at once.
 class BackupManager : public QObject
 {
 	Q_OBJECT
 
 public:
-	BackupManager();
+	BackupManager(DBManager *db, LogSink *logSink);
 	~BackupManager();
 
 signals:
-	void logInfo(QString text);
-	void logWarning(QString text);
-	void logError(QString text);
-	void logSuccess(QString text);
 	void backupFinished();
 
+	/// All due directories were backed up and the memory used by the run was released
+	void idle();
+
 public slots:
+	/// Reloads the directories into the scheduler and starts the due backups
 	void checkForBackups();
-	void updateBackupCheckTimer();
+
+public:
+	/// Counters accumulated over all runs since the start of the program; thread safe
+	const RunStats &totals() const {
+		return totals_;
+	}
+
+	/// Thread safe
+	bool isBackupRunning() const {
+		return runningCount_.load(std::memory_order_relaxed) > 0;
+	}
+
+	/// Number of files queued for or being copied by the seeding copy threads; thread safe
+	int pendingCopyCount() const {
+		return pendingCopies_.load(std::memory_order_relaxed);
+	}
+
+	/// Resident memory of the process measured when it last became idle (-1 before the first check or if not available); thread safe
+	qint64 idleResidentBytes() const {
+		return idleResidentBytes_.load(std::memory_order_relaxed);
+	}
+
+	/// Number of directories whose staged changes are being drained to the destination; thread safe
+	int drainingCount() const {
+		return drainingCount_.load(std::memory_order_relaxed);
+	}
+
+	/// Time of the next backup of each directory as scheduled (with the jitter, the time window and the failure backoff);
+	/// the directories being backed up are left out. Thread safe.
+	QHash<qlonglong, qlonglong> nextBackupTimes() const;
+
+public:
+	/// State of a change captured in a stage (stagedFiles.state)
+	enum class StageState {
+		/// Being copied into the stage, discarded if the program ends meanwhile
+		capturing = 0,
+
+		/// Waiting to be drained to the destination
+		staged = 1,
+
+		drained = 2
+	};
+
+	/// Directory of the stage of a backup directory with the captured copies
+	static QString stageDirPath(const QString &stagingDir, qlonglong dirId);
+
+	/// Lock file beside the database; the process running a BackupManager (the GUI or straw-backupd) holds it, so that two of them never back up the same directories
+	static QString lockFilePath();
+
+public:
+	/// Default of the maxConcurrentRuns setting
+	static const int defaultMaxConcurrentRuns = 2;
+
+	/// Default of backupDirectories.stagingLimit
+	static const qint64 defaultStagingLimit = qint64(10) * 1024 * 1024 * 1024;
+
+	/// Free space a stage leaves on its disk
+	static const qint64 stagingMinFreeBytes = 512 * 1024 * 1024;
+
+	/// A capture waiting for space in a full stage requests the drain again after this long, in case it stopped at an unavailable destination
+	static const int stageWaitMSecs = 5000;
+
+	/// How often a scan stores its checkpoint
+	static const int checkpointMSecs = 30000;
+
+	/// Idle threads of the run, drain and copy pools end after this long (Qt keeps them for 30 s), so the memory measured once idle does not include their stacks
+	static const int idleThreadExpiryMSecs = 1000;
 
 private:
-	bool copyFile(QString sourceFilePath, QString targetFilePath);
-	void commitUnchangedFileIds(const qlonglong &currentTime, QVector<qlonglong> &unchangedFileIds);
+	/// (id, remoteVersion) of a file in the catalog by (backupDirectory, filePath)
+	using FindFileStatement = DBStatement<std::tuple<qlonglong, qlonglong>(qlonglong, QString)>;
+
+	/// Sets lastChecked (first parameter) of the file with the id (second parameter)
+	using UpdateLastCheckedStatement = DBStatement<std::tuple<>(qlonglong, qlonglong)>;
+
+	/// File found by the directory walk whose database records are being looked up
+	struct PendingFile {
+		QFileInfo fileInfo;
+		QString filePath;
+		qlonglong lastModified;
+		qint64 size;
+
+		/// Indexes of the scanned runs the file belongs to (not excluded, not processed before a checkpoint) and the lookups in their catalogs
+		QVector<int> targets;
+		QVector<DBFuture<std::tuple<qlonglong, qlonglong>>> records;
+	};
+
+	/// State of a backup of one directory; several runs can be in progress at once
+	struct Run {
+		qlonglong dirId;
+		QString sourceDir;
+		QString remoteDir;
+		QVector<QRegExp> excludeRegexes;
+		qlonglong keepHistoryDuration;
+
+		/// First backup into an empty destination
+		bool isSeed;
 
-private slots:
-	void updateLastLogTime();
+		/// When the run started; currentTime is older if the run continues an interrupted one
+		qlonglong startTime;
+		qlonglong currentTime;
+
+		/// Suffix of the history file names beside the originals
+		QString timeSuffix;
+		VersionStore::Layout historyLayout;
+
+		/// The backup directory supports reflinks, history versions of changed files are made as clones
+		bool canReflink;
+
+		/// Last file processed by the interrupted run this run continues (currentTime is then the time of that run), empty when starting from the root
+		QString resumeAfter;
+
+		/// New and changed files are captured in the stage and drained to remoteDir in the background; empty if written directly
+		QString stagingDir;
+		qint64 stagingLimit;
+
+		/// Storage of remoteDir, the files of the backup directory are accessed through it
+		std::shared_ptr<StorageBackend> storage;
+
+		/// Created with the stats of the run; the checks of the destination go through it
+		std::shared_ptr<DestinationCache> destinationCache;
+
+		RunStats *stats;
+	};
+
+private:
+	/// Starts backups of the due directories on the run pool as long as there are free run slots, arms the timer for the next deadline
+	void dispatchDueRuns();
+	void onRunFinished(const QVector<qlonglong> &dirIds, const QVector<qlonglong> &failedDirIds);
+
+	/// Backs up the directories of one source, called on the run pool; the source is walked and read once for all of them.
+	/// Returns the directories that failed to be backed up (they are retried after a backoff).
+	QVector<qlonglong> backupDirectories(const QVector<qlonglong> &dirIds);
+
+	enum class Preparation {
+		ready,
+		deleted,
+		failed
+	};
+
+	/// Loads the directory into run and checks that its source and destination are available
+	Preparation prepareRun(qlonglong dirId, Run &run);
+
+	/// Regular backup pass: walks the source shared by the runs once and compares it to the catalog of each of them.
+	/// Returns for each run whether it finished (not if interrupted or if its destination became unavailable).
+	QVector<bool> scanDirectory(const QVector<const Run *> &runs, const QDir &sourceQDir);
+
+	/// First backup into an empty destination: copies in parallel without catalog lookups and bulk-loads the catalog; returns false if interrupted
+	bool seedDirectory(const Run &run, const QDir &sourceQDir);
+
+	/// Handles the files removed from the source, prunes the old versions and records the finished backup
+	void finishRun(const Run &run);
+
+	static bool isExcluded(const QString &filePath, const QVector<QRegExp> &excludeRegexes);
+
+	/// Commits the pending catalog updates and stores the point the scan can be continued from after an interruption or a crash
+	void storeCheckpoint(const Run &run, const QString &processedFilePath, UpdateLastCheckedStatement &updateLastCheckedStatement, QVector<qlonglong> &unchangedFileIds);
+
+private:
+	/// Queues a message to the log sink; the format (marked with QT_TR_NOOP) is translated in the BackupManager context once displayed. Thread safe.
+	template<typename... Args>
+	void log(LogLevel level, const char *format, const Args &...args) {
+		logSink_->log(level, QString(), staticMetaObject.className(), format, args...);
+	}
+
+	/// Same as above, the message is tagged with the directory being backed up
+	template<typename... Args>
+	void log(const Run &run, LogLevel level, const char *format, const Args &...args) {
+		logSink_->log(level, run.sourceDir, staticMetaObject.className(), format, args...);
+	}
+
+	/// Copies a new file (relative to the directories of the run) to the backup directory, or a changed one after moving its current copy to the history
+	bool writeFile(const Run &run, const QString &filePath, bool isChanged);
+
+	/// Same as writeFile, except that the data is then written by a FanOutCopy; isUpdate is set if the current copy stays in place to be updated
+	bool prepareFanOutTarget(const Run &run, const QString &filePath, bool isChanged, bool &isUpdate);
+
+	/// Moves an existing file (relative to the backup directory) out of the way: to the history in the version store layout, otherwise it is renamed to .orig
+	bool clearTarget(const Run &run, const QString &filePath);
+
+	/// Copies a local file to filePath in the backup directory; thread safe. checkCollision moves an existing file out of the way.
+	bool copyFile(const Run &run, const QString &sourceFilePath, const QString &filePath, bool checkCollision = true);
+
+	/// Copies a large file through a partial file that a later run continues if the copy is interrupted; source is opened
+	bool copyFileResumable(const Run &run, QFile &source, const QString &targetFilePath);
+
+	/// Moves the current copy of filePath (relative to the backup directory) to the history as the version replaced by this run; thread safe.
+	/// isClone keeps the current copy in place and makes the version a reflink of it; returns false without logging if the clone fails.
+	bool moveToHistory(const Run &run, const QString &filePath, bool isClone = false);
+
+	/// Rewrites the blocks of targetFilePath (in a local backup directory) that differ from sourceFilePath, keeping the rest shared with a reflinked history version
+	bool updateFile(const Run &run, const QString &sourceFilePath, const QString &targetFilePath);
+
+	/// Copies a new or changed file into the stage of the run once there is space; a file that does not fit into the empty stage is written directly.
+	/// isStaged is set if the file went to the stage; its catalog record (fileId, -1 for a new file) is then updated here, except remoteVersion, which the drain sets.
+	bool stageFile(const Run &run, const QString &filePath, qlonglong fileId, qint64 size, qlonglong lastModified, bool &isStaged);
+
+	/// Loads the usage of the stage of the directory unless it is kept already; drainMutex_ is locked
+	void loadStageUsage(qlonglong dirId);
+
+	/// Adds to the usage of the stage if it is kept, wakes the captures waiting for space when it drops; drainMutex_ is locked
+	void addStageUsage(qlonglong dirId, qint64 fileCount, qint64 byteCount);
+
+	/// Queues the removal of the current copy of the file behind the staged changes
+	void stageRemoval(const Run &run, const QString &filePath);
+
+	/// Starts draining the stage of the directory in the background unless it is being drained already; thread safe
+	void requestDrain(qlonglong dirId);
+
+	/// Drains the stage and blocks until the drain ends
+	void waitForDrain(qlonglong dirId);
+
+	/// Drains the directory as long as there are requests, called on the drain pool
+	void drainStage(qlonglong dirId);
+
+	/// Moves the staged changes of the directory to its destination in the order they were captured, stops at the first failure
+	void drainStagedFiles(qlonglong dirId);
+	bool drainStagedFile(const Run &run, const QString &filePath, const QString &stagedFilePath);
+
+	/// Moves the versions kept beside the originals into the version store, after the directory was switched to it
+	void migrateHistory(const Run &run);
+
+	/// Sets lastChecked of the files the run found unchanged, through the statement prepared by the scan
+	void commitUnchangedFileIds(const Run &run, UpdateLastCheckedStatement &updateLastCheckedStatement, QVector<qlonglong> &unchangedFileIds);
+
+	/// Returns the database caches and the free heap to the system after the backups, emits idle(); called once the idle pool threads ended
+	void releaseIdleMemory();
 
 private:
 	QThread thread_;
-	QTimer *backupCheckTimer_;
-	QDateTime lastLogTime_;
+	QTimer *scheduleTimer_;
+	DBManager *db_;
+	LogSink *logSink_;
 
 private:
-	QString currentTimeFileSuffix_;
+	/// Used from thread_ only
+	BackupScheduler scheduler_;
+	int maxConcurrentRuns_ = defaultMaxConcurrentRuns;
+
+	QThreadPool runPool_;
+
+	/// Seeds drop the files table indexes the scans depend on; a seed does that only if no scan holds the lock (and scans wait for it)
+	QReadWriteLock fileIndexLock_;
+
+	/// Stages are drained independently of the runs, each directory by one thread at a time
+	QThreadPool drainPool_;
+	QMutex drainMutex_;
+	QWaitCondition drainFinished_;
+	QSet<qlonglong> drainingDirIds_, drainRequestDirIds_;
+
+	/// Changes in the stage of a directory (capturing or staged), so that a capture does not ask the database whether it fits
+	struct StageUsage {
+		qint64 fileCount;
+		qint64 byteCount;
+
+		/// Incremented whenever space is freed, a capture that found the stage full waits only if it did not change meanwhile
+		quint64 releaseCount;
+	};
+
+	/// Loaded from the stagedFiles table by the first capture into the stage, then kept up to date by the captures and the drain
+	/// (their changes of stagedFiles are queued under drainMutex_ as well, so a load sees either both or neither); guarded by drainMutex_
+	QHash<qlonglong, StageUsage> stageUsage_;
+	QWaitCondition stageReleased_;
+
+private:
+	RunStats totals_;
+	std::atomic<int> runningCount_{0};
+	std::atomic<bool> isInterrupted_{false};
+	std::atomic<int> pendingCopies_{0};
+	std::atomic<qint64> idleResidentBytes_{-1};
+	std::atomic<int> drainingCount_{0};
+
+	/// Deadlines of scheduler_ as of the last dispatch, for the other threads
+	mutable QMutex nextBackupTimesMutex_;
+	QHash<qlonglong, qlonglong> nextBackupTimes_;
 
 };
 
@@ -0,0 +1,149 @@
+#include "backupscheduler.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <QDateTime>
+#include <QRandomGenerator>
+
+const qlonglong BackupScheduler::minInterval;
+const qlonglong BackupScheduler::maxJitter;
+const qlonglong BackupScheduler::initialBackoff;
+const qlonglong BackupScheduler::maxBackoff;
+const qlonglong BackupScheduler::groupWindow;
+
+void BackupScheduler::update(const QVector<Directory> &directories, qlonglong now)
+{
+	heap_.clear();
+	heap_.reserve(directories.size());
+	sources_.clear();
+
+	for(const Directory &directory : directories) {
+		if(running_.contains(directory.id))
+			continue;
+
+		// A requested backup is due immediately even after failures; a directory that was never backed up keeps the backoff
+		if(directory.lastFinished < 0 && lastFinished_.value(directory.id, -1) >= 0)
+			failures_.remove(directory.id);
+		lastFinished_.insert(directory.id, directory.lastFinished);
+
+		heap_.push_back({deadline(directory, now), directory.id});
+		sources_.insert(directory.id, directory.source);
+	}
+
+	std::make_heap(heap_.begin(), heap_.end(), std::greater<Entry>());
+}
+
+qlonglong BackupScheduler::nextDeadline() const
+{
+	return heap_.empty() ? -1 : heap_.front().deadline;
+}
+
+QHash<qlonglong, qlonglong> BackupScheduler::deadlines() const
+{
+	QHash<qlonglong, qlonglong> result;
+	result.reserve(int(heap_.size()));
+
+	for(const Entry &entry : heap_)
+		result.insert(entry.id, entry.deadline);
+
+	return result;
+}
+
+QVector<QVector<qlonglong>> BackupScheduler::takeDue(qlonglong now, int limit)
+{
+	QVector<QVector<qlonglong>> result;
+
+	while(result.size() < limit && !heap_.empty() && heap_.front().deadline <= now) {
+		std::pop_heap(heap_.begin(), heap_.end(), std::greater<Entry>());
+		const qlonglong id = heap_.back().id;
+		heap_.pop_back();
+
+		QVector<qlonglong> run = {id};
+		const QString source = sources_.value(id);
+
+		// Linear, but only once per run; the heap is rebuilt if anything was taken along
+		auto isTakenAlong = [&](const Entry &entry) {
+			return entry.deadline <= now + groupWindow && sources_.value(entry.id) == source;
+		};
+
+		const auto takenAlong = std::partition(heap_.begin(), heap_.end(), [&](const Entry &entry) { return !isTakenAlong(entry); });
+		if(takenAlong != heap_.end()) {
+			for(auto it = takenAlong; it != heap_.end(); ++ it)
+				run.append(it->id);
+
+			heap_.erase(takenAlong, heap_.end());
+			std::make_heap(heap_.begin(), heap_.end(), std::greater<Entry>());
+		}
+
+		for(const qlonglong runId : run)
+			running_.insert(runId);
+
+		runningCount_ ++;
+		result.append(run);
+	}
+
+	return result;
+}
+
+void BackupScheduler::finish(const QVector<qlonglong> &ids, const QVector<qlonglong> &failedIds, qlonglong now)
+{
+	runningCount_ --;
+
+	for(const qlonglong id : ids) {
+		running_.remove(id);
+
+		if(!failedIds.contains(id)) {
+			failures_.remove(id);
+			continue;
+		}
+
+		Failure failure = failures_.value(id, Failure{0, 0});
+		failure.count ++;
+		failure.time = now;
+		failures_.insert(id, failure);
+	}
+}
+
+qlonglong BackupScheduler::moveIntoWindow(qlonglong time, int windowStart, int windowEnd)
+{
+	if(windowStart < 0 || windowEnd < 0 || windowStart == windowEnd)
+		return time;
+
+	const QDateTime dateTime = QDateTime::fromSecsSinceEpoch(time);
+	const int minute = dateTime.time().hour() * 60 + dateTime.time().minute();
+
+	const bool isInside = windowStart < windowEnd ? (minute >= windowStart && minute < windowEnd) : (minute >= windowStart || minute < windowEnd);
+	if(isInside)
+		return time;
+
+	// Next start of the window, today or tomorrow
+	QDateTime start(dateTime.date(), QTime(windowStart / 60, windowStart % 60));
+	if(start.toSecsSinceEpoch() <= time)
+		start = start.addDays(1);
+
+	return start.toSecsSinceEpoch();
+}
+
+qlonglong BackupScheduler::deadline(const Directory &directory, qlonglong now)
+{
+	qlonglong result = now;
+
+	// Directories that were never backed up are not delayed by the jitter, the number of concurrent runs is limited by the caller anyway
+	if(directory.lastFinished >= 0) {
+		const qlonglong interval = qMax(directory.interval, minInterval);
+
+		if(!jitters_.contains(directory.id))
+			jitters_.insert(directory.id, QRandomGenerator::global()->generateDouble());
+
+		result = directory.lastFinished + interval + qlonglong(jitters_.value(directory.id) * qMin(interval / 10, maxJitter));
+	}
+
+	if(failures_.contains(directory.id)) {
+		const Failure failure = failures_.value(directory.id);
+		const qlonglong backoff = qMin(initialBackoff << qMin(failure.count - 1, 16), maxBackoff);
+		result = qMax(result, failure.time + backoff);
+	}
+
+	return moveIntoWindow(result, directory.windowStart, directory.windowEnd);
+}
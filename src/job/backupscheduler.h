@@ -0,0 +1,107 @@
+#ifndef BACKUPSCHEDULER_H
+#define BACKUPSCHEDULER_H
+
+#include <vector>
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+/// Decides when each backup directory is due; used from a single thread.
+/// The deadlines are kept in a min-heap, so the next wake-up time and the due directories are found without scanning the whole list.
+/// Times are seconds since epoch.
+class BackupScheduler
+{
+
+public:
+	struct Directory {
+		qlonglong id;
+		qlonglong interval;
+
+		/// -1 if the directory was never backed up (or a backup was requested) -> due immediately; a request also cancels the backoff of the earlier failures
+		qlonglong lastFinished;
+
+		/// Allowed time window in minutes after local midnight (windowEnd < windowStart spans midnight); -1 = any time
+		int windowStart, windowEnd;
+
+		/// Directories with the same source are backed up by one run when they are due together
+		QString source;
+	};
+
+public:
+	/// Directories are not scheduled more often than this, whatever their interval is
+	static const qlonglong minInterval = 60;
+
+	/// Upper bound of the random delay spreading directories with the same interval
+	static const qlonglong maxJitter = 300;
+
+	/// Delay after the first failure, doubled with each following failure up to maxBackoff
+	static const qlonglong initialBackoff = 60;
+	static const qlonglong maxBackoff = 6 * 3600;
+
+	/// Directories of the same source are spread by the jitter, so the run of a due one takes along those due this much later
+	static const qlonglong groupWindow = maxJitter;
+
+public:
+	/// Replaces the schedule with the directories as they are in the database; directories being backed up are left out until finish()
+	void update(const QVector<Directory> &directories, qlonglong now);
+
+	/// Earliest deadline of the directories not being backed up, -1 if there are none
+	qlonglong nextDeadline() const;
+
+	/// Deadlines of the directories not being backed up by their ids
+	QHash<qlonglong, qlonglong> deadlines() const;
+
+	/// Removes up to limit runs due at now from the schedule (earliest first) and marks their directories running.
+	/// A run is a due directory together with the directories of the same source that are due within groupWindow.
+	QVector<QVector<qlonglong>> takeDue(qlonglong now, int limit);
+
+	/// Marks the directories of a run no longer running; the failed ones are postponed by an exponential backoff
+	void finish(const QVector<qlonglong> &ids, const QVector<qlonglong> &failedIds, qlonglong now);
+
+	/// Number of runs in progress
+	int runningCount() const {
+		return runningCount_;
+	}
+
+	/// Moves the time into the allowed window of the directory (unchanged if it is inside or there is no window)
+	static qlonglong moveIntoWindow(qlonglong time, int windowStart, int windowEnd);
+
+private:
+	struct Failure {
+		int count;
+		qlonglong time;
+	};
+
+	struct Entry {
+		qlonglong deadline;
+		qlonglong id;
+
+		bool operator>(const Entry &other) const {
+			return deadline > other.deadline;
+		}
+	};
+
+private:
+	qlonglong deadline(const Directory &directory, qlonglong now);
+
+private:
+	/// Min-heap ordered by deadline
+	std::vector<Entry> heap_;
+
+	QSet<qlonglong> running_;
+	int runningCount_ = 0;
+
+	/// Source of each scheduled directory
+	QHash<qlonglong, QString> sources_;
+	QHash<qlonglong, Failure> failures_;
+
+	/// Directory::lastFinished as of the last update, a change to -1 is a requested backup
+	QHash<qlonglong, qlonglong> lastFinished_;
+
+	/// Jitter (as a fraction of the maximum) is chosen once per directory, so that the deadlines do not move between updates
+	QHash<qlonglong, double> jitters_;
+
+};
+
+#endif // BACKUPSCHEDULER_H
@@ -0,0 +1,386 @@
+#include "dbschema.h"
+
+#include "threaddb/dbmanager.h"
+#include "job/logsink.h"
+
+void DBSchema::create(DBManager *db)
+{
+	db->execAssoc("CREATE TABLE settings ("
+				 "key VARCHAR(64) PRIMARY KEY,"
+				 "value TEXT"
+				 ")");
+	db->exec("INSERT INTO settings(key, value) VALUES('dbVersion', ?)", {QString::number(version)});
+
+	db->execAssoc("CREATE TABLE backupDirectories ("
+				 "id INTEGER PRIMARY KEY,"
+				 "sourceDir TEXT,"
+				 "remoteDir TEXT,"
+				 "lastFinishedBackup INTEGER,"
+				 "backupInterval INTEGER,"
+				 "keepHistoryDuration INTEGER,"
+				 "excludeFilter TEXT,"
+				 "windowStart INTEGER," // Allowed time window in minutes after midnight, NULL = any time
+				 "windowEnd INTEGER,"
+				 "historyLayout INTEGER," // VersionStore::Layout, NULL = beside originals
+				 "stagingDir TEXT," // Local stage the changes are captured in before they are drained to remoteDir, NULL = written directly
+				 "stagingLimit INTEGER" // Bytes the directory may keep in the stage
+				 ")");
+
+	db->execAssoc("CREATE TABLE files ("
+				 "id INTEGER PRIMARY KEY,"
+				 "backupDirectory INTEGER,"
+				 "filePath TEXT,"
+				 "lastChecked INTEGER,"
+				 "remoteVersion INTEGER" // Modified time of the backed up file
+				 ")");
+
+	db->execAssoc("CREATE TABLE history ("
+				 "id INTEGER PRIMARY KEY,"
+				 "backupDirectory INTEGER,"
+				 "remoteFilePath TEXT,"
+				 "originalFilePath TEXT,"
+				 "version INTEGER"
+				 ")");
+
+	createFileIndexes(db);
+	db->execAssoc("CREATE INDEX i_history_backupDirectory_version ON history (backupDirectory, version)");
+	db->execAssoc("CREATE INDEX i_history_backupDirectory_originalFilePath_version ON history (backupDirectory, originalFilePath, version)");
+
+	createRunsTable(db);
+	addRunsReflinkColumns(db);
+	addRunsMetadataRequestColumns(db);
+	createPathsTable(db);
+	createPathSearch(db);
+	createPartialCopiesTable(db);
+	createRunCheckpointsTable(db);
+	createStagedFilesTable(db);
+	addStagedFilesLastModifiedColumn(db);
+}
+
+bool DBSchema::upgrade(DBManager *db, LogSink *logSink)
+{
+	QString version = storedVersion(db);
+
+	if(version == "1") {
+		db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN excludeFilter TEXT");
+
+		createFileIndexes(db);
+		db->execAssoc("CREATE INDEX i_history_backupDirectory_version ON history (backupDirectory, version)");
+
+		db->execAssoc("UPDATE settings SET value = '2' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 2."));
+
+		version = "2";
+	}
+
+	if(version == "2") {
+		createRunsTable(db);
+
+		db->execAssoc("UPDATE settings SET value = '3' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 3."));
+
+		version = "3";
+	}
+
+	if(version == "3") {
+		db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN windowStart INTEGER");
+		db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN windowEnd INTEGER");
+
+		db->execAssoc("UPDATE settings SET value = '4' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 4."));
+
+		version = "4";
+	}
+
+	if(version == "4") {
+		// Versions of a file at a point in time, see RestoreManager::plan
+		db->execAssoc("CREATE INDEX i_history_backupDirectory_originalFilePath_version ON history (backupDirectory, originalFilePath, version)");
+
+		db->execAssoc("UPDATE settings SET value = '5' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 5."));
+
+		version = "5";
+	}
+
+	if(version == "5") {
+		createPathsTable(db);
+		db->execAssoc("INSERT OR IGNORE INTO paths (backupDirectory, filePath, lastChanged) SELECT backupDirectory, originalFilePath, MAX(version) FROM history GROUP BY backupDirectory, originalFilePath");
+		db->execAssoc("INSERT OR IGNORE INTO paths (backupDirectory, filePath, lastChanged) SELECT backupDirectory, filePath, remoteVersion FROM files");
+
+		db->execAssoc("UPDATE settings SET value = '6' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 6."));
+
+		version = "6";
+	}
+
+	if(version == "6") {
+		db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN historyLayout INTEGER");
+
+		db->execAssoc("UPDATE settings SET value = '7' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 7."));
+
+		version = "7";
+	}
+
+	if(version == "7") {
+		addRunsReflinkColumns(db);
+
+		db->execAssoc("UPDATE settings SET value = '8' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 8."));
+
+		version = "8";
+	}
+
+	if(version == "8") {
+		createPartialCopiesTable(db);
+
+		db->execAssoc("UPDATE settings SET value = '9' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 9."));
+
+		version = "9";
+	}
+
+	if(version == "9") {
+		createRunCheckpointsTable(db);
+
+		db->execAssoc("UPDATE settings SET value = '10' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 10."));
+
+		version = "10";
+	}
+
+	if(version == "10") {
+		db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN stagingDir TEXT");
+		db->execAssoc("ALTER TABLE backupDirectories ADD COLUMN stagingLimit INTEGER");
+		createStagedFilesTable(db);
+
+		db->execAssoc("UPDATE settings SET value = '11' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 11."));
+
+		version = "11";
+	}
+
+	if(version == "11") {
+		addRunsMetadataRequestColumns(db);
+
+		db->execAssoc("UPDATE settings SET value = '12' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 12."));
+
+		version = "12";
+	}
+
+	if(version == "12") {
+		addStagedFilesLastModifiedColumn(db);
+
+		db->execAssoc("UPDATE settings SET value = '13' WHERE key = 'dbVersion'");
+		logSink->log(LogLevel::warning, QString(), "Global", QT_TR_NOOP("Verze databáze aktualizovaná na verzi 13."));
+
+		version = "13";
+	}
+
+	if(version != "13")
+		return false;
+
+	// Indexes and the path triggers are missing if the process ended while a directory was being seeded
+	createFileIndexes(db);
+	createPathTriggers(db);
+
+	// (Re)built from the paths table if the database was last opened by a build without FTS5
+	createPathSearch(db);
+	return true;
+}
+
+QString DBSchema::storedVersion(DBManager *db)
+{
+	return db->selectValueAssoc("SELECT value FROM settings WHERE key = 'dbVersion'").toString();
+}
+
+void DBSchema::createFileIndexes(DBManager *db)
+{
+	db->exec("CREATE INDEX IF NOT EXISTS i_files_backupDirectory_filePath ON files (backupDirectory, filePath)");
+	db->exec("CREATE INDEX IF NOT EXISTS i_files_backupDirectory_lastChecked ON files (backupDirectory, lastChecked)");
+}
+
+void DBSchema::dropFileIndexes(DBManager *db)
+{
+	db->exec("DROP INDEX IF EXISTS i_files_backupDirectory_filePath");
+	db->exec("DROP INDEX IF EXISTS i_files_backupDirectory_lastChecked");
+}
+
+void DBSchema::createPathTriggers(DBManager *db, qlonglong dirId)
+{
+	if(db->selectValue("SELECT COUNT(*) FROM sqlite_master WHERE name = 't_files_paths'").toLongLong() > 0)
+		return;
+
+	// What the trigger does for each inserted file, for the files inserted without it
+	const QString dirCondition = dirId >= 0 ? "(backupDirectory = ?)" : "1";
+	const DBManager::Args args = dirId >= 0 ? DBManager::Args{dirId} : DBManager::Args();
+
+	db->exec("UPDATE paths SET lastChanged = (SELECT f.lastChecked FROM files f WHERE (f.backupDirectory = paths.backupDirectory) AND (f.filePath = paths.filePath)) "
+			 "WHERE " + dirCondition + " AND EXISTS (SELECT 1 FROM files f WHERE (f.backupDirectory = paths.backupDirectory) AND (f.filePath = paths.filePath))", args);
+	db->exec("INSERT OR IGNORE INTO paths (backupDirectory, filePath, lastChanged) SELECT backupDirectory, filePath, lastChecked FROM files WHERE " + dirCondition, args);
+
+	createFilesPathsTrigger(db);
+
+	// Recreates the trigger of the full text index and rebuilds it from the paths table
+	createPathSearch(db);
+}
+
+void DBSchema::dropPathTriggers(DBManager *db)
+{
+	db->exec("DROP TRIGGER IF EXISTS t_files_paths");
+	db->exec("DROP TRIGGER IF EXISTS t_paths_search_insert");
+}
+
+bool DBSchema::hasPathSearch(DBManager *db)
+{
+	return hasFts5(db) && db->selectValue("SELECT COUNT(*) FROM sqlite_master WHERE name = 'pathSearch'").toLongLong() > 0;
+}
+
+bool DBSchema::hasFts5(DBManager *db)
+{
+	return db->selectValue("SELECT sqlite_compileoption_used('ENABLE_FTS5')").toBool();
+}
+
+void DBSchema::createPathsTable(DBManager *db)
+{
+	db->execAssoc("CREATE TABLE paths ("
+				 "id INTEGER PRIMARY KEY,"
+				 "backupDirectory INTEGER,"
+				 "filePath TEXT,"
+				 "lastChanged INTEGER" // Time the last version was backed up
+				 ")");
+	db->execAssoc("CREATE UNIQUE INDEX i_paths_backupDirectory_filePath ON paths (backupDirectory, filePath)");
+	db->execAssoc("CREATE INDEX i_paths_lastChanged ON paths (lastChanged)");
+
+	// New files and new history versions register their paths (a changed file always adds a history version)
+	createFilesPathsTrigger(db);
+	db->execAssoc("CREATE TRIGGER t_history_paths AFTER INSERT ON history BEGIN "
+				 "INSERT OR IGNORE INTO paths (backupDirectory, filePath) VALUES (NEW.backupDirectory, NEW.originalFilePath); "
+				 "UPDATE paths SET lastChanged = NEW.version WHERE (backupDirectory = NEW.backupDirectory) AND (filePath = NEW.originalFilePath); "
+				 "END");
+}
+
+void DBSchema::createFilesPathsTrigger(DBManager *db)
+{
+	db->execAssoc("CREATE TRIGGER IF NOT EXISTS t_files_paths AFTER INSERT ON files BEGIN "
+				 "INSERT OR IGNORE INTO paths (backupDirectory, filePath) VALUES (NEW.backupDirectory, NEW.filePath); "
+				 "UPDATE paths SET lastChanged = NEW.lastChecked WHERE (backupDirectory = NEW.backupDirectory) AND (filePath = NEW.filePath); "
+				 "END");
+}
+
+void DBSchema::createPathSearch(DBManager *db)
+{
+	// The same database may be opened by a build without FTS5, the triggers would then make every insert into paths fail
+	if(!hasFts5(db)) {
+		db->execAssoc("DROP TRIGGER IF EXISTS t_paths_search_insert");
+		db->execAssoc("DROP TRIGGER IF EXISTS t_paths_search_delete");
+		return;
+	}
+
+	if(db->selectValue("SELECT COUNT(*) FROM sqlite_master WHERE name = 't_paths_search_insert'").toLongLong() > 0)
+		return;
+
+	// Paths are split into words on '/', '.' and other punctuation; prefixes of 2 and 3 characters are indexed for the prefix queries
+	db->execAssoc("CREATE VIRTUAL TABLE IF NOT EXISTS pathSearch USING fts5(filePath, content='paths', content_rowid='id', prefix='2 3')");
+	db->execAssoc("INSERT INTO pathSearch (pathSearch) VALUES ('rebuild')");
+
+	// The delete trigger is kept while a seed drops the insert one, see dropPathTriggers
+	db->execAssoc("CREATE TRIGGER IF NOT EXISTS t_paths_search_insert AFTER INSERT ON paths BEGIN "
+				 "INSERT INTO pathSearch (rowid, filePath) VALUES (NEW.id, NEW.filePath); "
+				 "END");
+	db->execAssoc("CREATE TRIGGER IF NOT EXISTS t_paths_search_delete AFTER DELETE ON paths BEGIN "
+				 "INSERT INTO pathSearch (pathSearch, rowid, filePath) VALUES ('delete', OLD.id, OLD.filePath); "
+				 "END");
+}
+
+void DBSchema::createPartialCopiesTable(DBManager *db)
+{
+	db->execAssoc("CREATE TABLE partialCopies ("
+				 "id INTEGER PRIMARY KEY,"
+				 "backupDirectory INTEGER,"
+				 "filePath TEXT,"
+				 "sourceSize INTEGER," // Version of the source being copied
+				 "sourceModified INTEGER,"
+				 "bytesDone INTEGER," // Synced to disk, see ResumableCopy
+				 "blockChecksums TEXT,"
+				 "lastUpdated INTEGER"
+				 ")");
+	db->execAssoc("CREATE UNIQUE INDEX i_partialCopies_backupDirectory_filePath ON partialCopies (backupDirectory, filePath)");
+}
+
+void DBSchema::createRunCheckpointsTable(DBManager *db)
+{
+	db->execAssoc("CREATE TABLE runCheckpoints ("
+				 "backupDirectory INTEGER PRIMARY KEY,"
+				 "runTime INTEGER," // currentTime of the interrupted run
+				 "cursor TEXT," // Last processed file in the order of DirectoryWalk
+				 "updated INTEGER"
+				 ")");
+}
+
+void DBSchema::createStagedFilesTable(DBManager *db)
+{
+	db->execAssoc("CREATE TABLE stagedFiles ("
+				 "id INTEGER PRIMARY KEY," // Order the changes reach the destination in
+				 "backupDirectory INTEGER,"
+				 "filePath TEXT,"
+				 "stagedPath TEXT," // Copy in the stage, NULL = the file was removed
+				 "size INTEGER,"
+				 "runTime INTEGER," // currentTime of the run that captured the change, the time of the version it replaces in the history
+				 "state INTEGER," // BackupManager::StageState
+				 "drainedAt INTEGER"
+				 ")");
+	db->execAssoc("CREATE INDEX i_stagedFiles_backupDirectory_state ON stagedFiles (backupDirectory, state, id)");
+}
+
+void DBSchema::addStagedFilesLastModifiedColumn(DBManager *db)
+{
+	// Version the drain commits to files.remoteVersion once the copy reaches the destination, NULL for a removal
+	db->execAssoc("ALTER TABLE stagedFiles ADD COLUMN lastModified INTEGER");
+}
+
+void DBSchema::createRunsTable(DBManager *db)
+{
+	db->execAssoc("CREATE TABLE runs ("
+				 "id INTEGER PRIMARY KEY,"
+				 "backupDirectory INTEGER,"
+				 "started INTEGER,"
+				 "finished INTEGER,"
+				 "isSeed INTEGER,"
+				 "isInterrupted INTEGER,"
+				 "filesNew INTEGER,"
+				 "filesChanged INTEGER,"
+				 "filesUnchanged INTEGER,"
+				 "filesRemoved INTEGER,"
+				 "filesFailed INTEGER,"
+				 "bytesNew INTEGER,"
+				 "bytesChanged INTEGER,"
+				 "walkTime INTEGER," // Phase times in ms, summed over threads
+				 "statTime INTEGER,"
+				 "excludeTime INTEGER,"
+				 "lookupTime INTEGER,"
+				 "copyTime INTEGER,"
+				 "historyTime INTEGER,"
+				 "pruneTime INTEGER,"
+				 "commitTime INTEGER,"
+				 "copyLatency TEXT," // Log2 histograms in µs, see RunStats::Histogram
+				 "dbLatency TEXT"
+				 ")");
+	db->execAssoc("CREATE INDEX i_runs_backupDirectory ON runs (backupDirectory, id)");
+}
+
+void DBSchema::addRunsReflinkColumns(DBManager *db)
+{
+	// History versions made as reflinks, see RunStats::addReflink
+	db->execAssoc("ALTER TABLE runs ADD COLUMN reflinkedFiles INTEGER");
+	db->execAssoc("ALTER TABLE runs ADD COLUMN bytesWriteSaved INTEGER");
+	db->execAssoc("ALTER TABLE runs ADD COLUMN bytesSpaceSaved INTEGER");
+}
+
+void DBSchema::addRunsMetadataRequestColumns(DBManager *db)
+{
+	// Metadata requests sent to the destination and answered by the cache of the run, see RunStats::addMetadataRequest
+	db->execAssoc("ALTER TABLE runs ADD COLUMN metadataRequests INTEGER");
+	db->execAssoc("ALTER TABLE runs ADD COLUMN metadataRequestsSaved INTEGER");
+}
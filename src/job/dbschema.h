@@ -0,0 +1,64 @@
+#ifndef DBSCHEMA_H
+#define DBSCHEMA_H
+
+#include <QString>
+
+class DBManager;
+class LogSink;
+
+/// Tables and indexes of the application database, shared by the application and the benchmarks
+class DBSchema
+{
+
+public:
+	/// Version stored in settings.dbVersion by create() and upgrade()
+	static const int version = 13;
+
+public:
+	/// Creates all tables and indexes in an empty database
+	static void create(DBManager *db);
+
+	/// Migrates an existing database to the current version, reports each step to logSink; returns false if the stored version is not supported
+	static bool upgrade(DBManager *db, LogSink *logSink);
+
+	/// Version stored in the database
+	static QString storedVersion(DBManager *db);
+
+public:
+	/// Creates the files table indexes if they are missing (they are dropped while a directory is being seeded)
+	static void createFileIndexes(DBManager *db);
+	static void dropFileIndexes(DBManager *db);
+
+	/// Triggers registering the paths of new files in paths and pathSearch; dropped while a directory is being seeded, which then registers the paths in bulk.
+	/// createPathTriggers() registers the paths of the files of dirId (of all directories if -1) and recreates the triggers, unless they exist.
+	static void createPathTriggers(DBManager *db, qlonglong dirId = -1);
+	static void dropPathTriggers(DBManager *db);
+
+	/// Whether the full text index of the paths exists (it needs SQLite built with FTS5)
+	static bool hasPathSearch(DBManager *db);
+
+private:
+	/// Runs table as of version 3, later columns are added by the migrations (also when creating the database)
+	static void createRunsTable(DBManager *db);
+	static void addRunsReflinkColumns(DBManager *db);
+	static void addRunsMetadataRequestColumns(DBManager *db);
+
+	/// Progress of the interrupted copies of large files
+	static void createPartialCopiesTable(DBManager *db);
+
+	/// Where the interrupted scans continue, see BackupManager::storeCheckpoint
+	static void createRunCheckpointsTable(DBManager *db);
+
+	/// Changes captured in the staging directories and their draining to the destinations
+	static void createStagedFilesTable(DBManager *db);
+	static void addStagedFilesLastModifiedColumn(DBManager *db);
+
+	/// Every path that has a current copy or a history version, maintained by triggers on files and history
+	static void createPathsTable(DBManager *db);
+	static void createFilesPathsTrigger(DBManager *db);
+	static void createPathSearch(DBManager *db);
+	static bool hasFts5(DBManager *db);
+
+};
+
+#endif // DBSCHEMA_H
@@ -0,0 +1,130 @@
+#include "destinationcache.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "job/storagebackend.h"
+#include "job/runstats.h"
+
+const int DestinationCache::availabilityCheckMSecs;
+
+DestinationCache::DestinationCache(StorageBackend &storage, RunStats *stats) :
+	storage_(storage),
+	stats_(stats),
+	hasDirectories_(!storage.localDir().isEmpty())
+{
+
+}
+
+bool DestinationCache::isAvailable()
+{
+	{
+		QMutexLocker ml(&mutex_);
+		if(sinceAvailable_.isValid() && sinceAvailable_.elapsed() < availabilityCheckMSecs) {
+			addRequest(true);
+			return true;
+		}
+	}
+
+	addRequest(false);
+	if(!storage_.isAvailable())
+		return false;
+
+	QMutexLocker ml(&mutex_);
+	sinceAvailable_.start();
+	return true;
+}
+
+bool DestinationCache::mkpath(const QString &dirPath)
+{
+	if(!hasDirectories_)
+		return storage_.mkpath(dirPath);
+
+	bool isNew;
+	{
+		QMutexLocker ml(&mutex_);
+		if(existingPaths_.contains(dirPath)) {
+			addRequest(true);
+			return true;
+		}
+
+		isNew = isCreated(dirPath);
+	}
+
+	// Below a directory the run created there is nothing to look up
+	if(!isNew) {
+		addRequest(false);
+		isNew = !storage_.exists(dirPath);
+	}
+
+	if(isNew) {
+		addRequest(false);
+		if(!storage_.mkpath(dirPath))
+			return false;
+
+	} else
+		addRequest(true);
+
+	QMutexLocker ml(&mutex_);
+	if(isNew)
+		createdPaths_.insert(dirPath);
+
+	for(QString path = dirPath; !existingPaths_.contains(path); path = QFileInfo(path).path())
+		existingPaths_.insert(path);
+
+	return true;
+}
+
+bool DestinationCache::exists(const QString &filePath)
+{
+	{
+		QMutexLocker ml(&mutex_);
+		if(absentFilePaths_.contains(filePath) || (!presentFilePaths_.contains(filePath) && isCreated(QFileInfo(filePath).path()))) {
+			addRequest(true);
+			return false;
+		}
+	}
+
+	addRequest(false);
+	return storage_.exists(filePath);
+}
+
+void DestinationCache::setAbsent(const QString &filePath)
+{
+	QMutexLocker ml(&mutex_);
+	presentFilePaths_.remove(filePath);
+	absentFilePaths_.insert(filePath);
+}
+
+void DestinationCache::setPresent(const QString &filePath)
+{
+	QMutexLocker ml(&mutex_);
+	absentFilePaths_.remove(filePath);
+
+	if(isCreated(QFileInfo(filePath).path()))
+		presentFilePaths_.insert(filePath);
+}
+
+bool DestinationCache::isCreated(QString dirPath) const
+{
+	if(createdPaths_.isEmpty())
+		return false;
+
+	// Up to "." for relative paths, "/" for absolute ones
+	while(true) {
+		if(createdPaths_.contains(dirPath))
+			return true;
+
+		const QString parentPath = QFileInfo(dirPath).path();
+		if(parentPath == dirPath)
+			return false;
+
+		dirPath = parentPath;
+	}
+}
+
+void DestinationCache::addRequest(bool isSaved)
+{
+	if(stats_)
+		stats_->addMetadataRequest(isSaved);
+}
@@ -0,0 +1,66 @@
+#ifndef DESTINATIONCACHE_H
+#define DESTINATIONCACHE_H
+
+#include <QString>
+#include <QSet>
+#include <QMutex>
+#include <QElapsedTimer>
+
+class StorageBackend;
+class RunStats;
+
+/// What a run knows about its destination without asking the storage again: the directories that exist, the ones the run created and the files it moved away.
+/// On network shares each exists or mkpath is a round trip, so a run asks once per directory instead of once per file.
+/// Valid only while nobody else writes into the destination, i.e. for a single run. Thread safe.
+class DestinationCache
+{
+
+public:
+	/// Requests sent and saved are counted in stats (if set)
+	DestinationCache(StorageBackend &storage, RunStats *stats);
+
+public:
+	/// Whether the destination can be reached; once it was, the storage is asked again only after availabilityCheckMSecs
+	bool isAvailable();
+
+	/// Creates the directory unless the run knows it exists already. Directories found missing are remembered as created by the run, the files in them are absent.
+	bool mkpath(const QString &dirPath);
+
+	/// Whether the file exists; not asked if the run knows it is absent
+	bool exists(const QString &filePath);
+
+	/// The run moved or removed the file
+	void setAbsent(const QString &filePath);
+
+	/// The run wrote the file
+	void setPresent(const QString &filePath);
+
+public:
+	static const int availabilityCheckMSecs = 2000;
+
+private:
+	/// Whether dirPath or one of its parents was created by the run; mutex_ is locked
+	bool isCreated(QString dirPath) const;
+
+	void addRequest(bool isSaved);
+
+private:
+	StorageBackend &storage_;
+	RunStats *stats_;
+
+	/// Object stores have no directories, there is nothing to learn from them
+	const bool hasDirectories_;
+
+	QMutex mutex_;
+	QSet<QString> existingPaths_, createdPaths_;
+	QSet<QString> absentFilePaths_;
+
+	/// Files written into the directories created by the run, bounded by the new files in new directories
+	QSet<QString> presentFilePaths_;
+
+	/// Since the destination was last found available, invalid before
+	QElapsedTimer sinceAvailable_;
+
+};
+
+#endif // DESTINATIONCACHE_H
@@ -0,0 +1,115 @@
+#include "directorywalk.h"
+
+#include <algorithm>
+
+#include <QDir>
+
+DirectoryWalk::DirectoryWalk(const QString &rootDir, const QString &resumeAfter)
+{
+	enter(rootDir, resumeAfter.split('/', QString::SkipEmptyParts));
+	advance();
+}
+
+void DirectoryWalk::next()
+{
+	current_ = next_;
+	advance();
+}
+
+bool DirectoryWalk::isBefore(const QString &filePath, const QString &otherFilePath)
+{
+	const QStringList path = filePath.split('/', QString::SkipEmptyParts);
+	const QStringList otherPath = otherFilePath.split('/', QString::SkipEmptyParts);
+
+	for(int i = 0; i < path.size() && i < otherPath.size(); i ++) {
+		if(path[i] == otherPath[i])
+			continue;
+
+		// The files of a directory precede its subdirectories
+		const bool isFile = i == path.size() - 1;
+		const bool isOtherFile = i == otherPath.size() - 1;
+		if(isFile != isOtherFile)
+			return isFile;
+
+		return path[i] < otherPath[i];
+	}
+
+	return path.size() < otherPath.size();
+}
+
+void DirectoryWalk::enter(const QString &dirPath, const QStringList &resumeAfter)
+{
+	const QDir dir(dirPath);
+
+	// Sorted here rather than by QDir, so that the order does not depend on the locale
+	auto byName = [](const QFileInfo &a, const QFileInfo &b) {
+		return a.fileName() < b.fileName();
+	};
+
+	Level level;
+	level.files = dir.entryInfoList(QDir::Files | QDir::Readable, QDir::NoSort);
+	std::sort(level.files.begin(), level.files.end(), byName);
+
+	for(const QFileInfo &entry : dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::NoSort)) {
+		if(!entry.isSymLink())
+			level.dirs.append(entry);
+	}
+	std::sort(level.dirs.begin(), level.dirs.end(), byName);
+
+	if(resumeAfter.isEmpty()) {
+		stack_.append(level);
+		return;
+	}
+
+	const QString &name = resumeAfter.first();
+
+	// The file itself is in this directory -> continue with the files after it
+	if(resumeAfter.size() == 1) {
+		while(level.fileIndex < level.files.size() && !(name < level.files[level.fileIndex].fileName()))
+			level.fileIndex ++;
+
+		stack_.append(level);
+		return;
+	}
+
+	// The files of this directory precede its subdirectories, all of them were walked
+	level.fileIndex = level.files.size();
+	while(level.dirIndex < level.dirs.size() && level.dirs[level.dirIndex].fileName() < name)
+		level.dirIndex ++;
+
+	const bool isInDir = level.dirIndex < level.dirs.size() && level.dirs[level.dirIndex].fileName() == name;
+	const QString subdirPath = isInDir ? level.dirs[level.dirIndex].absoluteFilePath() : QString();
+
+	if(isInDir)
+		level.dirIndex ++;
+
+	stack_.append(level);
+
+	if(isInDir)
+		enter(subdirPath, resumeAfter.mid(1));
+}
+
+void DirectoryWalk::advance()
+{
+	while(!stack_.isEmpty()) {
+		Level &level = stack_.last();
+
+		if(level.fileIndex < level.files.size()) {
+			next_ = level.files[level.fileIndex ++];
+			hasNext_ = true;
+			return;
+		}
+
+		if(level.dirIndex < level.dirs.size()) {
+			// enter() appends to the stack, which invalidates level
+			const QString subdirPath = level.dirs[level.dirIndex ++].absoluteFilePath();
+			enter(subdirPath, QStringList());
+			continue;
+		}
+
+		stack_.removeLast();
+	}
+
+	next_ = QFileInfo();
+	hasNext_ = false;
+}
@@ -0,0 +1,56 @@
+#ifndef DIRECTORYWALK_H
+#define DIRECTORYWALK_H
+
+#include <QString>
+#include <QStringList>
+#include <QFileInfo>
+#include <QVector>
+
+/// Depth-first walk of the readable files of a directory tree in a fixed order (the files of a directory by name, then its subdirectories by name),
+/// so that an interrupted walk can continue after the last processed file. Skips hidden entries and does not follow symbolic links to directories, as QDirIterator.
+/// Used like QDirIterator: hasNext(), next(), fileInfo().
+class DirectoryWalk
+{
+
+public:
+	/// resumeAfter is the path of a file relative to rootDir, the walk starts with the file following it
+	explicit DirectoryWalk(const QString &rootDir, const QString &resumeAfter = QString());
+
+public:
+	bool hasNext() const {
+		return hasNext_;
+	}
+
+	void next();
+
+	QFileInfo fileInfo() const {
+		return current_;
+	}
+
+public:
+	/// Whether the walk reaches filePath before otherFilePath (both relative to the root)
+	static bool isBefore(const QString &filePath, const QString &otherFilePath);
+
+private:
+	struct Level {
+		QFileInfoList files;
+		QFileInfoList dirs;
+		int fileIndex = 0;
+		int dirIndex = 0;
+	};
+
+private:
+	/// Lists the directory; resumeAfter (relative to it) skips the entries up to it, descending into the directory it is in
+	void enter(const QString &dirPath, const QStringList &resumeAfter);
+
+	/// Finds the file following the current one
+	void advance();
+
+private:
+	QVector<Level> stack_;
+	QFileInfo current_, next_;
+	bool hasNext_ = false;
+
+};
+
+#endif // DIRECTORYWALK_H
@@ -0,0 +1,177 @@
+#include "fanoutcopy.h"
+
+#include <QFile>
+#include <QElapsedTimer>
+
+#include "job/filecopy.h"
+
+const qint64 FanOutCopy::chunkSize;
+const int FanOutCopy::maxQueuedChunks;
+
+FanOutCopy::FanOutCopy(int writerCount)
+{
+	for(int i = 0; i < writerCount; i ++) {
+		writers_.emplace_back(new Writer());
+
+		Writer *writer = writers_.back().get();
+		writer->thread = std::thread([this, writer]{
+			threadFunction(*writer);
+		});
+	}
+}
+
+FanOutCopy::~FanOutCopy()
+{
+	for(const std::unique_ptr<Writer> &writer : writers_) {
+		enqueue(*writer, Item::Kind::quit, Target());
+		writer->thread.join();
+	}
+}
+
+bool FanOutCopy::copy(const QString &sourceFilePath, const QVector<Target> &targets)
+{
+	for(const Target &target : targets)
+		enqueue(*writers_[size_t(target.writer)], Item::Kind::open, target);
+
+	QFile source(sourceFilePath);
+	bool isRead = source.open(QIODevice::ReadOnly);
+
+	while(isRead) {
+		// Each chunk is a new buffer shared by the queues of all the targets
+		const QByteArray chunk = source.read(chunkSize);
+
+		if(chunk.isEmpty()) {
+			isRead = source.error() == QFileDevice::NoError;
+			break;
+		}
+
+		for(const Target &target : targets)
+			enqueue(*writers_[size_t(target.writer)], Item::Kind::data, target, chunk);
+	}
+
+	for(const Target &target : targets)
+		enqueue(*writers_[size_t(target.writer)], isRead ? Item::Kind::finish : Item::Kind::abort, target);
+
+	return isRead;
+}
+
+void FanOutCopy::waitForDone()
+{
+	for(const std::unique_ptr<Writer> &writer : writers_) {
+		QMutexLocker ml(&writer->mutex);
+		while(writer->pendingCount)
+			writer->doneCondition.wait(&writer->mutex);
+	}
+}
+
+QVector<FanOutCopy::Result> FanOutCopy::takeResults()
+{
+	QVector<Result> result;
+
+	QMutexLocker ml(&resultsMutex_);
+	result.swap(results_);
+
+	return result;
+}
+
+void FanOutCopy::enqueue(Writer &writer, Item::Kind kind, const Target &target, const QByteArray &data)
+{
+	writer.freeSlots.acquire();
+
+	QMutexLocker ml(&writer.mutex);
+	writer.queue.enqueue({kind, target, data});
+	writer.pendingCount ++;
+	writer.wakeCondition.wakeOne();
+}
+
+void FanOutCopy::threadFunction(Writer &writer)
+{
+	QFile file;
+	Result result;
+	bool isFailed = false;
+	qint64 position = 0;
+	QElapsedTimer timer;
+
+	while(true) {
+		Item item;
+		{
+			QMutexLocker ml(&writer.mutex);
+			while(writer.queue.isEmpty())
+				writer.wakeCondition.wait(&writer.mutex);
+
+			item = writer.queue.dequeue();
+		}
+
+		writer.freeSlots.release();
+
+		if(item.kind == Item::Kind::quit)
+			return;
+
+		switch(item.kind) {
+			case Item::Kind::open:
+				timer.start();
+				result = Result{item.target, Status::finished, 0, 0, 0, 0};
+				position = 0;
+
+				file.setFileName(item.target.filePath);
+				isFailed = !file.open(item.target.isUpdate ? QIODevice::ReadWrite : QIODevice::WriteOnly);
+
+				if(!isFailed && item.target.isUpdate)
+					result.previousSize = file.size();
+				break;
+
+			case Item::Kind::data:
+				if(!isFailed && item.target.isUpdate)
+					isFailed = !FileCopy::updateChangedBlocks(file, position, item.data.constData(), item.data.size(), result.bytesWritten);
+
+				else if(!isFailed) {
+					isFailed = file.write(item.data) != item.data.size();
+					result.bytesWritten += item.data.size();
+				}
+
+				position += item.data.size();
+				break;
+
+			case Item::Kind::finish:
+				if(!isFailed)
+					isFailed = !(item.target.isUpdate ? file.resize(position) && file.flush() : file.flush());
+
+				file.close();
+
+				// A half written copy is neither the old nor the new version; the next run copies the file again
+				if(isFailed) {
+					file.remove();
+					result.status = Status::writeError;
+				}
+
+				result.sourceSize = position;
+				result.nsecs = timer.nsecsElapsed();
+				addResult(result);
+				break;
+
+			case Item::Kind::abort:
+				file.close();
+				file.remove();
+
+				result.status = Status::readError;
+				result.sourceSize = position;
+				result.nsecs = timer.nsecsElapsed();
+				addResult(result);
+				break;
+
+			case Item::Kind::quit:
+				break;
+		}
+
+		QMutexLocker ml(&writer.mutex);
+		writer.pendingCount --;
+		if(!writer.pendingCount)
+			writer.doneCondition.wakeAll();
+	}
+}
+
+void FanOutCopy::addResult(const Result &result)
+{
+	QMutexLocker ml(&resultsMutex_);
+	results_.append(result);
+}
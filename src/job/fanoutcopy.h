@@ -0,0 +1,117 @@
+#ifndef FANOUTCOPY_H
+#define FANOUTCOPY_H
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
+
+/// Copies files to several backup directories reading each source only once. Every backup directory has its own writer thread fed through a bounded queue,
+/// so a slow destination holds the reading (and the other destinations) back only once its queue is full. copy() returns as soon as the data is queued,
+/// the outcome of each write is collected by takeResults().
+class FanOutCopy
+{
+
+public:
+	struct Target {
+		/// Index of the writer (destination), less than writerCount
+		int writer;
+
+		QString filePath;
+
+		/// Rewrite only the blocks of the existing file that differ from the source (keeps the rest shared with its reflink), otherwise the file is created
+		bool isUpdate;
+
+		/// Identifies the write in the results
+		qlonglong tag;
+	};
+
+	enum class Status {
+		finished,
+		readError,
+		writeError
+	};
+
+	struct Result {
+		Target target;
+		Status status;
+		qint64 sourceSize;
+
+		/// Size of the updated file before the update
+		qint64 previousSize;
+		qint64 bytesWritten;
+
+		/// Time the writer spent on the file
+		qint64 nsecs;
+	};
+
+public:
+	explicit FanOutCopy(int writerCount);
+	~FanOutCopy();
+
+public:
+	/// Reads sourceFilePath and queues its data to the writers of the targets, each writer gets at most one target; blocks while the queue of any of them is full.
+	/// Returns false if the source could not be read, its targets are then removed and reported with readError.
+	bool copy(const QString &sourceFilePath, const QVector<Target> &targets);
+
+	/// Blocks until the writers have finished all the queued files
+	void waitForDone();
+
+	/// Results of the writes finished since the last call
+	QVector<Result> takeResults();
+
+public:
+	/// Size of the pieces the data is read and queued in
+	static const qint64 chunkSize = 1024 * 1024;
+
+	/// Capacity of the queue of each writer (in chunks), which bounds how far the fastest destination can get ahead of the slowest one
+	static const int maxQueuedChunks = 32;
+
+private:
+	struct Item {
+		enum class Kind {
+			open,
+			data,
+			finish,
+			abort,
+			quit
+		};
+
+		Kind kind;
+		Target target;
+		QByteArray data;
+	};
+
+	struct Writer {
+		QQueue<Item> queue;
+		QMutex mutex;
+		QWaitCondition wakeCondition, doneCondition;
+
+		/// Items queued and not processed yet
+		int pendingCount = 0;
+
+		QSemaphore freeSlots{maxQueuedChunks};
+		std::thread thread;
+	};
+
+private:
+	void enqueue(Writer &writer, Item::Kind kind, const Target &target, const QByteArray &data = QByteArray());
+	void threadFunction(Writer &writer);
+	void addResult(const Result &result);
+
+private:
+	std::vector<std::unique_ptr<Writer>> writers_;
+
+	QMutex resultsMutex_;
+	QVector<Result> results_;
+
+};
+
+#endif // FANOUTCOPY_H
@@ -0,0 +1,188 @@
+#include "filecopy.h"
+
+#include <cstring>
+
+#include <QByteArray>
+#include <QTemporaryFile>
+#include <QDir>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 27)
+#define FILECOPY_COPY_FILE_RANGE
+#endif
+
+#ifdef FICLONE
+#define FILECOPY_FICLONE
+#endif
+#endif
+
+const qint64 FileCopy::chunkSize;
+const qint64 FileCopy::bufferSize;
+const qint64 FileCopy::deltaBlockSize;
+
+bool FileCopy::copyData(QFile &source, QFile &target, const ProgressFunc &onProgress)
+{
+#ifdef FILECOPY_COPY_FILE_RANGE
+	bool isFirstChunk = true;
+	while(true) {
+		const ssize_t bytesCopied = copy_file_range(source.handle(), nullptr, target.handle(), nullptr, size_t(chunkSize), 0);
+
+		if(bytesCopied == 0)
+			return true;
+
+		if(bytesCopied < 0) {
+			// Not supported by the kernel or between these file systems -> nothing was copied yet, copy through the buffer
+			if(isFirstChunk && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+				break;
+
+			return false;
+		}
+
+		isFirstChunk = false;
+
+		if(onProgress)
+			onProgress(bytesCopied);
+	}
+#endif
+
+	QByteArray buffer;
+	buffer.resize(int(bufferSize));
+
+	qint64 bytesSinceProgress = 0;
+	while(true) {
+		const qint64 bytesRead = source.read(buffer.data(), buffer.size());
+
+		if(bytesRead == 0)
+			break;
+
+		if(bytesRead < 0 || target.write(buffer.data(), bytesRead) != bytesRead)
+			return false;
+
+		bytesSinceProgress += bytesRead;
+		if(onProgress && bytesSinceProgress >= chunkSize) {
+			onProgress(bytesSinceProgress);
+			bytesSinceProgress = 0;
+		}
+	}
+
+	if(onProgress && bytesSinceProgress)
+		onProgress(bytesSinceProgress);
+
+	return true;
+}
+
+bool FileCopy::cloneFile(const QString &sourceFilePath, const QString &targetFilePath)
+{
+#ifdef FILECOPY_FICLONE
+	QFile source(sourceFilePath);
+	QFile target(targetFilePath);
+
+	// An existing target is neither truncated nor removed below, the clone just fails
+	if(!source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly | QIODevice::NewOnly))
+		return false;
+
+	if(ioctl(target.handle(), FICLONE, source.handle()) == 0)
+		return true;
+
+	target.remove();
+	return false;
+#else
+	Q_UNUSED(sourceFilePath);
+	Q_UNUSED(targetFilePath);
+	return false;
+#endif
+}
+
+bool FileCopy::isCloneSupported(const QString &dirPath)
+{
+#ifdef FILECOPY_FICLONE
+	QTemporaryFile probe(QDir(dirPath).absoluteFilePath(".reflink-XXXXXX"));
+	if(!probe.open() || probe.write("x", 1) != 1 || !probe.flush())
+		return false;
+
+	const QString clonePath = probe.fileName() + ".clone";
+	const bool result = cloneFile(probe.fileName(), clonePath);
+
+	QFile::remove(clonePath);
+	return result;
+#else
+	Q_UNUSED(dirPath);
+	return false;
+#endif
+}
+
+bool FileCopy::updateChangedBlocks(QFile &source, QFile &target, qint64 &bytesWritten)
+{
+	bytesWritten = 0;
+
+	QByteArray sourceBuffer;
+	sourceBuffer.resize(int(bufferSize));
+
+	qint64 position = 0;
+	while(true) {
+		const qint64 sourceRead = source.read(sourceBuffer.data(), bufferSize);
+
+		if(sourceRead == 0)
+			break;
+
+		if(sourceRead < 0 || !updateChangedBlocks(target, position, sourceBuffer.constData(), sourceRead, bytesWritten))
+			return false;
+
+		position += sourceRead;
+	}
+
+	return target.resize(position) && target.flush();
+}
+
+bool FileCopy::updateChangedBlocks(QFile &target, qint64 position, const char *data, qint64 length, qint64 &bytesWritten)
+{
+	if(!target.seek(position))
+		return false;
+
+	QByteArray targetBuffer;
+	targetBuffer.resize(int(length));
+
+	// Shorter than length at the end of a target that grows
+	const qint64 targetRead = target.read(targetBuffer.data(), length);
+	if(targetRead < 0)
+		return false;
+
+	for(qint64 offset = 0; offset < length; offset += deltaBlockSize) {
+		const qint64 blockLength = qMin(deltaBlockSize, length - offset);
+
+		if(offset + blockLength <= targetRead && std::memcmp(data + offset, targetBuffer.constData() + offset, size_t(blockLength)) == 0)
+			continue;
+
+		if(!target.seek(position + offset) || target.write(data + offset, blockLength) != blockLength)
+			return false;
+
+		bytesWritten += blockLength;
+	}
+
+	return true;
+}
+
+bool FileCopy::syncToDisk(QFile &file)
+{
+	if(!file.flush())
+		return false;
+
+#if defined(Q_OS_WIN)
+	return FlushFileBuffers(HANDLE(_get_osfhandle(file.handle())));
+#elif defined(Q_OS_UNIX)
+	return fsync(file.handle()) == 0;
+#else
+	return true;
+#endif
+}
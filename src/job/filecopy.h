@@ -0,0 +1,51 @@
+#ifndef FILECOPY_H
+#define FILECOPY_H
+
+#include <functional>
+
+#include <QFile>
+
+/// Copying of file contents between opened files
+class FileCopy
+{
+
+public:
+	/// Called with the number of bytes copied since the last call
+	using ProgressFunc = std::function<void(qint64)>;
+
+public:
+	/// Copies the rest of source to target, both opened with no data read or written through QFile yet; returns false on read or write error.
+	/// On Linux the data is copied by the kernel (copy_file_range) without passing through user space, falling back to buffered copying where it is not supported.
+	static bool copyData(QFile &source, QFile &target, const ProgressFunc &onProgress = ProgressFunc());
+
+	/// Creates targetFilePath as a copy-on-write clone of sourceFilePath (FICLONE), sharing its data blocks; returns false if the file system does not support it
+	/// or targetFilePath exists already (the existing file is left as it is)
+	static bool cloneFile(const QString &sourceFilePath, const QString &targetFilePath);
+
+	/// Whether files in dirPath can be cloned, probed with a temporary file
+	static bool isCloneSupported(const QString &dirPath);
+
+	/// Makes target (opened read-write) equal to source by rewriting only the blocks that differ, so that the unchanged blocks stay shared with a clone.
+	/// bytesWritten receives the number of bytes rewritten; returns false on read or write error.
+	static bool updateChangedBlocks(QFile &source, QFile &target, qint64 &bytesWritten);
+
+	/// Same for a piece of the source data that belongs at position in target; adds the number of bytes rewritten to bytesWritten.
+	/// The caller resizes and flushes target once all the data was passed.
+	static bool updateChangedBlocks(QFile &target, qint64 position, const char *data, qint64 length, qint64 &bytesWritten);
+
+	/// Flushes the file to the storage device (fsync), so that the data written so far survives a crash
+	static bool syncToDisk(QFile &file);
+
+private:
+	/// Size of the blocks the progress is reported by
+	static const qint64 chunkSize = 64 * 1024 * 1024;
+
+	/// Buffer of the fallback copy and of the block comparison
+	static const qint64 bufferSize = 1024 * 1024;
+
+	/// Granularity of the block comparison
+	static const qint64 deltaBlockSize = 64 * 1024;
+
+};
+
+#endif // FILECOPY_H
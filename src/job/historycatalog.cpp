@@ -0,0 +1,115 @@
+#include "historycatalog.h"
+
+#include <QCoreApplication>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include "job/dbschema.h"
+#include "threaddb/dbpagedmodel.h"
+
+HistoryCatalog::Query HistoryCatalog::searchPaths(DBManager *db, qlonglong dirId, const QString &pattern, qlonglong changedSince)
+{
+	Query result;
+	QStringList conditions;
+
+	const QString trimmedPattern = pattern.trimmed();
+	if(!trimmedPattern.isEmpty()) {
+		// The full text index narrows the candidates to paths containing the words, the LIKE then checks the exact pattern
+		const QString match = matchQuery(trimmedPattern);
+		if(!match.isEmpty() && DBSchema::hasPathSearch(db)) {
+			conditions << "p.id IN (SELECT rowid FROM pathSearch WHERE pathSearch MATCH ?)";
+			result.args << match;
+		}
+
+		conditions << "p.filePath LIKE ? ESCAPE '\\'";
+		result.args << likePattern(trimmedPattern);
+	}
+
+	if(dirId != -1) {
+		conditions << "p.backupDirectory = ?";
+		result.args << dirId;
+	}
+
+	if(changedSince != -1) {
+		conditions << "p.lastChanged >= ?";
+		result.args << changedSince;
+	}
+
+	// Ordered by the unique index, so that the pages do not need to sort the whole result and each of them seeks to its first row
+	conditions << DBPagedModel::keysetCondition;
+	result.keyColumns = QStringList{"p.backupDirectory", "p.filePath"};
+
+	result.text = QString("SELECT p.backupDirectory, p.filePath AS '%1', strftime('%2', datetime(p.lastChanged, 'unixepoch', 'localtime')) AS '%3' FROM paths p WHERE (%4) ORDER BY p.backupDirectory, p.filePath").arg(
+				QCoreApplication::translate("HistoryCatalog", "Soubor"),
+				QCoreApplication::translate("HistoryCatalog", "%d.%m.%Y %H:%M"),
+				QCoreApplication::translate("HistoryCatalog", "Poslední změna"),
+				conditions.join(") AND ("));
+
+	return result;
+}
+
+HistoryCatalog::Query HistoryCatalog::versions(qlonglong dirId, const QString &filePath)
+{
+	Query result;
+
+	// history.version is the time the version was replaced, the current copy sorts above all of them; a new file waiting in the stage has no copy yet
+	result.text = QString("SELECT 9223372036854775807 AS sortKey, '%1' AS '%2', f.filePath AS '%3', d.remoteDir "
+						  "FROM files f JOIN backupDirectories d ON d.id = f.backupDirectory WHERE (f.backupDirectory = ?) AND (f.filePath = ?) AND (f.remoteVersion IS NOT NULL) "
+						  "UNION ALL "
+						  "SELECT h.version, '%4' || strftime('%5', datetime(h.version, 'unixepoch', 'localtime')), h.remoteFilePath, d.remoteDir "
+						  "FROM history h JOIN backupDirectories d ON d.id = h.backupDirectory WHERE (h.backupDirectory = ?) AND (h.originalFilePath = ?) "
+						  "ORDER BY 1 DESC").arg(
+				QCoreApplication::translate("HistoryCatalog", "aktuální"),
+				QCoreApplication::translate("HistoryCatalog", "Verze"),
+				QCoreApplication::translate("HistoryCatalog", "Záložní kopie"),
+				QCoreApplication::translate("HistoryCatalog", "platná do "),
+				QCoreApplication::translate("HistoryCatalog", "%d.%m.%Y %H:%M"));
+	result.args = {dirId, filePath, dirId, filePath};
+
+	return result;
+}
+
+QString HistoryCatalog::likePattern(const QString &pattern)
+{
+	QString result;
+	const bool hasWildcards = pattern.contains('*') || pattern.contains('?');
+
+	for(const QChar c : pattern) {
+		if(c == '\\' || c == '%' || c == '_')
+			result += '\\' + QString(c);
+		else if(hasWildcards && c == '*')
+			result += '%';
+		else if(hasWildcards && c == '?')
+			result += '_';
+		else
+			result += c;
+	}
+
+	return hasWildcards ? result : '%' + result + '%';
+}
+
+QString HistoryCatalog::matchQuery(const QString &pattern)
+{
+	static const QRegularExpression word("[\\p{L}\\p{N}]+");
+
+	const bool hasWildcards = pattern.contains('*') || pattern.contains('?');
+
+	// Indexed words are the runs of letters and digits. A word of the pattern is a prefix of an indexed word only if it starts where the path word starts:
+	// after a separator, or at the start of a wildcard pattern. A plain pattern is a substring and may start in the middle of a word, except for a single word,
+	// which is searched as a word prefix (a substring search would have to scan all the paths; "*word*" does that).
+	// Quoted words are not parsed as FTS5 operators.
+	const bool isSingleWord = !hasWildcards && word.match(pattern).capturedLength() == pattern.size();
+
+	QStringList terms;
+	QRegularExpressionMatchIterator it = word.globalMatch(pattern);
+	while(it.hasNext()) {
+		const QRegularExpressionMatch match = it.next();
+		const int start = match.capturedStart();
+
+		const bool isWordStart = start == 0 ? (hasWildcards || isSingleWord) : (pattern.at(start - 1) != '*' && pattern.at(start - 1) != '?');
+		if(isWordStart)
+			terms << '"' + match.captured() + "\"*";
+	}
+
+	return terms.join(' ');
+}
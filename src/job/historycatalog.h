@@ -0,0 +1,41 @@
+#ifndef HISTORYCATALOG_H
+#define HISTORYCATALOG_H
+
+#include <QString>
+#include <QStringList>
+
+#include "threaddb/dbmanager.h"
+
+/// Queries of the history browser over the paths table (and its full text index pathSearch, if available).
+/// The queries are ordered by indexed columns and have no LIMIT, so that they can be paged by DBPagedModel.
+class HistoryCatalog
+{
+
+public:
+	struct Query {
+		QString text;
+		DBManager::Args args;
+
+		/// Key the query is paged by, see DBPagedModel::setQuery
+		QStringList keyColumns;
+	};
+
+public:
+	/// Paths of files that were ever backed up; dirId -1 = all directories, changedSince -1 = any time.
+	/// pattern is a substring of the path, or a wildcard pattern if it contains '*' or '?'. A single word (no wildcards) is looked up as the start of a word of the path
+	/// in the full text index, "*word*" finds it inside words as well. Columns: backupDirectory, path, last change; paged by keyset.
+	static Query searchPaths(DBManager *db, qlonglong dirId, const QString &pattern, qlonglong changedSince = -1);
+
+	/// Backed up versions of a file, the current copy first. Columns: sort key, version, path of the copy (relative to the backup directory or absolute), backup directory.
+	static Query versions(qlonglong dirId, const QString &filePath);
+
+private:
+	/// LIKE pattern with the '\' escape
+	static QString likePattern(const QString &pattern);
+
+	/// FTS5 query preselecting the paths that can match pattern, empty if no word of pattern can be looked up in the index
+	static QString matchQuery(const QString &pattern);
+
+};
+
+#endif // HISTORYCATALOG_H
@@ -1,11 +1,18 @@
 #include "jobthread.h"
 
+#include <chrono>
+
 #include <QtConcurrent/QtConcurrent>
 #include <QMutexLocker>
 
+#include "tracer.h"
+
 JobThread::JobThread()
 {
-	thread_ = std::thread([=]{threadFunction();});
+	thread_ = std::thread([=]{
+		Tracer::setThreadName("JobThread");
+		threadFunction();
+	});
 }
 
 JobThread::~JobThread()
@@ -20,8 +27,14 @@ JobThread::~JobThread()
 
 void JobThread::executeNonblocking(JobThread::Job job)
 {
+	quint64 flowId = 0;
+	if(Tracer::isEnabled()) {
+		flowId = Tracer::newFlowId();
+		Tracer::flowStart("jobthread", "job", flowId);
+	}
+
 	QMutexLocker ml(&mutex_);
-	jobQueue_.enqueue(job);
+	jobQueue_.enqueue({job, now(), flowId});
 	wakeCondition_.wakeOne();
 }
 
@@ -41,6 +54,23 @@ void JobThread::executeBlocking(JobThread::Job job)
 	c.wait(&m);
 }
 
+JobThread::Stats JobThread::stats() const
+{
+	Stats result;
+	result.executedJobs = executedJobs_.load(std::memory_order_relaxed);
+	result.waitNsecs = waitNsecs_.load(std::memory_order_relaxed);
+	result.execNsecs = execNsecs_.load(std::memory_order_relaxed);
+
+	QMutexLocker ml(&mutex_);
+	result.backlog = jobQueue_.size();
+	return result;
+}
+
+qint64 JobThread::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void JobThread::threadFunction()
 {
 	mutex_.lock();
@@ -57,10 +87,22 @@ void JobThread::threadFunction()
 
 		}
 
-		Job job = jobQueue_.dequeue();
+		QueuedJob job = jobQueue_.dequeue();
 		mutex_.unlock();
 
-		job();
+		const qint64 started = now();
+		if(job.flowId)
+			Tracer::flowEnd("jobthread", "job", job.flowId);
+
+		job.job();
+		const qint64 finished = now();
+
+		if(job.flowId)
+			Tracer::complete("jobthread", "job", started, "waitUs", QString::number((started - job.enqueued) / 1000));
+
+		waitNsecs_.fetch_add(started - job.enqueued, std::memory_order_relaxed);
+		execNsecs_.fetch_add(finished - started, std::memory_order_relaxed);
+		executedJobs_.fetch_add(1, std::memory_order_relaxed);
 
 		mutex_.lock();
 	}
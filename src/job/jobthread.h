@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <thread>
+#include <atomic>
 
 #include <QQueue>
 #include <QMutex>
@@ -18,20 +19,48 @@ public:
 	JobThread();
 	~JobThread();
 
+	/// Cumulative counters for monitoring
+	struct Stats {
+		quint64 executedJobs;
+
+		/// Time the executed jobs spent waiting in the queue and executing
+		qint64 waitNsecs, execNsecs;
+
+		/// Jobs currently waiting in the queue
+		int backlog;
+	};
+
 public:
 	void executeNonblocking(Job job);
 	void executeBlocking(Job job);
 
+	Stats stats() const;
+
 private:
 	void threadFunction();
 
 private:
-	QQueue<Job> jobQueue_;
+	struct QueuedJob {
+		Job job;
+		qint64 enqueued;
+
+		/// Links the enqueue and the execution in the trace (0 when tracing is disabled)
+		quint64 flowId;
+	};
+
+	static qint64 now();
+
+private:
+	QQueue<QueuedJob> jobQueue_;
 	QWaitCondition wakeCondition_, quitCondition_;
-	QMutex mutex_;
+	mutable QMutex mutex_;
 	bool doQuit_ = false;
 	std::thread thread_;
 
+private:
+	std::atomic<quint64> executedJobs_{0};
+	std::atomic<qint64> waitNsecs_{0}, execNsecs_{0};
+
 };
 
 #endif // JOBTHREAD_H
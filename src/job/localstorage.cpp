@@ -0,0 +1,111 @@
+#include "localstorage.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QThread>
+
+LocalStorage::LocalStorage(const QString &rootDir) :
+	StorageBackend(qMax(4, QThread::idealThreadCount())),
+	rootQDir_(rootDir)
+{
+
+}
+
+LocalStorage::~LocalStorage()
+{
+	waitForDone();
+}
+
+QString LocalStorage::localDir() const
+{
+	return rootQDir_.path();
+}
+
+QString LocalStorage::location(const QString &path) const
+{
+	return rootQDir_.absoluteFilePath(path);
+}
+
+bool LocalStorage::isAvailable()
+{
+	return rootQDir_.exists();
+}
+
+bool LocalStorage::isEmpty()
+{
+	return rootQDir_.isEmpty();
+}
+
+bool LocalStorage::exists(const QString &path)
+{
+	return QFile::exists(rootQDir_.absoluteFilePath(path));
+}
+
+qint64 LocalStorage::size(const QString &path)
+{
+	const QFileInfo fileInfo(rootQDir_.absoluteFilePath(path));
+	return fileInfo.exists() ? fileInfo.size() : -1;
+}
+
+bool LocalStorage::mkpath(const QString &dirPath)
+{
+	return QDir().mkpath(rootQDir_.absoluteFilePath(dirPath));
+}
+
+void LocalStorage::rmpath(const QString &path)
+{
+	rootQDir_.rmpath(path);
+}
+
+bool LocalStorage::put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress)
+{
+	return copy(sourceFilePath, rootQDir_.absoluteFilePath(path), onProgress);
+}
+
+bool LocalStorage::get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress)
+{
+	return copy(rootQDir_.absoluteFilePath(path), targetFilePath, onProgress);
+}
+
+bool LocalStorage::rename(const QString &path, const QString &newPath)
+{
+	return QFile::rename(rootQDir_.absoluteFilePath(path), rootQDir_.absoluteFilePath(newPath));
+}
+
+bool LocalStorage::remove(const QString &path)
+{
+	return QFile::remove(rootQDir_.absoluteFilePath(path));
+}
+
+bool LocalStorage::list(const QString &dirPath, QStringList &filePaths)
+{
+	const QDir dir(rootQDir_.absoluteFilePath(dirPath));
+	filePaths.clear();
+
+	// A missing subdirectory has no files, a missing root is an unavailable share
+	if(!rootQDir_.exists())
+		return false;
+
+	QDirIterator iter(dir.path(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+	while(iter.hasNext())
+		filePaths.append(dir.relativeFilePath(iter.next()));
+
+	return true;
+}
+
+bool LocalStorage::copy(const QString &sourceFilePath, const QString &targetFilePath, const ProgressFunc &onProgress)
+{
+	QFile source(sourceFilePath);
+	QFile target(targetFilePath);
+
+	if(!source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly))
+		return false;
+
+	if(!FileCopy::copyData(source, target, onProgress) || !target.flush()) {
+		target.remove();
+		return false;
+	}
+
+	return true;
+}
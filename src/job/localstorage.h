@@ -0,0 +1,41 @@
+#ifndef LOCALSTORAGE_H
+#define LOCALSTORAGE_H
+
+#include <QDir>
+
+#include "job/storagebackend.h"
+
+/// Backup directory in the local file system or on a mounted share.
+class LocalStorage : public StorageBackend
+{
+
+public:
+	explicit LocalStorage(const QString &rootDir);
+	~LocalStorage() override;
+
+public:
+	QString localDir() const override;
+	QString location(const QString &path) const override;
+
+	bool isAvailable() override;
+	bool isEmpty() override;
+	bool exists(const QString &path) override;
+	qint64 size(const QString &path) override;
+	bool mkpath(const QString &dirPath) override;
+	void rmpath(const QString &path) override;
+	bool put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress = ProgressFunc()) override;
+	bool get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress = ProgressFunc()) override;
+	bool rename(const QString &path, const QString &newPath) override;
+	bool remove(const QString &path) override;
+	bool list(const QString &dirPath, QStringList &filePaths) override;
+
+private:
+	/// Copies between two local files; a half written target is removed
+	static bool copy(const QString &sourceFilePath, const QString &targetFilePath, const ProgressFunc &onProgress);
+
+private:
+	const QDir rootQDir_;
+
+};
+
+#endif // LOCALSTORAGE_H
@@ -0,0 +1,107 @@
+#include "logsink.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+
+LogRecord::LogRecord(LogLevel level, const QString &directory, const char *context, const char *format, int argCount) :
+	level(level),
+	time(QDateTime::currentMSecsSinceEpoch()),
+	directory(directory),
+	context(context),
+	format(format),
+	argCount(argCount)
+{
+
+}
+
+QString LogRecord::text() const
+{
+	const QString result = QCoreApplication::translate(context, format);
+
+	// Multi-arg overloads substitute in a single pass, so placeholders in the arguments (file names) stay untouched
+	switch(argCount) {
+	case 1: return result.arg(args[0]);
+	case 2: return result.arg(args[0], args[1]);
+	case 3: return result.arg(args[0], args[1], args[2]);
+	default: return result;
+	}
+}
+
+LogSink::LogSink(int capacityBits) :
+	cells_(new Cell[size_t(1) << capacityBits]),
+	mask_((size_t(1) << capacityBits) - 1)
+{
+	for(size_t i = 0; i <= mask_; i++)
+		cells_[i].sequence.store(i, std::memory_order_relaxed);
+
+	enqueuePos_.store(0, std::memory_order_relaxed);
+	dequeuePos_ = 0;
+	droppedCount_.store(0, std::memory_order_relaxed);
+	lastLogTime_.store(QDateTime::currentMSecsSinceEpoch(), std::memory_order_relaxed);
+}
+
+int LogSink::drain(QVector<LogRecord> &out, int maxCount)
+{
+	int result = 0;
+
+	while(result < maxCount) {
+		Cell &cell = cells_[dequeuePos_ & mask_];
+
+		// The cell is published by the producer by setting its sequence to pos + 1
+		if(cell.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1)
+			break;
+
+		out.append(LogRecord());
+		std::swap(out.last(), cell.record);
+
+		// Hand the cell back to the producers for the next lap around the buffer
+		cell.sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+		dequeuePos_ ++;
+		result ++;
+	}
+
+	return result;
+}
+
+quint64 LogSink::takeDroppedCount()
+{
+	return droppedCount_.exchange(0, std::memory_order_relaxed);
+}
+
+qint64 LogSink::msecsSinceLastLog() const
+{
+	return QDateTime::currentMSecsSinceEpoch() - lastLogTime_.load(std::memory_order_relaxed);
+}
+
+void LogSink::push(LogRecord &&record)
+{
+	lastLogTime_.store(record.time, std::memory_order_relaxed);
+
+	size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+	Cell *cell;
+
+	while(true) {
+		cell = &cells_[pos & mask_];
+		const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		const std::ptrdiff_t diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos);
+
+		// Cell is free -> try to claim it
+		if(diff == 0) {
+			if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+
+		// Cell still holds a message from the previous lap -> the buffer is full
+		else if(diff < 0) {
+			droppedCount_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		// Another producer claimed the cell meanwhile
+		else
+			pos = enqueuePos_.load(std::memory_order_relaxed);
+	}
+
+	cell->record = std::move(record);
+	cell->sequence.store(pos + 1, std::memory_order_release);
+}
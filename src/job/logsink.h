@@ -0,0 +1,109 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <atomic>
+#include <memory>
+
+#include <QString>
+#include <QVector>
+
+enum class LogLevel {
+	info,
+	success,
+	warning,
+	error
+};
+
+/// Message as queued by the producer; translation and argument substitution are deferred until the message is displayed
+struct LogRecord
+{
+	LogRecord() = default;
+
+	/// Record with the current time
+	LogRecord(LogLevel level, const QString &directory, const char *context, const char *format, int argCount = 0);
+
+	LogLevel level = LogLevel::info;
+
+	/// Milliseconds since epoch
+	qint64 time = 0;
+
+	/// Source directory of the backup the message relates to (empty if none)
+	QString directory;
+
+	/// Translation context and untranslated format (marked with QT_TR_NOOP) with %1..%3 placeholders
+	const char *context = nullptr;
+	const char *format = nullptr;
+
+	QString args[3];
+	int argCount = 0;
+
+	/// Translated message with the arguments substituted
+	QString text() const;
+};
+
+/// Bounded lock-free log queue with any number of producer threads and a single consumer (the GUI).
+/// Producers never wait for the consumer; messages that do not fit into the buffer are dropped and counted.
+class LogSink
+{
+
+public:
+	/// The buffer holds 2^capacityBits messages
+	explicit LogSink(int capacityBits = 14);
+
+public:
+	/// Thread safe, lock free
+	void log(LogLevel level, const QString &directory, const char *context, const char *format) {
+		push(LogRecord(level, directory, context, format));
+	}
+	void log(LogLevel level, const QString &directory, const char *context, const char *format, const QString &arg1) {
+		LogRecord r(level, directory, context, format, 1);
+		r.args[0] = arg1;
+		push(std::move(r));
+	}
+	void log(LogLevel level, const QString &directory, const char *context, const char *format, const QString &arg1, const QString &arg2) {
+		LogRecord r(level, directory, context, format, 2);
+		r.args[0] = arg1;
+		r.args[1] = arg2;
+		push(std::move(r));
+	}
+	void log(LogLevel level, const QString &directory, const char *context, const char *format, const QString &arg1, const QString &arg2, const QString &arg3) {
+		LogRecord r(level, directory, context, format, 3);
+		r.args[0] = arg1;
+		r.args[1] = arg2;
+		r.args[2] = arg3;
+		push(std::move(r));
+	}
+
+public:
+	/// Moves up to maxCount queued messages to the end of out, returns the number of messages moved. Only one thread may drain the sink.
+	int drain(QVector<LogRecord> &out, int maxCount);
+
+	/// Returns the number of messages dropped since the last call
+	quint64 takeDroppedCount();
+
+	/// Milliseconds elapsed since the last message was logged
+	qint64 msecsSinceLastLog() const;
+
+private:
+	void push(LogRecord &&record);
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		LogRecord record;
+	};
+
+private:
+	std::unique_ptr<Cell[]> cells_;
+	const size_t mask_;
+
+	/// Producer and consumer positions are kept on separate cache lines
+	alignas(64) std::atomic<size_t> enqueuePos_;
+	alignas(64) size_t dequeuePos_;
+
+	std::atomic<quint64> droppedCount_;
+	std::atomic<qint64> lastLogTime_;
+
+};
+
+#endif // LOGSINK_H
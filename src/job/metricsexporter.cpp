@@ -0,0 +1,196 @@
+#include "metricsexporter.h"
+
+#include <QSaveFile>
+#include <QLocalSocket>
+#include <QTextStream>
+
+#include "job/backupmanager.h"
+#include "job/runstats.h"
+#include "threaddb/dbmanager.h"
+#include "threaddb/dbsnapshot.h"
+#include "job/processmemory.h"
+
+static const char *outcomeLabels[] = {"new", "changed", "unchanged", "removed", "failed"};
+static const char *phaseLabels[] = {"walk", "stat", "exclude_matching", "catalog_lookup", "copy", "history_rename", "pruning", "db_commit"};
+
+static QString escapeLabel(QString value)
+{
+	return value.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+}
+
+static void writeHeader(QTextStream &out, const char *name, const char *type, const char *help)
+{
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " " << type << "\n";
+}
+
+/// Histogram buckets are cumulative in Prometheus; bucket i of RunStats::Histogram ends at 2^i µs
+static void writeHistogram(QTextStream &out, const char *name, const RunStats::Histogram &histogram, qint64 sumNsecs)
+{
+	quint64 count = 0;
+	for(int i = 0; i < RunStats::Histogram::bucketCount - 1; i++) {
+		count += histogram.bucket(i);
+		out << name << "_bucket{le=\"" << QString::number(double(quint64(1) << i) / 1000000.0, 'g', 10) << "\"} " << count << "\n";
+	}
+
+	count += histogram.bucket(RunStats::Histogram::bucketCount - 1);
+	out << name << "_bucket{le=\"+Inf\"} " << count << "\n";
+	out << name << "_sum " << double(sumNsecs) / 1e9 << "\n";
+	out << name << "_count " << count << "\n";
+}
+
+MetricsExporter::MetricsExporter(DBManager *db, BackupManager *backupManager) :
+	db_(db),
+	backupManager_(backupManager)
+{
+	connect(&publishTimer_, SIGNAL(timeout()), this, SLOT(publish()));
+	connect(&server_, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+
+	rateTimer_.start();
+	publishTimer_.start(publishInterval);
+}
+
+void MetricsExporter::setTextfilePath(const QString &path)
+{
+	textfilePath_ = path;
+}
+
+bool MetricsExporter::listen(const QString &socketName)
+{
+	// Socket file left behind by a crashed instance would make listen() fail
+	QLocalServer::removeServer(socketName);
+	return server_.listen(socketName);
+}
+
+QString MetricsExporter::render()
+{
+	const RunStats &totals = backupManager_->totals();
+
+	QString result;
+	QTextStream out(&result);
+
+	writeHeader(out, "strawbackup_backup_running", "gauge", "1 while a directory is being backed up.");
+	out << "strawbackup_backup_running " << (backupManager_->isBackupRunning() ? 1 : 0) << "\n";
+
+	writeHeader(out, "strawbackup_files_total", "counter", "Files processed since start by outcome.");
+	for(int i = 0; i < int(RunStats::Outcome::count); i++)
+		out << "strawbackup_files_total{outcome=\"" << outcomeLabels[i] << "\"} " << totals.fileCount(RunStats::Outcome(i)) << "\n";
+
+	writeHeader(out, "strawbackup_bytes_copied_total", "counter", "Bytes copied since start by outcome.");
+	out << "strawbackup_bytes_copied_total{outcome=\"new\"} " << totals.byteCount(RunStats::Outcome::newFile) << "\n";
+	out << "strawbackup_bytes_copied_total{outcome=\"changed\"} " << totals.byteCount(RunStats::Outcome::changed) << "\n";
+
+	writeHeader(out, "strawbackup_reflinked_versions_total", "counter", "History versions made as reflinks of the previous copy since start.");
+	out << "strawbackup_reflinked_versions_total " << totals.reflinkCount() << "\n";
+
+	writeHeader(out, "strawbackup_reflink_saved_bytes_total", "counter", "Bytes saved by reflinked history versions since start.");
+	out << "strawbackup_reflink_saved_bytes_total{kind=\"written\"} " << totals.bytesWriteSaved() << "\n";
+	out << "strawbackup_reflink_saved_bytes_total{kind=\"space\"} " << totals.bytesSpaceSaved() << "\n";
+
+	writeHeader(out, "strawbackup_metadata_requests_total", "counter", "Exists, mkpath and availability checks of the destinations since start, sent or answered by the cache of the run.");
+	out << "strawbackup_metadata_requests_total{result=\"sent\"} " << totals.metadataRequestCount() << "\n";
+	out << "strawbackup_metadata_requests_total{result=\"cached\"} " << totals.metadataRequestsSaved() << "\n";
+
+	writeHeader(out, "strawbackup_files_per_second", "gauge", "Files processed per second over the last publish interval.");
+	out << "strawbackup_files_per_second " << filesPerSecond_ << "\n";
+
+	writeHeader(out, "strawbackup_bytes_per_second", "gauge", "Bytes copied per second over the last publish interval.");
+	out << "strawbackup_bytes_per_second " << bytesPerSecond_ << "\n";
+
+	writeHeader(out, "strawbackup_phase_seconds_total", "counter", "Time spent in backup phases, summed over threads.");
+	for(int i = 0; i < int(RunStats::Phase::count); i++)
+		out << "strawbackup_phase_seconds_total{phase=\"" << phaseLabels[i] << "\"} " << double(totals.phaseTime(RunStats::Phase(i))) / 1e9 << "\n";
+
+	writeHeader(out, "strawbackup_copy_duration_seconds", "histogram", "Duration of file copies.");
+	writeHistogram(out, "strawbackup_copy_duration_seconds", totals.copyLatency, totals.phaseTime(RunStats::Phase::copy));
+
+	writeHeader(out, "strawbackup_db_wait_duration_seconds", "histogram", "Time the backup thread waited for catalog lookups and commits.");
+	writeHistogram(out, "strawbackup_db_wait_duration_seconds", totals.dbLatency, totals.phaseTime(RunStats::Phase::catalogLookup) + totals.phaseTime(RunStats::Phase::dbCommit));
+
+	writeHeader(out, "strawbackup_copy_queue_depth", "gauge", "Files queued for or being copied by the copy threads.");
+	out << "strawbackup_copy_queue_depth " << backupManager_->pendingCopyCount() << "\n";
+
+	const qint64 residentBytes = ProcessMemory::residentBytes();
+	if(residentBytes >= 0) {
+		writeHeader(out, "strawbackup_resident_memory_bytes", "gauge", "Resident memory of the process.");
+		out << "strawbackup_resident_memory_bytes " << residentBytes << "\n";
+	}
+
+	const qint64 idleResidentBytes = backupManager_->idleResidentBytes();
+	if(idleResidentBytes >= 0) {
+		writeHeader(out, "strawbackup_idle_resident_memory_bytes", "gauge", "Resident memory of the process after the memory was released at the end of the last backup check.");
+		out << "strawbackup_idle_resident_memory_bytes " << idleResidentBytes << "\n";
+	}
+
+	const JobThread::Stats writerStats = db_->writerStats();
+	const JobThread::Stats readerStats = db_->readerStats();
+
+	writeHeader(out, "strawbackup_db_queue_depth", "gauge", "Database jobs waiting in the connection queues.");
+	out << "strawbackup_db_queue_depth{connection=\"writer\"} " << writerStats.backlog << "\n";
+	out << "strawbackup_db_queue_depth{connection=\"reader\"} " << readerStats.backlog << "\n";
+
+	writeHeader(out, "strawbackup_db_jobs_total", "counter", "Database jobs executed.");
+	out << "strawbackup_db_jobs_total{connection=\"writer\"} " << writerStats.executedJobs << "\n";
+	out << "strawbackup_db_jobs_total{connection=\"reader\"} " << readerStats.executedJobs << "\n";
+
+	writeHeader(out, "strawbackup_db_job_wait_seconds_total", "counter", "Time database jobs spent queued.");
+	out << "strawbackup_db_job_wait_seconds_total{connection=\"writer\"} " << double(writerStats.waitNsecs) / 1e9 << "\n";
+	out << "strawbackup_db_job_wait_seconds_total{connection=\"reader\"} " << double(readerStats.waitNsecs) / 1e9 << "\n";
+
+	writeHeader(out, "strawbackup_db_job_exec_seconds_total", "counter", "Time spent executing database jobs.");
+	out << "strawbackup_db_job_exec_seconds_total{connection=\"writer\"} " << double(writerStats.execNsecs) / 1e9 << "\n";
+	out << "strawbackup_db_job_exec_seconds_total{connection=\"reader\"} " << double(readerStats.execNsecs) / 1e9 << "\n";
+
+	writeHeader(out, "strawbackup_last_success_timestamp_seconds", "gauge", "Time of the last finished backup of the directory.");
+	{
+		DBSnapshot snapshot(db_);
+		DBQuery directory = snapshot.selectQuery("SELECT sourceDir, lastFinishedBackup FROM backupDirectories WHERE lastFinishedBackup IS NOT NULL");
+		while(directory.next())
+			out << "strawbackup_last_success_timestamp_seconds{directory=\"" << escapeLabel(directory.value("sourceDir").toString()) << "\"} " << directory.value("lastFinishedBackup").toLongLong() << "\n";
+	}
+
+	out.flush();
+	return result;
+}
+
+void MetricsExporter::publish()
+{
+	updateRates();
+
+	if(textfilePath_.isEmpty())
+		return;
+
+	// The collector must never see a partially written file
+	QSaveFile file(textfilePath_);
+	if(!file.open(QIODevice::WriteOnly))
+		return;
+
+	file.write(render().toUtf8());
+	file.commit();
+}
+
+void MetricsExporter::onNewConnection()
+{
+	while(QLocalSocket *socket = server_.nextPendingConnection()) {
+		connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+		socket->write(render().toUtf8());
+		socket->disconnectFromServer();
+	}
+}
+
+void MetricsExporter::updateRates()
+{
+	const RunStats &totals = backupManager_->totals();
+
+	quint64 files = 0;
+	for(int i = 0; i < int(RunStats::Outcome::count); i++)
+		files += totals.fileCount(RunStats::Outcome(i));
+
+	const quint64 bytes = totals.byteCount(RunStats::Outcome::newFile) + totals.byteCount(RunStats::Outcome::changed);
+	const double seconds = qMax<qint64>(1, rateTimer_.restart()) / 1000.0;
+
+	filesPerSecond_ = (files - lastFiles_) / seconds;
+	bytesPerSecond_ = (bytes - lastBytes_) / seconds;
+	lastFiles_ = files;
+	lastBytes_ = bytes;
+}
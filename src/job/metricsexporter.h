@@ -0,0 +1,57 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QLocalServer>
+
+class DBManager;
+class BackupManager;
+
+/// Publishes BackupManager and DBManager counters in the Prometheus text format:
+/// periodically into a node-exporter textfile collector file and on request through a local (Unix) socket.
+/// All values are read from counters maintained anyway, so nothing is added to the backup hot path.
+class MetricsExporter : public QObject
+{
+	Q_OBJECT
+
+public:
+	MetricsExporter(DBManager *db, BackupManager *backupManager);
+
+public:
+	/// Empty path disables the textfile export
+	void setTextfilePath(const QString &path);
+
+	/// Starts serving the metrics on the local socket (path on Unix, pipe name on Windows); every connection receives the metrics and is closed
+	bool listen(const QString &socketName);
+
+	/// Current metrics in the Prometheus text exposition format
+	QString render();
+
+public:
+	static const int publishInterval = 15000;
+
+private slots:
+	void publish();
+	void onNewConnection();
+
+private:
+	/// Updates files/s and bytes/s since the previous call
+	void updateRates();
+
+private:
+	DBManager *db_;
+	BackupManager *backupManager_;
+	QString textfilePath_;
+	QTimer publishTimer_;
+	QLocalServer server_;
+
+private:
+	QElapsedTimer rateTimer_;
+	quint64 lastFiles_ = 0, lastBytes_ = 0;
+	double filesPerSecond_ = 0, bytesPerSecond_ = 0;
+
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,45 @@
+#include "processmemory.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#include <malloc.h>
+#include <QFile>
+#include <QList>
+#endif
+
+qint64 ProcessMemory::residentBytes()
+{
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return -1;
+
+	return qint64(counters.WorkingSetSize);
+#elif defined(Q_OS_LINUX)
+	// Second field is the resident page count
+	QFile file("/proc/self/statm");
+	if(!file.open(QIODevice::ReadOnly))
+		return -1;
+
+	const QList<QByteArray> fields = file.readAll().split(' ');
+	if(fields.size() < 2)
+		return -1;
+
+	return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+	return -1;
+#endif
+}
+
+void ProcessMemory::releaseFreeMemory()
+{
+#if defined(Q_OS_WIN)
+	HeapCompact(GetProcessHeap(), 0);
+	SetProcessWorkingSetSize(GetCurrentProcess(), SIZE_T(-1), SIZE_T(-1));
+#elif defined(Q_OS_LINUX) && defined(__GLIBC__)
+	malloc_trim(0);
+#endif
+}
@@ -0,0 +1,19 @@
+#ifndef PROCESSMEMORY_H
+#define PROCESSMEMORY_H
+
+#include <QtGlobal>
+
+/// Memory of the whole process, for the idle mode between backups
+class ProcessMemory
+{
+
+public:
+	/// Current resident set size (working set on Windows), -1 if not available on the platform
+	static qint64 residentBytes();
+
+	/// Returns the free heap memory to the system and (on Windows) trims the working set
+	static void releaseFreeMemory();
+
+};
+
+#endif // PROCESSMEMORY_H
@@ -0,0 +1,206 @@
+#include "restoremanager.h"
+
+#include <algorithm>
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFile>
+#include <QSet>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QSqlRecord>
+#include <QtConcurrent/QtConcurrent>
+
+#include "threaddb/dbmanager.h"
+#include "threaddb/dbsnapshot.h"
+#include "job/tracer.h"
+
+RestoreManager::RestoreManager(DBManager *db, LogSink *logSink) :
+	db_(db),
+	logSink_(logSink)
+{
+
+}
+
+RestoreManager::Plan RestoreManager::plan(qlonglong dirId, qlonglong time, const QString &pathPrefix)
+{
+	Plan result;
+
+	// Cleared here rather than in restore(), so that a cancel while planning also stops the restore that follows
+	isCancelled_ = false;
+
+	DBSnapshot snapshot(db_);
+
+	const QSqlRecord directory = snapshot.selectRowDef("SELECT remoteDir, keepHistoryDuration FROM backupDirectories WHERE id = ?", {dirId});
+	if(directory.isEmpty())
+		return result;
+
+	result.storage = StorageBackend::create(directory.value("remoteDir").toString());
+	StorageBackend &storage = *result.storage;
+
+	if(time < QDateTime::currentSecsSinceEpoch() - directory.value("keepHistoryDuration").toLongLong())
+		log(LogLevel::warning, QT_TR_NOOP("Verze starší než doba uchovávání již mohly být smazány, obnovená složka nemusí být úplná."));
+
+	// Prefix 'a/b' selects the file 'a/b' and everything under 'a/b/'
+	const QString prefix = pathPrefix.isEmpty() ? QString() : QDir::cleanPath(QDir::fromNativeSeparators(pathPrefix));
+	auto isSelected = [&](const QString &filePath) {
+		return prefix.isEmpty() || filePath == prefix || (filePath.startsWith(prefix) && filePath.at(prefix.size()) == '/');
+	};
+
+	// A version moved to the history after time is the one that was current at time (history.version is the time the version was replaced or deleted).
+	// The catalog does not record when a file was created, so a file created after time and changed later is restored in its first version.
+	DBQuery version = snapshot.selectQuery(
+				"SELECT originalFilePath, remoteFilePath, MIN(version) FROM history WHERE (backupDirectory = ?) AND (version > ?) GROUP BY originalFilePath",
+				{dirId, time});
+
+	while(version.next() && !isCancelled_) {
+		const QString filePath = version.value(0).toString();
+		if(isSelected(filePath))
+			result.items.append({version.value(1).toString(), filePath, 0, -1});
+	}
+
+	// Current copies that were modified before time and not replaced since (a new file waiting in the stage has a NULL remoteVersion)
+	DBQuery file = snapshot.selectQuery(
+				"SELECT filePath, remoteVersion FROM files f WHERE (backupDirectory = ?) AND (remoteVersion <= ?) "
+				"AND NOT EXISTS (SELECT 1 FROM history h WHERE (h.backupDirectory = f.backupDirectory) AND (h.originalFilePath = f.filePath) AND (h.version > ?))",
+				{dirId, time, time});
+
+	while(file.next() && !isCancelled_) {
+		const QString filePath = file.value(0).toString();
+		if(isSelected(filePath))
+			result.items.append({filePath, filePath, 0, file.value(1).toLongLong()});
+	}
+
+	if(isCancelled_)
+		return Plan();
+
+	// Sizes are needed for the progress; the stats are issued in parallel, as they are dominated by the latency of the backup storage
+	QtConcurrent::blockingMap(result.items, [this, &storage](Item &item) {
+		if(!isCancelled_)
+			item.size = qMax<qint64>(0, storage.size(item.backupFilePath));
+	});
+
+	if(isCancelled_)
+		return Plan();
+
+	for(const Item &item : result.items)
+		result.byteCount += item.size;
+
+	// Restoring in path order keeps the writes into each target directory together
+	std::sort(result.items.begin(), result.items.end(), [](const Item &a, const Item &b) {
+		return a.filePath < b.filePath;
+	});
+
+	return result;
+}
+
+bool RestoreManager::restore(const Plan &plan, const QString &targetDir, bool overwrite)
+{
+	targetDir_ = targetDir;
+
+	if(isCancelled_) {
+		log(LogLevel::warning, QT_TR_NOOP("Obnova přerušena."));
+		return false;
+	}
+
+	const QDir targetQDir(targetDir);
+	const int fileCount = plan.items.size();
+
+	if(!overwrite && targetQDir.exists() && !targetQDir.isEmpty()) {
+		log(LogLevel::error, QT_TR_NOOP("Složka '%1' není prázdná, obnova by přepsala soubory v ní."), targetDir);
+		return false;
+	}
+
+	log(LogLevel::info, QT_TR_NOOP("Obnovuji %1 souborů (%2 MB)..."), QString::number(fileCount), QString::number(plan.byteCount / (1024 * 1024)));
+
+	// Directories are created up front, so that the copy threads do not race on creating the same path
+	QSet<QString> paths;
+	for(const Item &item : plan.items)
+		paths.insert(QFileInfo(targetQDir.absoluteFilePath(item.filePath)).absolutePath());
+
+	for(const QString &path : paths) {
+		if(!QDir().mkpath(path))
+			log(LogLevel::error, QT_TR_NOOP("Nepodařilo se vytvořit cestu '%1'!"), path);
+	}
+
+	std::atomic<int> nextItem{0}, filesDone{0}, filesFailed{0};
+	std::atomic<qint64> bytesDone{0};
+
+	// Each copy thread takes the next file from the plan until there are none left
+	QThreadPool copyPool;
+	// The plan of a directory deleted meanwhile is empty and has no storage
+	copyPool.setMaxThreadCount(plan.storage ? plan.storage->maxRequestsInFlight() : 1);
+
+	for(int i = 0; i < copyPool.maxThreadCount(); i++) {
+		QtConcurrent::run(&copyPool, [&]{
+			while(!isCancelled_) {
+				const int index = nextItem ++;
+				if(index >= fileCount)
+					break;
+
+				const Item &item = plan.items[index];
+				if(!restoreFile(*plan.storage, item, targetQDir.absoluteFilePath(item.filePath), bytesDone))
+					filesFailed ++;
+
+				filesDone ++;
+			}
+		});
+	}
+
+	QElapsedTimer tmr;
+	tmr.start();
+
+	auto reportProgress = [&]{
+		const int files = filesDone;
+		const qint64 bytes = bytesDone;
+
+		// Bytes estimate the remaining time better, unless all the files are empty
+		const double fraction = plan.byteCount ? double(bytes) / plan.byteCount : fileCount ? double(files) / fileCount : 1;
+		const int etaSeconds = fraction > 0 ? int(tmr.elapsed() * (1 - fraction) / fraction / 1000) : -1;
+
+		emit progress(files, fileCount, bytes, plan.byteCount, etaSeconds);
+
+		if(logSink_->msecsSinceLastLog() >= 10000)
+			log(LogLevel::info, QT_TR_NOOP("Obnoveno souborů: %1 z %2, zbývá přibližně %3 s"), QString::number(files), QString::number(fileCount), etaSeconds >= 0 ? QString::number(etaSeconds) : QString("?"));
+	};
+
+	while(!copyPool.waitForDone(250))
+		reportProgress();
+
+	reportProgress();
+
+	if(isCancelled_) {
+		log(LogLevel::warning, QT_TR_NOOP("Obnova přerušena."));
+		return false;
+	}
+
+	if(filesFailed) {
+		log(LogLevel::error, QT_TR_NOOP("Obnova dokončena, %1 souborů se nepodařilo obnovit."), QString::number(filesFailed));
+		return false;
+	}
+
+	log(LogLevel::success, QT_TR_NOOP("Obnova dokončena za %1 s."), QString::number(tmr.elapsed() / 1000));
+	return true;
+}
+
+bool RestoreManager::restoreFile(StorageBackend &storage, const Item &item, const QString &targetFilePath, std::atomic<qint64> &bytesDone)
+{
+	const QString backupLocation = storage.location(item.backupFilePath);
+	TraceSpan span("restore", "restoreFile", "source", backupLocation);
+
+	const bool isCopied = storage.get(item.backupFilePath, targetFilePath, [&](qint64 bytes) {
+		bytesDone += bytes;
+	});
+
+	if(!isCopied) {
+		log(LogLevel::error, QT_TR_NOOP("Nepodařilo se obnovit soubor '%1' -> '%2'!"), backupLocation, targetFilePath);
+		return false;
+	}
+
+	// Opened without truncating, the time can only be set on an open file
+	QFile tgt(targetFilePath);
+	if(item.lastModified >= 0 && tgt.open(QIODevice::ReadWrite))
+		tgt.setFileTime(QDateTime::fromSecsSinceEpoch(item.lastModified), QFileDevice::FileModificationTime);
+
+	return true;
+}
@@ -0,0 +1,87 @@
+#ifndef RESTOREMANAGER_H
+#define RESTOREMANAGER_H
+
+#include <atomic>
+#include <memory>
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QDir>
+
+#include "job/logsink.h"
+#include "job/storagebackend.h"
+
+class DBManager;
+
+/// Restores a backed up directory as it was at a given time, from the current copies (files table) and the history versions.
+/// plan() and restore() are blocking and are meant to be called from a worker thread (or a command line tool).
+class RestoreManager : public QObject
+{
+	Q_OBJECT
+
+public:
+	/// File to be restored
+	struct Item {
+		/// Path of the copy in the backup directory, as stored in the catalog
+		QString backupFilePath;
+
+		/// Path relative to the restored directory
+		QString filePath;
+
+		qint64 size;
+
+		/// Modification time to be set on the restored file, -1 if not known (history versions)
+		qlonglong lastModified;
+	};
+
+	struct Plan {
+		QVector<Item> items;
+		qint64 byteCount = 0;
+
+		/// Storage of the backup directory the copies are read from
+		std::shared_ptr<StorageBackend> storage;
+	};
+
+public:
+	RestoreManager(DBManager *db, LogSink *logSink);
+
+signals:
+	/// Emitted from the thread calling restore(), at most a few times per second; etaSeconds is -1 until it can be estimated
+	void progress(int filesDone, int fileCount, qint64 bytesDone, qint64 byteCount, int etaSeconds);
+
+public:
+	/// Files of the directory as they were at time (seconds since epoch); limited to pathPrefix (relative path of a file or a subdirectory) if set.
+	/// The plan is empty if it was cancelled.
+	Plan plan(qlonglong dirId, qlonglong time, const QString &pathPrefix = QString());
+
+	/// Copies the planned files to targetDir in parallel; returns false if any of the files failed or the restore was cancelled.
+	/// The existing files of targetDir are replaced, so a non-empty targetDir is refused unless overwrite is set.
+	bool restore(const Plan &plan, const QString &targetDir, bool overwrite = false);
+
+	/// Stops the plan() or restore() in progress; thread safe. The cancel holds until the next plan(), so the restore of a cancelled plan does not start.
+	void cancel() {
+		isCancelled_ = true;
+	}
+
+private:
+	/// Called on the copy threads
+	bool restoreFile(StorageBackend &storage, const Item &item, const QString &targetFilePath, std::atomic<qint64> &bytesDone);
+
+	template<typename... Args>
+	void log(LogLevel level, const char *format, const Args &...args) {
+		logSink_->log(level, targetDir_, staticMetaObject.className(), format, args...);
+	}
+
+private:
+	DBManager *db_;
+	LogSink *logSink_;
+
+	/// Directory being restored to, tags the log messages
+	QString targetDir_;
+
+	std::atomic<bool> isCancelled_{false};
+
+};
+
+#endif // RESTOREMANAGER_H
@@ -0,0 +1,209 @@
+#include "resumablecopy.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QSqlRecord>
+
+#include "threaddb/dbmanager.h"
+
+const qint64 ResumableCopy::minFileSize;
+const qint64 ResumableCopy::blockSize;
+const int ResumableCopy::checkpointMSecs;
+const qint64 ResumableCopy::chunkSize;
+
+ResumableCopy::ResumableCopy(DBManager *db, qlonglong dirId, const QString &remoteDir, const QString &filePath) :
+	db_(db),
+	dirId_(dirId),
+	remoteDir_(remoteDir),
+	filePath_(filePath)
+{
+
+}
+
+ResumableCopy::Result ResumableCopy::copy(QFile &source, qlonglong sourceModified, const std::atomic<bool> &isInterrupted, const FileCopy::ProgressFunc &onProgress)
+{
+	const QDir remoteQDir(remoteDir_);
+	const qint64 sourceSize = source.size();
+
+	partialId_ = -1;
+	checksums_.clear();
+	bytesResumed_ = 0;
+
+	qint64 bytesDone = 0;
+	const QSqlRecord record = db_->selectRowDef(
+				"SELECT id, sourceSize, sourceModified, bytesDone, blockChecksums FROM partialCopies WHERE (backupDirectory = ?) AND (filePath = ?)",
+				{dirId_, filePath_});
+
+	if(!record.isEmpty()) {
+		// A partial copy of another version of the source is of no use
+		if(record.value("sourceSize").toLongLong() != sourceSize || record.value("sourceModified").toLongLong() != sourceModified) {
+			QFile::remove(remoteQDir.absoluteFilePath(partialPath(record.value("id").toLongLong())));
+			db_->exec("DELETE FROM partialCopies WHERE id = ?", {record.value("id")});
+
+		} else {
+			partialId_ = record.value("id").toLongLong();
+			bytesDone = record.value("bytesDone").toLongLong();
+			checksums_ = record.value("blockChecksums").toString().split(',', QString::SkipEmptyParts);
+
+			// Touched copies are not stale
+			db_->exec("UPDATE partialCopies SET lastUpdated = ? WHERE id = ?", {QDateTime::currentSecsSinceEpoch(), partialId_});
+		}
+	}
+
+	if(partialId_ == -1) {
+		partialId_ = db_->insert(
+					"INSERT INTO partialCopies (backupDirectory, filePath, sourceSize, sourceModified, bytesDone, blockChecksums, lastUpdated) VALUES (?, ?, ?, ?, 0, '', ?)",
+					{dirId_, filePath_, sourceSize, sourceModified, QDateTime::currentSecsSinceEpoch()}).toLongLong();
+	}
+
+	partialFilePath_ = remoteQDir.absoluteFilePath(partialPath(partialId_));
+	if(!QDir().mkpath(QFileInfo(partialFilePath_).absolutePath()))
+		return Result::writeError;
+
+	QFile partial(partialFilePath_);
+	if(!partial.open(QIODevice::ReadWrite))
+		return Result::writeError;
+
+	qint64 offset = verifiedOffset(partial, bytesDone);
+	if(!partial.resize(offset) || !partial.seek(offset))
+		return Result::writeError;
+
+	if(!source.seek(offset))
+		return Result::readError;
+
+	bytesResumed_ = offset;
+
+	QByteArray buffer;
+	buffer.resize(int(chunkSize));
+
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	QElapsedTimer sinceCheckpoint;
+	sinceCheckpoint.start();
+
+	while(offset < sourceSize) {
+		const qint64 blockStart = offset;
+		const qint64 blockEnd = qMin(blockStart + blockSize, sourceSize);
+
+		if(isInterrupted) {
+			checkpoint(partial, blockStart);
+			return Result::interrupted;
+		}
+
+		hash.reset();
+		while(offset < blockEnd) {
+			const qint64 bytesRead = source.read(buffer.data(), qMin<qint64>(buffer.size(), blockEnd - offset));
+
+			if(bytesRead <= 0) {
+				checkpoint(partial, blockStart);
+				return Result::readError;
+			}
+
+			// The destination may be gone, the progress stored by the last checkpoint stays
+			if(partial.write(buffer.constData(), bytesRead) != bytesRead)
+				return Result::writeError;
+
+			hash.addData(buffer.constData(), int(bytesRead));
+			offset += bytesRead;
+
+			if(onProgress)
+				onProgress(bytesRead);
+		}
+
+		checksums_.append(QString::fromLatin1(hash.result().toHex()));
+
+		if(sinceCheckpoint.elapsed() >= checkpointMSecs) {
+			if(!checkpoint(partial, offset))
+				return Result::writeError;
+
+			sinceCheckpoint.restart();
+		}
+	}
+
+	if(!FileCopy::syncToDisk(partial))
+		return Result::writeError;
+
+	partial.close();
+
+	if(!QFile::rename(partialFilePath_, remoteQDir.absoluteFilePath(filePath_)))
+		return Result::writeError;
+
+	db_->exec("DELETE FROM partialCopies WHERE id = ?", {partialId_});
+	return Result::finished;
+}
+
+int ResumableCopy::removeStale(DBManager *db, qlonglong dirId, const QString &remoteDir, qlonglong time)
+{
+	const QDir remoteQDir(remoteDir);
+	int result = 0;
+
+	DBQuery stale = db->selectQuery("SELECT id FROM partialCopies WHERE (backupDirectory = ?) AND (lastUpdated < ?)", {dirId, time});
+	while(stale.next()) {
+		QFile::remove(remoteQDir.absoluteFilePath(partialPath(stale.value(0).toLongLong())));
+		db->exec("DELETE FROM partialCopies WHERE id = ?", {stale.value(0)});
+		result ++;
+	}
+
+	return result;
+}
+
+QString ResumableCopy::partialDirName()
+{
+	return QStringLiteral(".partial");
+}
+
+qint64 ResumableCopy::verifiedOffset(QFile &partial, qint64 bytesDone)
+{
+	// Only complete blocks are resumed. The blocks before a checkpoint were synced to disk, so normally only the last one needs to be verified;
+	// if it does not match (the storage lost or tore the writes), the previous blocks are checked one by one.
+	int blockCount = int(qMin<qint64>(checksums_.size(), qMin(bytesDone, partial.size()) / blockSize));
+
+	QByteArray buffer;
+	buffer.resize(int(chunkSize));
+
+	QCryptographicHash hash(QCryptographicHash::Md5);
+
+	while(blockCount > 0) {
+		const qint64 blockStart = (blockCount - 1) * blockSize;
+
+		hash.reset();
+		bool isRead = partial.seek(blockStart);
+
+		for(qint64 offset = 0; isRead && offset < blockSize; ) {
+			const qint64 bytesRead = partial.read(buffer.data(), qMin<qint64>(buffer.size(), blockSize - offset));
+			isRead = bytesRead > 0;
+
+			if(isRead) {
+				hash.addData(buffer.constData(), int(bytesRead));
+				offset += bytesRead;
+			}
+		}
+
+		if(isRead && QString::fromLatin1(hash.result().toHex()) == checksums_[blockCount - 1])
+			break;
+
+		blockCount --;
+	}
+
+	checksums_ = checksums_.mid(0, blockCount);
+	return blockCount * blockSize;
+}
+
+bool ResumableCopy::checkpoint(QFile &partial, qint64 offset)
+{
+	if(!FileCopy::syncToDisk(partial))
+		return false;
+
+	db_->exec(
+				"UPDATE partialCopies SET bytesDone = ?, blockChecksums = ?, lastUpdated = ? WHERE id = ?",
+				{offset, QStringList(checksums_.mid(0, int(offset / blockSize))).join(','), QDateTime::currentSecsSinceEpoch(), partialId_});
+
+	return true;
+}
+
+QString ResumableCopy::partialPath(qlonglong partialId)
+{
+	return QString("%1/%2.part").arg(partialDirName(), QString::number(partialId));
+}
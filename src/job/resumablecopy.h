@@ -0,0 +1,90 @@
+#ifndef RESUMABLECOPY_H
+#define RESUMABLECOPY_H
+
+#include <atomic>
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+
+#include "job/filecopy.h"
+
+class DBManager;
+
+/// Copy of a large file into the backup directory that survives an interruption. The data is written to a partial file in .partial in the backup directory,
+/// the progress and a checksum of each written block are stored in the partialCopies table. A later copy of the same version of the source
+/// continues from the last block of the partial file that still matches its checksum.
+class ResumableCopy
+{
+
+public:
+	enum class Result {
+		finished,
+		interrupted,
+		readError,
+		writeError
+	};
+
+public:
+	/// filePath is relative to remoteDir
+	ResumableCopy(DBManager *db, qlonglong dirId, const QString &remoteDir, const QString &filePath);
+
+public:
+	/// Copies source (opened, modified at sourceModified) to filePath, which must not exist. Stops between blocks once isInterrupted is set.
+	/// Unless finished, the partial file is kept for the next attempt.
+	Result copy(QFile &source, qlonglong sourceModified, const std::atomic<bool> &isInterrupted, const FileCopy::ProgressFunc &onProgress = FileCopy::ProgressFunc());
+
+	/// Bytes of the partial file reused by the last copy()
+	qint64 bytesResumed() const {
+		return bytesResumed_;
+	}
+
+	QString partialFilePath() const {
+		return partialFilePath_;
+	}
+
+public:
+	/// Removes the partial files of the directory not touched since time (their sources were removed, excluded or copied otherwise); returns the number removed
+	static int removeStale(DBManager *db, qlonglong dirId, const QString &remoteDir, qlonglong time);
+
+	static QString partialDirName();
+
+public:
+	/// Smaller files are copied directly
+	static const qint64 minFileSize = 64 * 1024 * 1024;
+
+	/// Unit of the checksums and of the resume offset
+	static const qint64 blockSize = 16 * 1024 * 1024;
+
+	/// The progress is stored at most this often
+	static const int checkpointMSecs = 10000;
+
+private:
+	/// Size of the reads and writes
+	static const qint64 chunkSize = 1024 * 1024;
+
+private:
+	/// Offset up to which the partial file matches the stored checksums, walking back from the stored progress
+	qint64 verifiedOffset(QFile &partial, qint64 bytesDone);
+
+	/// Makes the written data durable and stores the progress up to offset
+	bool checkpoint(QFile &partial, qint64 offset);
+
+	static QString partialPath(qlonglong partialId);
+
+private:
+	DBManager *db_;
+	qlonglong dirId_;
+	QString remoteDir_;
+	QString filePath_;
+
+	qlonglong partialId_ = -1;
+	QString partialFilePath_;
+
+	/// Hex MD5 of each complete block of the partial file
+	QStringList checksums_;
+	qint64 bytesResumed_ = 0;
+
+};
+
+#endif // RESUMABLECOPY_H
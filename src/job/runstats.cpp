@@ -0,0 +1,205 @@
+#include "runstats.h"
+
+#include <QDateTime>
+#include <QStringList>
+
+#include "threaddb/dbmanager.h"
+
+RunStats::Histogram::Histogram()
+{
+	for(auto &bucket : buckets_)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+void RunStats::Histogram::add(qint64 nsecs)
+{
+	quint64 usecs = quint64(qMax<qint64>(0, nsecs)) / 1000;
+
+	int bucket = 0;
+	while(usecs && bucket < bucketCount - 1) {
+		usecs >>= 1;
+		bucket ++;
+	}
+
+	buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+quint64 RunStats::Histogram::bucket(int i) const
+{
+	return buckets_[i].load(std::memory_order_relaxed);
+}
+
+QString RunStats::Histogram::toString() const
+{
+	int used = bucketCount;
+	while(used && buckets_[used - 1].load(std::memory_order_relaxed) == 0)
+		used --;
+
+	QStringList result;
+	for(int i = 0; i < used; i++)
+		result.append(QString::number(buckets_[i].load(std::memory_order_relaxed)));
+
+	return result.join(',');
+}
+
+RunStats::PhaseTimer::PhaseTimer(RunStats *stats, Phase phase) :
+	stats_(stats),
+	phase_(phase)
+{
+	if(stats_)
+		timer_.start();
+}
+
+RunStats::PhaseTimer::~PhaseTimer()
+{
+	finish();
+}
+
+void RunStats::PhaseTimer::finish()
+{
+	if(stats_)
+		stats_->addPhaseTime(phase_, timer_.nsecsElapsed());
+
+	stats_ = nullptr;
+}
+
+RunStats::RunStats(bool isSeed, RunStats *totals) :
+	isSeed_(isSeed),
+	started_(QDateTime::currentSecsSinceEpoch()),
+	totals_(totals)
+{
+	for(auto &time : phaseTimes_)
+		time.store(0, std::memory_order_relaxed);
+
+	for(int i = 0; i < int(Outcome::count); i++) {
+		fileCounts_[i].store(0, std::memory_order_relaxed);
+		byteCounts_[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+void RunStats::addPhaseTime(Phase phase, qint64 nsecs)
+{
+	phaseTimes_[int(phase)].fetch_add(nsecs, std::memory_order_relaxed);
+
+	if(phase == Phase::copy)
+		copyLatency.add(nsecs);
+
+	else if(phase == Phase::catalogLookup || phase == Phase::dbCommit)
+		dbLatency.add(nsecs);
+
+	if(totals_)
+		totals_->addPhaseTime(phase, nsecs);
+}
+
+void RunStats::addFile(Outcome outcome, qint64 bytes)
+{
+	fileCounts_[int(outcome)].fetch_add(1, std::memory_order_relaxed);
+	byteCounts_[int(outcome)].fetch_add(quint64(bytes), std::memory_order_relaxed);
+
+	if(totals_)
+		totals_->addFile(outcome, bytes);
+}
+
+void RunStats::addReflink(qint64 bytesWriteSaved, qint64 bytesSpaceSaved)
+{
+	reflinkCount_.fetch_add(1, std::memory_order_relaxed);
+	bytesWriteSaved_.fetch_add(quint64(bytesWriteSaved), std::memory_order_relaxed);
+	bytesSpaceSaved_.fetch_add(quint64(bytesSpaceSaved), std::memory_order_relaxed);
+
+	if(totals_)
+		totals_->addReflink(bytesWriteSaved, bytesSpaceSaved);
+}
+
+void RunStats::addMetadataRequest(bool isSaved)
+{
+	(isSaved ? metadataRequestsSaved_ : metadataRequestCount_).fetch_add(1, std::memory_order_relaxed);
+
+	if(totals_)
+		totals_->addMetadataRequest(isSaved);
+}
+
+qint64 RunStats::phaseTime(Phase phase) const
+{
+	return phaseTimes_[int(phase)].load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::fileCount(Outcome outcome) const
+{
+	return fileCounts_[int(outcome)].load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::byteCount(Outcome outcome) const
+{
+	return byteCounts_[int(outcome)].load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::reflinkCount() const
+{
+	return reflinkCount_.load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::bytesWriteSaved() const
+{
+	return bytesWriteSaved_.load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::bytesSpaceSaved() const
+{
+	return bytesSpaceSaved_.load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::metadataRequestCount() const
+{
+	return metadataRequestCount_.load(std::memory_order_relaxed);
+}
+
+quint64 RunStats::metadataRequestsSaved() const
+{
+	return metadataRequestsSaved_.load(std::memory_order_relaxed);
+}
+
+void RunStats::store(DBManager *db, qlonglong backupDirectory, bool isInterrupted) const
+{
+	auto msecs = [this](Phase phase) {
+		return phaseTime(phase) / 1000000;
+	};
+
+	db->execAssoc(
+				"INSERT INTO runs (backupDirectory, started, finished, isSeed, isInterrupted, "
+				"filesNew, filesChanged, filesUnchanged, filesRemoved, filesFailed, bytesNew, bytesChanged, "
+				"walkTime, statTime, excludeTime, lookupTime, copyTime, historyTime, pruneTime, commitTime, copyLatency, dbLatency, reflinkedFiles, bytesWriteSaved, bytesSpaceSaved, metadataRequests, metadataRequestsSaved) "
+				"VALUES (:backupDirectory, :started, :finished, :isSeed, :isInterrupted, "
+				":filesNew, :filesChanged, :filesUnchanged, :filesRemoved, :filesFailed, :bytesNew, :bytesChanged, "
+				":walkTime, :statTime, :excludeTime, :lookupTime, :copyTime, :historyTime, :pruneTime, :commitTime, :copyLatency, :dbLatency, :reflinkedFiles, :bytesWriteSaved, :bytesSpaceSaved, :metadataRequests, :metadataRequestsSaved)",
+				{
+					{":backupDirectory", backupDirectory},
+					{":started", started_},
+					{":finished", QDateTime::currentSecsSinceEpoch()},
+					{":isSeed", isSeed_},
+					{":isInterrupted", isInterrupted},
+					{":filesNew", fileCount(Outcome::newFile)},
+					{":filesChanged", fileCount(Outcome::changed)},
+					{":filesUnchanged", fileCount(Outcome::unchanged)},
+					{":filesRemoved", fileCount(Outcome::removed)},
+					{":filesFailed", fileCount(Outcome::failed)},
+					{":bytesNew", byteCount(Outcome::newFile)},
+					{":bytesChanged", byteCount(Outcome::changed)},
+					{":walkTime", msecs(Phase::walk)},
+					{":statTime", msecs(Phase::stat)},
+					{":excludeTime", msecs(Phase::excludeMatching)},
+					{":lookupTime", msecs(Phase::catalogLookup)},
+					{":copyTime", msecs(Phase::copy)},
+					{":historyTime", msecs(Phase::historyRename)},
+					{":pruneTime", msecs(Phase::pruning)},
+					{":commitTime", msecs(Phase::dbCommit)},
+					{":copyLatency", copyLatency.toString()},
+					{":dbLatency", dbLatency.toString()},
+					{":reflinkedFiles", reflinkCount()},
+					{":bytesWriteSaved", bytesWriteSaved()},
+					{":bytesSpaceSaved", bytesSpaceSaved()},
+					{":metadataRequests", metadataRequestCount()},
+					{":metadataRequestsSaved", metadataRequestsSaved()}
+				});
+
+	db->exec("DELETE FROM runs WHERE (backupDirectory = ?) AND id NOT IN (SELECT id FROM runs WHERE backupDirectory = ? ORDER BY id DESC LIMIT ?)", {backupDirectory, backupDirectory, maxStoredRuns});
+}
@@ -0,0 +1,133 @@
+#ifndef RUNSTATS_H
+#define RUNSTATS_H
+
+#include <atomic>
+
+#include <QString>
+#include <QElapsedTimer>
+
+class DBManager;
+
+/// Instrumentation of a single backup run of a directory, stored in the runs table when the run ends.
+/// All counters are atomic, the copy threads of the seeding mode update them concurrently (phase times are summed over the threads).
+/// Runs of the directories of one source share its walk and stats, whose time is split evenly among them.
+class RunStats
+{
+
+public:
+	enum class Phase {
+		walk,
+		stat,
+		excludeMatching,
+		catalogLookup,
+		copy,
+		historyRename,
+		pruning,
+		dbCommit,
+		count
+	};
+
+	enum class Outcome {
+		newFile,
+		changed,
+		unchanged,
+		removed,
+		failed,
+		count
+	};
+
+	/// Latency histogram; bucket 0 counts latencies under 1 µs, bucket i latencies in [2^(i-1), 2^i) µs
+	class Histogram
+	{
+
+	public:
+		static const int bucketCount = 32;
+
+	public:
+		Histogram();
+
+		void add(qint64 nsecs);
+
+		quint64 bucket(int i) const;
+
+		/// Bucket counts separated by commas, trailing empty buckets are omitted
+		QString toString() const;
+
+	private:
+		std::atomic<quint64> buckets_[bucketCount];
+
+	};
+
+	/// Adds the time from construction to destruction to the phase (does nothing if stats is nullptr)
+	class PhaseTimer
+	{
+
+	public:
+		PhaseTimer(RunStats *stats, Phase phase);
+		~PhaseTimer();
+
+		/// Adds the time measured so far, the destructor then does nothing
+		void finish();
+
+	private:
+		RunStats *stats_;
+		Phase phase_;
+		QElapsedTimer timer_;
+
+	};
+
+public:
+	/// Everything added to the run is also added to totals (if set), which accumulates the counters over runs
+	explicit RunStats(bool isSeed, RunStats *totals = nullptr);
+
+public:
+	/// Copy phase time also goes to copyLatency, catalog lookup and commit time to dbLatency
+	void addPhaseTime(Phase phase, qint64 nsecs);
+	void addFile(Outcome outcome, qint64 bytes = 0);
+
+	/// A history version was made as a reflink of the previous copy, which was then updated in place
+	void addReflink(qint64 bytesWriteSaved, qint64 bytesSpaceSaved);
+
+	/// An exists, mkpath or availability check of the destination was sent, or answered by the DestinationCache of the run (isSaved)
+	void addMetadataRequest(bool isSaved);
+
+	qint64 phaseTime(Phase phase) const;
+	quint64 fileCount(Outcome outcome) const;
+	quint64 byteCount(Outcome outcome) const;
+
+	quint64 reflinkCount() const;
+
+	/// Bytes not written compared to copying the whole files
+	quint64 bytesWriteSaved() const;
+
+	/// Bytes the history versions share with the current copies
+	quint64 bytesSpaceSaved() const;
+
+	quint64 metadataRequestCount() const;
+	quint64 metadataRequestsSaved() const;
+
+public:
+	/// Queues insertion of the run into the runs table, keeps last maxStoredRuns runs of the directory
+	void store(DBManager *db, qlonglong backupDirectory, bool isInterrupted) const;
+
+public:
+	static const int maxStoredRuns = 100;
+
+public:
+	Histogram copyLatency, dbLatency;
+
+private:
+	const bool isSeed_;
+	const qlonglong started_;
+	RunStats *totals_;
+
+	std::atomic<qint64> phaseTimes_[int(Phase::count)];
+	std::atomic<quint64> fileCounts_[int(Outcome::count)];
+	std::atomic<quint64> byteCounts_[int(Outcome::count)];
+
+	std::atomic<quint64> reflinkCount_{0}, bytesWriteSaved_{0}, bytesSpaceSaved_{0};
+	std::atomic<quint64> metadataRequestCount_{0}, metadataRequestsSaved_{0};
+
+};
+
+#endif // RUNSTATS_H
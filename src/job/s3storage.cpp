@@ -0,0 +1,561 @@
+#include "s3storage.h"
+
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QUrlQuery>
+#include <QThread>
+#include <QThreadStorage>
+#include <QEventLoop>
+#include <QTimer>
+#include <QHash>
+#include <QVector>
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+#include <QXmlStreamReader>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+
+const int S3Storage::defaultMaxRequestsInFlight;
+const qint64 S3Storage::multipartThreshold;
+const qint64 S3Storage::minPartSize;
+const int S3Storage::maxPartCount;
+const int S3Storage::maxPartsInFlight;
+const qint64 S3Storage::copyPartSize;
+const int S3Storage::maxAttempts;
+const int S3Storage::retryDelayMSecs;
+const int S3Storage::stallTimeoutMSecs;
+const int S3Storage::availabilityCacheMSecs;
+
+S3Storage::S3Storage(const QUrl &url) :
+	StorageBackend(requestsInFlight(url))
+{
+	const bool isHttp = url.scheme() == "s3+http";
+	const int defaultPort = isHttp ? 80 : 443;
+
+	// The HTTP stack puts the port into the Host header only if it is not the default one, the signed header must be the same
+	host_ = QUrl::toAce(url.host());
+	if(url.port() != -1 && url.port() != defaultPort)
+		host_ += ':' + QByteArray::number(url.port());
+
+	endpoint_ = (isHttp ? "http://" : "https://") + QUrl::toAce(url.host());
+	if(url.port() != -1)
+		endpoint_ += ':' + QByteArray::number(url.port());
+
+	const QStringList path = url.path().split('/', QString::SkipEmptyParts);
+	bucket_ = path.value(0);
+	prefix_ = path.mid(1).join('/');
+
+	const QUrlQuery query(url);
+	region_ = query.hasQueryItem("region") ? query.queryItemValue("region").toLatin1() : qgetenv("AWS_REGION");
+	if(region_.isEmpty())
+		region_ = "us-east-1";
+
+	accessKey_ = qgetenv("AWS_ACCESS_KEY_ID");
+	secretKey_ = qgetenv("AWS_SECRET_ACCESS_KEY");
+
+	location_ = url.toString(QUrl::RemoveQuery | QUrl::RemoveUserInfo | QUrl::StripTrailingSlash);
+}
+
+S3Storage::~S3Storage()
+{
+	waitForDone();
+}
+
+QString S3Storage::localDir() const
+{
+	return QString();
+}
+
+QString S3Storage::location(const QString &path) const
+{
+	const QString cleanPath = QDir::cleanPath(path);
+	return cleanPath == "." || cleanPath.isEmpty() ? location_ : location_ + '/' + cleanPath;
+}
+
+bool S3Storage::isAvailable()
+{
+	{
+		QMutexLocker ml(&availabilityMutex_);
+		if(sinceAvailable_.isValid() && sinceAvailable_.elapsed() < availabilityCacheMSecs)
+			return true;
+	}
+
+	// Not locked during the request, the other threads would queue behind it; concurrent checks may then send a request each
+	const bool isOk = request("HEAD", QString()).isOk();
+
+	QMutexLocker ml(&availabilityMutex_);
+	if(isOk)
+		sinceAvailable_.start();
+	else
+		sinceAvailable_.invalidate();
+
+	return isOk;
+}
+
+bool S3Storage::isEmpty()
+{
+	// An unreachable bucket is not taken as empty, that would make the next backup a seed
+	bool isOk = true;
+	return listKeys(keyPrefix(QString()), 1, isOk).isEmpty() && isOk;
+}
+
+bool S3Storage::exists(const QString &path)
+{
+	return request("HEAD", key(path)).status == 200;
+}
+
+qint64 S3Storage::size(const QString &path)
+{
+	const Response response = request("HEAD", key(path));
+	return response.status == 200 ? response.contentLength : -1;
+}
+
+bool S3Storage::mkpath(const QString &dirPath)
+{
+	Q_UNUSED(dirPath);
+	return true;
+}
+
+void S3Storage::rmpath(const QString &path)
+{
+	Q_UNUSED(path);
+}
+
+bool S3Storage::put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress)
+{
+	QFile source(sourceFilePath);
+	if(!source.open(QIODevice::ReadOnly))
+		return false;
+
+	if(source.size() > multipartThreshold)
+		return putMultipart(source, key(path), onProgress);
+
+	const QByteArray data = source.readAll();
+	if(source.error() != QFileDevice::NoError)
+		return false;
+
+	if(!request("PUT", key(path), Query(), data).isOk())
+		return false;
+
+	if(onProgress)
+		onProgress(data.size());
+
+	return true;
+}
+
+bool S3Storage::get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress)
+{
+	QFile target(targetFilePath);
+	if(!target.open(QIODevice::WriteOnly))
+		return false;
+
+	for(int attempt = 1; attempt <= maxAttempts; attempt ++) {
+		// The body is written as it arrives, a retry starts over
+		target.resize(0);
+		target.seek(0);
+
+		QNetworkReply *reply = send(networkManager(), "GET", key(path), Query(), QByteArray());
+		bool isWritten = true;
+
+		auto writeData = [&]{
+			if(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200)
+				return;
+
+			const QByteArray data = reply->readAll();
+			isWritten = isWritten && target.write(data) == data.size();
+
+			if(onProgress && !data.isEmpty())
+				onProgress(data.size());
+		};
+
+		QObject::connect(reply, &QNetworkReply::readyRead, reply, writeData);
+
+		if(!reply->isFinished()) {
+			QEventLoop loop;
+			QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+			loop.exec();
+		}
+
+		writeData();
+		const Response response = takeResponse(reply);
+
+		if(response.status == 200) {
+			if(isWritten && target.flush())
+				return true;
+
+			break;
+		}
+
+		if(!response.isRetryable())
+			break;
+
+		QThread::msleep(retryDelayMSecs * attempt);
+	}
+
+	target.remove();
+	return false;
+}
+
+bool S3Storage::rename(const QString &path, const QString &newPath)
+{
+	const QString sourceKey = key(path);
+	const QString targetKey = key(newPath);
+
+	const Response head = request("HEAD", sourceKey);
+	if(head.status != 200 || !copyObject(sourceKey, targetKey, head.contentLength))
+		return false;
+
+	// If the delete fails, the object stays under both keys and the caller takes the rename as failed
+	return request("DELETE", sourceKey).isOk();
+}
+
+bool S3Storage::remove(const QString &path)
+{
+	return request("DELETE", key(path)).isOk();
+}
+
+bool S3Storage::list(const QString &dirPath, QStringList &filePaths)
+{
+	const QString prefix = keyPrefix(dirPath);
+	bool isOk = true;
+
+	filePaths.clear();
+	for(const QString &objectKey : listKeys(prefix, 0, isOk))
+		filePaths.append(objectKey.mid(prefix.size()));
+
+	return isOk;
+}
+
+QString S3Storage::key(const QString &path) const
+{
+	const QString cleanPath = QDir::cleanPath(path);
+	if(cleanPath == "." || cleanPath.isEmpty())
+		return prefix_;
+
+	return prefix_.isEmpty() ? cleanPath : prefix_ + '/' + cleanPath;
+}
+
+QString S3Storage::keyPrefix(const QString &dirPath) const
+{
+	const QString dirKey = key(dirPath);
+	return dirKey.isEmpty() ? QString() : dirKey + '/';
+}
+
+QNetworkReply *S3Storage::send(QNetworkAccessManager &manager, const QByteArray &verb, const QString &key, const Query &query, const QByteArray &payload, const Headers &headers)
+{
+	auto hmac = [](const QByteArray &key, const QByteArray &message) {
+		return QMessageAuthenticationCode::hash(message, key, QCryptographicHash::Sha256);
+	};
+
+	const QDateTime now = QDateTime::currentDateTimeUtc();
+	const QByteArray date = now.toString("yyyyMMdd").toLatin1();
+	const QByteArray dateTime = now.toString("yyyyMMdd'T'hhmmss'Z'").toLatin1();
+	const QByteArray payloadHash = QCryptographicHash::hash(payload, QCryptographicHash::Sha256).toHex();
+
+	// Path style addressing; the path and the query are encoded once here, the signature covers exactly what is sent
+	QByteArray path = '/' + QUrl::toPercentEncoding(bucket_);
+	if(!key.isEmpty())
+		path += '/' + QUrl::toPercentEncoding(key, "/");
+
+	QByteArray queryString;
+	for(auto item = query.constBegin(); item != query.constEnd(); ++ item) {
+		if(!queryString.isEmpty())
+			queryString += '&';
+
+		queryString += QUrl::toPercentEncoding(item.key()) + '=' + QUrl::toPercentEncoding(item.value());
+	}
+
+	QMap<QByteArray, QByteArray> signedHeaders;
+	signedHeaders.insert("host", host_);
+	signedHeaders.insert("x-amz-content-sha256", payloadHash);
+	signedHeaders.insert("x-amz-date", dateTime);
+	for(const QPair<QByteArray, QByteArray> &header : headers)
+		signedHeaders.insert(header.first.toLower(), header.second);
+
+	QByteArray canonicalHeaders, signedHeaderNames;
+	for(auto header = signedHeaders.constBegin(); header != signedHeaders.constEnd(); ++ header) {
+		canonicalHeaders += header.key() + ':' + header.value().trimmed() + '\n';
+		signedHeaderNames += (signedHeaderNames.isEmpty() ? QByteArray() : QByteArray(";")) + header.key();
+	}
+
+	const QByteArray canonicalRequest = verb + '\n' + path + '\n' + queryString + '\n' + canonicalHeaders + '\n' + signedHeaderNames + '\n' + payloadHash;
+	const QByteArray scope = date + '/' + region_ + "/s3/aws4_request";
+	const QByteArray stringToSign = "AWS4-HMAC-SHA256\n" + dateTime + '\n' + scope + '\n' + QCryptographicHash::hash(canonicalRequest, QCryptographicHash::Sha256).toHex();
+
+	const QByteArray signingKey = hmac(hmac(hmac(hmac("AWS4" + secretKey_, date), region_), "s3"), "aws4_request");
+	const QByteArray signature = hmac(signingKey, stringToSign).toHex();
+
+	QNetworkRequest networkRequest(QUrl::fromEncoded(endpoint_ + path + (queryString.isEmpty() ? QByteArray() : '?' + queryString), QUrl::StrictMode));
+
+	for(auto header = signedHeaders.constBegin(); header != signedHeaders.constEnd(); ++ header) {
+		if(header.key() != "host")
+			networkRequest.setRawHeader(header.key(), header.value());
+	}
+
+	networkRequest.setRawHeader("Authorization", "AWS4-HMAC-SHA256 Credential=" + accessKey_ + '/' + scope + ", SignedHeaders=" + signedHeaderNames + ", Signature=" + signature);
+
+	// A HEAD sent as a custom request would wait for a body
+	QNetworkReply *reply;
+	if(verb == "HEAD")
+		reply = manager.head(networkRequest);
+	else if(verb == "GET")
+		reply = manager.get(networkRequest);
+	else {
+		networkRequest.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+		reply = manager.sendCustomRequest(networkRequest, verb, payload);
+	}
+
+	// Aborted once no data moved for a while; the transfers of large parts and downloads may take much longer than that in total
+	QTimer *stallTimer = new QTimer(reply);
+	stallTimer->setSingleShot(true);
+	stallTimer->setInterval(stallTimeoutMSecs);
+	QObject::connect(stallTimer, &QTimer::timeout, reply, &QNetworkReply::abort);
+	QObject::connect(reply, &QNetworkReply::uploadProgress, stallTimer, [stallTimer]{
+		stallTimer->start();
+	});
+	QObject::connect(reply, &QNetworkReply::downloadProgress, stallTimer, [stallTimer]{
+		stallTimer->start();
+	});
+	stallTimer->start();
+
+	return reply;
+}
+
+S3Storage::Response S3Storage::request(const QByteArray &verb, const QString &key, const Query &query, const QByteArray &payload, const Headers &headers)
+{
+	Response response;
+
+	for(int attempt = 1; attempt <= maxAttempts; attempt ++) {
+		response = takeResponse(send(networkManager(), verb, key, query, payload, headers));
+
+		if(!response.isRetryable())
+			break;
+
+		if(attempt < maxAttempts)
+			QThread::msleep(retryDelayMSecs * attempt);
+	}
+
+	return response;
+}
+
+bool S3Storage::putMultipart(QFile &source, const QString &key, const ProgressFunc &onProgress)
+{
+	const Response created = request("POST", key, {{"uploads", QString()}});
+	const QString uploadId = xmlValue(created.body, "UploadId");
+
+	if(!created.isOk() || uploadId.isEmpty())
+		return false;
+
+	const qint64 partSize = qMax(minPartSize, (source.size() + maxPartCount - 1) / maxPartCount);
+	QNetworkAccessManager &manager = networkManager();
+
+	struct Part {
+		QByteArray data;
+		int attempt;
+	};
+
+	// Parts in flight by their replies; the data is kept until the part is stored, for a retry
+	QHash<QNetworkReply *, int> partNumbers;
+	QHash<int, Part> parts;
+	QVector<QByteArray> etags;
+
+	QEventLoop loop;
+	bool isFailed = false, hasMoreData = true;
+
+	auto sendPart = [&](int partNumber) {
+		QNetworkReply *reply = send(manager, "PUT", key, {{"partNumber", QString::number(partNumber)}, {"uploadId", uploadId}}, parts[partNumber].data);
+		QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+		partNumbers.insert(reply, partNumber);
+	};
+
+	while(true) {
+		// The reads are sequential, the parts read ahead are sent in parallel
+		while(!isFailed && hasMoreData && partNumbers.size() < maxPartsInFlight) {
+			const QByteArray data = source.read(partSize);
+
+			if(data.isEmpty()) {
+				isFailed = source.error() != QFileDevice::NoError;
+				hasMoreData = false;
+				break;
+			}
+
+			etags.append(QByteArray());
+			parts.insert(etags.size(), {data, 1});
+			sendPart(etags.size());
+		}
+
+		if(partNumbers.isEmpty())
+			break;
+
+		bool isAnyFinished = false;
+		for(QNetworkReply *reply : partNumbers.keys())
+			isAnyFinished = isAnyFinished || reply->isFinished();
+
+		if(!isAnyFinished)
+			loop.exec();
+
+		for(QNetworkReply *reply : partNumbers.keys()) {
+			if(!reply->isFinished())
+				continue;
+
+			const int partNumber = partNumbers.take(reply);
+			const Response response = takeResponse(reply);
+			Part &part = parts[partNumber];
+
+			if(response.isOk() && !response.etag.isEmpty()) {
+				etags[partNumber - 1] = response.etag;
+
+				if(onProgress)
+					onProgress(part.data.size());
+
+				parts.remove(partNumber);
+
+			} else if(!isFailed && response.isRetryable() && part.attempt < maxAttempts) {
+				QThread::msleep(retryDelayMSecs * part.attempt);
+				part.attempt ++;
+				sendPart(partNumber);
+
+			} else
+				isFailed = true;
+		}
+	}
+
+	if(!isFailed) {
+		QByteArray completion = "<CompleteMultipartUpload>";
+		for(int i = 0; i < etags.size(); i ++)
+			completion += "<Part><PartNumber>" + QByteArray::number(i + 1) + "</PartNumber><ETag>" + etags[i] + "</ETag></Part>";
+		completion += "</CompleteMultipartUpload>";
+
+		if(request("POST", key, {{"uploadId", uploadId}}, completion).isOk())
+			return true;
+	}
+
+	// The stored parts would be kept (and billed) until aborted
+	request("DELETE", key, {{"uploadId", uploadId}});
+	return false;
+}
+
+bool S3Storage::copyObject(const QString &sourceKey, const QString &targetKey, qint64 size)
+{
+	const QByteArray copySource = '/' + QUrl::toPercentEncoding(bucket_) + '/' + QUrl::toPercentEncoding(sourceKey, "/");
+
+	if(size <= copyPartSize)
+		return request("PUT", targetKey, Query(), QByteArray(), {{"x-amz-copy-source", copySource}}).isOk();
+
+	const Response created = request("POST", targetKey, {{"uploads", QString()}});
+	const QString uploadId = xmlValue(created.body, "UploadId");
+
+	if(!created.isOk() || uploadId.isEmpty())
+		return false;
+
+	QByteArray completion = "<CompleteMultipartUpload>";
+	bool isFailed = false;
+
+	for(qint64 offset = 0, partNumber = 1; offset < size && !isFailed; offset += copyPartSize, partNumber ++) {
+		const QByteArray range = "bytes=" + QByteArray::number(offset) + '-' + QByteArray::number(qMin(offset + copyPartSize, size) - 1);
+		const Response part = request("PUT", targetKey, {{"partNumber", QString::number(partNumber)}, {"uploadId", uploadId}}, QByteArray(),
+				{{"x-amz-copy-source", copySource}, {"x-amz-copy-source-range", range}});
+
+		// The ETag of a copied part is in the body
+		const QString etag = xmlValue(part.body, "ETag");
+		isFailed = !part.isOk() || etag.isEmpty();
+
+		completion += "<Part><PartNumber>" + QByteArray::number(partNumber) + "</PartNumber><ETag>" + etag.toHtmlEscaped().toUtf8() + "</ETag></Part>";
+	}
+
+	completion += "</CompleteMultipartUpload>";
+
+	if(!isFailed && request("POST", targetKey, {{"uploadId", uploadId}}, completion).isOk())
+		return true;
+
+	request("DELETE", targetKey, {{"uploadId", uploadId}});
+	return false;
+}
+
+QStringList S3Storage::listKeys(const QString &prefix, int maxKeys, bool &isOk)
+{
+	QStringList result;
+	QString continuationToken;
+
+	do {
+		Query query{{"list-type", "2"}, {"prefix", prefix}};
+		if(maxKeys)
+			query.insert("max-keys", QString::number(maxKeys));
+		if(!continuationToken.isEmpty())
+			query.insert("continuation-token", continuationToken);
+
+		const Response response = request("GET", QString(), query);
+		if(!response.isOk()) {
+			isOk = false;
+			return result;
+		}
+
+		continuationToken.clear();
+
+		QXmlStreamReader xml(response.body);
+		while(!xml.atEnd()) {
+			if(xml.readNext() != QXmlStreamReader::StartElement)
+				continue;
+
+			if(xml.name() == "Key")
+				result.append(xml.readElementText());
+			else if(xml.name() == "NextContinuationToken")
+				continuationToken = xml.readElementText();
+		}
+
+	} while(!continuationToken.isEmpty() && (!maxKeys || result.size() < maxKeys));
+
+	return result;
+}
+
+S3Storage::Response S3Storage::takeResponse(QNetworkReply *reply)
+{
+	if(!reply->isFinished()) {
+		QEventLoop loop;
+		QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+		loop.exec();
+	}
+
+	Response response;
+	response.status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	response.body = reply->readAll();
+	response.etag = reply->rawHeader("ETag");
+
+	const QVariant contentLength = reply->header(QNetworkRequest::ContentLengthHeader);
+	if(contentLength.isValid())
+		response.contentLength = contentLength.toLongLong();
+
+	delete reply;
+	return response;
+}
+
+QString S3Storage::xmlValue(const QByteArray &xml, const QString &name)
+{
+	QXmlStreamReader reader(xml);
+
+	while(!reader.atEnd()) {
+		if(reader.readNext() == QXmlStreamReader::StartElement && reader.name() == name)
+			return reader.readElementText();
+	}
+
+	return QString();
+}
+
+QNetworkAccessManager &S3Storage::networkManager()
+{
+	// Deleted by the storage when the thread ends
+	static QThreadStorage<QNetworkAccessManager *> managers;
+
+	if(!managers.hasLocalData())
+		managers.setLocalData(new QNetworkAccessManager());
+
+	return *managers.localData();
+}
+
+int S3Storage::requestsInFlight(const QUrl &url)
+{
+	const int requests = QUrlQuery(url).queryItemValue("requests").toInt();
+	return requests > 0 ? requests : defaultMaxRequestsInFlight;
+}
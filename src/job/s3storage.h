@@ -0,0 +1,146 @@
+#ifndef S3STORAGE_H
+#define S3STORAGE_H
+
+#include <QUrl>
+#include <QMap>
+#include <QList>
+#include <QPair>
+#include <QByteArray>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include "job/storagebackend.h"
+
+class QFile;
+class QNetworkAccessManager;
+class QNetworkReply;
+
+/// Backup directory in a bucket of an S3-compatible object store, addressed as s3://host[:port]/bucket[/prefix] (HTTPS) or s3+http://... (plain HTTP, e.g. a local test server).
+/// The query of the URL may set region and requests (the maximum of requests in flight). The credentials are taken from AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY.
+/// Object stores have no directories and no rename, a rename is a server side copy followed by a delete. Large files are uploaded in parts sent in parallel.
+class S3Storage : public StorageBackend
+{
+
+public:
+	explicit S3Storage(const QUrl &url);
+	~S3Storage() override;
+
+public:
+	QString localDir() const override;
+	QString location(const QString &path) const override;
+
+	bool isAvailable() override;
+	bool isEmpty() override;
+	bool exists(const QString &path) override;
+	qint64 size(const QString &path) override;
+	bool mkpath(const QString &dirPath) override;
+	void rmpath(const QString &path) override;
+	bool put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress = ProgressFunc()) override;
+	bool get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress = ProgressFunc()) override;
+	bool rename(const QString &path, const QString &newPath) override;
+	bool remove(const QString &path) override;
+	bool list(const QString &dirPath, QStringList &filePaths) override;
+
+public:
+	static const int defaultMaxRequestsInFlight = 16;
+
+	/// Larger files are uploaded in parts
+	static const qint64 multipartThreshold = 16 * 1024 * 1024;
+	static const qint64 minPartSize = 8 * 1024 * 1024;
+
+	/// Limit of the object store
+	static const int maxPartCount = 10000;
+
+	/// Parts of one file sent at once; bounds the memory of an upload to maxPartsInFlight parts
+	static const int maxPartsInFlight = 4;
+
+	/// Larger objects are copied in parts of this size, so that no single request takes too long
+	static const qint64 copyPartSize = 256 * 1024 * 1024;
+
+	/// Requests failed on the network or by a server error are sent again up to this many times in total
+	static const int maxAttempts = 3;
+	static const int retryDelayMSecs = 1000;
+
+	/// A request that neither sends nor receives any data for this long is aborted
+	static const int stallTimeoutMSecs = 120000;
+
+	/// How long a successful check of the bucket is trusted, the scans check the availability for each file
+	static const int availabilityCacheMSecs = 5000;
+
+private:
+	/// Query of a request, sorted by name as the signature needs
+	using Query = QMap<QString, QString>;
+
+	/// Additional x-amz-* headers, signed with the request
+	using Headers = QList<QPair<QByteArray, QByteArray>>;
+
+	struct Response {
+		/// HTTP status, 0 if the request failed on the network
+		int status = 0;
+
+		QByteArray body;
+		QByteArray etag;
+		qint64 contentLength = -1;
+
+		/// Copies and completed uploads report errors in the body of a successful response
+		bool isOk() const {
+			return status >= 200 && status < 300 && !body.contains("<Error>");
+		}
+
+		bool isRetryable() const {
+			return status == 0 || status >= 500;
+		}
+	};
+
+private:
+	/// Key of the object of path
+	QString key(const QString &path) const;
+
+	/// Prefix of the keys under dirPath
+	QString keyPrefix(const QString &dirPath) const;
+
+	/// Signs (AWS Signature Version 4) and starts the request; key is empty for requests on the bucket
+	QNetworkReply *send(QNetworkAccessManager &manager, const QByteArray &verb, const QString &key, const Query &query, const QByteArray &payload, const Headers &headers = Headers());
+
+	/// Sends the request and waits for the response, retrying failures that may pass
+	Response request(const QByteArray &verb, const QString &key, const Query &query = Query(), const QByteArray &payload = QByteArray(), const Headers &headers = Headers());
+
+	bool putMultipart(QFile &source, const QString &key, const ProgressFunc &onProgress);
+	bool copyObject(const QString &sourceKey, const QString &targetKey, qint64 size);
+
+	/// Keys starting with prefix, at most maxKeys of them (all if 0); isOk is cleared if the listing failed
+	QStringList listKeys(const QString &prefix, int maxKeys, bool &isOk);
+
+	/// Waits for the reply to finish (running an event loop), deletes it
+	static Response takeResponse(QNetworkReply *reply);
+
+	/// Text of the first element of the name in the XML
+	static QString xmlValue(const QByteArray &xml, const QString &name);
+
+	/// Each thread sends its requests through its own manager, which keeps the connections open between them
+	static QNetworkAccessManager &networkManager();
+
+	/// Value of the requests query item, or the default
+	static int requestsInFlight(const QUrl &url);
+
+private:
+	/// scheme://host[:port] of the HTTP requests
+	QByteArray endpoint_;
+
+	/// Value of the Host header
+	QByteArray host_;
+
+	QString bucket_;
+	QString prefix_;
+	QByteArray region_;
+	QByteArray accessKey_, secretKey_;
+
+	/// The URL without the query, for the messages
+	QString location_;
+
+	QMutex availabilityMutex_;
+	QElapsedTimer sinceAvailable_;
+
+};
+
+#endif // S3STORAGE_H
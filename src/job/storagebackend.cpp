@@ -0,0 +1,71 @@
+#include "storagebackend.h"
+
+#include <QtConcurrent/QtConcurrent>
+
+#include "job/localstorage.h"
+#include "job/s3storage.h"
+
+const int StorageBackend::idleThreadExpiryMSecs;
+
+StorageBackend::StorageBackend(int maxRequestsInFlight)
+{
+	pool_.setMaxThreadCount(maxRequestsInFlight);
+	pool_.setExpiryTimeout(idleThreadExpiryMSecs);
+}
+
+StorageBackend::~StorageBackend()
+{
+
+}
+
+/// Set by the benchmarks only
+static StorageBackend::Factory storageFactory;
+
+std::shared_ptr<StorageBackend> StorageBackend::create(const QString &remoteDir)
+{
+	if(storageFactory)
+		return storageFactory(remoteDir);
+
+	if(isObjectStore(remoteDir))
+		return std::make_shared<S3Storage>(QUrl(remoteDir));
+
+	return std::make_shared<LocalStorage>(remoteDir);
+}
+
+void StorageBackend::setFactory(const Factory &factory)
+{
+	storageFactory = factory;
+}
+
+bool StorageBackend::isObjectStore(const QString &remoteDir)
+{
+	return remoteDir.startsWith("s3://") || remoteDir.startsWith("s3+http://");
+}
+
+QFuture<bool> StorageBackend::putAsync(const QString &sourceFilePath, const QString &path)
+{
+	return QtConcurrent::run(&pool_, [=]{
+		return put(sourceFilePath, path);
+	});
+}
+
+QFuture<bool> StorageBackend::getAsync(const QString &path, const QString &targetFilePath)
+{
+	return QtConcurrent::run(&pool_, [=]{
+		return get(path, targetFilePath);
+	});
+}
+
+QFuture<bool> StorageBackend::renameAsync(const QString &path, const QString &newPath)
+{
+	return QtConcurrent::run(&pool_, [=]{
+		return rename(path, newPath);
+	});
+}
+
+QFuture<bool> StorageBackend::removeAsync(const QString &path)
+{
+	return QtConcurrent::run(&pool_, [=]{
+		return remove(path);
+	});
+}
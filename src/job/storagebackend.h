@@ -0,0 +1,106 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <memory>
+#include <functional>
+
+#include <QString>
+#include <QStringList>
+#include <QFuture>
+#include <QThreadPool>
+
+#include "job/filecopy.h"
+
+/// Storage the backup directory (backupDirectories.remoteDir) lives in: a local or mounted directory, or an S3-compatible object store.
+/// Paths are relative to the root of the backup directory and separated by '/'; absolute paths of local directories stored by older catalogs are accepted too.
+/// The operations block and are thread safe. The *Async variants run them on the pool of the storage, which keeps up to maxRequestsInFlight() of them in progress.
+class StorageBackend
+{
+
+public:
+	using ProgressFunc = FileCopy::ProgressFunc;
+
+public:
+	virtual ~StorageBackend();
+
+public:
+	using Factory = std::function<std::shared_ptr<StorageBackend>(const QString &remoteDir)>;
+
+	/// s3:// and s3+http:// URLs address an object store, anything else is a local directory
+	static std::shared_ptr<StorageBackend> create(const QString &remoteDir);
+
+	/// Replaces create() for the benchmarks, which substitute instrumented storages; set before any storage is created
+	static void setFactory(const Factory &factory);
+
+	static bool isObjectStore(const QString &remoteDir);
+
+public:
+	/// The backup directory in the local file system, which the callers may write in place (clones, partial copies, block updates); empty for remote storages
+	virtual QString localDir() const = 0;
+
+	/// Absolute path or URL of path, for the messages
+	virtual QString location(const QString &path) const = 0;
+
+	/// Whether the backup directory can be reached
+	virtual bool isAvailable() = 0;
+
+	/// The backup directory holds no files
+	virtual bool isEmpty() = 0;
+
+	virtual bool exists(const QString &path) = 0;
+
+	/// Size of the file, -1 if it does not exist
+	virtual qint64 size(const QString &path) = 0;
+
+	/// Creates the directory and its parents; object stores have no directories
+	virtual bool mkpath(const QString &dirPath) = 0;
+
+	/// Removes the path and its parents up to the root as long as they are empty directories
+	virtual void rmpath(const QString &path) = 0;
+
+	/// Writes the local file sourceFilePath to path, replacing the file there
+	virtual bool put(const QString &sourceFilePath, const QString &path, const ProgressFunc &onProgress = ProgressFunc()) = 0;
+
+	/// Reads path into the local file targetFilePath
+	virtual bool get(const QString &path, const QString &targetFilePath, const ProgressFunc &onProgress = ProgressFunc()) = 0;
+
+	virtual bool rename(const QString &path, const QString &newPath) = 0;
+	virtual bool remove(const QString &path) = 0;
+
+	/// Files under dirPath (all of them for an empty one) and in its subdirectories, relative to dirPath; returns false if they could not be listed
+	virtual bool list(const QString &dirPath, QStringList &filePaths) = 0;
+
+public:
+	QFuture<bool> putAsync(const QString &sourceFilePath, const QString &path);
+	QFuture<bool> getAsync(const QString &path, const QString &targetFilePath);
+	QFuture<bool> renameAsync(const QString &path, const QString &newPath);
+	QFuture<bool> removeAsync(const QString &path);
+
+	/// Pool the asynchronous operations run on; callers queue their own sequences of operations on it to share its limit
+	QThreadPool *threadPool() {
+		return &pool_;
+	}
+
+	int maxRequestsInFlight() const {
+		return pool_.maxThreadCount();
+	}
+
+	/// Blocks until the asynchronous operations are finished
+	void waitForDone() {
+		pool_.waitForDone();
+	}
+
+public:
+	/// Idle threads of the pool end after this long; a run keeps its storage while it walks the source, the threads are not kept meanwhile
+	static const int idleThreadExpiryMSecs = 1000;
+
+protected:
+	/// The destructors of the implementations wait for the asynchronous operations, which call them
+	explicit StorageBackend(int maxRequestsInFlight);
+
+private:
+	QThreadPool pool_;
+
+};
+
+#endif // STORAGEBACKEND_H
@@ -0,0 +1,207 @@
+#include "tracer.h"
+
+#include <chrono>
+
+#include <QMutexLocker>
+#include <QFile>
+#include <QTextStream>
+#include <QCoreApplication>
+
+
+struct Tracer::Event
+{
+	char phase;
+	const char *category, *name;
+	qint64 time;
+	qint64 duration;
+	quint64 flowId;
+	const char *argName;
+	QString argValue;
+};
+
+struct Tracer::ThreadBuffer
+{
+	QMutex mutex;
+	int threadId;
+	QString threadName;
+	std::vector<Event> events;
+	quint64 droppedCount = 0;
+
+	/// A thread records into the buffer; guarded by buffersMutex_
+	bool isInUse = true;
+};
+
+/// Returns the buffer of the thread once the thread finishes
+struct Tracer::ThreadBufferLease
+{
+	ThreadBuffer *buffer = nullptr;
+
+	~ThreadBufferLease() {
+		if(!buffer)
+			return;
+
+		QMutexLocker ml(&buffersMutex_);
+		buffer->isInUse = false;
+	}
+};
+
+std::atomic<bool> Tracer::enabled_{false};
+std::atomic<quint64> Tracer::lastFlowId_{0};
+QMutex Tracer::buffersMutex_;
+std::vector<std::unique_ptr<Tracer::ThreadBuffer>> Tracer::buffers_;
+
+void Tracer::start()
+{
+	enabled_.store(true, std::memory_order_relaxed);
+}
+
+bool Tracer::stop(const QString &filePath)
+{
+	enabled_.store(false, std::memory_order_relaxed);
+
+	QFile file(filePath);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	QTextStream out(&file);
+	out.setCodec("UTF-8");
+
+	auto escape = [](QString str) {
+		return str.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n").replace('\r', "\\r").replace('\t', "\\t");
+	};
+
+	const qint64 pid = QCoreApplication::applicationPid();
+	bool isFirst = true;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	QMutexLocker bml(&buffersMutex_);
+	for(const auto &buffer : buffers_) {
+		QMutexLocker ml(&buffer->mutex);
+
+		const QString threadName = buffer->droppedCount ? QString("%1 (%2 events dropped)").arg(buffer->threadName).arg(buffer->droppedCount) : buffer->threadName;
+		out << (isFirst ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"" << escape(threadName) << "\"}}";
+		isFirst = false;
+
+		for(const Event &e : buffer->events) {
+			// Timestamps are in microseconds
+			out << ",\n{\"ph\":\"" << e.phase << "\",\"cat\":\"" << e.category << "\",\"name\":\"" << e.name << "\",\"pid\":" << pid << ",\"tid\":" << buffer->threadId
+					<< ",\"ts\":" << QString::number(e.time / 1000.0, 'f', 3);
+
+			if(e.phase == 'X')
+				out << ",\"dur\":" << QString::number(e.duration / 1000.0, 'f', 3);
+
+			if(e.phase == 's' || e.phase == 'f')
+				out << ",\"id\":" << e.flowId << (e.phase == 'f' ? ",\"bp\":\"e\"" : "");
+
+			if(e.argName)
+				out << ",\"args\":{\"" << e.argName << "\":\"" << escape(e.argValue) << "\"}";
+
+			out << "}";
+		}
+
+		buffer->events.clear();
+		buffer->droppedCount = 0;
+	}
+
+	out << "\n]}\n";
+	out.flush();
+
+	return file.error() == QFile::NoError;
+}
+
+qint64 Tracer::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::setThreadName(const QString &name)
+{
+	ThreadBuffer *buffer = threadBuffer();
+	QMutexLocker ml(&buffer->mutex);
+	buffer->threadName = name;
+}
+
+void Tracer::complete(const char *category, const char *name, qint64 start, const char *argName, const QString &argValue)
+{
+	if(!isEnabled())
+		return;
+
+	const qint64 time = now();
+	record(Event{'X', category, name, start, time - start, 0, argName, argName ? argValue : QString()});
+}
+
+void Tracer::begin(const char *category, const char *name, const char *argName, const QString &argValue)
+{
+	if(!isEnabled())
+		return;
+
+	record(Event{'B', category, name, now(), 0, 0, argName, argName ? argValue : QString()});
+}
+
+void Tracer::end(const char *category, const char *name)
+{
+	if(!isEnabled())
+		return;
+
+	record(Event{'E', category, name, now(), 0, 0, nullptr, QString()});
+}
+
+quint64 Tracer::newFlowId()
+{
+	return ++lastFlowId_;
+}
+
+void Tracer::flowStart(const char *category, const char *name, quint64 flowId)
+{
+	if(!isEnabled())
+		return;
+
+	record(Event{'s', category, name, now(), 0, flowId, nullptr, QString()});
+}
+
+void Tracer::flowEnd(const char *category, const char *name, quint64 flowId)
+{
+	if(!isEnabled())
+		return;
+
+	record(Event{'f', category, name, now(), 0, flowId, nullptr, QString()});
+}
+
+Tracer::ThreadBuffer *Tracer::threadBuffer()
+{
+	thread_local ThreadBufferLease lease;
+	if(lease.buffer)
+		return lease.buffer;
+
+	QMutexLocker ml(&buffersMutex_);
+
+	// The events of the finished thread stay in the buffer, the trace shows the new thread on its track (named by the new thread, if at all)
+	for(const auto &buffer : buffers_) {
+		if(!buffer->isInUse) {
+			buffer->isInUse = true;
+			buffer->threadName = QString("thread %1").arg(buffer->threadId);
+			lease.buffer = buffer.get();
+			return lease.buffer;
+		}
+	}
+
+	buffers_.emplace_back(new ThreadBuffer());
+	lease.buffer = buffers_.back().get();
+	lease.buffer->threadId = int(buffers_.size());
+	lease.buffer->threadName = QString("thread %1").arg(lease.buffer->threadId);
+	return lease.buffer;
+}
+
+void Tracer::record(Event &&event)
+{
+	ThreadBuffer *buffer = threadBuffer();
+
+	// Only contended while the trace is being written
+	QMutexLocker ml(&buffer->mutex);
+	if(buffer->events.size() >= size_t(maxEventsPerThread)) {
+		buffer->droppedCount ++;
+		return;
+	}
+
+	buffer->events.push_back(std::move(event));
+}
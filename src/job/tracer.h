@@ -0,0 +1,132 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <vector>
+#include <memory>
+
+#include <QString>
+#include <QMutex>
+
+/// Opt-in recording of trace events in the Chrome/Perfetto trace-event JSON format.
+/// Each thread records into its own buffer, so recording only takes an uncontended lock; the buffers are merged when the trace is written.
+/// All recording functions do nothing unless tracing is enabled (check isEnabled() before preparing expensive arguments).
+class Tracer
+{
+
+public:
+	static bool isEnabled() {
+		return enabled_.load(std::memory_order_relaxed);
+	}
+
+	static void start();
+
+	/// Stops the recording and writes the trace to the file, returns false on failure
+	static bool stop(const QString &filePath);
+
+	/// Monotonic time in nanoseconds
+	static qint64 now();
+
+public:
+	/// Name of the calling thread in the trace
+	static void setThreadName(const QString &name);
+
+	/// Span of the calling thread that started at start (from now()) and ends now; argName/argValue are an optional argument shown with the event
+	static void complete(const char *category, const char *name, qint64 start, const char *argName = nullptr, const QString &argValue = QString());
+
+	/// Begin and end of a span of the calling thread, must be nested properly
+	static void begin(const char *category, const char *name, const char *argName = nullptr, const QString &argValue = QString());
+	static void end(const char *category, const char *name);
+
+	/// Flow arrow between two events (e.g. job enqueue and execution) on possibly different threads
+	static quint64 newFlowId();
+	static void flowStart(const char *category, const char *name, quint64 flowId);
+	static void flowEnd(const char *category, const char *name, quint64 flowId);
+
+public:
+	/// Events recorded by a thread above this count are dropped
+	static const int maxEventsPerThread = 4 * 1024 * 1024;
+
+private:
+	struct Event;
+	struct ThreadBuffer;
+	struct ThreadBufferLease;
+
+	static ThreadBuffer *threadBuffer();
+	static void record(Event &&event);
+
+private:
+	static std::atomic<bool> enabled_;
+	static std::atomic<quint64> lastFlowId_;
+
+	/// Thread buffers, owned here so that the events of finished threads are kept. The buffer of a finished thread is taken over by the next new thread
+	/// (the pool threads expire and are recreated), so there are only as many buffers as threads that recorded at the same time.
+	static QMutex buffersMutex_;
+	static std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+
+};
+
+/// Records a complete event spanning the lifetime of the object
+class TraceSpan
+{
+
+public:
+	TraceSpan(const char *category, const char *name, const char *argName = nullptr, const QString &argValue = QString()) :
+		category_(category),
+		name_(name),
+		argName_(argName),
+		start_(Tracer::isEnabled() ? Tracer::now() : -1)
+	{
+		if(start_ != -1 && argName)
+			argValue_ = argValue;
+	}
+
+	~TraceSpan() {
+		if(start_ != -1)
+			Tracer::complete(category_, name_, start_, argName_, argValue_);
+	}
+
+private:
+	const char *category_, *name_, *argName_;
+	const qint64 start_;
+	QString argValue_;
+
+};
+
+/// Back-to-back spans of the calling thread, one for each run of equal keys passed to update() (e.g. the directory being walked)
+class TraceSegments
+{
+
+public:
+	TraceSegments(const char *category, const char *name, const char *argName) :
+		category_(category),
+		name_(name),
+		argName_(argName)
+	{}
+
+	~TraceSegments() {
+		if(isOpen_)
+			Tracer::end(category_, name_);
+	}
+
+public:
+	void update(const QString &key) {
+		if(!Tracer::isEnabled() || (isOpen_ && key == key_))
+			return;
+
+		if(isOpen_)
+			Tracer::end(category_, name_);
+
+		Tracer::begin(category_, name_, argName_, key);
+		key_ = key;
+		isOpen_ = true;
+	}
+
+private:
+	const char *category_, *name_, *argName_;
+	QString key_;
+	bool isOpen_ = false;
+
+};
+
+#endif // TRACER_H
@@ -0,0 +1,39 @@
+#include "versionstore.h"
+
+#include <QFileInfo>
+
+QString VersionStore::dirName()
+{
+	return QStringLiteral(".versions");
+}
+
+QString VersionStore::versionPath(qlonglong historyId, const QString &suffix)
+{
+	// Fibonacci hashing; the top bits of the product depend on all bits of the id
+	const quint64 hash = quint64(historyId) * Q_UINT64_C(0x9E3779B97F4A7C15);
+
+	return QString("%1/%2/%3/%4%5").arg(
+				dirName(),
+				QString::number((hash >> 56) & 0xff, 16).rightJustified(2, '0'),
+				QString::number((hash >> 48) & 0xff, 16).rightJustified(2, '0'),
+				QString::number(historyId),
+				suffix.isEmpty() ? QString() : '.' + suffix);
+}
+
+bool VersionStore::isInStore(const QString &remoteFilePath)
+{
+	return remoteFilePath.startsWith(dirName() + '/');
+}
+
+QString VersionStore::besideOriginalPath(const QString &filePath, const QString &timeSuffix)
+{
+	const QFileInfo fileInfo(filePath);
+	const QString fileName = QString("%1.bkp.%2.%3").arg(fileInfo.completeBaseName(), timeSuffix, fileInfo.suffix());
+
+	return fileInfo.path() == "." ? fileName : fileInfo.path() + '/' + fileName;
+}
+
+VersionStore::Layout VersionStore::layout(const QVariant &historyLayout)
+{
+	return historyLayout.toInt() == int(Layout::versionStore) ? Layout::versionStore : Layout::besideOriginals;
+}
@@ -0,0 +1,38 @@
+#ifndef VERSIONSTORE_H
+#define VERSIONSTORE_H
+
+#include <QString>
+#include <QVariant>
+
+/// Where the history versions are kept in the backup directory. The paths are relative to the backup directory, as stored in history.remoteFilePath.
+class VersionStore
+{
+
+public:
+	/// Value of backupDirectories.historyLayout
+	enum class Layout {
+		/// Renamed in place to name.bkp.<time>.ext next to the current copy
+		besideOriginals = 0,
+
+		/// Moved to the hash-sharded version store, addressed by history.id
+		versionStore = 1
+	};
+
+public:
+	/// Directory of the version store, directly in the backup directory
+	static QString dirName();
+
+	/// .versions/xx/yy/<historyId>.ext; two levels of 256 shards spread the versions evenly, whatever the ids are
+	static QString versionPath(qlonglong historyId, const QString &suffix);
+
+	/// Whether remoteFilePath (relative to the backup directory) is in the version store
+	static bool isInStore(const QString &remoteFilePath);
+
+	/// Version of filePath renamed in place, tagged with timeSuffix
+	static QString besideOriginalPath(const QString &filePath, const QString &timeSuffix);
+
+	static Layout layout(const QVariant &historyLayout);
+
+};
+
+#endif // VERSIONSTORE_H
@@ -0,0 +1,19 @@
+# Deadlines, grouping and failure backoff of BackupScheduler
+
+QT       += core testlib
+QT       -= gui
+
+TEMPLATE = app
+CONFIG += console c++14 testcase
+CONFIG -= app_bundle
+
+TARGET = tst_backupscheduler
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_backupscheduler.cpp \
+    ../../job/backupscheduler.cpp
+
+HEADERS += \
+    ../../job/backupscheduler.h
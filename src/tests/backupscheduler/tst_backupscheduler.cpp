@@ -0,0 +1,99 @@
+#include <QtTest>
+
+#include "job/backupscheduler.h"
+
+/// Deadlines of BackupScheduler; the directories have no time window, so the results do not depend on the local time
+class TestBackupScheduler : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void dueAfterInterval();
+	void failureBackoff();
+	void requestAfterFailure();
+
+private:
+	static BackupScheduler::Directory directory(qlonglong id, qlonglong lastFinished);
+
+	static const qlonglong now = 1700000000;
+	static const qlonglong interval = 3600;
+
+};
+
+const qlonglong TestBackupScheduler::now;
+const qlonglong TestBackupScheduler::interval;
+
+void TestBackupScheduler::dueAfterInterval()
+{
+	BackupScheduler scheduler;
+	scheduler.update({directory(1, now - 600), directory(2, -1)}, now);
+
+	// Never backed up -> due immediately, the other one after the interval and a jitter of up to a tenth of it
+	QCOMPARE(scheduler.takeDue(now, 10), QVector<QVector<qlonglong>>({{2}}));
+	QVERIFY(scheduler.nextDeadline() >= now - 600 + interval);
+	QVERIFY(scheduler.nextDeadline() <= now - 600 + interval + interval / 10);
+	QCOMPARE(scheduler.runningCount(), 1);
+
+	// The running directory has no deadline until it finishes
+	QCOMPARE(scheduler.deadlines().size(), 1);
+	QCOMPARE(scheduler.deadlines().value(1), scheduler.nextDeadline());
+
+	scheduler.finish({2}, {}, now);
+	QCOMPARE(scheduler.runningCount(), 0);
+}
+
+void TestBackupScheduler::failureBackoff()
+{
+	BackupScheduler scheduler;
+	scheduler.update({directory(1, -1)}, now);
+	QCOMPARE(scheduler.takeDue(now, 1).size(), 1);
+
+	// A directory that was never backed up is retried after the backoff, doubled by each failure
+	scheduler.finish({1}, {1}, now);
+	scheduler.update({directory(1, -1)}, now);
+	QCOMPARE(scheduler.nextDeadline(), now + BackupScheduler::initialBackoff);
+	QVERIFY(scheduler.takeDue(now, 1).isEmpty());
+
+	const qlonglong retryTime = now + BackupScheduler::initialBackoff;
+	QCOMPARE(scheduler.takeDue(retryTime, 1).size(), 1);
+
+	scheduler.finish({1}, {1}, retryTime);
+	scheduler.update({directory(1, -1)}, retryTime);
+	QCOMPARE(scheduler.nextDeadline(), retryTime + 2 * BackupScheduler::initialBackoff);
+
+	// A successful run ends the backoff
+	QCOMPARE(scheduler.takeDue(retryTime + 2 * BackupScheduler::initialBackoff, 1).size(), 1);
+	scheduler.finish({1}, {}, retryTime);
+	scheduler.update({directory(1, -1)}, retryTime);
+	QCOMPARE(scheduler.nextDeadline(), retryTime);
+}
+
+void TestBackupScheduler::requestAfterFailure()
+{
+	BackupScheduler scheduler;
+	scheduler.update({directory(1, now - 2 * interval)}, now);
+	QCOMPARE(scheduler.takeDue(now, 1).size(), 1);
+
+	scheduler.finish({1}, {1}, now);
+	scheduler.update({directory(1, now - 2 * interval)}, now);
+	QCOMPARE(scheduler.nextDeadline(), now + BackupScheduler::initialBackoff);
+
+	// Requesting a backup resets lastFinished -> due immediately despite the failure
+	scheduler.update({directory(1, -1)}, now + 1);
+	QCOMPARE(scheduler.nextDeadline(), now + 1);
+	QCOMPARE(scheduler.takeDue(now + 1, 1), QVector<QVector<qlonglong>>({{1}}));
+
+	// The requested run fails too -> backoff from the first failure again
+	scheduler.finish({1}, {1}, now + 1);
+	scheduler.update({directory(1, -1)}, now + 1);
+	QCOMPARE(scheduler.nextDeadline(), now + 1 + BackupScheduler::initialBackoff);
+}
+
+BackupScheduler::Directory TestBackupScheduler::directory(qlonglong id, qlonglong lastFinished)
+{
+	return {id, interval, lastFinished, -1, -1, QString("/source/%1").arg(id)};
+}
+
+QTEST_GUILESS_MAIN(TestBackupScheduler)
+
+#include "tst_backupscheduler.moc"
@@ -0,0 +1,26 @@
+# Integration test of the S3 backend against a real object store (e.g. a local MinIO server).
+# Skipped unless STRAW_BACKUP_TEST_S3_URL is set to a writable bucket, s3+http://localhost:9000/bucket; the credentials are taken from AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY.
+
+QT       += core concurrent network testlib
+QT       -= gui
+
+TEMPLATE = app
+CONFIG += console c++14 testcase
+CONFIG -= app_bundle
+
+TARGET = tst_s3storage
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_s3storage.cpp \
+    ../../job/storagebackend.cpp \
+    ../../job/localstorage.cpp \
+    ../../job/s3storage.cpp \
+    ../../job/filecopy.cpp
+
+HEADERS += \
+    ../../job/storagebackend.h \
+    ../../job/localstorage.h \
+    ../../job/s3storage.h \
+    ../../job/filecopy.h
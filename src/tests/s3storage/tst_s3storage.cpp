@@ -0,0 +1,194 @@
+#include <memory>
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QCryptographicHash>
+
+#include "job/s3storage.h"
+
+/// Operations of S3Storage against the bucket in STRAW_BACKUP_TEST_S3_URL; each run of the test works under its own prefix and removes it at the end
+class TestS3Storage : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void putAndGet();
+	void putMultipart();
+	void rename();
+	void remove();
+	void list();
+
+private:
+	/// Writes a local file of the size with content depending on seed, returns its path
+	QString writeLocalFile(const QString &name, qint64 size, int seed);
+
+	static QByteArray fileHash(const QString &filePath);
+
+private:
+	QTemporaryDir tmpDir_;
+	std::unique_ptr<S3Storage> storage_;
+
+};
+
+void TestS3Storage::initTestCase()
+{
+	const QString url = QString::fromLocal8Bit(qgetenv("STRAW_BACKUP_TEST_S3_URL"));
+	if(url.isEmpty())
+		QSKIP("STRAW_BACKUP_TEST_S3_URL is not set");
+
+	QVERIFY(tmpDir_.isValid());
+
+	QUrl prefixUrl(url);
+	prefixUrl.setPath(prefixUrl.path() + QString("/tst-s3storage-%1").arg(QDateTime::currentMSecsSinceEpoch()));
+	storage_.reset(new S3Storage(prefixUrl));
+
+	QVERIFY(storage_->isAvailable());
+	QVERIFY(storage_->isEmpty());
+}
+
+void TestS3Storage::cleanupTestCase()
+{
+	if(!storage_)
+		return;
+
+	QStringList filePaths;
+	QVERIFY(storage_->list(QString(), filePaths));
+
+	for(const QString &filePath : filePaths)
+		QVERIFY(storage_->remove(filePath));
+
+	QVERIFY(storage_->isEmpty());
+}
+
+void TestS3Storage::putAndGet()
+{
+	const QString sourceFilePath = writeLocalFile("small", 100000, 1);
+
+	qint64 bytesSent = 0;
+	QVERIFY(storage_->put(sourceFilePath, "a/small.bin", [&](qint64 bytes) {
+		bytesSent += bytes;
+	}));
+	QCOMPARE(bytesSent, qint64(100000));
+
+	QVERIFY(storage_->exists("a/small.bin"));
+	QCOMPARE(storage_->size("a/small.bin"), qint64(100000));
+	QVERIFY(!storage_->exists("a/missing.bin"));
+	QCOMPARE(storage_->size("a/missing.bin"), qint64(-1));
+
+	const QString targetFilePath = QDir(tmpDir_.path()).absoluteFilePath("small.get");
+	QVERIFY(storage_->get("a/small.bin", targetFilePath));
+	QCOMPARE(fileHash(targetFilePath), fileHash(sourceFilePath));
+
+	// Replacing an object
+	const QString replacementFilePath = writeLocalFile("replacement", 1000, 2);
+	QVERIFY(storage_->put(replacementFilePath, "a/small.bin"));
+	QCOMPARE(storage_->size("a/small.bin"), qint64(1000));
+
+	QVERIFY(!storage_->get("a/missing.bin", targetFilePath));
+}
+
+void TestS3Storage::putMultipart()
+{
+	// Over the threshold and not a multiple of the part size, the last part is short
+	const qint64 size = S3Storage::multipartThreshold + S3Storage::minPartSize / 2 + 123;
+	const QString sourceFilePath = writeLocalFile("large", size, 3);
+
+	qint64 bytesSent = 0;
+	QVERIFY(storage_->put(sourceFilePath, "large.bin", [&](qint64 bytes) {
+		bytesSent += bytes;
+	}));
+	QCOMPARE(bytesSent, size);
+	QCOMPARE(storage_->size("large.bin"), size);
+
+	const QString targetFilePath = QDir(tmpDir_.path()).absoluteFilePath("large.get");
+	QVERIFY(storage_->get("large.bin", targetFilePath));
+	QCOMPARE(fileHash(targetFilePath), fileHash(sourceFilePath));
+
+	// Renamed by a copy in parts only above copyPartSize, a plain copy here
+	QVERIFY(storage_->rename("large.bin", "large-renamed.bin"));
+	QCOMPARE(storage_->size("large-renamed.bin"), size);
+	QVERIFY(storage_->remove("large-renamed.bin"));
+}
+
+void TestS3Storage::rename()
+{
+	const QString sourceFilePath = writeLocalFile("rename", 5000, 4);
+	QVERIFY(storage_->put(sourceFilePath, "b/old.bin"));
+
+	QVERIFY(storage_->rename("b/old.bin", "b/c/new.bin"));
+	QVERIFY(!storage_->exists("b/old.bin"));
+	QVERIFY(storage_->exists("b/c/new.bin"));
+
+	const QString targetFilePath = QDir(tmpDir_.path()).absoluteFilePath("rename.get");
+	QVERIFY(storage_->get("b/c/new.bin", targetFilePath));
+	QCOMPARE(fileHash(targetFilePath), fileHash(sourceFilePath));
+
+	QVERIFY(!storage_->rename("b/missing.bin", "b/other.bin"));
+	QVERIFY(!storage_->exists("b/other.bin"));
+}
+
+void TestS3Storage::remove()
+{
+	QVERIFY(storage_->put(writeLocalFile("remove", 10, 5), "d/removed.bin"));
+	QVERIFY(storage_->exists("d/removed.bin"));
+
+	QVERIFY(storage_->remove("d/removed.bin"));
+	QVERIFY(!storage_->exists("d/removed.bin"));
+}
+
+void TestS3Storage::list()
+{
+	const QString sourceFilePath = writeLocalFile("list", 10, 6);
+	QVERIFY(storage_->put(sourceFilePath, "e/1.bin"));
+	QVERIFY(storage_->put(sourceFilePath, "e/f/2.bin"));
+	QVERIFY(storage_->put(sourceFilePath, "ef/3.bin"));
+
+	// "ef" is not under "e"
+	QStringList filePaths;
+	QVERIFY(storage_->list("e", filePaths));
+	filePaths.sort();
+	QCOMPARE(filePaths, QStringList({"1.bin", "f/2.bin"}));
+
+	QVERIFY(storage_->list("missing", filePaths));
+	QVERIFY(filePaths.isEmpty());
+}
+
+QString TestS3Storage::writeLocalFile(const QString &name, qint64 size, int seed)
+{
+	const QString filePath = QDir(tmpDir_.path()).absoluteFilePath(name);
+
+	QFile file(filePath);
+	if(!file.open(QIODevice::WriteOnly))
+		return QString();
+
+	QByteArray chunk(1024 * 1024, Qt::Uninitialized);
+	for(qint64 offset = 0; offset < size; offset += chunk.size()) {
+		for(int i = 0; i < chunk.size(); i ++)
+			chunk[i] = char((offset + i) * 31 + seed);
+
+		file.write(chunk.constData(), qMin<qint64>(chunk.size(), size - offset));
+	}
+
+	return filePath;
+}
+
+QByteArray TestS3Storage::fileHash(const QString &filePath)
+{
+	QFile file(filePath);
+	if(!file.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	QCryptographicHash hash(QCryptographicHash::Sha256);
+	hash.addData(&file);
+	return hash.result();
+}
+
+QTEST_GUILESS_MAIN(TestS3Storage)
+
+#include "tst_s3storage.moc"
@@ -0,0 +1,2 @@
+TEMPLATE = subdirs
+SUBDIRS = threaddb backupscheduler s3storage
@@ -0,0 +1,3 @@
+TARGET = tst_threaddb_qtsql
+
+include(../threaddbtest.pri)
@@ -0,0 +1,4 @@
+CONFIG += threaddb_sqlite3
+TARGET = tst_threaddb_sqlite3
+
+include(../threaddbtest.pri)
@@ -0,0 +1,8 @@
+#-------------------------------------------------
+#
+# threaddb behaviour tests, run against both database backends with 'make check'
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+SUBDIRS = qtsql sqlite3
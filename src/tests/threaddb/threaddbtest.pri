@@ -0,0 +1,21 @@
+# Behaviour tests of the threaddb layer, shared by the QtSql and the sqlite3 build of the test
+
+QT       += core sql testlib
+QT       -= gui
+
+TEMPLATE = app
+CONFIG += console c++14 testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    $$PWD/tst_threaddb.cpp \
+    $$PWD/../../job/jobthread.cpp \
+    $$PWD/../../job/tracer.cpp
+
+HEADERS += \
+    $$PWD/../../job/jobthread.h \
+    $$PWD/../../job/tracer.h
+
+include($$PWD/../../threaddb/threaddb.pri)
@@ -0,0 +1,269 @@
+#include <atomic>
+#include <memory>
+#include <tuple>
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QSqlField>
+
+#include "threaddb/dbmanager.h"
+#include "threaddb/dbsnapshot.h"
+#include "threaddb/dbstatement.h"
+#include "threaddb/dbpagedmodel.h"
+
+/// Behaviour of the threaddb layer that the QtSql and the native sqlite3 backends must share; built once for each of them
+class TestThreadDB : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void init();
+	void cleanup();
+
+	void emptyResults();
+	void nullValues();
+	void positionalAndNamedBinding();
+	void insertId();
+	void queryErrors();
+	void queryIteration();
+	void snapshotIsolation();
+	void statementTypes();
+	void statementErrors();
+	void manyDistinctQueries();
+	void pagedModel();
+
+private:
+	QTemporaryDir tmpDir_;
+	std::unique_ptr<DBManager> db_;
+	std::atomic<int> errorCount_{0};
+
+};
+
+void TestThreadDB::init()
+{
+	QVERIFY(tmpDir_.isValid());
+
+	db_.reset(new DBManager());
+	errorCount_ = 0;
+
+	// Emitted on the db threads
+	connect(db_.get(), &DBManager::sigQueryError, [this](QString, QString){
+		errorCount_ ++;
+	});
+
+	db_->openSQLITE(QDir(tmpDir_.path()).absoluteFilePath(QString("%1.sqlite").arg(QTest::currentTestFunction())));
+	db_->blockingExec("CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT, size INTEGER)");
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::cleanup()
+{
+	db_.reset();
+}
+
+void TestThreadDB::emptyResults()
+{
+	QCOMPARE(db_->selectValue("SELECT COUNT(*) FROM items").toLongLong(), qlonglong(0));
+
+	QSqlRecord def;
+	def.append(QSqlField("name"));
+	def.setValue("name", "default");
+	QCOMPARE(db_->selectRowDef("SELECT name FROM items WHERE id = ?", {1}, def).value("name").toString(), QString("default"));
+
+	DBQuery query = db_->selectQuery("SELECT id, name FROM items");
+	QCOMPARE(query.rowCount(), 0);
+	QVERIFY(!query.next());
+	QCOMPARE(int(errorCount_), 0);
+
+	// selectRow and selectValue report a missing row as an error
+	QVERIFY(db_->selectRow("SELECT name FROM items WHERE id = ?", {1}).isEmpty());
+	QVERIFY(!db_->selectValue("SELECT name FROM items WHERE id = ?", {1}).isValid());
+	QCOMPARE(int(errorCount_), 2);
+}
+
+void TestThreadDB::nullValues()
+{
+	db_->insert("INSERT INTO items (name, size) VALUES (?, ?)", {QVariant(), QVariant()});
+
+	const QSqlRecord row = db_->selectRow("SELECT name, size FROM items");
+	QVERIFY(row.value("name").isNull());
+	QVERIFY(row.value("size").isNull());
+
+	QVERIFY(db_->selectValue("SELECT size FROM items").isNull());
+	QCOMPARE(db_->selectValue("SELECT COUNT(*) FROM items WHERE name IS NULL").toLongLong(), qlonglong(1));
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::positionalAndNamedBinding()
+{
+	db_->exec("INSERT INTO items (name, size) VALUES (?, ?)", {"positional", 1});
+	db_->execAssoc("INSERT INTO items (name, size) VALUES (:name, :size)", {{":name", "named"}, {":size", 2}});
+
+	// Named parameters are bound by name, not in the order they are passed
+	db_->execAssoc("INSERT INTO items (name, size) VALUES (:name, :size)", {{":size", 3}, {":name", "reordered"}});
+
+	QCOMPARE(db_->selectValue("SELECT size FROM items WHERE name = ?", {"positional"}).toLongLong(), qlonglong(1));
+	QCOMPARE(db_->selectValueAssoc("SELECT size FROM items WHERE name = :name", {{":name", "named"}}).toLongLong(), qlonglong(2));
+	QCOMPARE(db_->selectValueAssoc("SELECT size FROM items WHERE name = :name", {{":name", "reordered"}}).toLongLong(), qlonglong(3));
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::insertId()
+{
+	const qlonglong firstId = db_->insert("INSERT INTO items (name) VALUES (?)", {"a"}).toLongLong();
+	const qlonglong secondId = db_->insertAssoc("INSERT INTO items (name) VALUES (:name)", {{":name", "b"}}).toLongLong();
+
+	QVERIFY(firstId > 0);
+	QCOMPARE(secondId, firstId + 1);
+	QCOMPARE(db_->selectValue("SELECT name FROM items WHERE id = ?", {secondId}).toString(), QString("b"));
+}
+
+void TestThreadDB::queryErrors()
+{
+	QVERIFY(!db_->insert("INSERT INTO missing (name) VALUES (?)", {"a"}).isValid());
+	QCOMPARE(int(errorCount_), 1);
+
+	QVERIFY(db_->selectRow("SELEC name FROM items").isEmpty());
+	QCOMPARE(int(errorCount_), 2);
+
+	DBQuery query = db_->selectQuery("SELECT nothing FROM items");
+	QCOMPARE(query.rowCount(), 0);
+	QVERIFY(!query.next());
+	QCOMPARE(int(errorCount_), 3);
+
+	// The connection is usable after the errors
+	db_->blockingExec("INSERT INTO items (name) VALUES (?)", {"after"});
+	QCOMPARE(db_->selectValue("SELECT COUNT(*) FROM items").toLongLong(), qlonglong(1));
+	QCOMPARE(int(errorCount_), 3);
+}
+
+void TestThreadDB::queryIteration()
+{
+	for(int i = 0; i < 10; i ++)
+		db_->exec("INSERT INTO items (name, size) VALUES (?, ?)", {QString("item%1").arg(i), i});
+
+	DBQuery query = db_->selectQuery("SELECT name, size FROM items WHERE size >= ? ORDER BY size", {5});
+	QCOMPARE(query.rowCount(), 5);
+	QCOMPARE(query.columnCount(), 2);
+
+	int expectedSize = 5;
+	while(query.next()) {
+		QCOMPARE(query.value(1).toInt(), expectedSize);
+		QCOMPARE(query.value("name").toString(), QString("item%1").arg(expectedSize));
+		expectedSize ++;
+	}
+
+	QCOMPARE(expectedSize, 10);
+
+	QVERIFY(query.seek(0));
+	QCOMPARE(query.value("size").toInt(), 5);
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::snapshotIsolation()
+{
+	db_->blockingExec("INSERT INTO items (name) VALUES (?)", {"before"});
+
+	{
+		DBSnapshot snapshot(db_.get());
+		QCOMPARE(snapshot.selectValue("SELECT COUNT(*) FROM items").toLongLong(), qlonglong(1));
+
+		db_->blockingExec("INSERT INTO items (name) VALUES (?)", {"during"});
+
+		// The snapshot keeps seeing the state of its first read
+		QCOMPARE(snapshot.selectValue("SELECT COUNT(*) FROM items").toLongLong(), qlonglong(1));
+		QCOMPARE(snapshot.selectQuery("SELECT name FROM items").rowCount(), 1);
+		QCOMPARE(snapshot.selectRowDefAssoc("SELECT name FROM items WHERE name = :name", {{":name", "during"}}).isEmpty(), true);
+	}
+
+	DBSnapshot snapshot(db_.get());
+	QCOMPARE(snapshot.selectValue("SELECT COUNT(*) FROM items").toLongLong(), qlonglong(2));
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::statementTypes()
+{
+	DBStatement<std::tuple<>(QString, qlonglong)> insertStatement(db_.get(), "INSERT INTO items (name, size) VALUES (?, ?)");
+	DBStatement<std::tuple<qlonglong, QString, qlonglong>(qlonglong)> selectStatement(db_.get(), "SELECT id, name, size FROM items WHERE size >= ? ORDER BY size");
+
+	QVERIFY(insertStatement.exec("a", 1));
+	insertStatement.execAsync("b", 2);
+	QVERIFY(insertStatement.execBatch({std::make_tuple(QString("c"), qlonglong(3)), std::make_tuple(QString("d"), qlonglong(4))}));
+
+	// Async statements are executed in order with the other queries of the writer
+	const QVector<std::tuple<qlonglong, QString, qlonglong>> rows = selectStatement.selectAll(2);
+	QCOMPARE(rows.size(), 3);
+	QCOMPARE(std::get<1>(rows[0]), QString("b"));
+	QCOMPARE(std::get<2>(rows[2]), qlonglong(4));
+
+	const auto def = std::make_tuple(qlonglong(-1), QString("none"), qlonglong(-1));
+	QCOMPARE(std::get<1>(selectStatement.selectRowDef(def, 100)), QString("none"));
+	QCOMPARE(std::get<1>(selectStatement.selectRowDefAsync(def, 3).result()), QString("c"));
+
+	// NULLs are read as the default values of the column types
+	db_->blockingExec("INSERT INTO items (name, size) VALUES (NULL, 10)");
+	const auto nullRow = selectStatement.selectRowDef(def, 10);
+	QVERIFY(std::get<1>(nullRow).isEmpty());
+	QCOMPARE(std::get<2>(nullRow), qlonglong(10));
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::statementErrors()
+{
+	DBStatement<std::tuple<>(QString)> invalidStatement(db_.get(), "INSERT INTO missing (name) VALUES (?)");
+	QCOMPARE(int(errorCount_), 1);
+
+	DBStatement<std::tuple<>(qlonglong)> conflictStatement(db_.get(), "INSERT INTO items (id) VALUES (?)");
+	QVERIFY(conflictStatement.exec(1));
+	QVERIFY(!conflictStatement.exec(1));
+	QVERIFY(errorCount_ >= 2);
+
+	// A failed execution does not break the next one
+	QVERIFY(conflictStatement.exec(2));
+	QCOMPARE(db_->selectValue("SELECT COUNT(*) FROM items").toLongLong(), qlonglong(2));
+}
+
+void TestThreadDB::manyDistinctQueries()
+{
+	db_->blockingExec("INSERT INTO items (name, size) VALUES (?, ?)", {"hot", 7});
+
+	// More distinct query texts than the native backend caches, interleaved with a query used all the time
+	for(int i = 0; i < 500; i ++) {
+		QCOMPARE(db_->selectValue(QString("SELECT size + %1 FROM items WHERE name = ?").arg(i), {"hot"}).toLongLong(), qlonglong(7 + i));
+		QCOMPARE(db_->selectValue("SELECT size FROM items WHERE name = ?", {"hot"}).toLongLong(), qlonglong(7));
+	}
+
+	QCOMPARE(int(errorCount_), 0);
+}
+
+void TestThreadDB::pagedModel()
+{
+	// Duplicate sizes: the key needs the id to be unique
+	for(int i = 0; i < 10; i ++)
+		db_->blockingExec("INSERT INTO items (name, size) VALUES (?, ?)", {QString("item%1").arg(i), i % 4});
+
+	DBPagedModel offsetModel(db_.get()), keysetModel(db_.get());
+	offsetModel.setQuery("SELECT size, id, name FROM items WHERE size >= ? ORDER BY size, id", {1}, QStringList(), 3);
+	keysetModel.setQuery("SELECT size, id, name FROM items WHERE (size >= ?) AND (" + DBPagedModel::keysetCondition + ") ORDER BY size, id", {1}, {"size", "id"}, 3);
+
+	for(DBPagedModel *model : {&offsetModel, &keysetModel}) {
+		QCOMPARE(model->rowCount(), 3);
+		QCOMPARE(model->columnCount(), 3);
+
+		while(model->canFetchMore(QModelIndex()))
+			model->fetchMore(QModelIndex());
+
+		QCOMPARE(model->rowCount(), 7);
+		for(int row = 1; row < model->rowCount(); row ++) {
+			const auto previous = std::make_tuple(model->value(row - 1, 0).toInt(), model->value(row - 1, 1).toLongLong());
+			QVERIFY(previous < std::make_tuple(model->value(row, 0).toInt(), model->value(row, 1).toLongLong()));
+		}
+	}
+
+	QCOMPARE(int(errorCount_), 0);
+}
+
+QTEST_GUILESS_MAIN(TestThreadDB)
+
+#include "tst_threaddb.moc"
@@ -0,0 +1,73 @@
+#ifndef DBCONNECTION_H
+#define DBCONNECTION_H
+
+#include "job/jobthread.h"
+
+#ifdef THREADDB_NATIVE_SQLITE
+
+#include <QHash>
+#include <QString>
+
+#include "sqlite3util.h"
+
+/// Database connection together with the thread it is exclusively used from
+struct DBConnection
+{
+	JobThread jobThread;
+	sqlite3 *db = nullptr;
+
+	struct CachedStatement {
+		sqlite3_stmt *stmt;
+
+		/// Value of lastStatementUse when the statement was last returned, the least recently used one is evicted first
+		quint64 lastUse;
+	};
+
+	/// Statements prepared with SQLITE_PREPARE_PERSISTENT, reused by their query text
+	QHash<QString, CachedStatement> statementCache;
+	quint64 lastStatementUse = 0;
+
+	/// Returns cached prepared statement for the query (prepares it on first use), nullptr on error
+	sqlite3_stmt *statement(const QString &query);
+
+	bool open(const QString &filename, int flags);
+	void close();
+
+	bool exec(const char *query);
+	bool transaction();
+
+	/// Frees the page cache and other memory the connection does not need right now
+	void releaseMemory();
+	bool commit();
+	QString lastError() const;
+};
+
+/// Executed statement passed to DBManager::ManipFunc
+using DBCursor = SQLite3Cursor;
+
+#else
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
+/// Database connection together with the thread it is exclusively used from
+struct DBConnection
+{
+	JobThread jobThread;
+	QSqlDatabase db;
+
+	bool transaction() { return db.transaction(); }
+
+	/// Frees the page cache and other memory the connection does not need right now
+	void releaseMemory() { QSqlQuery(db).exec("PRAGMA shrink_memory"); }
+	bool commit() { return db.commit(); }
+	QString lastError() const { return db.lastError().text(); }
+};
+
+/// Executed query passed to DBManager::ManipFunc
+using DBCursor = QSqlQuery;
+
+#endif
+
+#endif // DBCONNECTION_H
@@ -0,0 +1,78 @@
+#include "dbconnection.h"
+
+// Statements beyond this count evict the least recently used one, so that one-off queries do not push out the hot ones
+static const int maxCachedStatements = 64;
+
+sqlite3_stmt *DBConnection::statement(const QString &query)
+{
+	auto it = statementCache.find(query);
+	if(it != statementCache.end()) {
+		it->lastUse = ++ lastStatementUse;
+		return it->stmt;
+	}
+
+	if(statementCache.size() >= maxCachedStatements) {
+		auto leastRecentlyUsed = statementCache.begin();
+		for(auto candidate = statementCache.begin(); candidate != statementCache.end(); ++ candidate) {
+			if(candidate->lastUse < leastRecentlyUsed->lastUse)
+				leastRecentlyUsed = candidate;
+		}
+
+		sqlite3_finalize(leastRecentlyUsed->stmt);
+		statementCache.erase(leastRecentlyUsed);
+	}
+
+	sqlite3_stmt *result = nullptr;
+	if(sqlite3_prepare16_v3(db, query.utf16(), query.size() * int(sizeof(ushort)), SQLITE_PREPARE_PERSISTENT, &result, nullptr) != SQLITE_OK)
+		return nullptr;
+
+	statementCache.insert(query, {result, ++ lastStatementUse});
+	return result;
+}
+
+bool DBConnection::open(const QString &filename, int flags)
+{
+	if(sqlite3_open_v2(filename.toUtf8().constData(), &db, flags | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK)
+		return false;
+
+	// Same default as the QSQLITE driver
+	sqlite3_busy_timeout(db, 5000);
+	return true;
+}
+
+void DBConnection::close()
+{
+	for(const CachedStatement &cached : statementCache)
+		sqlite3_finalize(cached.stmt);
+
+	statementCache.clear();
+
+	// Statements of DBStatement instances that outlive the connection keep it alive until finalized
+	sqlite3_close_v2(db);
+	db = nullptr;
+}
+
+bool DBConnection::exec(const char *query)
+{
+	return sqlite3_exec(db, query, nullptr, nullptr, nullptr) == SQLITE_OK;
+}
+
+void DBConnection::releaseMemory()
+{
+	sqlite3_db_release_memory(db);
+}
+
+bool DBConnection::transaction()
+{
+	return exec("BEGIN");
+}
+
+bool DBConnection::commit()
+{
+	return exec("COMMIT");
+}
+
+QString DBConnection::lastError() const
+{
+	return QString::fromUtf8(sqlite3_errmsg(db));
+}
@@ -0,0 +1,87 @@
+#ifndef DBFUTURE_H
+#define DBFUTURE_H
+
+#include <functional>
+
+#include <QSharedPointer>
+#include <QPointer>
+#include <QObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+/// Result of an asynchronous DBManager call. Copies share the same state.
+template<typename T>
+class DBFuture
+{
+
+public:
+	using Continuation = std::function<void(const T&)>;
+
+public:
+	DBFuture() : d_(new State()) {}
+
+public:
+	bool isFinished() const {
+		QMutexLocker ml(&d_->mutex);
+		return d_->finished;
+	}
+
+	/// Blocks the calling thread until the result is available
+	T result() const {
+		QMutexLocker ml(&d_->mutex);
+		while(!d_->finished)
+			d_->finishedCondition.wait(&d_->mutex);
+
+		return d_->value;
+	}
+
+	/// Calls cont with the result from the event loop of context's thread (never directly from then()); nothing is called if context gets deleted meanwhile.
+	/// A future has a single consumer: then() is called at most once, a second continuation would replace the first one.
+	void then(QObject *context, const Continuation &cont) const {
+		QMutexLocker ml(&d_->mutex);
+		Q_ASSERT(!d_->continuation);
+
+		// Kept also when the result is delivered right away, so that the assert catches a second consumer in either order
+		d_->context = context;
+		d_->continuation = cont;
+
+		if(d_->finished)
+			deliver(context, cont, d_->value);
+	}
+
+public:
+	/// Called by the producer (db thread) when the result is ready
+	void setResult(const T &value) const {
+		QMutexLocker ml(&d_->mutex);
+		d_->value = value;
+		d_->finished = true;
+		d_->finishedCondition.wakeAll();
+
+		if(d_->continuation)
+			deliver(d_->context, d_->continuation, value);
+	}
+
+private:
+	static void deliver(QObject *context, const Continuation &cont, const T &value) {
+		if(!context)
+			return;
+
+		QMetaObject::invokeMethod(context, [cont, value]{ cont(value); }, Qt::QueuedConnection);
+	}
+
+private:
+	struct State {
+		QMutex mutex;
+		QWaitCondition finishedCondition;
+		bool finished = false;
+		T value;
+		QPointer<QObject> context;
+		Continuation continuation;
+	};
+
+	QSharedPointer<State> d_;
+
+};
+
+#endif // DBFUTURE_H
@@ -1,289 +1,292 @@
 #include "dbmanager.h"
 
 #include <QMutexLocker>
-#include <QSqlError>
-#include <QSqlQuery>
-#include <QPointer>
 
 DBManager::DBManager()
 {
 
 }
 
-DBManager::~DBManager()
+void DBManager::execAssoc(QString query, const AssocArgs &args)
 {
-	if(db_.isOpen())
-		db_.close();
-
-	QSqlDatabase::removeDatabase(db_.connectionName());
+	asyncExecAssoc(writer_, query, args, [](DBCursor &){}, []{});
 }
 
-void DBManager::openSQLITE(const QString &filename)
+void DBManager::exec(QString query, const DBManager::Args &args)
 {
-	QByteArray uniqIdBytes;
-	DBManager *thisPtr = this;
-	uniqIdBytes.append( (const char*) &thisPtr, sizeof(thisPtr) );
-	QString uniqId = QString::fromLatin1(uniqIdBytes.toHex());
-
-	jobThread_.executeNonblocking([=] {
-		db_ = QSqlDatabase::addDatabase("QSQLITE", uniqId);
-		db_.setDatabaseName(filename);
-
-		if( !db_.open() )
-			emit sigOpenError(db_.lastError().text());
-		else
-			db_.exec("PRAGMA journal_mode = TRUNCATE");
-	});
+	asyncExec(writer_, query, args, [](DBCursor &){}, []{});
 }
 
-void DBManager::execAssoc(QString query, const AssocArgs &args)
+void DBManager::blockingExecAssoc(const QString &query, const DBManager::AssocArgs &args)
 {
-	jobThread_.executeNonblocking([=] {
-		QSqlQuery q(db_);
-
-		q.prepare(query);
-		for(AssocArg arg : args)
-			q.bindValue(arg.first, arg.second);
+	execAssocAsync(query, args).result();
+}
 
-		if( !q.exec() )
-			emit sigQueryError(queryDesc(q, args), q.lastError().text());
-	});
+void DBManager::blockingExec(const QString &query, const DBManager::Args &args)
+{
+	execAsync(query, args).result();
 }
 
-void DBManager::exec(QString query, const DBManager::Args &args)
+QVariant DBManager::insertAssoc(const QString &query, const DBManager::AssocArgs &args)
 {
-	jobThread_.executeNonblocking([=] {
-		QSqlQuery q(db_);
+	return insertAssocAsync(query, args).result();
+}
 
-		q.prepare(query);
-		for(int i = 0; i < args.length(); i ++)
-			q.bindValue(i, args[i]);
+QVariant DBManager::insert(const QString &query, const DBManager::Args &args)
+{
+	return insertAsync(query, args).result();
+}
 
-		if( !q.exec() )
-			emit sigQueryError(queryDesc(q, args), q.lastError().text());
-	});
+QSqlRecord DBManager::selectRowAssoc(const QString &query, const DBManager::AssocArgs &args)
+{
+	return selectRowAssocAsync(query, args).result();
 }
 
-void DBManager::blockingExecAssoc(const QString &query, const DBManager::AssocArgs &args)
+QSqlRecord DBManager::selectRow(const QString &query, const DBManager::Args &args)
 {
-	jobThread_.executeBlocking([&] {
-		QSqlQuery q(db_);
+	return selectRowAsync(query, args).result();
+}
 
-		q.prepare(query);
-		for(AssocArg arg : args)
-			q.bindValue(arg.first, arg.second);
+QSqlRecord DBManager::selectRowDefAssoc(const QString &query, const DBManager::AssocArgs &args, QSqlRecord def)
+{
+	return selectRowDefAssocAsync(query, args, def).result();
+}
 
-		if( !q.exec() )
-			emit sigQueryError(queryDesc(q, args), q.lastError().text());
-	});
+QSqlRecord DBManager::selectRowDef(const QString &query, const DBManager::Args &args, QSqlRecord def)
+{
+	return selectRowDefAsync(query, args, def).result();
 }
 
-void DBManager::blockingExec(const QString &query, const DBManager::Args &args)
+QVariant DBManager::selectValueAssoc(const QString &query, const DBManager::AssocArgs &args)
 {
-	jobThread_.executeBlocking([&] {
-		QSqlQuery q(db_);
+	return selectValueAssocAsync(query, args).result();
+}
 
-		q.prepare(query);
-		for(int i = 0; i < args.length(); i ++)
-			q.bindValue(i, args[i]);
+QVariant DBManager::selectValue(const QString &query, const DBManager::Args &args)
+{
+	return selectValueAsync(query, args).result();
+}
 
-		if( !q.exec() )
-			emit sigQueryError(queryDesc(q, args), q.lastError().text());
-	});
+DBQuery DBManager::selectQueryAssoc(const QString &query, const DBManager::AssocArgs &args)
+{
+	return selectQueryAssocAsync(query, args).result();
 }
 
-QVariant DBManager::insertAssoc(const QString &query, const DBManager::AssocArgs &args)
+DBQuery DBManager::selectQuery(const QString &query, const DBManager::Args &args)
 {
-	QVariant result;
-	blockingExecAssoc(query, args, [&](QSqlQuery &q){ result = q.lastInsertId(); });
-	return result;
+	return selectQueryAsync(query, args).result();
 }
 
-QVariant DBManager::insert(const QString &query, const DBManager::Args &args)
+DBFuture<bool> DBManager::execAssocAsync(const QString &query, const DBManager::AssocArgs &args)
 {
-	QVariant result;
-	blockingExec(query, args, [&](QSqlQuery &q){ result = q.lastInsertId(); });
+	DBFuture<bool> result;
+	asyncExecAssoc(writer_, query, args, [=](DBCursor &){ result.setResult(true); }, [=]{ result.setResult(false); });
 	return result;
 }
 
-QSqlRecord DBManager::selectRowAssoc(const QString &query, const DBManager::AssocArgs &args)
+DBFuture<bool> DBManager::execAsync(const QString &query, const DBManager::Args &args)
 {
-	QSqlRecord result;
-	blockingExecAssoc(query, args, [&](QSqlQuery &q){
-		if(!q.next())
-			emit sigQueryError(queryDesc(q, args), "No rows returned (selectRow)");
-		else
-			result = q.record();
-	});
+	DBFuture<bool> result;
+	asyncExec(writer_, query, args, [=](DBCursor &){ result.setResult(true); }, [=]{ result.setResult(false); });
 	return result;
 }
 
-QSqlRecord DBManager::selectRow(const QString &query, const DBManager::Args &args)
+DBFuture<QVariant> DBManager::insertAssocAsync(const QString &query, const DBManager::AssocArgs &args)
 {
-	QSqlRecord result;
-	blockingExec(query, args, [&](QSqlQuery &q){
-		if(!q.next())
-			emit sigQueryError(queryDesc(q, args), "No rows returned (selectRow)");
-		else
-			result = q.record();
-	});
+	DBFuture<QVariant> result;
+	asyncExecAssoc(writer_, query, args, [=](DBCursor &q){ result.setResult(q.lastInsertId()); }, [=]{ result.setResult(QVariant()); });
 	return result;
 }
 
-QSqlRecord DBManager::selectRowDefAssoc(const QString &query, const DBManager::AssocArgs &args, QSqlRecord def)
+DBFuture<QVariant> DBManager::insertAsync(const QString &query, const DBManager::Args &args)
 {
-	QSqlRecord result;
-	blockingExecAssoc(query, args, [&](QSqlQuery &q){
-		if(!q.next())
-			result = def;
-		else
-			result = q.record();
-	});
+	DBFuture<QVariant> result;
+	asyncExec(writer_, query, args, [=](DBCursor &q){ result.setResult(q.lastInsertId()); }, [=]{ result.setResult(QVariant()); });
 	return result;
 }
 
-QSqlRecord DBManager::selectRowDef(const QString &query, const DBManager::Args &args, QSqlRecord def)
+DBFuture<QSqlRecord> DBManager::selectRowAssocAsync(const QString &query, const DBManager::AssocArgs &args)
 {
-	QSqlRecord result;
-	blockingExec(query, args, [&](QSqlQuery &q){
-		if(!q.next())
-			result = def;
-		else
-			result = q.record();
-	});
-	return result;
+	return selectRowAssocAsync(writer_, query, args);
 }
 
-QVariant DBManager::selectValueAssoc(const QString &query, const DBManager::AssocArgs &args)
+DBFuture<QSqlRecord> DBManager::selectRowAsync(const QString &query, const DBManager::Args &args)
 {
-	QVariant result;
-	blockingExecAssoc(query, args, [&](QSqlQuery &q){
-		if(!q.next())
-			emit sigQueryError(queryDesc(q, args), "No rows returned (selectValue)");
-		else
-			result = q.value(0);
-	});
-	return result;
+	return selectRowAsync(writer_, query, args);
 }
 
-QVariant DBManager::selectValue(const QString &query, const DBManager::Args &args)
+DBFuture<QSqlRecord> DBManager::selectRowDefAssocAsync(const QString &query, const DBManager::AssocArgs &args, QSqlRecord def)
 {
-	QVariant result;
-	blockingExec(query, args, [&](QSqlQuery &q){
-		if(!q.next())
-			emit sigQueryError(queryDesc(q, args), "No rows returned (selectValue)");
-		else
-			result = q.value(0);
-	});
-	return result;
+	return selectRowDefAssocAsync(writer_, query, args, def);
 }
 
-DBQuery DBManager::selectQueryAssoc(const QString &query, const DBManager::AssocArgs &args)
+DBFuture<QSqlRecord> DBManager::selectRowDefAsync(const QString &query, const DBManager::Args &args, QSqlRecord def)
 {
-	DBQuery result;
+	return selectRowDefAsync(writer_, query, args, def);
+}
 
-	jobThread_.executeBlocking([&] {
+DBFuture<QVariant> DBManager::selectValueAssocAsync(const QString &query, const DBManager::AssocArgs &args)
+{
+	return selectValueAssocAsync(writer_, query, args);
+}
 
-		QPointer<DBManager> thisPtr(this);
-		auto deleter = [thisPtr](QSqlQuery *q){
-			if(thisPtr.isNull())
-				delete q;
-			else
-				thisPtr->jobThread_.executeNonblocking([=]{
-					delete q;
-				});
-		};
+DBFuture<QVariant> DBManager::selectValueAsync(const QString &query, const DBManager::Args &args)
+{
+	return selectValueAsync(writer_, query, args);
+}
 
-		QSharedPointer<QSqlQuery> q(new QSqlQuery(db_), deleter);
+DBFuture<DBQuery> DBManager::selectQueryAssocAsync(const QString &query, const DBManager::AssocArgs &args)
+{
+	return selectQueryAssocAsync(writer_, query, args);
+}
 
-		q->prepare(query);
-		for(AssocArg arg : args)
-			q->bindValue(arg.first, arg.second);
+DBFuture<DBQuery> DBManager::selectQueryAsync(const QString &query, const DBManager::Args &args)
+{
+	return selectQueryAsync(writer_, query, args);
+}
 
-		if( !q->exec() )
-			emit sigQueryError(query, q->lastError().text());
+void DBManager::waitJobDone()
+{
+	writer_.jobThread.executeBlocking([]{});
+}
 
-		result = DBQuery(this, q);
-	});
+DBFuture<QSqlRecord> DBManager::selectRowAssocAsync(DBConnection &c, const QString &query, const DBManager::AssocArgs &args)
+{
+	DBFuture<QSqlRecord> result;
+	asyncExecAssoc(c, query, args, [=](DBCursor &q){
+		if(!q.next()) {
+			emit sigQueryError(queryDesc(query, args), "No rows returned (selectRow)");
+			result.setResult(QSqlRecord());
+		} else
+			result.setResult(q.record());
+	}, [=]{ result.setResult(QSqlRecord()); });
 	return result;
 }
 
-DBQuery DBManager::selectQuery(const QString &query, const DBManager::Args &args)
+DBFuture<QSqlRecord> DBManager::selectRowAsync(DBConnection &c, const QString &query, const DBManager::Args &args)
 {
-	DBQuery result;
-	QPointer<DBManager> thisPtr(this);
+	DBFuture<QSqlRecord> result;
+	asyncExec(c, query, args, [=](DBCursor &q){
+		if(!q.next()) {
+			emit sigQueryError(queryDesc(query, args), "No rows returned (selectRow)");
+			result.setResult(QSqlRecord());
+		} else
+			result.setResult(q.record());
+	}, [=]{ result.setResult(QSqlRecord()); });
+	return result;
+}
 
-	jobThread_.executeBlocking([&] {
-		auto deleter = [=](QSqlQuery *q){
-			if(thisPtr.isNull())
-				delete q;
-			else
-				jobThread_.executeNonblocking([=]{
-					delete q;
-				});
-		};
-		QSharedPointer<QSqlQuery> q(new QSqlQuery(db_), deleter);
+DBFuture<QSqlRecord> DBManager::selectRowDefAssocAsync(DBConnection &c, const QString &query, const DBManager::AssocArgs &args, const QSqlRecord &def)
+{
+	DBFuture<QSqlRecord> result;
+	asyncExecAssoc(c, query, args, [=](DBCursor &q){
+		if(!q.next())
+			result.setResult(def);
+		else
+			result.setResult(q.record());
+	}, [=]{ result.setResult(def); });
+	return result;
+}
 
-		q->prepare(query);
-		for(int i = 0; i < args.length(); i ++)
-			q->bindValue(i, args[i]);
+DBFuture<QSqlRecord> DBManager::selectRowDefAsync(DBConnection &c, const QString &query, const DBManager::Args &args, const QSqlRecord &def)
+{
+	DBFuture<QSqlRecord> result;
+	asyncExec(c, query, args, [=](DBCursor &q){
+		if(!q.next())
+			result.setResult(def);
+		else
+			result.setResult(q.record());
+	}, [=]{ result.setResult(def); });
+	return result;
+}
 
-		if( !q->exec() )
-			emit sigQueryError(query, q->lastError().text());
+DBFuture<QVariant> DBManager::selectValueAssocAsync(DBConnection &c, const QString &query, const DBManager::AssocArgs &args)
+{
+	DBFuture<QVariant> result;
+	asyncExecAssoc(c, query, args, [=](DBCursor &q){
+		if(!q.next()) {
+			emit sigQueryError(queryDesc(query, args), "No rows returned (selectValue)");
+			result.setResult(QVariant());
+		} else
+			result.setResult(q.value(0));
+	}, [=]{ result.setResult(QVariant()); });
+	return result;
+}
 
-		result = DBQuery(this, q);
-	});
+DBFuture<QVariant> DBManager::selectValueAsync(DBConnection &c, const QString &query, const DBManager::Args &args)
+{
+	DBFuture<QVariant> result;
+	asyncExec(c, query, args, [=](DBCursor &q){
+		if(!q.next()) {
+			emit sigQueryError(queryDesc(query, args), "No rows returned (selectValue)");
+			result.setResult(QVariant());
+		} else
+			result.setResult(q.value(0));
+	}, [=]{ result.setResult(QVariant()); });
 	return result;
 }
 
-void DBManager::customQueryOperation(const DBManager::QueryOpFunc &opFunc)
+void DBManager::releaseMemory()
 {
-	jobThread_.executeBlocking([&] {
-		opFunc(db_);
+	writer_.jobThread.executeBlocking([this]{
+		writer_.releaseMemory();
 	});
+
+	// Leased readers are released too, the job runs between the queries of the snapshot
+	for(DBConnection *reader : readers_) {
+		reader->jobThread.executeBlocking([reader]{
+			reader->releaseMemory();
+		});
+	}
 }
 
-void DBManager::waitJobDone()
+JobThread::Stats DBManager::writerStats() const
 {
-	jobThread_.executeBlocking([]{});
+	return writer_.jobThread.stats();
 }
 
-void DBManager::blockingExecAssoc(const QString &query, const DBManager::AssocArgs &args, DBManager::ManipFunc manF)
+JobThread::Stats DBManager::readerStats() const
 {
-	jobThread_.executeBlocking([&] {
-		QSqlQuery q(db_);
-
-		q.prepare(query);
-		for(AssocArg arg : args)
-			q.bindValue(arg.first, arg.second);
+	JobThread::Stats result{0, 0, 0, 0};
+
+	for(const DBConnection *reader : readers_) {
+		const JobThread::Stats stats = reader->jobThread.stats();
+		result.executedJobs += stats.executedJobs;
+		result.waitNsecs += stats.waitNsecs;
+		result.execNsecs += stats.execNsecs;
+		result.backlog += stats.backlog;
+	}
 
-		if( !q.exec() )
-			emit sigQueryError(queryDesc(q, args), q.lastError().text());
-		else
-			manF(q);
-	});
+	return result;
 }
 
-void DBManager::blockingExec(const QString &query, const DBManager::Args &args, DBManager::ManipFunc manF)
+DBConnection *DBManager::acquireReader()
 {
-	jobThread_.executeBlocking([&] {
-		QSqlQuery q(db_);
+	QMutexLocker ml(&readerMutex_);
 
-		q.prepare(query);
-		for(int i = 0; i < args.length(); i ++)
-			q.bindValue(i, args[i]);
+	if(readers_.isEmpty())
+		return &writer_;
 
-		if( !q.exec() )
-			emit sigQueryError(queryDesc(q, args), q.lastError().text());
-		else
-			manF(q);
-	});
+	while(freeReaders_.isEmpty())
+		readerReleased_.wait(&readerMutex_);
+
+	return freeReaders_.takeLast();
+}
+
+void DBManager::releaseReader(DBConnection *reader)
+{
+	if(reader == &writer_)
+		return;
+
+	QMutexLocker ml(&readerMutex_);
+	freeReaders_.append(reader);
+	readerReleased_.wakeOne();
 }
 
 
-QString DBManager::queryDesc(const QSqlQuery &q, const Args &args)
+QString DBManager::queryDesc(const QString &query, const Args &args)
 {
-	QString result = q.lastQuery() + " [";
+	QString result = query + " [";
 	for(int i = 0; i < args.size(); i ++) {
 		if(i)
 			result += ", ";
@@ -294,9 +297,9 @@ QString DBManager::queryDesc(const QSqlQuery &q, const Args &args)
 	return result;
 }
 
-QString DBManager::queryDesc(const QSqlQuery &q, const AssocArgs &args)
+QString DBManager::queryDesc(const QString &query, const AssocArgs &args)
 {
-	QString result = q.lastQuery() + " {";
+	QString result = query + " {";
 	for(int i = 0; i < args.size(); i ++) {
 		if(i)
 			result += ", ";
@@ -4,11 +4,14 @@
 #include <QVector>
 #include <QPair>
 #include <QVariant>
-#include <QSqlDatabase>
 #include <QSqlRecord>
+#include <QMutex>
+#include <QWaitCondition>
 
 #include "job/jobthread.h"
+#include "dbconnection.h"
 #include "dbquery.h"
+#include "dbfuture.h"
 
 class DBManager : public QObject
 {
@@ -16,6 +19,8 @@ class DBManager : public QObject
 
 public:
 	friend class DBQuery;
+	friend class DBSnapshot;
+	template<typename> friend class DBStatement;
 
 	using Arg = QVariant;
 	using Args = QVector<QVariant>;
@@ -23,15 +28,16 @@ public:
 	using AssocArg = QPair<QString,QVariant>;
 	using AssocArgs = QVector<AssocArg>;
 
-	using ManipFunc = std::function<void(QSqlQuery&)>;
-	using QueryOpFunc = std::function<void(QSqlDatabase&)>;
+	using ManipFunc = std::function<void(DBCursor&)>;
+	using QueryOpFunc = std::function<void(DBConnection&)>;
 
 public:
 	DBManager();
 	~DBManager();
 
 public:
-	void openSQLITE(const QString &filename);
+	/// Opens the database in WAL mode; readerCount read-only connections are opened for DBSnapshot
+	void openSQLITE(const QString &filename, int readerCount = 2);
 
 public:
 	/// Nonblocking query
@@ -61,27 +67,79 @@ public:
 	DBQuery selectQueryAssoc(const QString &query, const AssocArgs &args = AssocArgs());
 	DBQuery selectQuery(const QString &query, const Args &args = Args());
 
-	/// Creates a query on the db thread and calls opFunc on it
+public:
+	/// Asynchronous variants of the blocking queries above; the blocking ones are just waiting for these
+	DBFuture<bool> execAssocAsync(const QString &query, const AssocArgs &args = AssocArgs());
+	DBFuture<bool> execAsync(const QString &query, const Args &args = Args());
+
+	DBFuture<QVariant> insertAssocAsync(const QString &query, const AssocArgs &args = AssocArgs());
+	DBFuture<QVariant> insertAsync(const QString &query, const Args &args = Args());
+
+	DBFuture<QSqlRecord> selectRowAssocAsync(const QString &query, const AssocArgs &args = AssocArgs());
+	DBFuture<QSqlRecord> selectRowAsync(const QString &query, const Args &args = Args());
+
+	DBFuture<QSqlRecord> selectRowDefAssocAsync(const QString &query, const AssocArgs &args = AssocArgs(), QSqlRecord def = QSqlRecord());
+	DBFuture<QSqlRecord> selectRowDefAsync(const QString &query, const Args &args = Args(), QSqlRecord def = QSqlRecord());
+
+	DBFuture<QVariant> selectValueAssocAsync(const QString &query, const AssocArgs &args = AssocArgs());
+	DBFuture<QVariant> selectValueAsync(const QString &query, const Args &args = Args());
+
+	DBFuture<DBQuery> selectQueryAssocAsync(const QString &query, const AssocArgs &args = AssocArgs());
+	DBFuture<DBQuery> selectQueryAsync(const QString &query, const Args &args = Args());
+
+public:
+	/// Calls opFunc with the writer connection on the db thread
 	void customQueryOperation(const QueryOpFunc &opFunc);
 
 	/// Blocks the calling thread untill all queued queries are executed
 	void waitJobDone();
 
+	/// Frees the page caches of all connections once their queued queries are executed; blocking
+	void releaseMemory();
+
+	/// Job queue statistics of the writer connection and of the read-only connections (summed)
+	JobThread::Stats writerStats() const;
+	JobThread::Stats readerStats() const;
+
 public:
-	QString queryDesc(const QSqlQuery &q, const Args &args);
-	QString queryDesc(const QSqlQuery &q, const AssocArgs &args);
+	QString queryDesc(const QString &query, const Args &args);
+	QString queryDesc(const QString &query, const AssocArgs &args);
 
 signals:
 	void sigQueryError(QString query, QString error);
 	void sigOpenError(QString error);
 
 private:
-	void blockingExecAssoc(const QString &query, const AssocArgs &args, ManipFunc manF);
-	void blockingExec(const QString &query, const Args &args, ManipFunc manF);
+	using FailFunc = std::function<void()>;
+
+	/// Executes the query on the connection thread and calls manF on success or failF on failure
+	void asyncExecAssoc(DBConnection &c, const QString &query, const AssocArgs &args, ManipFunc manF, FailFunc failF);
+	void asyncExec(DBConnection &c, const QString &query, const Args &args, ManipFunc manF, FailFunc failF);
+
+	DBFuture<QSqlRecord> selectRowAssocAsync(DBConnection &c, const QString &query, const AssocArgs &args);
+	DBFuture<QSqlRecord> selectRowAsync(DBConnection &c, const QString &query, const Args &args);
+
+	DBFuture<QSqlRecord> selectRowDefAssocAsync(DBConnection &c, const QString &query, const AssocArgs &args, const QSqlRecord &def);
+	DBFuture<QSqlRecord> selectRowDefAsync(DBConnection &c, const QString &query, const Args &args, const QSqlRecord &def);
+
+	DBFuture<QVariant> selectValueAssocAsync(DBConnection &c, const QString &query, const AssocArgs &args);
+	DBFuture<QVariant> selectValueAsync(DBConnection &c, const QString &query, const Args &args);
+
+	DBFuture<DBQuery> selectQueryAssocAsync(DBConnection &c, const QString &query, const AssocArgs &args);
+	DBFuture<DBQuery> selectQueryAsync(DBConnection &c, const QString &query, const Args &args);
+
+private:
+	/// Leases a read-only connection for exclusive use, blocks until one is available (returns writer if there are no readers)
+	DBConnection *acquireReader();
+	void releaseReader(DBConnection *reader);
+
+private:
+	DBConnection writer_;
 
 private:
-	JobThread jobThread_;
-	QSqlDatabase db_;
+	QVector<DBConnection*> readers_, freeReaders_;
+	QMutex readerMutex_;
+	QWaitCondition readerReleased_;
 
 };
 
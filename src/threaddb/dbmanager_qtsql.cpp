@@ -0,0 +1,179 @@
+#include "dbmanager.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QPointer>
+
+#include "job/tracer.h"
+
+// QtSql backend of DBManager
+
+DBManager::~DBManager()
+{
+	for(DBConnection *reader : readers_) {
+		reader->jobThread.executeBlocking([reader]{
+			if(reader->db.isOpen())
+				reader->db.close();
+		});
+
+		const QString connectionName = reader->db.connectionName();
+		delete reader;
+		QSqlDatabase::removeDatabase(connectionName);
+	}
+
+	if(writer_.db.isOpen())
+		writer_.db.close();
+
+	QSqlDatabase::removeDatabase(writer_.db.connectionName());
+}
+
+void DBManager::openSQLITE(const QString &filename, int readerCount)
+{
+	QByteArray uniqIdBytes;
+	DBManager *thisPtr = this;
+	uniqIdBytes.append( (const char*) &thisPtr, sizeof(thisPtr) );
+	QString uniqId = QString::fromLatin1(uniqIdBytes.toHex());
+
+	for(int i = 0; i < readerCount; i ++) {
+		DBConnection *reader = new DBConnection();
+		readers_.append(reader);
+		freeReaders_.append(reader);
+	}
+
+	writer_.jobThread.executeNonblocking([=] {
+		writer_.db = QSqlDatabase::addDatabase("QSQLITE", uniqId);
+		writer_.db.setDatabaseName(filename);
+
+		if( !writer_.db.open() ) {
+			emit sigOpenError(writer_.db.lastError().text());
+			return;
+		}
+
+		// WAL lets the read-only connections read concurrently with the writer
+		writer_.db.exec("PRAGMA journal_mode = WAL");
+
+		// Readers are opened only after the writer has created the database file
+		for(int i = 0; i < readers_.size(); i ++) {
+			DBConnection *reader = readers_[i];
+			reader->jobThread.executeNonblocking([=] {
+				reader->db = QSqlDatabase::addDatabase("QSQLITE", QString("%1_r%2").arg(uniqId).arg(i));
+				reader->db.setDatabaseName(filename);
+				reader->db.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+				if( !reader->db.open() )
+					emit sigOpenError(reader->db.lastError().text());
+			});
+		}
+	});
+}
+
+void DBManager::customQueryOperation(const DBManager::QueryOpFunc &opFunc)
+{
+	writer_.jobThread.executeBlocking([&] {
+		opFunc(writer_);
+	});
+}
+
+void DBManager::asyncExecAssoc(DBConnection &c, const QString &query, const DBManager::AssocArgs &args, DBManager::ManipFunc manF, FailFunc failF)
+{
+	DBConnection *cPtr = &c;
+	c.jobThread.executeNonblocking([=] {
+		TraceSpan span("db", "query", "sql", query);
+
+		QSqlQuery q(cPtr->db);
+
+		q.prepare(query);
+		for(AssocArg arg : args)
+			q.bindValue(arg.first, arg.second);
+
+		if( !q.exec() ) {
+			emit sigQueryError(queryDesc(q.lastQuery(), args), q.lastError().text());
+			failF();
+		} else
+			manF(q);
+	});
+}
+
+void DBManager::asyncExec(DBConnection &c, const QString &query, const DBManager::Args &args, DBManager::ManipFunc manF, FailFunc failF)
+{
+	DBConnection *cPtr = &c;
+	c.jobThread.executeNonblocking([=] {
+		TraceSpan span("db", "query", "sql", query);
+
+		QSqlQuery q(cPtr->db);
+
+		q.prepare(query);
+		for(int i = 0; i < args.length(); i ++)
+			q.bindValue(i, args[i]);
+
+		if( !q.exec() ) {
+			emit sigQueryError(queryDesc(q.lastQuery(), args), q.lastError().text());
+			failF();
+		} else
+			manF(q);
+	});
+}
+
+DBFuture<DBQuery> DBManager::selectQueryAssocAsync(DBConnection &c, const QString &query, const DBManager::AssocArgs &args)
+{
+	DBFuture<DBQuery> result;
+	QPointer<DBManager> thisPtr(this);
+	DBConnection *cPtr = &c;
+
+	c.jobThread.executeNonblocking([=] {
+		TraceSpan span("db", "query", "sql", query);
+
+		auto deleter = [thisPtr, cPtr](QSqlQuery *q){
+			if(thisPtr.isNull())
+				delete q;
+			else
+				cPtr->jobThread.executeNonblocking([=]{
+					delete q;
+				});
+		};
+
+		QSharedPointer<QSqlQuery> q(new QSqlQuery(cPtr->db), deleter);
+
+		q->prepare(query);
+		for(AssocArg arg : args)
+			q->bindValue(arg.first, arg.second);
+
+		if( !q->exec() )
+			emit sigQueryError(query, q->lastError().text());
+
+		result.setResult(DBQuery(this, cPtr, q));
+	});
+	return result;
+}
+
+DBFuture<DBQuery> DBManager::selectQueryAsync(DBConnection &c, const QString &query, const DBManager::Args &args)
+{
+	DBFuture<DBQuery> result;
+	QPointer<DBManager> thisPtr(this);
+	DBConnection *cPtr = &c;
+
+	c.jobThread.executeNonblocking([=] {
+		TraceSpan span("db", "query", "sql", query);
+
+		auto deleter = [thisPtr, cPtr](QSqlQuery *q){
+			if(thisPtr.isNull())
+				delete q;
+			else
+				cPtr->jobThread.executeNonblocking([=]{
+					delete q;
+				});
+		};
+
+		QSharedPointer<QSqlQuery> q(new QSqlQuery(cPtr->db), deleter);
+
+		q->prepare(query);
+		for(int i = 0; i < args.length(); i ++)
+			q->bindValue(i, args[i]);
+
+		if( !q->exec() )
+			emit sigQueryError(query, q->lastError().text());
+
+		result.setResult(DBQuery(this, cPtr, q));
+	});
+	return result;
+}
@@ -0,0 +1,130 @@
+#include "dbmanager.h"
+
+#include "job/tracer.h"
+
+// Native sqlite3 backend of DBManager
+
+DBManager::~DBManager()
+{
+	for(DBConnection *reader : readers_) {
+		reader->jobThread.executeBlocking([reader]{
+			reader->close();
+		});
+
+		delete reader;
+	}
+
+	writer_.jobThread.executeBlocking([this]{
+		writer_.close();
+	});
+}
+
+void DBManager::openSQLITE(const QString &filename, int readerCount)
+{
+	for(int i = 0; i < readerCount; i ++) {
+		DBConnection *reader = new DBConnection();
+		readers_.append(reader);
+		freeReaders_.append(reader);
+	}
+
+	writer_.jobThread.executeNonblocking([=] {
+		if( !writer_.open(filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) ) {
+			emit sigOpenError(writer_.lastError());
+			return;
+		}
+
+		// WAL lets the read-only connections read concurrently with the writer
+		writer_.exec("PRAGMA journal_mode = WAL");
+
+		// Readers are opened only after the writer has created the database file
+		for(DBConnection *reader : readers_) {
+			reader->jobThread.executeNonblocking([=] {
+				if( !reader->open(filename, SQLITE_OPEN_READONLY) )
+					emit sigOpenError(reader->lastError());
+			});
+		}
+	});
+}
+
+void DBManager::customQueryOperation(const DBManager::QueryOpFunc &opFunc)
+{
+	writer_.jobThread.executeBlocking([&] {
+		opFunc(writer_);
+	});
+}
+
+void DBManager::asyncExecAssoc(DBConnection &c, const QString &query, const DBManager::AssocArgs &args, DBManager::ManipFunc manF, FailFunc failF)
+{
+	DBConnection *cPtr = &c;
+	c.jobThread.executeNonblocking([=] {
+		TraceSpan span("db", "query", "sql", query);
+
+		sqlite3_stmt *stmt = cPtr->statement(query);
+		if( !stmt ) {
+			emit sigQueryError(queryDesc(query, args), cPtr->lastError());
+			failF();
+			return;
+		}
+
+		for(AssocArg arg : args)
+			SQLite3::bindVariant(stmt, sqlite3_bind_parameter_index(stmt, arg.first.toUtf8().constData()), arg.second);
+
+		DBCursor q(cPtr->db, stmt);
+		if( !q.exec() ) {
+			emit sigQueryError(queryDesc(query, args), q.lastError());
+			failF();
+		} else
+			manF(q);
+	});
+}
+
+void DBManager::asyncExec(DBConnection &c, const QString &query, const DBManager::Args &args, DBManager::ManipFunc manF, FailFunc failF)
+{
+	DBConnection *cPtr = &c;
+	c.jobThread.executeNonblocking([=] {
+		TraceSpan span("db", "query", "sql", query);
+
+		sqlite3_stmt *stmt = cPtr->statement(query);
+		if( !stmt ) {
+			emit sigQueryError(queryDesc(query, args), cPtr->lastError());
+			failF();
+			return;
+		}
+
+		for(int i = 0; i < args.length(); i ++)
+			SQLite3::bindVariant(stmt, i + 1, args[i]);
+
+		DBCursor q(cPtr->db, stmt);
+		if( !q.exec() ) {
+			emit sigQueryError(queryDesc(query, args), q.lastError());
+			failF();
+		} else
+			manF(q);
+	});
+}
+
+DBFuture<DBQuery> DBManager::selectQueryAssocAsync(DBConnection &c, const QString &query, const DBManager::AssocArgs &args)
+{
+	DBFuture<DBQuery> result;
+	DBConnection *cPtr = &c;
+
+	asyncExecAssoc(c, query, args, [=](DBCursor &q){
+		result.setResult(DBQuery(this, cPtr, query, q.fetchAll()));
+	}, [=]{
+		result.setResult(DBQuery(this, cPtr, query, QSharedPointer<SQLite3Result>(new SQLite3Result())));
+	});
+	return result;
+}
+
+DBFuture<DBQuery> DBManager::selectQueryAsync(DBConnection &c, const QString &query, const DBManager::Args &args)
+{
+	DBFuture<DBQuery> result;
+	DBConnection *cPtr = &c;
+
+	asyncExec(c, query, args, [=](DBCursor &q){
+		result.setResult(DBQuery(this, cPtr, query, q.fetchAll()));
+	}, [=]{
+		result.setResult(DBQuery(this, cPtr, query, QSharedPointer<SQLite3Result>(new SQLite3Result())));
+	});
+	return result;
+}
@@ -0,0 +1,134 @@
+#include "dbpagedmodel.h"
+
+#include <QSqlRecord>
+
+#include "dbsnapshot.h"
+
+const QString DBPagedModel::keysetCondition = "{keyset}";
+
+DBPagedModel::DBPagedModel(DBManager *manager, QObject *parent) :
+	QAbstractTableModel(parent),
+	manager_(manager)
+{
+
+}
+
+void DBPagedModel::setQuery(const QString &query, const DBManager::Args &args, const QStringList &keyColumns, int pageSize)
+{
+	beginResetModel();
+	query_ = query;
+	args_ = args;
+	keyColumns_ = keyColumns;
+	pageSize_ = pageSize;
+	columnNames_.clear();
+	rows_.clear();
+	isComplete_ = false;
+	endResetModel();
+
+	fetchMore(QModelIndex());
+}
+
+void DBPagedModel::clear()
+{
+	beginResetModel();
+	query_.clear();
+	columnNames_.clear();
+	rows_.clear();
+	isComplete_ = true;
+	endResetModel();
+}
+
+QVariant DBPagedModel::value(int row, int column) const
+{
+	if(row < 0 || row >= rows_.size() || column < 0 || column >= columnNames_.size())
+		return QVariant();
+
+	return rows_[row][column];
+}
+
+int DBPagedModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : rows_.size();
+}
+
+int DBPagedModel::columnCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : columnNames_.size();
+}
+
+QVariant DBPagedModel::data(const QModelIndex &item, int role) const
+{
+	if(role != Qt::DisplayRole)
+		return QVariant();
+
+	return value(item.row(), item.column());
+}
+
+QVariant DBPagedModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if(orientation != Qt::Horizontal || role != Qt::DisplayRole || section < 0 || section >= columnNames_.size())
+		return QAbstractItemModel::headerData(section, orientation, role);
+
+	return columnNames_[section];
+}
+
+bool DBPagedModel::canFetchMore(const QModelIndex &parent) const
+{
+	return !parent.isValid() && !isComplete_;
+}
+
+void DBPagedModel::fetchMore(const QModelIndex &parent)
+{
+	if(!canFetchMore(parent))
+		return;
+
+	DBManager::Args args = args_;
+	QString queryText;
+
+	if(keyColumns_.isEmpty()) {
+		args << pageSize_ << rows_.size();
+		queryText = query_ + " LIMIT ? OFFSET ?";
+
+	} else {
+		// Rows after the last loaded one; the row value comparison follows the order of the key
+		QString condition = "1";
+		if(!rows_.isEmpty()) {
+			QStringList placeholders;
+			for(int i = 0; i < keyColumns_.size(); i++) {
+				args << rows_.last()[i];
+				placeholders << "?";
+			}
+
+			condition = "(" + keyColumns_.join(", ") + ") > (" + placeholders.join(", ") + ")";
+		}
+
+		args << pageSize_;
+		queryText = QString(query_).replace(keysetCondition, condition) + " LIMIT ?";
+	}
+
+	DBQuery query = DBSnapshot(manager_).selectQuery(queryText, args);
+
+	if(columnNames_.isEmpty() && query.columnCount()) {
+		beginInsertColumns(QModelIndex(), 0, query.columnCount() - 1);
+		for(int i = 0; i < query.columnCount(); i++)
+			columnNames_.append(query.record().fieldName(i));
+		endInsertColumns();
+	}
+
+	isComplete_ = query.rowCount() < pageSize_;
+
+	// Failed query -> -1
+	if(query.rowCount() <= 0)
+		return;
+
+	beginInsertRows(QModelIndex(), rows_.size(), rows_.size() + query.rowCount() - 1);
+	while(query.next()) {
+		QVector<QVariant> row;
+		row.reserve(columnNames_.size());
+		for(int i = 0; i < columnNames_.size(); i++)
+			row.append(query.value(i));
+
+		rows_.append(row);
+	}
+	endInsertRows();
+}
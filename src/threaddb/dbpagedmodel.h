@@ -0,0 +1,59 @@
+#ifndef DBPAGEDMODEL_H
+#define DBPAGEDMODEL_H
+
+#include <QAbstractTableModel>
+#include <QStringList>
+
+#include "dbmanager.h"
+
+/// Table model loading the rows of a query in pages as the view scrolls down (canFetchMore/fetchMore), for results too large to be loaded at once.
+/// Each page is a query on a read-only connection, so the model does not wait for the writer. With key columns a page continues after the key of the last loaded row
+/// (keyset paging, the index seeks there); otherwise it is a LIMIT/OFFSET query, whose cost grows with the number of rows skipped.
+class DBPagedModel : public QAbstractTableModel
+{
+	Q_OBJECT
+
+public:
+	explicit DBPagedModel(DBManager *manager, QObject *parent = 0);
+
+public:
+	/// Query without LIMIT; the first page is loaded immediately. Column names are the headers.
+	/// keyColumns are the expressions of a unique key the query is ordered by (ascending), selected as its first columns; the query then contains keysetCondition
+	/// in its WHERE clause after all its parameters, which the model replaces by the condition selecting the rows of the page.
+	void setQuery(const QString &query, const DBManager::Args &args = DBManager::Args(), const QStringList &keyColumns = QStringList(), int pageSize = 256);
+	void clear();
+
+	/// Value of the loaded row
+	QVariant value(int row, int column) const;
+
+public:
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+	QVariant data(const QModelIndex &item, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+	bool canFetchMore(const QModelIndex &parent) const override;
+	void fetchMore(const QModelIndex &parent) override;
+
+public:
+	/// Placeholder of the paging condition in a query with key columns
+	static const QString keysetCondition;
+
+private:
+	DBManager *manager_;
+
+	QString query_;
+	DBManager::Args args_;
+	QStringList keyColumns_;
+	int pageSize_ = 256;
+
+	QStringList columnNames_;
+	QVector<QVector<QVariant>> rows_;
+
+	/// The last page was shorter than pageSize_
+	bool isComplete_ = true;
+
+};
+
+#endif // DBPAGEDMODEL_H
@@ -3,11 +3,17 @@
 
 #include <QSharedPointer>
 #include <QVariant>
-#include <QSqlQuery>
 #include <QSqlRecord>
 #include <QHash>
 
+#ifdef THREADDB_NATIVE_SQLITE
+#include "sqlite3util.h"
+#else
+#include <QSqlQuery>
+#endif
+
 class DBManager;
+struct DBConnection;
 
 class DBQuery {
 
@@ -21,7 +27,11 @@ public:
 public:
 	DBQuery();
 	DBQuery(DBManager *manager);
-	DBQuery(DBManager *manager, QSharedPointer<QSqlQuery> query);
+#ifdef THREADDB_NATIVE_SQLITE
+	DBQuery(DBManager *manager, DBConnection *connection, const QString &query, QSharedPointer<SQLite3Result> result);
+#else
+	DBQuery(DBManager *manager, DBConnection *connection, QSharedPointer<QSqlQuery> query);
+#endif
 
 public:
 	void prepare(const QString &query);
@@ -47,9 +57,20 @@ public:
 	int columnCount() const;
 
 private:
+#ifdef THREADDB_NATIVE_SQLITE
+	/// Sets the result and moves before the first row
+	void setResult(QSharedPointer<SQLite3Result> result);
+
+	QString query_;
+	QSharedPointer<SQLite3Result> result_;
+	int pos_ = -1;
+#else
 	QSharedPointer<QSqlQuery> query_;
+#endif
+
 	QSqlRecord rec_;
 	DBManager *manager_ = nullptr;
+	DBConnection *connection_ = nullptr;
 	int rowCount_ = -1;
 
 };
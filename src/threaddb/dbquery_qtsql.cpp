@@ -0,0 +1,121 @@
+#include "dbquery.h"
+
+#include <QSqlError>
+
+#include "dbmanager.h"
+
+// QtSql backend of DBQuery
+
+DBQuery::DBQuery(DBManager *manager)
+{
+	manager_ = manager;
+	connection_ = &manager_->writer_;
+	connection_->jobThread.executeBlocking([this]{
+		query_.reset( new QSqlQuery(connection_->db) );
+	});
+}
+
+DBQuery::DBQuery(DBManager *manager, DBConnection *connection, QSharedPointer<QSqlQuery> query)
+{
+	query_ = query;
+	manager_ = manager;
+	connection_ = connection;
+
+	rec_ = query_->record();
+
+	query_->last();
+	rowCount_ = qMax(0, query_->at() + 1);
+	query_->seek(-1);
+}
+
+void DBQuery::prepare(const QString &query)
+{
+	connection_->jobThread.executeNonblocking([this,query]{
+		query_->prepare(query);
+	});
+}
+
+void DBQuery::execAssoc(const DBQuery::AssocArgs &args)
+{
+	connection_->jobThread.executeBlocking([this,args]{
+		for(AssocArg arg : args)
+			query_->bindValue(arg.first, arg.second);
+
+		if( !query_->exec() )
+			emit manager_->sigQueryError(manager_->queryDesc(query_->lastQuery(), args), query_->lastError().text());
+
+		if( query_->isSelect() ) {
+			query_->last();
+			rowCount_ = qMax(0, query_->at() + 1);
+			query_->seek(-1);
+
+		} else
+			rowCount_ = -1;
+	});
+}
+
+void DBQuery::exec(const DBQuery::Args &args)
+{
+	connection_->jobThread.executeBlocking([this,args]{
+		for(int i = 0; i < args.length(); i ++)
+			query_->bindValue(i, args[i]);
+
+		if( !query_->exec() )
+			emit manager_->sigQueryError(manager_->queryDesc(query_->lastQuery(), args), query_->lastError().text());
+
+		if( query_->isSelect() ) {
+			query_->last();
+			rowCount_ = qMax(0, query_->at() + 1);
+			query_->seek(-1);
+
+		} else
+			rowCount_ = -1;
+	});
+}
+
+void DBQuery::execAssocAsync(const DBQuery::AssocArgs &args)
+{
+	connection_->jobThread.executeNonblocking([this,args]{
+		for(AssocArg arg : args)
+			query_->bindValue(arg.first, arg.second);
+
+		if( !query_->exec() )
+			emit manager_->sigQueryError(manager_->queryDesc(query_->lastQuery(), args), query_->lastError().text());
+	});
+}
+
+void DBQuery::execAsync(const DBQuery::Args &args)
+{
+	connection_->jobThread.executeNonblocking([this,args]{
+		for(int i = 0; i < args.length(); i ++)
+			query_->bindValue(i, args[i]);
+
+		if( !query_->exec() )
+			emit manager_->sigQueryError(manager_->queryDesc(query_->lastQuery(), args), query_->lastError().text());
+	});
+}
+
+bool DBQuery::isValid() const
+{
+	return !query_.isNull();
+}
+
+bool DBQuery::next()
+{
+	bool result;
+	connection_->jobThread.executeBlocking([&]{
+		result = query_->next();
+		rec_ = query_->record();
+	});
+	return result;
+}
+
+bool DBQuery::seek(int pos)
+{
+	bool result;
+	connection_->jobThread.executeBlocking([&]{
+		result = query_->seek(pos);
+		rec_ = query_->record();
+	});
+	return result;
+}
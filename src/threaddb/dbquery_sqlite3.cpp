@@ -0,0 +1,137 @@
+#include "dbquery.h"
+
+#include "dbmanager.h"
+
+// Native sqlite3 backend of DBQuery; results are fetched whole on the db thread, so iterating them does not need the db thread
+
+/// Executes the query on the connection (must be called from its thread), returns nullptr on error
+static QSharedPointer<SQLite3Result> executeQuery(DBManager *manager, DBConnection *connection, const QString &query, const QString &queryDesc, const std::function<void(sqlite3_stmt*)> &bindFunc)
+{
+	sqlite3_stmt *stmt = connection->statement(query);
+	if( !stmt ) {
+		emit manager->sigQueryError(queryDesc, connection->lastError());
+		return QSharedPointer<SQLite3Result>();
+	}
+
+	bindFunc(stmt);
+
+	SQLite3Cursor q(connection->db, stmt);
+	if( !q.exec() ) {
+		emit manager->sigQueryError(queryDesc, q.lastError());
+		return QSharedPointer<SQLite3Result>();
+	}
+
+	return q.fetchAll();
+}
+
+DBQuery::DBQuery(DBManager *manager)
+{
+	manager_ = manager;
+	connection_ = &manager_->writer_;
+}
+
+DBQuery::DBQuery(DBManager *manager, DBConnection *connection, const QString &query, QSharedPointer<SQLite3Result> result)
+{
+	manager_ = manager;
+	connection_ = connection;
+	query_ = query;
+
+	setResult(result);
+	rowCount_ = result_->rowCount;
+}
+
+void DBQuery::prepare(const QString &query)
+{
+	// Statements are prepared (and cached) by the connection on first execution
+	query_ = query;
+}
+
+void DBQuery::execAssoc(const DBQuery::AssocArgs &args)
+{
+	QSharedPointer<SQLite3Result> result;
+	connection_->jobThread.executeBlocking([&]{
+		result = executeQuery(manager_, connection_, query_, manager_->queryDesc(query_, args), [&](sqlite3_stmt *stmt){
+			for(AssocArg arg : args)
+				SQLite3::bindVariant(stmt, sqlite3_bind_parameter_index(stmt, arg.first.toUtf8().constData()), arg.second);
+		});
+	});
+
+	setResult(result);
+}
+
+void DBQuery::exec(const DBQuery::Args &args)
+{
+	QSharedPointer<SQLite3Result> result;
+	connection_->jobThread.executeBlocking([&]{
+		result = executeQuery(manager_, connection_, query_, manager_->queryDesc(query_, args), [&](sqlite3_stmt *stmt){
+			for(int i = 0; i < args.length(); i ++)
+				SQLite3::bindVariant(stmt, i + 1, args[i]);
+		});
+	});
+
+	setResult(result);
+}
+
+void DBQuery::execAssocAsync(const DBQuery::AssocArgs &args)
+{
+	DBManager *manager = manager_;
+	DBConnection *connection = connection_;
+	const QString query = query_;
+	connection_->jobThread.executeNonblocking([=]{
+		executeQuery(manager, connection, query, manager->queryDesc(query, args), [&](sqlite3_stmt *stmt){
+			for(AssocArg arg : args)
+				SQLite3::bindVariant(stmt, sqlite3_bind_parameter_index(stmt, arg.first.toUtf8().constData()), arg.second);
+		});
+	});
+}
+
+void DBQuery::execAsync(const DBQuery::Args &args)
+{
+	DBManager *manager = manager_;
+	DBConnection *connection = connection_;
+	const QString query = query_;
+	connection_->jobThread.executeNonblocking([=]{
+		executeQuery(manager, connection, query, manager->queryDesc(query, args), [&](sqlite3_stmt *stmt){
+			for(int i = 0; i < args.length(); i ++)
+				SQLite3::bindVariant(stmt, i + 1, args[i]);
+		});
+	});
+}
+
+bool DBQuery::isValid() const
+{
+	return manager_ != nullptr;
+}
+
+bool DBQuery::next()
+{
+	return seek(pos_ + 1);
+}
+
+bool DBQuery::seek(int pos)
+{
+	if(!result_ || pos < 0 || pos >= result_->rowCount) {
+		pos_ = result_ ? qBound(-1, pos, result_->rowCount) : -1;
+		rec_.clearValues();
+		return false;
+	}
+
+	pos_ = pos;
+
+	const int columnCount = rec_.count();
+	const QVariant *row = result_->values.constData() + pos * columnCount;
+	for(int i = 0; i < columnCount; i ++)
+		rec_.setValue(i, row[i]);
+
+	return true;
+}
+
+void DBQuery::setResult(QSharedPointer<SQLite3Result> result)
+{
+	result_ = result ? result : QSharedPointer<SQLite3Result>(new SQLite3Result());
+	pos_ = -1;
+	rec_ = result_->columns;
+
+	// Same as QtSql backend - row count is only known for select statements
+	rowCount_ = rec_.isEmpty() ? -1 : result_->rowCount;
+}
@@ -0,0 +1,67 @@
+#include "dbsnapshot.h"
+
+DBSnapshot::DBSnapshot(DBManager *manager)
+{
+	manager_ = manager;
+	connection_ = manager_->acquireReader();
+
+	// Without readers the snapshot falls back to the writer connection, which must not be kept in a transaction
+	if(connection_ != &manager_->writer_) {
+		connection_->jobThread.executeNonblocking([this]{
+			if( !connection_->transaction() )
+				emit manager_->sigQueryError("BEGIN (DBSnapshot)", connection_->lastError());
+		});
+	}
+}
+
+DBSnapshot::~DBSnapshot()
+{
+	if(connection_ != &manager_->writer_) {
+		DBConnection *connection = connection_;
+		connection_->jobThread.executeBlocking([connection]{
+			connection->commit();
+		});
+	}
+
+	manager_->releaseReader(connection_);
+}
+
+QSqlRecord DBSnapshot::selectRowAssoc(const QString &query, const AssocArgs &args)
+{
+	return manager_->selectRowAssocAsync(*connection_, query, args).result();
+}
+
+QSqlRecord DBSnapshot::selectRow(const QString &query, const Args &args)
+{
+	return manager_->selectRowAsync(*connection_, query, args).result();
+}
+
+QSqlRecord DBSnapshot::selectRowDefAssoc(const QString &query, const AssocArgs &args, QSqlRecord def)
+{
+	return manager_->selectRowDefAssocAsync(*connection_, query, args, def).result();
+}
+
+QSqlRecord DBSnapshot::selectRowDef(const QString &query, const Args &args, QSqlRecord def)
+{
+	return manager_->selectRowDefAsync(*connection_, query, args, def).result();
+}
+
+QVariant DBSnapshot::selectValueAssoc(const QString &query, const AssocArgs &args)
+{
+	return manager_->selectValueAssocAsync(*connection_, query, args).result();
+}
+
+QVariant DBSnapshot::selectValue(const QString &query, const Args &args)
+{
+	return manager_->selectValueAsync(*connection_, query, args).result();
+}
+
+DBQuery DBSnapshot::selectQueryAssoc(const QString &query, const AssocArgs &args)
+{
+	return manager_->selectQueryAssocAsync(*connection_, query, args).result();
+}
+
+DBQuery DBSnapshot::selectQuery(const QString &query, const Args &args)
+{
+	return manager_->selectQueryAsync(*connection_, query, args).result();
+}
@@ -0,0 +1,44 @@
+#ifndef DBSNAPSHOT_H
+#define DBSNAPSHOT_H
+
+#include <QSqlRecord>
+
+#include "dbmanager.h"
+
+/// Leases one of the read-only connections of the manager for its lifetime.
+/// All queries executed through the snapshot run in a single read transaction, so they see the same state of the database.
+/// Runs concurrently with the writer (and other snapshots); writes queued on the manager are not visible until they are executed.
+class DBSnapshot
+{
+
+public:
+	using Args = DBManager::Args;
+	using AssocArgs = DBManager::AssocArgs;
+
+public:
+	DBSnapshot(DBManager *manager);
+	~DBSnapshot();
+
+	DBSnapshot(const DBSnapshot &) = delete;
+	DBSnapshot &operator=(const DBSnapshot &) = delete;
+
+public:
+	QSqlRecord selectRowAssoc(const QString &query, const AssocArgs &args = AssocArgs());
+	QSqlRecord selectRow(const QString &query, const Args &args = Args());
+
+	QSqlRecord selectRowDefAssoc(const QString &query, const AssocArgs &args = AssocArgs(), QSqlRecord def = QSqlRecord());
+	QSqlRecord selectRowDef(const QString &query, const Args &args = Args(), QSqlRecord def = QSqlRecord());
+
+	QVariant selectValueAssoc(const QString &query, const AssocArgs &args = AssocArgs());
+	QVariant selectValue(const QString &query, const Args &args = Args());
+
+	DBQuery selectQueryAssoc(const QString &query, const AssocArgs &args = AssocArgs());
+	DBQuery selectQuery(const QString &query, const Args &args = Args());
+
+private:
+	DBManager *manager_;
+	DBConnection *connection_;
+
+};
+
+#endif // DBSNAPSHOT_H
@@ -0,0 +1,268 @@
+#ifndef DBSTATEMENT_H
+#define DBSTATEMENT_H
+
+#include <tuple>
+#include <utility>
+#include <initializer_list>
+
+#include <QSharedPointer>
+#include <QPointer>
+
+#ifndef THREADDB_NATIVE_SQLITE
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#endif
+
+#include "dbmanager.h"
+#include "job/tracer.h"
+
+/// Prepared statement with parameter and column types fixed at compile time.
+/// The signature is Row(Params...), Row being a std::tuple of the column types (std::tuple<> for statements without result columns).
+/// Parameters are bound positionally to '?' placeholders and columns are read by index, so no parameter names or argument vectors are built per call.
+/// The statement is prepared once on the writer thread and reused. With the native sqlite3 backend, values are bound and read without QVariant.
+template<typename Signature>
+class DBStatement;
+
+template<typename... Columns, typename... Params>
+class DBStatement<std::tuple<Columns...>(Params...)>
+{
+
+public:
+	using Row = std::tuple<Columns...>;
+	using ParamTuple = std::tuple<Params...>;
+
+public:
+	DBStatement(DBManager *manager, const QString &query) {
+		manager_ = manager;
+		connection_ = &manager->writer_;
+
+		QPointer<DBManager> managerPtr(manager);
+		DBConnection *connection = connection_;
+		auto deleter = [managerPtr, connection](State *d){
+			if(managerPtr.isNull())
+				delete d;
+			else
+				connection->jobThread.executeNonblocking([=]{
+					delete d;
+				});
+		};
+
+		connection_->jobThread.executeBlocking([&]{
+			d_ = QSharedPointer<State>(new State(connection->db), deleter);
+			if( !d_->prepare(query) )
+				emit manager->sigQueryError(query, connection->lastError());
+		});
+	}
+
+public:
+	/// Blocking execution, returns false on failure
+	bool exec(const Params &...params) {
+		const ParamTuple args(params...);
+		bool result;
+		connection_->jobThread.executeBlocking([&]{
+			result = run(manager_, *d_, args);
+			d_->finish();
+		});
+		return result;
+	}
+
+	/// Nonblocking execution
+	void execAsync(const Params &...params) {
+		const ParamTuple args(params...);
+		DBManager *manager = manager_;
+		QSharedPointer<State> d = d_;
+		connection_->jobThread.executeNonblocking([=]{
+			run(manager, *d, args);
+			d->finish();
+		});
+	}
+
+	/// Blocking execution of the statement for each of the parameter tuples in a single transaction
+	bool execBatch(const QVector<ParamTuple> &batch) {
+		bool result = true;
+		connection_->jobThread.executeBlocking([&]{
+			connection_->transaction();
+
+			for(const ParamTuple &args : batch) {
+				result &= run(manager_, *d_, args);
+				d_->finish();
+			}
+
+			connection_->commit();
+		});
+		return result;
+	}
+
+	/// Blocking query, returns first row selected (returns def if no rows)
+	Row selectRowDef(const Row &def, const Params &...params) {
+		const ParamTuple args(params...);
+		Row result = def;
+		connection_->jobThread.executeBlocking([&]{
+			if(run(manager_, *d_, args) && d_->next())
+				result = readRow(*d_, std::index_sequence_for<Columns...>());
+
+			d_->finish();
+		});
+		return result;
+	}
+
+	/// Nonblocking variant of selectRowDef
+	DBFuture<Row> selectRowDefAsync(const Row &def, const Params &...params) {
+		const ParamTuple args(params...);
+		DBManager *manager = manager_;
+		QSharedPointer<State> d = d_;
+		DBFuture<Row> result;
+		connection_->jobThread.executeNonblocking([=]{
+			if(run(manager, *d, args) && d->next())
+				result.setResult(readRow(*d, std::index_sequence_for<Columns...>()));
+			else
+				result.setResult(def);
+
+			d->finish();
+		});
+		return result;
+	}
+
+	/// Blocking query, returns all rows selected
+	QVector<Row> selectAll(const Params &...params) {
+		const ParamTuple args(params...);
+		QVector<Row> result;
+		connection_->jobThread.executeBlocking([&]{
+			if(run(manager_, *d_, args)) {
+				while(d_->next())
+					result.append(readRow(*d_, std::index_sequence_for<Columns...>()));
+			}
+
+			d_->finish();
+		});
+		return result;
+	}
+
+private:
+#ifdef THREADDB_NATIVE_SQLITE
+	struct State {
+		State(sqlite3 *db) : db(db) {}
+		~State() { sqlite3_finalize(stmt); }
+
+		bool prepare(const QString &query) {
+			queryText = query;
+			return sqlite3_prepare16_v3(db, query.utf16(), query.size() * int(sizeof(ushort)), SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) == SQLITE_OK;
+		}
+
+		/// Steps to the first row, returns false on error
+		bool exec() {
+			const int rc = sqlite3_step(stmt);
+			hasPendingRow = rc == SQLITE_ROW;
+			isDone = rc == SQLITE_DONE;
+			return hasPendingRow || isDone;
+		}
+
+		bool next() {
+			if(hasPendingRow) {
+				hasPendingRow = false;
+				return true;
+			}
+
+			if(isDone || sqlite3_step(stmt) != SQLITE_ROW) {
+				isDone = true;
+				return false;
+			}
+
+			return true;
+		}
+
+		/// Resets the statement and releases the bound values (they are bound without copying)
+		void finish() {
+			sqlite3_reset(stmt);
+			sqlite3_clear_bindings(stmt);
+		}
+
+		QString lastQuery() const { return queryText; }
+		QString lastError() const { return QString::fromUtf8(sqlite3_errmsg(db)); }
+		int columnCount() const { return sqlite3_column_count(stmt); }
+		bool isSelect() const { return columnCount() > 0; }
+
+		sqlite3 *db;
+		sqlite3_stmt *stmt = nullptr;
+		QString queryText;
+		bool hasPendingRow = false, isDone = false;
+		bool columnsChecked = false;
+	};
+#else
+	struct State {
+		State(const QSqlDatabase &db) : query(db) {}
+
+		bool prepare(const QString &queryText) { return query.prepare(queryText); }
+		bool exec() { return query.exec(); }
+		bool next() { return query.next(); }
+		void finish() { query.finish(); }
+
+		QString lastQuery() const { return query.lastQuery(); }
+		QString lastError() const { return query.lastError().text(); }
+		int columnCount() const { return query.record().count(); }
+		bool isSelect() const { return query.isSelect(); }
+
+		QSqlQuery query;
+		bool columnsChecked = false;
+	};
+#endif
+
+private:
+	/// Binds args and executes the statement, runs on the connection thread
+	static bool run(DBManager *manager, State &d, const ParamTuple &args) {
+		TraceSpan span("db", "statement", "sql", d.lastQuery());
+
+		bindParams(d, args, std::index_sequence_for<Params...>());
+
+		if( !d.exec() ) {
+			emit manager->sigQueryError(manager->queryDesc(d.lastQuery(), toArgs(args, std::index_sequence_for<Params...>())), d.lastError());
+			d.finish();
+			return false;
+		}
+
+		if( !d.columnsChecked && d.isSelect() ) {
+			d.columnsChecked = true;
+
+			if( d.columnCount() != int(sizeof...(Columns)) )
+				emit manager->sigQueryError(manager->queryDesc(d.lastQuery(), toArgs(args, std::index_sequence_for<Params...>())), QString("Statement returns %1 columns, %2 expected (DBStatement)").arg(d.columnCount()).arg(sizeof...(Columns)));
+		}
+
+		return true;
+	}
+
+#ifdef THREADDB_NATIVE_SQLITE
+	template<std::size_t... I>
+	static void bindParams(State &d, const ParamTuple &args, std::index_sequence<I...>) {
+		(void) std::initializer_list<int>{0, (SQLite3::bindNative(d.stmt, int(I) + 1, std::get<I>(args)), 0)...};
+	}
+
+	template<std::size_t... I>
+	static Row readRow(const State &d, std::index_sequence<I...>) {
+		return Row(SQLite3::columnNative<Columns>(d.stmt, int(I))...);
+	}
+#else
+	template<std::size_t... I>
+	static void bindParams(State &d, const ParamTuple &args, std::index_sequence<I...>) {
+		(void) std::initializer_list<int>{0, (d.query.bindValue(int(I), QVariant::fromValue(std::get<I>(args))), 0)...};
+	}
+
+	template<std::size_t... I>
+	static Row readRow(const State &d, std::index_sequence<I...>) {
+		return Row(d.query.value(int(I)).template value<Columns>()...);
+	}
+#endif
+
+	template<std::size_t... I>
+	static DBManager::Args toArgs(const ParamTuple &args, std::index_sequence<I...>) {
+		return DBManager::Args{QVariant::fromValue(std::get<I>(args))...};
+	}
+
+private:
+	DBManager *manager_;
+	DBConnection *connection_;
+	QSharedPointer<State> d_;
+
+};
+
+#endif // DBSTATEMENT_H
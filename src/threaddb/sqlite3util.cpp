@@ -0,0 +1,152 @@
+#include "sqlite3util.h"
+
+#include <QSqlField>
+
+int SQLite3::bindVariant(sqlite3_stmt *stmt, int index, const QVariant &value)
+{
+	if(value.isNull())
+		return sqlite3_bind_null(stmt, index);
+
+	switch(value.type()) {
+
+	case QVariant::Bool:
+	case QVariant::Int:
+	case QVariant::UInt:
+	case QVariant::LongLong:
+	case QVariant::ULongLong:
+		return sqlite3_bind_int64(stmt, index, value.toLongLong());
+
+	case QVariant::Double:
+		return sqlite3_bind_double(stmt, index, value.toDouble());
+
+	case QVariant::ByteArray: {
+		const QByteArray data = value.toByteArray();
+		return sqlite3_bind_blob(stmt, index, data.constData(), data.size(), SQLITE_TRANSIENT);
+	}
+
+	default: {
+		const QString str = value.toString();
+		return sqlite3_bind_text16(stmt, index, str.utf16(), str.size() * int(sizeof(ushort)), SQLITE_TRANSIENT);
+	}
+
+	}
+}
+
+QVariant SQLite3::columnVariant(sqlite3_stmt *stmt, int index)
+{
+	switch(sqlite3_column_type(stmt, index)) {
+
+	case SQLITE_INTEGER:
+		return QVariant(qlonglong(sqlite3_column_int64(stmt, index)));
+
+	case SQLITE_FLOAT:
+		return QVariant(sqlite3_column_double(stmt, index));
+
+	case SQLITE_BLOB:
+		return QVariant(columnNative<QByteArray>(stmt, index));
+
+	case SQLITE_NULL:
+		return QVariant(QVariant::String);
+
+	default:
+		return QVariant(columnNative<QString>(stmt, index));
+
+	}
+}
+
+QSqlRecord SQLite3::columnsRecord(sqlite3_stmt *stmt)
+{
+	QSqlRecord result;
+
+	const int columnCount = sqlite3_column_count(stmt);
+	for(int i = 0; i < columnCount; i ++)
+		result.append(QSqlField(QString::fromUtf8(sqlite3_column_name(stmt, i))));
+
+	return result;
+}
+
+SQLite3Cursor::SQLite3Cursor(sqlite3 *db, sqlite3_stmt *stmt)
+{
+	db_ = db;
+	stmt_ = stmt;
+}
+
+SQLite3Cursor::~SQLite3Cursor()
+{
+	sqlite3_reset(stmt_);
+	sqlite3_clear_bindings(stmt_);
+}
+
+bool SQLite3Cursor::exec()
+{
+	const int rc = sqlite3_step(stmt_);
+
+	hasPendingRow_ = rc == SQLITE_ROW;
+	isDone_ = rc == SQLITE_DONE;
+	isOnRow_ = false;
+
+	return hasPendingRow_ || isDone_;
+}
+
+bool SQLite3Cursor::next()
+{
+	if(hasPendingRow_) {
+		hasPendingRow_ = false;
+		isOnRow_ = true;
+		return true;
+	}
+
+	if(isDone_ || !isOnRow_)
+		return isOnRow_ = false;
+
+	const int rc = sqlite3_step(stmt_);
+	isOnRow_ = rc == SQLITE_ROW;
+	isDone_ = !isOnRow_;
+	return isOnRow_;
+}
+
+QVariant SQLite3Cursor::value(int i) const
+{
+	if(!isOnRow_)
+		return QVariant();
+
+	return SQLite3::columnVariant(stmt_, i);
+}
+
+QSqlRecord SQLite3Cursor::record() const
+{
+	QSqlRecord result = SQLite3::columnsRecord(stmt_);
+
+	if(isOnRow_) {
+		for(int i = 0; i < result.count(); i ++)
+			result.setValue(i, SQLite3::columnVariant(stmt_, i));
+	}
+
+	return result;
+}
+
+QVariant SQLite3Cursor::lastInsertId() const
+{
+	return QVariant(qlonglong(sqlite3_last_insert_rowid(db_)));
+}
+
+QSharedPointer<SQLite3Result> SQLite3Cursor::fetchAll()
+{
+	QSharedPointer<SQLite3Result> result(new SQLite3Result());
+	result->columns = SQLite3::columnsRecord(stmt_);
+
+	const int columnCount = result->columns.count();
+	while(next()) {
+		for(int i = 0; i < columnCount; i ++)
+			result->values.append(SQLite3::columnVariant(stmt_, i));
+
+		result->rowCount ++;
+	}
+
+	return result;
+}
+
+QString SQLite3Cursor::lastError() const
+{
+	return QString::fromUtf8(sqlite3_errmsg(db_));
+}
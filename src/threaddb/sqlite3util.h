@@ -0,0 +1,97 @@
+#ifndef SQLITE3UTIL_H
+#define SQLITE3UTIL_H
+
+#include <sqlite3.h>
+
+#include <QString>
+#include <QVariant>
+#include <QByteArray>
+#include <QVector>
+#include <QSqlRecord>
+#include <QSharedPointer>
+
+// Helpers of the native sqlite3 backend of threaddb
+
+namespace SQLite3 {
+
+	/// Binds a QVariant to the statement parameter (1-based), the value is copied
+	int bindVariant(sqlite3_stmt *stmt, int index, const QVariant &value);
+
+	/// Reads column (0-based) of the current row as a QVariant, converted the same way as the QSQLITE driver does
+	QVariant columnVariant(sqlite3_stmt *stmt, int index);
+
+	/// Record with names of the result columns of the statement and null values
+	QSqlRecord columnsRecord(sqlite3_stmt *stmt);
+
+	// Typed binding without QVariant; text and blobs are bound without copying, so they must outlive the step
+	inline int bindNative(sqlite3_stmt *stmt, int index, int value) { return sqlite3_bind_int(stmt, index, value); }
+	inline int bindNative(sqlite3_stmt *stmt, int index, qlonglong value) { return sqlite3_bind_int64(stmt, index, value); }
+	inline int bindNative(sqlite3_stmt *stmt, int index, double value) { return sqlite3_bind_double(stmt, index, value); }
+	inline int bindNative(sqlite3_stmt *stmt, int index, const QString &value) { return sqlite3_bind_text16(stmt, index, value.utf16(), value.size() * int(sizeof(ushort)), SQLITE_STATIC); }
+	inline int bindNative(sqlite3_stmt *stmt, int index, const QByteArray &value) { return sqlite3_bind_blob(stmt, index, value.constData(), value.size(), SQLITE_STATIC); }
+
+	// Typed column reading without QVariant
+	template<typename T> T columnNative(sqlite3_stmt *stmt, int index);
+
+	template<> inline int columnNative<int>(sqlite3_stmt *stmt, int index) { return sqlite3_column_int(stmt, index); }
+	template<> inline qlonglong columnNative<qlonglong>(sqlite3_stmt *stmt, int index) { return sqlite3_column_int64(stmt, index); }
+	template<> inline double columnNative<double>(sqlite3_stmt *stmt, int index) { return sqlite3_column_double(stmt, index); }
+
+	template<> inline QString columnNative<QString>(sqlite3_stmt *stmt, int index) {
+		const ushort *data = static_cast<const ushort*>(sqlite3_column_text16(stmt, index));
+		return QString::fromUtf16(data, sqlite3_column_bytes16(stmt, index) / int(sizeof(ushort)));
+	}
+
+	template<> inline QByteArray columnNative<QByteArray>(sqlite3_stmt *stmt, int index) {
+		const char *data = static_cast<const char*>(sqlite3_column_blob(stmt, index));
+		return QByteArray(data, sqlite3_column_bytes(stmt, index));
+	}
+
+}
+
+/// Fully fetched result of a statement
+struct SQLite3Result
+{
+	QSqlRecord columns;
+
+	/// Row-major values
+	QVector<QVariant> values;
+
+	int rowCount = 0;
+};
+
+/// Executed statement, offers the subset of QSqlQuery interface the backend-independent code uses.
+/// The statement is reset when the cursor is destroyed.
+class SQLite3Cursor
+{
+
+public:
+	SQLite3Cursor(sqlite3 *db, sqlite3_stmt *stmt);
+	~SQLite3Cursor();
+
+	SQLite3Cursor(const SQLite3Cursor &) = delete;
+	SQLite3Cursor &operator=(const SQLite3Cursor &) = delete;
+
+public:
+	/// Executes the statement (steps to the first row), returns false on error
+	bool exec();
+
+	bool next();
+
+	QVariant value(int i) const;
+	QSqlRecord record() const;
+	QVariant lastInsertId() const;
+
+	/// Fetches all the (remaining) rows
+	QSharedPointer<SQLite3Result> fetchAll();
+
+	QString lastError() const;
+
+private:
+	sqlite3 *db_;
+	sqlite3_stmt *stmt_;
+	bool hasPendingRow_ = false, isOnRow_ = false, isDone_ = false;
+
+};
+
+#endif // SQLITE3UTIL_H
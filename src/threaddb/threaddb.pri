@@ -0,0 +1,40 @@
+# Sources of the threaddb layer, shared by the application and the benchmarks
+#
+# The database backend is selected at build time:
+#   default                 - QtSql (QSQLITE driver)
+#   CONFIG+=threaddb_sqlite3 - native sqlite3 C API (links the system sqlite3 library)
+
+SOURCES += \
+    $$PWD/dbmanager.cpp \
+    $$PWD/dbmodel.cpp \
+    $$PWD/dbpagedmodel.cpp \
+    $$PWD/dbquery.cpp \
+    $$PWD/dbsnapshot.cpp
+
+HEADERS += \
+    $$PWD/dbmanager.h \
+    $$PWD/dbmodel.h \
+    $$PWD/dbpagedmodel.h \
+    $$PWD/dbquery.h \
+    $$PWD/dbconnection.h \
+    $$PWD/dbsnapshot.h \
+    $$PWD/dbfuture.h \
+    $$PWD/dbstatement.h
+
+threaddb_sqlite3 {
+    DEFINES += THREADDB_NATIVE_SQLITE
+    LIBS += -lsqlite3
+
+    SOURCES += \
+        $$PWD/dbmanager_sqlite3.cpp \
+        $$PWD/dbquery_sqlite3.cpp \
+        $$PWD/dbconnection_sqlite3.cpp \
+        $$PWD/sqlite3util.cpp
+
+    HEADERS += \
+        $$PWD/sqlite3util.h
+} else {
+    SOURCES += \
+        $$PWD/dbmanager_qtsql.cpp \
+        $$PWD/dbquery_qtsql.cpp
+}